@@ -0,0 +1,96 @@
+/*
+ * This file is part of Mico's toy RPN Calculator
+ *
+ * Mico's toy RPN Calculator is free software:
+ * you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mico's toy RPN Calculator is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mico's toy RPN Calculator. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Dispatch cost of the program interpreter: loop-heavy HP-41 style
+// programs run under the switch loop and under the threaded loop.
+// Build with "make bench" and run from bin/:
+//   ./bench_dispatch [repetitions] [program ...]
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <gsl/gsl_rng.h>
+#include "stack.h"
+#include "registers.h"
+#include "globals.h"
+#include "words.h"
+#include "run_machine.h"
+
+static const char* default_programs[] = {
+  "../bench/countdown.prg",
+  "../bench/nested_loop.prg",
+  "../bench/gosub_loop.prg",
+};
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + 1e-9 * (double)ts.tv_nsec;
+}
+
+static double time_runs(Program* prog, int mode, int reps) {
+  Stack stack;
+  init_stack(&stack);
+  dispatch_mode = mode;
+  double t0 = now();
+  for (int r = 0; r < reps; r++) {
+    run_RPN_code(&stack, prog);
+    free_stack(&stack);
+  }
+  double t = now() - t0;
+  destroy_stack(&stack);
+  return t;
+}
+
+static void bench_program(const char* file, int reps) {
+  Program* prog = calloc(1, sizeof *prog);
+  if (!prog || !load_program_from_file(file, prog)) {
+    free(prog);
+    return;
+  }
+
+  time_runs(prog, DISPATCH_SWITCH, 1);   // warm up
+  double sw = time_runs(prog, DISPATCH_SWITCH, reps);
+  double th = time_runs(prog, DISPATCH_THREADED, reps);
+
+  printf("%-26s switch %8.2f ms/run   threaded %8.2f ms/run   %5.2fx\n",
+         file, 1e3 * sw / reps, 1e3 * th / reps, sw / th);
+  free_program(prog);
+  free(prog);
+}
+
+int main(int argc, char** argv) {
+  int reps = argc > 1 ? atoi(argv[1]) : 20;
+  if (reps <= 0) reps = 1;
+
+  global_rng = gsl_rng_alloc(gsl_rng_mt19937);
+  init_registers();
+  load_macros_from_file();
+
+  if (argc > 2) {
+    for (int i = 2; i < argc; i++) bench_program(argv[i], reps);
+  } else {
+    for (size_t i = 0; i < sizeof default_programs / sizeof *default_programs; i++)
+      bench_program(default_programs[i], reps);
+  }
+
+  gsl_rng_free(global_rng);
+  return 0;
+}
@@ -0,0 +1,301 @@
+/*
+ * This file is part of Mico's toy RPN Calculator
+ *
+ * Mico's toy RPN Calculator is free software:
+ * you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mico's toy RPN Calculator is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mico's toy RPN Calculator. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Elementwise real and complex kernels against the gsl_matrix_get/set
+// loops they replaced, in millions of elements per second. Complex cases
+// use Z, W for complex matrices, w for a complex scalar and A for a real
+// matrix promoted on the fly. Each operation runs on
+// n x n operands, first unpadded and then as views into n x (n + 3)
+// parents so every row is strided. The "loop" column is the old
+// per-element code; the others force each vector level this CPU has.
+// Every level's result is checked bit for bit against the loop.
+// Build with "make bench" and run from bin/:
+//   ./bench_elementwise [repetitions]
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <gsl/gsl_rng.h>
+#include <gsl/gsl_matrix.h>
+#include <gsl/gsl_complex_math.h>
+#include "stack.h"
+#include "registers.h"
+#include "globals.h"
+#include "elementwise.h"
+
+enum { MM, MS, SM,     // matrix op matrix, matrix op scalar, scalar op matrix
+       AW, WA };       // real matrix op complex scalar, and the reverse
+
+typedef struct {
+  const char* name;
+  ew_op op;
+  int shape;
+} bench_case;
+
+static const bench_case cases[] = {
+  { "A .* B",  EW_MUL, MM },
+  { "A ./ B",  EW_DIV, MM },
+  { "A .^ B",  EW_POW, MM },
+  { "A + s",   EW_ADD, MS },
+  { "s - A",   EW_SUB, SM },
+  { "s ./ A",  EW_DIV, SM },
+  { "A .^ s",  EW_POW, MS },
+};
+
+static const bench_case complex_cases[] = {
+  { "Z + W",   EW_ADD, MM },
+  { "Z .* W",  EW_MUL, MM },
+  { "Z ./ W",  EW_DIV, MM },
+  { "Z + w",   EW_ADD, MS },
+  { "Z .* w",  EW_MUL, MS },
+  { "Z ./ w",  EW_DIV, MS },
+  { "w - Z",   EW_SUB, SM },
+  { "Z .^ w",  EW_POW, MS },
+  { "A + w",   EW_ADD, AW },
+  { "A .* w",  EW_MUL, AW },
+  { "w ./ A",  EW_DIV, WA },
+};
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + 1e-9 * (double)ts.tv_nsec;
+}
+
+static double apply(ew_op op, double x, double y) {
+  switch (op) {
+  case EW_ADD: return x + y;
+  case EW_SUB: return x - y;
+  case EW_MUL: return x * y;
+  case EW_DIV: return x / y;
+  default:     return pow(x, y);
+  }
+}
+
+// The loop binary_fun.c used before the kernels
+static void old_loop(const bench_case* c, gsl_matrix* d, const gsl_matrix* x,
+                     const gsl_matrix* y, double s) {
+  for (size_t i = 0; i < d->size1; ++i)
+    for (size_t j = 0; j < d->size2; ++j) {
+      double v = gsl_matrix_get(x, i, j);
+      double r = c->shape == MM ? apply(c->op, v, gsl_matrix_get(y, i, j))
+               : c->shape == MS ? apply(c->op, v, s)
+               : apply(c->op, s, v);
+      gsl_matrix_set(d, i, j, r);
+    }
+}
+
+static void kernel(const bench_case* c, gsl_matrix* d, const gsl_matrix* x,
+                   const gsl_matrix* y, double s) {
+  if (c->shape == MM) ew_matrix_matrix(c->op, d, x, y);
+  else if (c->shape == MS) ew_matrix_scalar(c->op, d, x, s);
+  else ew_scalar_matrix(c->op, d, s, x);
+}
+
+static gsl_complex complex_apply(ew_op op, gsl_complex x, gsl_complex y) {
+  switch (op) {
+  case EW_ADD: return gsl_complex_add(x, y);
+  case EW_SUB: return gsl_complex_sub(x, y);
+  case EW_MUL: return gsl_complex_mul(x, y);
+  case EW_DIV: return gsl_complex_div(x, y);
+  default:     return gsl_complex_pow(x, y);
+  }
+}
+
+// The complex loops binary_fun.c used, promoting real entries one by one
+static void old_complex_loop(const bench_case* c, gsl_matrix_complex* d,
+                             const gsl_matrix_complex* x, const gsl_matrix_complex* y,
+                             const gsl_matrix* a, gsl_complex w) {
+  for (size_t i = 0; i < d->size1; ++i)
+    for (size_t j = 0; j < d->size2; ++j) {
+      gsl_complex v = c->shape >= AW ? gsl_complex_rect(gsl_matrix_get(a, i, j), 0.0)
+                                     : gsl_matrix_complex_get(x, i, j);
+      gsl_complex r = c->shape == MM ? complex_apply(c->op, v, gsl_matrix_complex_get(y, i, j))
+                    : c->shape == SM || c->shape == WA ? complex_apply(c->op, w, v)
+                    : complex_apply(c->op, v, w);
+      gsl_matrix_complex_set(d, i, j, r);
+    }
+}
+
+static void complex_kernel(const bench_case* c, gsl_matrix_complex* d,
+                           const gsl_matrix_complex* x, const gsl_matrix_complex* y,
+                           const gsl_matrix* a, gsl_complex w) {
+  switch (c->shape) {
+  case MM: ew_complex_matrix_matrix(c->op, d, x, y); break;
+  case MS: ew_complex_matrix_scalar(c->op, d, x, w); break;
+  case SM: ew_complex_scalar_matrix(c->op, d, w, x); break;
+  case AW: ew_real_matrix_complex_scalar(c->op, d, a, w); break;
+  default: ew_complex_scalar_real_matrix(c->op, d, w, a);
+  }
+}
+
+static bool same_complex(const gsl_matrix_complex* a, const gsl_matrix_complex* b) {
+  for (size_t i = 0; i < a->size1; i++)
+    if (memcmp(a->data + 2 * i * a->tda, b->data + 2 * i * b->tda, 2 * a->size2 * sizeof(double)))
+      return false;
+  return true;
+}
+
+static bool same(const gsl_matrix* a, const gsl_matrix* b) {
+  for (size_t i = 0; i < a->size1; i++)
+    if (memcmp(a->data + i * a->tda, b->data + i * b->tda, a->size2 * sizeof(double)))
+      return false;
+  return true;
+}
+
+// Best of three, in million elements per second
+static double rate(const bench_case* c, int level, gsl_matrix* d, const gsl_matrix* x,
+                   const gsl_matrix* y, double s, int reps) {
+  double best = 1e30;
+  if (level >= 0) simd_use_level((simd_level)level);
+  for (int t = 0; t < 3; t++) {
+    double t0 = now();
+    for (int r = 0; r < reps; r++) {
+      if (level < 0) old_loop(c, d, x, y, s);
+      else kernel(c, d, x, y, s);
+    }
+    double e = now() - t0;
+    if (e < best) best = e;
+  }
+  return 1e-6 * (double)reps * (double)(d->size1 * d->size2) / best;
+}
+
+static void run(size_t n, bool padded, int reps, simd_level top) {
+  size_t width = padded ? n + 3 : n;
+  gsl_matrix* parent[4];
+  gsl_matrix_view view[4];
+  gsl_matrix* m[4];   // x, y, result of the loop, result of a kernel
+  for (int k = 0; k < 4; k++) {
+    parent[k] = matrix_alloc(n, width);
+    view[k] = gsl_matrix_submatrix(parent[k], 0, 0, n, n);
+    m[k] = &view[k].matrix;
+  }
+  for (size_t i = 0; i < n; i++)
+    for (size_t j = 0; j < n; j++) {
+      gsl_matrix_set(m[0], i, j, 0.5 + gsl_rng_uniform(global_rng));
+      gsl_matrix_set(m[1], i, j, 0.5 + gsl_rng_uniform(global_rng));
+    }
+  int r = (int)(reps * 1024.0 * 1024.0 / ((double)n * n)) + 1;
+
+  printf("\nn = %zu, %s rows, %d runs\n", n, padded ? "strided" : "unpadded", r);
+  printf("%-8s %10s", "", "loop");
+  for (int l = SIMD_SCALAR; l <= (int)top; l++) printf(" %10s", simd_level_name((simd_level)l));
+  printf("\n");
+
+  for (size_t i = 0; i < sizeof cases / sizeof cases[0]; i++) {
+    const bench_case* c = &cases[i];
+    double s = c->op == EW_POW ? 2.0 : 1.25;
+    int cr = c->op == EW_POW ? r / 8 + 1 : r;   // pow is libm-bound
+    printf("%-8s %10.0f", c->name, rate(c, -1, m[2], m[0], m[1], s, cr));
+    for (int l = SIMD_SCALAR; l <= (int)top; l++) {
+      double v = rate(c, l, m[3], m[0], m[1], s, cr);
+      printf(" %10.0f%s", v, same(m[2], m[3]) ? "" : "!");
+    }
+    printf("\n");
+  }
+  for (int k = 0; k < 4; k++) matrix_release(parent[k]);
+}
+
+static double complex_rate(const bench_case* c, int level, gsl_matrix_complex* d,
+                           const gsl_matrix_complex* x, const gsl_matrix_complex* y,
+                           const gsl_matrix* a, gsl_complex w, int reps) {
+  double best = 1e30;
+  if (level >= 0) simd_use_level((simd_level)level);
+  for (int t = 0; t < 3; t++) {
+    double t0 = now();
+    for (int r = 0; r < reps; r++) {
+      if (level < 0) old_complex_loop(c, d, x, y, a, w);
+      else complex_kernel(c, d, x, y, a, w);
+    }
+    double e = now() - t0;
+    if (e < best) best = e;
+  }
+  return 1e-6 * (double)reps * (double)(d->size1 * d->size2) / best;
+}
+
+static void run_complex(size_t n, bool padded, int reps, simd_level top) {
+  size_t width = padded ? n + 3 : n;
+  gsl_matrix_complex* parent[4];
+  gsl_matrix_complex_view view[4];
+  gsl_matrix_complex* m[4];   // x, y, result of the loop, result of a kernel
+  for (int k = 0; k < 4; k++) {
+    parent[k] = matrix_complex_alloc(n, width);
+    view[k] = gsl_matrix_complex_submatrix(parent[k], 0, 0, n, n);
+    m[k] = &view[k].matrix;
+  }
+  gsl_matrix* real_parent = matrix_alloc(n, width);
+  gsl_matrix_view real_view = gsl_matrix_submatrix(real_parent, 0, 0, n, n);
+  gsl_matrix* a = &real_view.matrix;
+  for (size_t i = 0; i < n; i++)
+    for (size_t j = 0; j < n; j++) {
+      for (int k = 0; k < 2; k++)
+        gsl_matrix_complex_set(m[k], i, j,
+                               gsl_complex_rect(gsl_rng_uniform(global_rng) - 0.5,
+                                                0.5 + gsl_rng_uniform(global_rng)));
+      gsl_matrix_set(a, i, j, 0.5 + gsl_rng_uniform(global_rng));
+    }
+  gsl_complex w = gsl_complex_rect(1.25, -0.75);
+  int r = (int)(reps * 1024.0 * 1024.0 / ((double)n * n)) + 1;
+
+  printf("\nn = %zu complex, %s rows, %d runs\n", n, padded ? "strided" : "unpadded", r);
+  printf("%-8s %10s", "", "loop");
+  for (int l = SIMD_SCALAR; l <= (int)top; l++) printf(" %10s", simd_level_name((simd_level)l));
+  printf("\n");
+
+  for (size_t i = 0; i < sizeof complex_cases / sizeof complex_cases[0]; i++) {
+    const bench_case* c = &complex_cases[i];
+    int cr = c->op == EW_POW ? r / 16 + 1 : r;   // complex log and exp per entry
+    printf("%-8s %10.0f", c->name, complex_rate(c, -1, m[2], m[0], m[1], a, w, cr));
+    for (int l = SIMD_SCALAR; l <= (int)top; l++) {
+      double v = complex_rate(c, l, m[3], m[0], m[1], a, w, cr);
+      printf(" %10.0f%s", v, same_complex(m[2], m[3]) ? "" : "!");
+    }
+    printf("\n");
+  }
+  for (int k = 0; k < 4; k++) matrix_complex_release(parent[k]);
+  matrix_release(real_parent);
+}
+
+int main(int argc, char** argv) {
+  int reps = argc > 1 ? atoi(argv[1]) : 20;
+  if (reps <= 0) reps = 1;
+  global_rng = gsl_rng_alloc(gsl_rng_mt19937);
+  init_registers();
+
+  simd_level top = simd_best_level();
+  printf("Million elements per second; '!' marks a result that differs from the loop\n");
+  printf("Best vector level on this CPU: %s\n", simd_level_name(top));
+
+  static const size_t sizes[] = {64, 512, 2048};
+  for (size_t i = 0; i < sizeof sizes / sizeof sizes[0]; i++) {
+    run(sizes[i], false, reps, top);
+    run(sizes[i], true, reps, top);
+  }
+  for (size_t i = 0; i < sizeof sizes / sizeof sizes[0]; i++) {
+    run_complex(sizes[i], false, reps, top);
+    run_complex(sizes[i], true, reps, top);
+  }
+
+  gsl_rng_free(global_rng);
+  return 0;
+}
@@ -0,0 +1,27 @@
+/*
+ * This file is part of Mico's toy RPN Calculator
+ *
+ * Mico's toy RPN Calculator is free software:
+ * you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mico's toy RPN Calculator is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mico's toy RPN Calculator. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Globals main.c defines for the calculator. The benchmarks link every
+// object except main.o, so they take these instead.
+
+#include <gsl/gsl_rng.h>
+#include "stack.h"
+#include "registers.h"
+
+gsl_rng * global_rng;
+Register registers[MAX_REG];
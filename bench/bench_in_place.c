@@ -0,0 +1,133 @@
+/*
+ * This file is part of Mico's toy RPN Calculator
+ *
+ * Mico's toy RPN Calculator is free software:
+ * you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mico's toy RPN Calculator is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mico's toy RPN Calculator. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Matrix arithmetic written into an operand instead of a new matrix.
+// Each pass runs "over + over -" as one REPL line. With undo off every
+// result goes into a free operand; with undo on, the journal shares the
+// matrices the line reaches, so the first operation on each copies it.
+// Then checks, through matrix_results_in_place, which REPL lines write a
+// result into an operand; it exits with 1 if that changes. Build with
+// "make bench" and run from bin/:
+//   ./bench_in_place [repetitions]
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <gsl/gsl_rng.h>
+#include "stack.h"
+#include "registers.h"
+#include "globals.h"
+#include "eval_fun.h"
+#include "binary_fun.h"
+#include "undo.h"
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + 1e-9 * (double)ts.tv_nsec;
+}
+
+static gsl_matrix* filled(size_t n, double x) {
+  gsl_matrix* m = matrix_alloc(n, n);
+  gsl_matrix_set_all(m, x);
+  return m;
+}
+
+// Runs `line` as the REPL does, `reps` times
+static void run_lines(Stack* stack, const char* line, int reps) {
+  char buf[64];
+  snprintf(buf, sizeof buf, "%s", line);
+  for (int r = 0; r < reps; r++) {
+    undo_begin_line(stack);
+    evaluate_line(stack, buf);
+    undo_end_line(stack);
+  }
+}
+
+static double time_loop(size_t n, int reps, int levels) {
+  undo_levels = levels;
+  Stack stack;
+  init_stack(&stack);
+  push_matrix_real(&stack, filled(n, 1.0));
+  push_matrix_real(&stack, filled(n, 2.0));
+  run_lines(&stack, "over + over -", 1);   // compile the line once
+  double t0 = now();
+  run_lines(&stack, "over + over -", reps);
+  double t = now() - t0;
+  free_undo_journal();
+  destroy_stack(&stack);
+  return t;
+}
+
+// Runs `line` on a 300 x 300 matrix an earlier line left, and reports
+// how many results went into an operand
+static bool check_in_place(const char* line, int levels, unsigned long expected) {
+  undo_levels = levels;
+  Stack stack;
+  init_stack(&stack);
+  undo_begin_line(&stack);
+  push_matrix_real(&stack, filled(300, 1.0));
+  undo_end_line(&stack);
+
+  unsigned long before = matrix_results_in_place;
+  run_lines(&stack, line, 1);
+  unsigned long got = matrix_results_in_place - before;
+
+  free_undo_journal();
+  destroy_stack(&stack);
+  printf("%-12s %11d %9lu %9lu  %s\n", line, levels, got, expected,
+         got == expected ? "ok" : "FAILED");
+  return got == expected;
+}
+
+int main(int argc, char** argv) {
+  int reps = argc > 1 ? atoi(argv[1]) : 20000;
+  if (reps <= 0) reps = 1;
+  global_rng = gsl_rng_alloc(gsl_rng_mt19937);
+  init_registers();
+
+  static const size_t sizes[] = {4, 32, 128, 512};
+  printf("\"over + over -\" lines on n x n real matrices, %d runs\n", reps);
+  printf("%6s %12s %12s %9s\n", "n", "undo on (s)", "undo off (s)", "speedup");
+  for (size_t i = 0; i < sizeof sizes / sizeof sizes[0]; i++) {
+    size_t n = sizes[i];
+    int r = n >= 512 ? reps / 100 + 1 : n >= 128 ? reps / 10 + 1 : reps;
+    double copied = 1e30, in_place = 1e30;
+    for (int t = 0; t < 3; t++) {   // best of three, alternating
+      double p = time_loop(n, r, 16);
+      double q = time_loop(n, r, 0);
+      if (p < copied) copied = p;
+      if (q < in_place) in_place = q;
+    }
+    printf("%6zu %12.3f %12.3f %8.2fx\n", n, copied, in_place, copied / in_place);
+  }
+
+  // The journal shares the matrix the earlier line left, so the first
+  // operation on it copies; the second works on that copy in place
+  printf("\nResults written into an operand\n");
+  printf("%-12s %11s %9s %9s\n", "line", "undo_levels", "in place", "expected");
+  bool ok = check_in_place("1 +", 0, 1);
+  ok &= check_in_place("1 +", 16, 0);
+  ok &= check_in_place("1 + 2 *", 16, 1);
+  ok &= check_in_place("1 + 2 * 3 -", 16, 2);
+
+  gsl_rng_free(global_rng);
+  return ok ? 0 : 1;
+}
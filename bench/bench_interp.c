@@ -0,0 +1,101 @@
+/*
+ * This file is part of Mico's toy RPN Calculator
+ *
+ * Mico's toy RPN Calculator is free software:
+ * you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mico's toy RPN Calculator is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mico's toy RPN Calculator. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Interpreter throughput on an RPN program, with the compiled-line cache
+// and with the plain lex-and-evaluate path. Build with "make bench" and run
+// from bin/, like the calculator itself:
+//   ./bench_interp [program] [repetitions]
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <gsl/gsl_rng.h>
+#include "stack.h"
+#include "registers.h"
+#include "globals.h"
+#include "run_machine.h"
+#include "compiler.h"
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + 1e-9 * (double)ts.tv_nsec;
+}
+
+static double time_runs(Program* prog, int reps) {
+  Stack stack;
+  init_stack(&stack);
+  double t0 = now();
+  for (int r = 0; r < reps; r++) {
+    run_RPN_code(&stack, prog);
+    free_stack(&stack);
+  }
+  double t = now() - t0;
+  destroy_stack(&stack);
+  return t;
+}
+
+int main(int argc, char** argv) {
+  const char* file = argc > 1 ? argv[1] : "../data/prog_test.prg";
+  int reps = argc > 2 ? atoi(argv[2]) : 20000;
+  if (reps <= 0) reps = 1;
+
+  global_rng = gsl_rng_alloc(gsl_rng_mt19937);
+  init_registers();
+  Program prog = {.count = 0, .label_count = 0};
+  if (!load_program_from_file(file, &prog)) return 1;
+
+  // The program prints; send that to /dev/null while timing
+  fflush(stdout);
+  int saved_stdout = dup(STDOUT_FILENO);
+  int devnull = open("/dev/null", O_WRONLY);
+  if (saved_stdout < 0 || devnull < 0) {
+    perror("bench_interp");
+    return 1;
+  }
+  dup2(devnull, STDOUT_FILENO);
+
+  line_cache_enabled = true;
+  time_runs(&prog, 1);                      // compiles every line once
+  cache_stats = (line_cache_stats){0};
+  double compiled = time_runs(&prog, reps);
+  unsigned long long tokens = cache_stats.tokens;
+  unsigned long misses = cache_stats.misses;
+
+  line_cache_enabled = false;
+  double interpreted = time_runs(&prog, reps);
+
+  fflush(stdout);
+  dup2(saved_stdout, STDOUT_FILENO);
+  close(devnull);
+  close(saved_stdout);
+
+  printf("%s, %d runs, %llu tokens\n", file, reps, tokens);
+  printf("  lexed each time : %8.3f s  %12.0f tokens/s\n", interpreted, (double)tokens / interpreted);
+  printf("  compiled cache  : %8.3f s  %12.0f tokens/s  (%lu recompiles)\n",
+         compiled, (double)tokens / compiled, misses);
+  printf("  speedup         : %8.2fx\n", interpreted / compiled);
+
+  free_program(&prog);
+  gsl_rng_free(global_rng);
+  return 0;
+}
@@ -0,0 +1,101 @@
+/*
+ * This file is part of Mico's toy RPN Calculator
+ *
+ * Mico's toy RPN Calculator is free software:
+ * you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mico's toy RPN Calculator is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mico's toy RPN Calculator. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Large-matrix kernels on plain, 64-byte aligned and huge-page storage.
+// "over *" allocates a fresh product every pass; "over .*" runs in place
+// in the operand it was given. Columns:
+//   malloc   operands from GSL's own allocator, huge pages off
+//   aligned  operands and results 64-byte aligned, huge pages off
+//   huge     as aligned, blocks of 4 MB and more on transparent huge pages
+// Build with "make bench" and run from bin/:
+//   ./bench_matrix_align [repetitions]
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <gsl/gsl_rng.h>
+#include "stack.h"
+#include "registers.h"
+#include "globals.h"
+#include "eval_fun.h"
+
+enum { PLAIN, ALIGNED, HUGE, MODES };
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + 1e-9 * (double)ts.tv_nsec;
+}
+
+// PLAIN takes GSL's own malloc storage instead of matrix_alloc's
+static gsl_matrix* filled(size_t n, double x, int mode) {
+  gsl_matrix* m = mode == PLAIN ? gsl_matrix_alloc(n, n) : matrix_alloc(n, n);
+  gsl_matrix_set_all(m, x);
+  return m;
+}
+
+// x stays a fixed point of the line, so values neither grow nor vanish
+static double time_loop(const char* op, size_t n, double x, int reps, int mode) {
+  matrix_huge_pages = mode == HUGE;
+  Stack stack;
+  init_stack(&stack);
+  push_matrix_real(&stack, filled(n, x, mode));
+  push_matrix_real(&stack, filled(n, x, mode));
+  evaluate_line(&stack, op);   // compile the line once
+  double t0 = now();
+  for (int r = 0; r < reps; r++) evaluate_line(&stack, op);
+  double t = now() - t0;
+  destroy_stack(&stack);
+  return t;
+}
+
+static void run(const char* op, const size_t* sizes, int count, int reps, bool product) {
+  printf("\n\"%s\" on n x n real matrices\n", op);
+  printf("%6s %6s %12s %12s %12s\n", "n", "runs", "malloc (s)", "aligned (s)", "huge (s)");
+  for (int i = 0; i < count; i++) {
+    size_t n = sizes[i];
+    double x = product ? 1.0 / (double)n : 1.0;
+    int r = (int)(reps * (product ? 128.0 * 128.0 * 128.0 / ((double)n * n * n)
+                                  : 2048.0 * 2048.0 / ((double)n * n))) + 1;
+    double best[MODES] = {1e30, 1e30, 1e30};
+    for (int t = 0; t < 3; t++) {   // best of three, alternating
+      for (int mode = 0; mode < MODES; mode++) {
+        double s = time_loop(op, n, x, r, mode);
+        if (s < best[mode]) best[mode] = s;
+      }
+    }
+    printf("%6zu %6d %12.3f %12.3f %12.3f\n", n, r, best[PLAIN], best[ALIGNED], best[HUGE]);
+  }
+}
+
+int main(int argc, char** argv) {
+  int reps = argc > 1 ? atoi(argv[1]) : 20;
+  if (reps <= 0) reps = 1;
+  global_rng = gsl_rng_alloc(gsl_rng_mt19937);
+  init_registers();
+
+  static const size_t product_sizes[] = {128, 256, 512};
+  static const size_t elementwise_sizes[] = {512, 1024, 2048};
+  run("over *", product_sizes, 3, reps, true);
+  run("over .*", elementwise_sizes, 3, reps, false);
+
+  gsl_rng_free(global_rng);
+  return 0;
+}
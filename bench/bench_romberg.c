@@ -0,0 +1,113 @@
+/*
+ * This file is part of Mico's toy RPN Calculator
+ *
+ * Mico's toy RPN Calculator is free software:
+ * you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mico's toy RPN Calculator is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mico's toy RPN Calculator. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// A 20-level Romberg run (2^19 + 1 evaluations of the integrand) through
+// the interpreter, lexing every call and then with the line cache, and
+// through a compiled real kernel. Tolerance is zero, so every level runs.
+// Build with "make bench" and run from bin/:
+//   ./bench_romberg ["word definition" ...]
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <gsl/gsl_rng.h>
+#include "stack.h"
+#include "registers.h"
+#include "globals.h"
+#include "words.h"
+#include "integration_and_zeros.h"
+
+static const char* default_words[] = {
+  ": rb_poly dup dup * 3 * swap 2 * - 1 + ;",
+  ": rb_osc dup * sin 1 + ;",
+  ": rb_bell dup * chs exp pi * ;",
+};
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + 1e-9 * (double)ts.tv_nsec;
+}
+
+static double time_integral(double* result) {
+  Stack stack;
+  init_stack(&stack);
+  push_real(&stack, 0.0);
+  push_real(&stack, 2.0);
+  double t0 = now();
+  integrate(&stack);
+  double t = now() - t0;
+  *result = pop(&stack).real;
+  destroy_stack(&stack);
+  return t;
+}
+
+int main(int argc, char** argv) {
+  int n = argc > 1 ? argc - 1 : (int)(sizeof default_words / sizeof *default_words);
+  const char** defs = argc > 1 ? (const char**)argv + 1 : default_words;
+
+  global_rng = gsl_rng_alloc(gsl_rng_mt19937);
+  init_registers();
+  intg_tolerance = 0.0;
+
+  // The unconverged warning goes to stderr once per run
+  fflush(stderr);
+  int saved_stderr = dup(STDERR_FILENO);
+  int devnull = open("/dev/null", O_WRONLY);
+  if (saved_stderr < 0 || devnull < 0) {
+    perror("bench_romberg");
+    return 1;
+  }
+
+  for (int i = 0; i < n; i++) {
+    if (!is_word_definition(defs[i]) || word_count == 0) {
+      fprintf(stderr, "bench_romberg: not a word definition: %s\n", defs[i]);
+      continue;
+    }
+    selected_function = word_count - 1;
+
+    double lexed_result, slow, fast;
+    dup2(devnull, STDERR_FILENO);
+    real_kernels_enabled = false;
+    line_cache_enabled = false;
+    double lexed = time_integral(&lexed_result);
+    line_cache_enabled = true;
+    double interpreted = time_integral(&slow);
+    real_kernels_enabled = true;
+    double kernel = time_integral(&fast);
+    fflush(stderr);
+    dup2(saved_stderr, STDERR_FILENO);
+
+    printf("%s\n", defs[i]);
+    printf("  lexed       : %8.3f s  %.17g\n", lexed, lexed_result);
+    printf("  interpreter : %8.3f s  %.17g\n", interpreted, slow);
+    printf("  kernel      : %8.3f s  %.17g%s\n", kernel, fast, slow == fast || (isnan(slow) && isnan(fast)) ? "" : "  (differs)");
+    printf("  speedup     : %8.2fx over the line cache, %.2fx over lexing\n",
+           interpreted / kernel, lexed / kernel);
+  }
+
+  close(devnull);
+  close(saved_stderr);
+  gsl_rng_free(global_rng);
+  return 0;
+}
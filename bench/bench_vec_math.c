@@ -0,0 +1,249 @@
+/*
+ * This file is part of Mico's toy RPN Calculator
+ *
+ * Mico's toy RPN Calculator is free software:
+ * you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mico's toy RPN Calculator is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mico's toy RPN Calculator. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Vector math against libm. For each function and argument range it
+// prints the worst error in ULP over random arguments, measured against
+// the long double functions, then millions of elements per second for
+// the libm loop and for each vector level this CPU has, as vm_real runs
+// it: levels below a function's vector level call libm. '!' marks a level
+// whose results differ from both the best level and libm. Complex
+// functions are measured against gsl_complex per element, with the error
+// in ULP of |f(z)|.
+// Build with "make bench" and run from bin/:
+//   ./bench_vec_math [repetitions]
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <complex.h>
+#include <time.h>
+#include <gsl/gsl_rng.h>
+#include <gsl/gsl_matrix.h>
+#include <gsl/gsl_complex_math.h>
+#include "stack.h"
+#include "registers.h"
+#include "globals.h"
+#include "elementwise.h"
+#include "math_helpers.h"
+#include "vec_math.h"
+
+#define N 65536
+
+typedef struct {
+  const char* name;
+  vm_fn fn;
+  double lo, hi;
+  bool log_scale;   // arguments spread evenly over the exponents
+  double (*libm)(double);
+  long double (*exact)(long double);
+} real_case;
+
+static const real_case real_cases[] = {
+  { "sin",   VM_SIN,   -M_PI, M_PI, false, sin, sinl },
+  { "sin",   VM_SIN,   -1e5, 1e5, false, sin, sinl },
+  { "cos",   VM_COS,   -M_PI, M_PI, false, cos, cosl },
+  { "cos",   VM_COS,   -1e5, 1e5, false, cos, cosl },
+  { "tan",   VM_TAN,   -M_PI, M_PI, false, tan, tanl },
+  { "exp",   VM_EXP,   -1.0, 1.0, false, exp, expl },
+  { "exp",   VM_EXP,   -740.0, 709.0, false, exp, expl },
+  { "log",   VM_LOG,   0.5, 2.0, false, log, logl },
+  { "log",   VM_LOG,   1e-310, 1e300, true, log, logl },
+  { "log10", VM_LOG10, 0.5, 2.0, false, log10, log10l },
+  { "log10", VM_LOG10, 1e-310, 1e300, true, log10, log10l },
+  { "sqrt",  VM_SQRT,  0.0, 1e10, false, sqrt, sqrtl },
+  { "tanh",  VM_TANH,  -1.0, 1.0, false, tanh, tanhl },
+  { "tanh",  VM_TANH,  -20.0, 20.0, false, tanh, tanhl },
+};
+
+typedef struct {
+  const char* name;
+  vm_fn fn;
+  gsl_complex (*gsl)(gsl_complex);
+  long double complex (*exact)(long double complex);
+} complex_case;
+
+static const complex_case complex_cases[] = {
+  { "exp",  VM_EXP,  gsl_complex_exp,  cexpl },
+  { "sin",  VM_SIN,  gsl_complex_sin,  csinl },
+  { "cos",  VM_COS,  gsl_complex_cos,  ccosl },
+  { "sqrt", VM_SQRT, gsl_complex_sqrt, csqrtl },
+};
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + 1e-9 * (double)ts.tv_nsec;
+}
+
+// |y - exact| in units of the last place of the double nearest exact
+static double ulp_error(double y, long double exact) {
+  if (isnan(y) || isnan(exact)) return isnan(y) && isnan(exact) ? 0.0 : INFINITY;
+  if (isinf(exact)) return y == exact ? 0.0 : INFINITY;
+  int e;
+  frexpl(exact, &e);
+  long double ulp = ldexpl(1.0L, e - 53 < -1074 ? -1074 : e - 53);
+  return (double)(fabsl((long double)y - exact) / ulp);
+}
+
+static double worst(const double* y, const double* x, long double (*exact)(long double)) {
+  double w = 0.0;
+  for (int i = 0; i < N; i++) {
+    double e = ulp_error(y[i], exact(x[i]));
+    if (e > w) w = e;
+  }
+  return w;
+}
+
+// Best of three, in million elements per second
+static double real_rate(const real_case* c, int level, double* y, const double* x, int reps) {
+  double best = 1e30;
+  if (level >= 0) simd_use_level((simd_level)level);
+  for (int t = 0; t < 3; t++) {
+    double t0 = now();
+    for (int r = 0; r < reps; r++) {
+      if (level < 0)
+        for (int i = 0; i < N; i++) y[i] = c->libm(x[i]);
+      else vm_real(c->fn, y, x, N);
+    }
+    double e = now() - t0;
+    if (e < best) best = e;
+  }
+  return 1e-6 * (double)reps * N / best;
+}
+
+static void run_real(int reps, simd_level top) {
+  double* x = malloc(N * sizeof *x);
+  double* y = malloc(N * sizeof *y);
+  double* first = malloc(N * sizeof *first);
+  double* libm_y = malloc(N * sizeof *libm_y);
+
+  printf("\n%-6s %-22s %8s %8s %10s", "", "arguments", "libm ulp", "vec ulp", "libm");
+  for (int l = SIMD_SCALAR; l <= (int)top; l++) printf(" %10s", simd_level_name((simd_level)l));
+  printf("\n");
+
+  for (size_t k = 0; k < sizeof real_cases / sizeof real_cases[0]; k++) {
+    const real_case* c = &real_cases[k];
+    for (int i = 0; i < N; i++) {
+      double u = gsl_rng_uniform(global_rng);
+      x[i] = c->log_scale ? exp(log(c->lo) + u * (log(c->hi) - log(c->lo)))
+                          : c->lo + u * (c->hi - c->lo);
+    }
+    char range[32];
+    snprintf(range, sizeof range, "[%g, %g]", c->lo, c->hi);
+    int r = reps * 16;
+
+    double libm_rate = real_rate(c, -1, y, x, r);
+    double libm_ulp = worst(y, x, c->exact);
+    memcpy(libm_y, y, N * sizeof *y);
+    simd_use_level(top);
+    vm_real(c->fn, first, x, N);
+    printf("%-6s %-22s %8.3f %8.3f %10.0f", c->name, range, libm_ulp, worst(first, x, c->exact), libm_rate);
+    for (int l = SIMD_SCALAR; l <= (int)top; l++) {
+      double v = real_rate(c, l, y, x, r);
+      bool differs = memcmp(y, first, N * sizeof *y) && memcmp(y, libm_y, N * sizeof *y);
+      printf(" %10.0f%s", v, differs ? "!" : "");
+    }
+    printf("\n");
+  }
+  free(x);
+  free(y);
+  free(first);
+  free(libm_y);
+}
+
+static double complex_worst(const gsl_matrix_complex* y, const gsl_matrix_complex* x,
+                            long double complex (*exact)(long double complex)) {
+  double w = 0.0;
+  for (size_t i = 0; i < y->size2; i++) {
+    long double complex z = x->data[2 * i] + x->data[2 * i + 1] * (long double complex)I;
+    long double complex f = exact(z);
+    double err = ulp_error(hypot(y->data[2 * i] - (double)creall(f), y->data[2 * i + 1] - (double)cimagl(f))
+                           + (double)cabsl(f), cabsl(f));
+    if (err > w) w = err;
+  }
+  return w;
+}
+
+static double complex_rate(const complex_case* c, int level, gsl_matrix_complex* y,
+                           const gsl_matrix_complex* x, int reps) {
+  double best = 1e30;
+  if (level >= 0) simd_use_level((simd_level)level);
+  for (int t = 0; t < 3; t++) {
+    double t0 = now();
+    for (int r = 0; r < reps; r++) {
+      if (level < 0)
+        for (size_t i = 0; i < x->size2; i++)
+          gsl_matrix_complex_set(y, 0, i, c->gsl(gsl_matrix_complex_get(x, 0, i)));
+      else vm_complex_matrix(c->fn, y, x);
+    }
+    double e = now() - t0;
+    if (e < best) best = e;
+  }
+  return 1e-6 * (double)reps * (double)x->size2 / best;
+}
+
+static void run_complex(int reps, simd_level top) {
+  gsl_matrix_complex* x = matrix_complex_alloc(1, N);
+  gsl_matrix_complex* y = matrix_complex_alloc(1, N);
+  gsl_matrix_complex* first = matrix_complex_alloc(1, N);
+  for (int i = 0; i < 2 * N; i++) x->data[i] = 6.0 * gsl_rng_uniform(global_rng) - 3.0;
+
+  printf("\n%-6s %-22s %8s %8s %10s", "", "complex, |re|, |im| < 3", "gsl ulp", "vec ulp", "gsl");
+  for (int l = SIMD_SCALAR; l <= (int)top; l++) printf(" %10s", simd_level_name((simd_level)l));
+  printf("\n");
+
+  for (size_t k = 0; k < sizeof complex_cases / sizeof complex_cases[0]; k++) {
+    const complex_case* c = &complex_cases[k];
+    int r = reps * 4;
+    double gsl_rate = complex_rate(c, -1, y, x, r);
+    double gsl_ulp = complex_worst(y, x, c->exact);
+    simd_use_level(top);
+    vm_complex_matrix(c->fn, first, x);
+    printf("%-6s %-22s %8.3f %8.3f %10.0f", c->name, "", gsl_ulp, complex_worst(first, x, c->exact), gsl_rate);
+    for (int l = SIMD_SCALAR; l <= (int)top; l++) {
+      double v = complex_rate(c, l, y, x, r);
+      printf(" %10.0f%s", v, memcmp(y->data, first->data, 2 * N * sizeof(double)) ? "!" : "");
+    }
+    printf("\n");
+  }
+  matrix_complex_release(x);
+  matrix_complex_release(y);
+  matrix_complex_release(first);
+}
+
+int main(int argc, char** argv) {
+  int reps = argc > 1 ? atoi(argv[1]) : 4;
+  if (reps <= 0) reps = 1;
+  global_rng = gsl_rng_alloc(gsl_rng_mt19937);
+  init_registers();
+
+  simd_level top = simd_best_level();
+  printf("Worst error in ULP over %d arguments; million elements per second.\n", N);
+  printf("'!' marks a level whose results differ from the best level's (and libm's).\n");
+  printf("Best vector level on this CPU: %s\n", simd_level_name(top));
+
+  run_real(reps, top);
+  run_complex(reps, top);
+
+  gsl_rng_free(global_rng);
+  return 0;
+}
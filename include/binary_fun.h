@@ -19,13 +19,9 @@
 #ifndef BINARY_FUN_H
 #define BINARY_FUN_H
 
-void add_top_two_scalars(Stack* stack);
-void add_top_two_matrices(Stack* stack);
 void multiply_top_two_scalars(Stack* stack);
 void subtract_top_two_scalars(Stack* stack);
 void divide_top_two_scalars(Stack* stack);
-void subtract_top_two_matrices(Stack* stack);
-void multiply_top_two_matrices(Stack* stack);
 void add_top_two(Stack* stack);
 void sub_top_two(Stack* stack);
 void mul_top_two(Stack* stack);
@@ -37,6 +33,9 @@ void dot_div_top_two(Stack* stack);
 void dot_mult_top_two(Stack* stack);
 void dot_pow_top_two(Stack* stack);
 
+// Arithmetic results written into an operand instead of a new matrix
+extern unsigned long matrix_results_in_place;
+
 #endif //BINARY_FUN_H
 
   
@@ -0,0 +1,159 @@
+/*
+ * This file is part of Mico's toy RPN Calculator
+ *
+ * Mico's toy RPN Calculator is free software:
+ * you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mico's toy RPN Calculator is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mico's toy RPN Calculator. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef COMPILER_H
+#define COMPILER_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include "stack.h"
+
+typedef void (*builtin_func)(Stack* stack);
+
+struct symbol;
+
+// One bytecode instruction per token of the source line
+typedef enum {
+  BC_END,
+  BC_PUSH_REAL,
+  BC_PUSH_COMPLEX,
+  BC_PUSH_STRING,       // literal: the text between the quotes
+  BC_PUSH_MATRIX,       // literal: an inline real matrix, parsed once
+  BC_PUSH_CMATRIX,      // literal: an inline complex or mixed matrix
+  BC_MATRIX_FILE,       // literal: [r,c,"file"], read on every execution
+  BC_ADD,
+  BC_SUB,
+  BC_MUL,
+  BC_DIV,
+  BC_POW,
+  BC_DOT_MUL,
+  BC_DOT_DIV,
+  BC_DOT_POW,
+  BC_BUILTIN,
+  BC_CALL,              // macro or user word, resolved through its symbol
+  BC_ECHO,              // the lone punctuation tokens < > : ; |
+  BC_ILLEGAL,
+
+  // Superinstructions, formed by the peephole pass (peephole.c)
+  BC_SQUARE,            // dup *
+  BC_NIP,               // swap drop
+  BC_OVER2_DIV,         // over over /
+  BC_OVER_SUB,          // over -
+  BC_SWAP_DIV,          // swap /
+  BC_PCT_DELTA,         // over - swap /
+  BC_ADD_K,             // <number> +   (number kept inline)
+  BC_SUB_K,             // <number> -
+  BC_MUL_K,             // <number> *
+  BC_DIV_K,             // <number> /
+
+  // Check-free variants, chosen by stack_effects.c where the stack depth
+  // and operand types are proven; only found in code_block.fast.
+  // The first ten mirror the superinstructions above, in the same order.
+  BC_SQUARE_R,
+  BC_NIP_R,
+  BC_OVER2_DIV_RR,
+  BC_OVER_SUB_RR,
+  BC_SWAP_DIV_RR,
+  BC_PCT_DELTA_RR,
+  BC_ADD_K_R,
+  BC_SUB_K_R,
+  BC_MUL_K_R,
+  BC_DIV_K_R,
+  BC_ADD_RR,
+  BC_SUB_RR,
+  BC_MUL_RR,
+  BC_DIV_RR,
+  BC_POW_RR,
+  BC_CMP_RR,            // cmp: a comparison_op
+  BC_REAL_FN,           // real_fn applied to the real on top
+  BC_DUP_R,
+  BC_DROP_R,
+  BC_SWAP_RR,
+  BC_OVER_RR,
+  BC_OP_COUNT
+} bc_op;
+
+// Check-free variant of a superinstruction
+#define BC_FAST_FUSED(op) ((bc_op)((op) + (BC_SQUARE_R - BC_SQUARE)))
+
+typedef struct {
+  bc_op op;
+  int opcode;                    // BC_BUILTIN: which builtin (OP_*)
+  union {
+    double number;
+    struct { double re, im; } z;
+    int literal;                 // index into code_block.literals
+    builtin_func fn;
+    const struct symbol* sym;
+    char ch;
+    int cmp;
+    double (*real_fn)(double);
+  };
+} bc_instr;
+
+typedef struct {
+  bc_op op;                      // instruction kind that owns the literal
+  char* text;                    // NUL-terminated copy of the token slice
+  size_t len;
+  void* value;                   // parsed matrix, once it parsed cleanly
+} bc_literal;
+
+// Net stack effect of a block, as far as stack_effects.c can prove it
+typedef struct {
+  bool complete;                 // every instruction was modelled
+  bool underflows;               // pops from a stack it has just cleared
+  bool clears;                   // runs clst, so every entry counts as consumed
+  int needs;                     // entries consumed from below the entry depth
+  int delta;                     // depth change, if complete
+  int peak;                      // most entries above the entry depth at once
+} stack_effect;
+
+typedef struct code_block {
+  bc_instr* code;                // always ends with BC_END
+  int count;
+  stack_effect effect;           // of code, with nothing assumed about inputs
+  bc_instr* fast;                // code with check-free ops, or NULL; valid
+  int fast_needs;                //   when the top fast_needs entries are real
+  int fast_peak;                 //   and fast_peak more entries fit
+  bc_literal* literals;
+  int literal_count;
+  int token_count;               // source tokens, for throughput statistics
+  int refs;
+} code_block;
+
+typedef struct {
+  unsigned long hits;
+  unsigned long misses;
+  unsigned long flushes;
+  unsigned long evictions;       // lines dropped from a full bucket
+  unsigned long long tokens;     // source tokens executed from compiled code
+} line_cache_stats;
+
+extern line_cache_stats cache_stats;
+
+code_block* compile_line(const char* line);        // new block, one reference
+void retain_code(code_block* code);
+void release_code(code_block* code);
+
+// Compiled form of a line, from the cache when the same text was seen
+// before. The caller gets its own reference and releases it after running,
+// so a flush triggered by the line itself (eval, batch) cannot free it.
+code_block* cached_compile_line(const char* line);
+void flush_line_cache(void);
+
+#endif // COMPILER_H
@@ -0,0 +1,65 @@
+/*
+ * This file is part of Mico's toy RPN Calculator
+ *
+ * Mico's toy RPN Calculator is free software:
+ * you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mico's toy RPN Calculator is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mico's toy RPN Calculator. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef ELEMENTWISE_H
+#define ELEMENTWISE_H
+
+#include <gsl/gsl_matrix.h>
+#include <gsl/gsl_complex.h>
+
+// Elementwise arithmetic on matrices, one row of contiguous doubles at a
+// time (the whole block at once when no matrix has padded rows). Add,
+// subtract, multiply and divide run on the widest vector unit the CPU
+// has, chosen on first use; pow calls libm per element. Results are
+// bit-identical to the scalar loops at every level: each element is one
+// IEEE operation, never fused or reassociated.
+//
+// Complex matrices are worked on in their interleaved storage, with the
+// same formulas as gsl_complex_mul, gsl_complex_div and friends. A real
+// matrix meeting a complex scalar is promoted inside the kernel, without
+// building a complex value per element. Division by a varying complex
+// value and pow run per element.
+//
+// dst may be the same matrix as an operand, but must not overlap one
+// in any other way. Sizes must already match.
+
+typedef enum { EW_ADD, EW_SUB, EW_MUL, EW_DIV, EW_POW, EW_OP_COUNT } ew_op;
+
+typedef enum { SIMD_SCALAR, SIMD_SSE2, SIMD_AVX2, SIMD_AVX512, SIMD_LEVELS } simd_level;
+
+void ew_matrix_matrix(ew_op op, gsl_matrix* dst, const gsl_matrix* x, const gsl_matrix* y);
+void ew_matrix_scalar(ew_op op, gsl_matrix* dst, const gsl_matrix* x, double s);   // x op s
+void ew_scalar_matrix(ew_op op, gsl_matrix* dst, double s, const gsl_matrix* x);   // s op x
+
+void ew_complex_matrix_matrix(ew_op op, gsl_matrix_complex* dst,
+                              const gsl_matrix_complex* x, const gsl_matrix_complex* y);
+void ew_complex_matrix_scalar(ew_op op, gsl_matrix_complex* dst,
+                              const gsl_matrix_complex* x, gsl_complex s);
+void ew_complex_scalar_matrix(ew_op op, gsl_matrix_complex* dst,
+                              gsl_complex s, const gsl_matrix_complex* x);
+void ew_real_matrix_complex_scalar(ew_op op, gsl_matrix_complex* dst,
+                                   const gsl_matrix* x, gsl_complex s);
+void ew_complex_scalar_real_matrix(ew_op op, gsl_matrix_complex* dst,
+                                   gsl_complex s, const gsl_matrix* x);
+
+simd_level simd_best_level(void);            // what this CPU supports
+simd_level simd_use_level(simd_level level);  // clamped to the best; returns the level in use
+simd_level simd_current_level(void);          // the level in use, picking the best on first call
+const char* simd_level_name(simd_level level);
+
+#endif // ELEMENTWISE_H
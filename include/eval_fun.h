@@ -21,8 +21,11 @@
 
 #include "lexer.h"
 #include "stack.h"
+#include "compiler.h"
 
-void evaluate_line(Stack *stack, char * line);
-void evaluate_one_token(Stack *stack, Token tok);
+void evaluate_line(Stack *stack, const char* line);
+void evaluate_one_token(Stack *stack, const Token* tok);
+void execute_code(Stack *stack, code_block* code);
+builtin_func builtin_for_opcode(int opcode);
 
 #endif // EVAL_FUN_H
@@ -21,4 +21,13 @@
 
 extern const char* const function_names[];
 
+#define REACH_WHOLE_STACK (-1)
+
+typedef struct {
+  const char* name;
+  int reach;           // entries from the top, or REACH_WHOLE_STACK
+} builtin_reach_spec;
+
+extern const builtin_reach_spec builtin_reaches[];   // NULL-terminated
+
 #endif
@@ -25,6 +25,12 @@
 
 #define MAX_PATH 2048
 
+// How run_RPN_code dispatches program steps (config key dispatch_mode)
+typedef enum {
+  DISPATCH_SWITCH,     // portable switch loop
+  DISPATCH_THREADED    // computed goto; needs GCC or clang, else uses the switch
+} dispatch_kind;
+
 extern gsl_rng * global_rng;
 
 extern bool fixed_point;
@@ -32,6 +38,9 @@ extern bool verbose_mode;
 extern bool completed_batch;
 extern bool test_flag;
 extern bool skip_stack_printing;
+extern bool line_cache_enabled;
+extern bool real_kernels_enabled;
+extern int dispatch_mode;
 extern int print_precision;
 extern int selected_function;
 extern char path_to_data_and_programs[MAX_PATH];
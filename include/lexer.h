@@ -28,7 +28,6 @@
 #include <readline/history.h>
 #include <readline/readline.h>
 
-#define MAX_TOKEN_LEN 1024
 #define MAX_INPUT_LEN 4096
 #define MAX_SUBTOKEN_LEN 100
 
@@ -59,9 +58,20 @@ typedef enum {
   TOK_UNKNOWN,
 } token_type;
 
+struct symbol;
+
+// A token is a slice of the lexer input; nothing is copied. Numbers and
+// complex literals arrive decoded, names arrive resolved to a symbol.
+// Strings and inline matrices slice the text inside the quotes/brackets.
 typedef struct {
   token_type type;
-  char text[MAX_TOKEN_LEN];
+  const char* start;                 // first character in the input
+  size_t len;
+  union {
+    double number;                   // TOK_NUMBER
+    struct { double re, im; } z;     // TOK_COMPLEX
+    const struct symbol* sym;        // TOK_FUNCTION, TOK_IDENTIFIER
+  };
 } Token;
 
 typedef struct {
@@ -73,8 +83,7 @@ void skip_whitespace(Lexer* lexer);
 char peek(Lexer* lexer);
 char advance(Lexer* lexer);
 bool match(Lexer* lexer, char expected);
-Token make_token(token_type type, const char* text);
-bool is_function_name(const char* name);
+Token make_token(token_type type, const char* start, size_t len);
 Token lex_number(Lexer* lexer);
 Token lex_identifier(Lexer* lexer);
 Token lex_string(Lexer* lexer);
@@ -0,0 +1,34 @@
+/*
+ * This file is part of Mico's toy RPN Calculator
+ *
+ * Mico's toy RPN Calculator is free software:
+ * you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mico's toy RPN Calculator is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mico's toy RPN Calculator. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef LINE_ARENA_H
+#define LINE_ARENA_H
+
+#include <stddef.h>
+
+// Bump allocator for temporaries that live no longer than one input line,
+// such as the staging arrays of matrix literals. Nothing is freed on its
+// own; the REPL resets the whole arena once the line has run, so callers
+// must not keep arena memory past the end of the line.
+
+void* line_alloc(size_t size);   // 16-byte aligned, NULL if out of memory
+char* line_strndup(const char* str, size_t len);
+void line_arena_reset(void);
+void free_line_arena(void);
+
+#endif // LINE_ARENA_H
@@ -0,0 +1,51 @@
+/*
+ * This file is part of Mico's toy RPN Calculator
+ *
+ * Mico's toy RPN Calculator is free software:
+ * you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mico's toy RPN Calculator is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mico's toy RPN Calculator. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef MATRIX_ALLOC_H
+#define MATRIX_ALLOC_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <gsl/gsl_matrix.h>
+
+// Matrices the calculator keeps (stack, registers, results) come from
+// these rather than gsl_matrix_alloc, and go back through matrix_free
+// once payload.h drops the last reference. Storage policy for matrix
+// data lives here and nowhere else.
+//
+// The data starts on a 64-byte boundary. Blocks of 4 MB and more also
+// ask for transparent huge pages unless matrix_huge_pages is 0.
+extern int matrix_huge_pages;   // madvise(MADV_HUGEPAGE) on large blocks
+
+gsl_matrix* matrix_alloc(size_t rows, size_t cols);
+gsl_matrix* matrix_calloc(size_t rows, size_t cols);
+gsl_matrix_complex* matrix_complex_alloc(size_t rows, size_t cols);
+gsl_matrix_complex* matrix_complex_calloc(size_t rows, size_t cols);
+
+// Also takes matrices from gsl_matrix_alloc, which own their block
+void matrix_free(gsl_matrix* m);
+void matrix_complex_free(gsl_matrix_complex* m);
+
+// Storage alone, for a matrix from matrix_alloc whose data goes to the
+// spill file and back. Dropping leaves data and block NULL; restoring
+// gives it fresh storage, with contents undefined.
+void matrix_storage_drop(void* m, bool is_complex);
+bool matrix_storage_restore(void* m, bool is_complex);   // false if over budget or out of memory
+void* matrix_header_like(const void* m, bool is_complex);   // same shape, no storage yet
+
+#endif // MATRIX_ALLOC_H
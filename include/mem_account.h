@@ -0,0 +1,44 @@
+/*
+ * This file is part of Mico's toy RPN Calculator
+ *
+ * Mico's toy RPN Calculator is free software:
+ * you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mico's toy RPN Calculator is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mico's toy RPN Calculator. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef MEM_ACCOUNT_H
+#define MEM_ACCOUNT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "stack.h"
+
+// Accounting of matrix storage, the bulk of what a session holds. Every
+// new block is charged when it is allocated and credited when it goes
+// back to the system, so the running total covers the stack, registers,
+// the undo journal and operations in flight alike. `mem` breaks the
+// total down by owner.
+//
+// With memory_budget_mb set, an allocation that would go over the budget
+// fails: matrix_alloc and friends return NULL after saying why, and the
+// operation reports it and leaves its operands where they were.
+
+extern int memory_budget_mb;   // 0 for no budget
+
+bool memory_charge(size_t bytes);   // false, with a message, when over budget
+void memory_credit(size_t bytes);
+size_t memory_in_use(void);
+
+void print_memory_report(const Stack* stack);
+
+#endif // MEM_ACCOUNT_H
@@ -0,0 +1,52 @@
+/*
+ * This file is part of Mico's toy RPN Calculator
+ *
+ * Mico's toy RPN Calculator is free software:
+ * you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mico's toy RPN Calculator is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mico's toy RPN Calculator. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef NAMED_STACKS_H
+#define NAMED_STACKS_H
+
+#include "stack.h"
+
+// Named stacks for side-by-side scenarios. The REPL works on one Stack
+// at a time; the others are parked here under their names, each with its
+// own undo history. Forking shares every payload with the current stack
+// instead of copying it, so a fork of large matrices costs one entry per
+// item, and switching moves the Stack and history structs, so it takes
+// the same time whatever is on the stacks. The first stack is "main".
+//
+//   "name" sfork    park a copy of the current stack under a new name
+//   "name" sswitch  make the named stack current, parking this one
+//   "name" sdrop    forget a parked stack
+//   slist           list the stacks and their depths
+//
+// A line that switches stacks is journaled in two parts: the part before
+// the switch in the history of the stack it left, the rest in the new one.
+
+#define NAMED_STACK_NAME_MAX 31
+
+void init_named_stacks(Stack* stack);   // the REPL's stack, which becomes "main"
+void stack_fork(Stack* stack);
+void stack_switch(Stack* stack);
+void stack_drop_named(Stack* stack);
+void list_named_stacks(Stack* stack);
+
+// Entries and undo records of the parked stacks
+void parked_stacks_for_each_entry(void (*visit)(const stack_element* e, void* ctx), void* ctx);
+void parked_histories_for_each_entry(void (*visit)(const stack_element* e, void* ctx), void* ctx);
+void free_named_stacks(void);
+
+#endif // NAMED_STACKS_H
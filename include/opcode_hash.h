@@ -0,0 +1,37 @@
+/*
+ * This file is part of Mico's toy RPN Calculator
+ *
+ * Mico's toy RPN Calculator is free software:
+ * you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mico's toy RPN Calculator is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mico's toy RPN Calculator. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef OPCODE_HASH_H
+#define OPCODE_HASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// FNV-style string hash shared by tools/gen_opcodes.c and the runtime lookup.
+// A seed of 0 selects the bucket, non-zero seeds place names inside a bucket.
+static inline uint32_t opcode_hash(uint32_t seed, const char* s, size_t len) {
+  uint32_t h = seed ? seed : 0x01000193u;
+  for (size_t i = 0; i < len; i++)
+    h = (h * 0x01000193u) ^ (uint8_t)s[i];
+  return h;
+}
+
+// Opcode (index into function_names[]) of a builtin, or -1 (OP_NONE)
+int lookup_opcode(const char* name, size_t len);
+
+#endif // OPCODE_HASH_H
@@ -0,0 +1,48 @@
+/*
+ * This file is part of Mico's toy RPN Calculator
+ *
+ * Mico's toy RPN Calculator is free software:
+ * you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mico's toy RPN Calculator is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mico's toy RPN Calculator. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef PAYLOAD_H
+#define PAYLOAD_H
+
+#include <stdbool.h>
+#include <gsl/gsl_matrix.h>
+#include "matrix_alloc.h"
+
+// Matrix and string payloads are shared between stack slots, registers
+// and the undo copy instead of being deep-copied. A payload with a
+// single owner has no count; a side table counts the extra
+// references of shared ones. Code that writes into a payload first makes
+// its slot unique (make_unique in stack.h).
+
+void payload_retain(const void* p);
+bool payload_release(const void* p);   // true when that was the last reference
+bool payload_is_shared(const void* p);
+
+// Bytes memory_charge'd for a matrix's storage, kept beside the counts so
+// that only storage matrix_alloc charged is ever credited
+bool payload_set_charge(const void* p, size_t bytes);   // false if out of memory
+size_t payload_charge(const void* p);                    // 0 if never charged
+size_t payload_take_charge(const void* p);               // and forget it
+
+// Drop a reference to a matrix; the last one frees it. Use these, not
+// gsl_matrix_free, for any matrix the calculator may share.
+void matrix_release(gsl_matrix* m);
+void matrix_complex_release(gsl_matrix_complex* m);
+void string_release(char* s);
+
+#endif // PAYLOAD_H
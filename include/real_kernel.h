@@ -0,0 +1,61 @@
+/*
+ * This file is part of Mico's toy RPN Calculator
+ *
+ * Mico's toy RPN Calculator is free software:
+ * you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mico's toy RPN Calculator is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mico's toy RPN Calculator. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef REAL_KERNEL_H
+#define REAL_KERNEL_H
+
+#include <stdbool.h>
+#include "words.h"
+
+#define KERNEL_STACK_SIZE 32
+
+struct kernel_step;
+typedef double* (*kernel_fn)(double* sp, const struct kernel_step* step);
+
+// One closure: the operation and what it captured at build time
+typedef struct kernel_step {
+  kernel_fn fn;
+  union {
+    double k;                     // pushed constant or immediate operand
+    double (*f)(double);          // unary function
+    int cmp;                      // comparison_op
+  };
+} kernel_step;
+
+// A user word proven to be a pure real function of one real, compiled
+// to closures over a private double stack. Solvers call run_real_kernel
+// instead of going through a Stack and the interpreter.
+typedef struct {
+  kernel_step* steps;
+  int count;
+  int capacity;
+} real_kernel;
+
+bool build_real_kernel(const user_word* w, real_kernel* kernel);
+void free_real_kernel(real_kernel* kernel);
+
+static inline double run_real_kernel(const real_kernel* kernel, double x) {
+  double stack[KERNEL_STACK_SIZE];
+  double* sp = stack;
+  *sp = x;
+  for (const kernel_step* s = kernel->steps, *end = s + kernel->count; s < end; s++)
+    sp = s->fn(sp, s);
+  return *sp;
+}
+
+#endif // REAL_KERNEL_H
@@ -36,9 +36,19 @@ typedef enum {
   INSTR_TEST
 } instr_type;
 
+struct code_block;
+
+typedef bool (*compare_fn)(Stack* stack);
+
+// Filled in when the program is loaded, so running it does no string work
 typedef struct {
   instr_type type;
   char* arg;
+  union {
+    struct code_block* code;   // INSTR_WORD: the line, compiled
+    int target;                // INSTR_GOTO, INSTR_GOSUB: pc of the label
+    compare_fn test;           // INSTR_TEST: the predicate
+  };
 } Instruction;
 
 typedef struct {
@@ -80,7 +90,7 @@ bool is_ctr_lte_0(Stack* stack);
 bool is_ctr_compare(Stack* stack, const char* op);
 
 // Batch execution
-int run_batch(Stack * stack, char *fname);
+int run_batch(Stack * stack, const char *fname);
 
 // Program execution
 void list_program(const Program* prog);
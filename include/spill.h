@@ -0,0 +1,73 @@
+/*
+ * This file is part of Mico's toy RPN Calculator
+ *
+ * Mico's toy RPN Calculator is free software:
+ * you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mico's toy RPN Calculator is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mico's toy RPN Calculator. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SPILL_H
+#define SPILL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <gsl/gsl_matrix.h>
+#include "stack.h"
+
+// Spill tier for long sessions. With spill_mb set, resident matrix data
+// over that many megabytes is trimmed between operations: the least
+// recently used large matrices in registers, in the undo journal, or
+// deeper in the stack than the next operation reaches, have their data
+// written to an unlinked temporary file and their storage freed. The
+// matrix itself stays, with data and block set to NULL (see
+// matrix_storage_drop), so sharing, dimensions and printing are
+// unaffected. Each operation loads back whatever it reaches before it
+// runs, and rcl loads the recalled value right away; when a matrix cannot
+// be loaded back, the operation is not run.
+//
+// With register_pack_kb set, sto also compresses matrices of that many
+// kilobytes and more in memory (word_codec.h) when that saves at least a
+// quarter; a matrix still shared elsewhere is packed as the register's
+// own copy. They are reached the same way; rcl pushes an unpacked copy
+// and leaves the register packed.
+
+extern int spill_mb;          // resident matrix data to keep, 0 turns spilling off
+extern int register_pack_kb;  // smallest matrix sto packs, 0 turns packing off
+extern int spilled_count;     // matrices whose data is on disk or packed
+
+static inline bool spill_active(void) {
+  return spill_mb > 0 || spilled_count > 0;
+}
+
+static inline bool matrix_spilled(const gsl_matrix* m) {
+  return !m->data;
+}
+
+static inline bool matrix_complex_spilled(const gsl_matrix_complex* m) {
+  return !m->data;
+}
+
+void spill_watch_stack(Stack* stack);         // the stack whose deep entries may go
+bool spill_touch(Stack* stack, int reach);    // before an operation on the top `reach` entries
+bool spill_load_element(const stack_element* e);   // false if it stays spilled
+void spill_register_used(int index);
+void spill_forget(const void* m);             // a spilled matrix is being freed
+bool spill_pack(stack_element* e);           // false if it stays as it is
+size_t packed_size_of(const stack_element* e);   // 0 unless packed
+bool spill_unpack_copy(const stack_element* e, stack_element* copy);
+size_t spilled_bytes(void);
+size_t packed_bytes(void);
+void print_spill_stats(void);
+void close_spill_file(void);
+
+#endif // SPILL_H
@@ -20,11 +20,13 @@
 #define STACK_H
 
 #include <string.h> 
+#include <stdbool.h>
 #include <complex.h>
 #include <gsl/gsl_matrix.h>
 #include <gsl/gsl_complex_math.h>
+#include "payload.h"
 
-#define STACK_SIZE 100
+#define STACK_INITIAL_CAPACITY 64
 
 #define GUARANTEE_STACK(stack, n)					\
   do {									\
@@ -42,30 +44,91 @@ typedef enum {
   TYPE_MATRIX_COMPLEX
 } value_type;
 
+// Strings up to this length live inside the element, in text[]; longer
+// ones are refcounted buffers behind string. Read either through
+// element_string.
+#define SHORT_STRING_MAX 15
+
 typedef struct {
   value_type type;
+  bool short_string;   // TYPE_STRING stored in text[]
   union {
     double real;
     gsl_complex complex_val;
     char* string;
+    char text[SHORT_STRING_MAX + 1];
     gsl_matrix* matrix_real;
     gsl_matrix_complex* matrix_complex;
   };
 } stack_element;
 
+static inline const char* element_string(const stack_element* e) {
+  return e->short_string ? e->text : e->string;
+}
+
+// Grows on demand, up to stack_limit entries if one is set. items moves
+// when the stack grows, so pointers into it only last until the next push.
 typedef struct {
-  stack_element items[STACK_SIZE];
+  stack_element* items;
   int top;
+  int capacity;
 } Stack;
 
+extern int stack_limit;   // most entries a stack may hold, 0 for no limit
+
+bool stack_grow(Stack* stack, int n);   // slow path of stack_reserve
+void stack_overflow(void);
+stack_element stack_underflow(void);
+
+// Room for n more entries above the top
+static inline bool stack_reserve(Stack* stack, int n) {
+  return stack->top + n < stack->capacity || stack_grow(stack, n);
+}
+
+static inline void push_real(Stack* stack, double value) {
+  if (!stack_reserve(stack, 1)) {
+    stack_overflow();
+    return;
+  }
+  stack_element* e = &stack->items[++stack->top];
+  e->type = TYPE_REAL;
+  e->real = value;
+}
+
+static inline void push_complex(Stack* stack, gsl_complex value) {
+  if (!stack_reserve(stack, 1)) {
+    stack_overflow();
+    return;
+  }
+  stack_element* e = &stack->items[++stack->top];
+  e->type = TYPE_COMPLEX;
+  e->complex_val = value;
+}
+
+static inline stack_element pop(Stack* stack) {
+  if (stack->top < 0) return stack_underflow();
+  return stack->items[stack->top--];
+}
+
+// O(1) copies: matrices and strings are shared, not duplicated
+stack_element share_element(const stack_element* e);
+void release_element(stack_element* e);
+bool make_unique(stack_element* e);   // call before writing into e's payload
+
+// Make e a string of len characters and return the buffer to fill in;
+// the terminating NUL is already in place. NULL if out of memory.
+char* init_string(stack_element* e, size_t len);
+bool set_string(stack_element* e, const char* str, size_t len);
+char* writable_string(stack_element* e);   // make_unique, then the buffer
+
 void init_stack(Stack* stack);
+void destroy_stack(Stack* stack);   // free_stack, then release the items
 int stack_size(const Stack* stack);
-void push_real(Stack* stack, double value);
-void push_complex(Stack* stack, gsl_complex value);
 void push_string(Stack* stack, const char* str);
+void push_string_n(Stack* stack, const char* str, size_t len);
+void push_string_literal(Stack* stack, const char* str, size_t len);   // interned when long
 void push_matrix_real(Stack* stack, gsl_matrix* matrix);
 void push_matrix_complex(Stack* stack, gsl_matrix_complex* matrix);
-stack_element pop(Stack* stack);
 int stack_dup(Stack* stack);
 void swap(Stack* stack);
 stack_element check_top(Stack* stack);
@@ -0,0 +1,77 @@
+/*
+ * This file is part of Mico's toy RPN Calculator
+ *
+ * Mico's toy RPN Calculator is free software:
+ * you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mico's toy RPN Calculator is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mico's toy RPN Calculator. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef STACK_EFFECTS_H
+#define STACK_EFFECTS_H
+
+#include "compiler.h"
+
+// What the analysis knows about one stack entry
+typedef enum {
+  VK_ANY,
+  VK_NUMBER,       // real or complex, not known which
+  VK_REAL,
+  VK_COMPLEX,
+  VK_STRING,
+  VK_MATRIX,
+  VK_CMATRIX
+} value_kind;
+
+#define MAX_TRACKED_INPUTS 16
+
+// How a builtin moves the stack, for the ones the analysis understands
+typedef enum {
+  FX_UNKNOWN = 0,     // not modelled: the analysis stops here
+  FX_NONE,            // reads at most, e.g. print
+  FX_CONST,           // pushes a real
+  FX_REAL_UNARY,      // 1 -> 1, kind preserved (sin, exp, chs, ...)
+  FX_NUMBER_UNARY,    // 1 -> 1, a real may come out complex (ln, log, sqrt)
+  FX_TO_REAL,         // 1 -> 1, any scalar to a real (abs, re, im, arg)
+  FX_CMP,             // 2 -> 1 real
+  FX_DUP,
+  FX_DROP,
+  FX_SWAP,
+  FX_OVER,
+  FX_NIP,
+  FX_TUCK,
+  FX_ROLL,
+  FX_CLST
+} builtin_effect;
+
+// The tables behind the analysis, for other code generators
+builtin_effect builtin_effect_of(int opcode);
+double (*real_unary_of(int opcode))(double);   // NULL if none applies
+int comparison_of(int opcode);                 // FX_CMP builtins
+double constant_of(int opcode);                // FX_CONST builtins
+
+// Abstract interpretation of code[0..count). inputs[0] is the kind of the
+// entry on top at the start, inputs[1] the one below, and so on; entries
+// past n_inputs are VK_ANY. Modelling stops at the first instruction whose
+// outcome is not certain (calls, matrix ops, operands of unknown kind) and
+// the effect then describes the prefix before it. If out is not NULL it
+// receives a copy of the code with check-free ops where the kinds allow,
+// and *specialized the number of ops replaced. *result, if not NULL, gets
+// the kind left on top when the effect is complete.
+stack_effect analyse_code(const bc_instr* code, int count,
+                          const value_kind* inputs, int n_inputs,
+                          bc_instr* out, int* specialized, value_kind* result);
+
+// Fill in code->effect and, when it pays, code->fast
+void specialize_code(code_block* code);
+
+#endif // STACK_EFFECTS_H
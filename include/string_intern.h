@@ -0,0 +1,37 @@
+/*
+ * This file is part of Mico's toy RPN Calculator
+ *
+ * Mico's toy RPN Calculator is free software:
+ * you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mico's toy RPN Calculator is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mico's toy RPN Calculator. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef STRING_INTERN_H
+#define STRING_INTERN_H
+
+#include <stddef.h>
+
+// String literals longer than SHORT_STRING_MAX (file names, prompts) in
+// compiled code are kept once in an intern table, so pushing the same
+// literal again costs a reference count instead of a malloc and a copy.
+// The table holds one reference of its own; writers copy first, like any
+// shared payload. When only that reference is left, string_release drops
+// the entry, so the table holds just the literals still in use.
+
+// A reference to the interned copy of str, or a private copy if the
+// table cannot grow. NULL if out of memory.
+char* intern_string(const char* str, size_t len);
+void release_if_interned(char* str);   // str is down to its last reference
+void free_interned_strings(void);
+
+#endif // STRING_INTERN_H
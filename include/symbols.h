@@ -0,0 +1,40 @@
+/*
+ * This file is part of Mico's toy RPN Calculator
+ *
+ * Mico's toy RPN Calculator is free software:
+ * you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mico's toy RPN Calculator is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mico's toy RPN Calculator. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SYMBOLS_H
+#define SYMBOLS_H
+
+#include <stddef.h>
+#include "words.h"
+
+// One interned identifier. Symbols live for the whole session, so the
+// lexer can hand out pointers to them and the evaluator can follow the
+// bindings without looking at the name again.
+typedef struct symbol {
+  char* name;
+  size_t len;
+  int opcode;            // builtin opcode, or -1
+  user_word* macro;      // bound macro, or NULL
+  user_word* word;       // bound user word, or NULL
+  struct symbol* next;   // hash chain
+} symbol;
+
+symbol* intern_symbol(const char* name, size_t len);
+void rebind_word_symbols(void);   // call after words[] or macros[] change
+
+#endif // SYMBOLS_H
@@ -21,11 +21,14 @@
 
 #include <complex.h>
 #include "stack.h"
+#include "vec_math.h"
 
 void apply_real_unary(Stack* stack, double (*func)(double));
 void apply_complex_unary(Stack* stack, gsl_complex (*func)(gsl_complex));
 void apply_complex_matrix_unary_inplace(Stack* stack, gsl_complex (*func)(gsl_complex));
 void apply_real_matrix_unary_inplace(Stack* stack, double (*func)(double));
+void apply_real_matrix_vm_inplace(Stack* stack, vm_fn fn);
+void apply_complex_matrix_vm_inplace(Stack* stack, vm_fn fn);
 void complex_matrix_real_part(Stack *s);
 void complex_matrix_imag_part(Stack *s);
 void complex_matrix_abs_by_element(Stack *s);
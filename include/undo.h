@@ -0,0 +1,79 @@
+/*
+ * This file is part of Mico's toy RPN Calculator
+ *
+ * Mico's toy RPN Calculator is free software:
+ * you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mico's toy RPN Calculator is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mico's toy RPN Calculator. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef UNDO_H
+#define UNDO_H
+
+#include <stdbool.h>
+#include "stack.h"
+#include "compiler.h"
+
+// Undo journal for REPL lines.
+//
+// Instead of copying the whole stack before every line, the REPL records
+// only the entries a line changes. Every operation that may write below
+// the current top first calls undo_touch with how many entries from the
+// top it can reach; the first time a line reaches an entry, that entry is
+// saved (shared, not copied). When the line ends, the saved entries and
+// whatever the line left above them make one journal record, so a line
+// costs in proportion to what it touched. undo and redo swap the two sides
+// of a record back in. Matrices and strings are copy-on-write, so sharing
+// them with the journal keeps the recorded values intact.
+
+extern int undo_levels;   // records kept for undo/redo, 0 turns the journal off
+
+typedef struct {
+  Stack* stack;           // stack the current line runs on, or NULL
+  int low;                // entries below this index are untouched so far
+} undo_recorder;
+
+extern undo_recorder undo_rec;
+
+void undo_save_below(Stack* stack, int low);   // slow path of undo_touch
+
+// The next operation may change or pop the top `reach` entries
+static inline void undo_touch(Stack* stack, int reach) {
+  if (stack == undo_rec.stack && stack->top + 1 - reach < undo_rec.low)
+    undo_save_below(stack, stack->top + 1 - reach);
+}
+
+static inline void undo_touch_all(Stack* stack) {
+  undo_touch(stack, stack->top + 1);
+}
+
+int builtin_reach(int opcode);            // stack depth a builtin may change
+int instr_reach(const bc_instr* ins);     // the same for one instruction
+void undo_touch_instr(Stack* stack, const bc_instr* ins);
+
+void undo_begin_line(Stack* stack);
+void undo_end_line(Stack* stack);
+bool undo_line(Stack* stack);             // false if there is nothing to undo
+bool redo_line(Stack* stack);             // false if there is nothing to redo
+void undo_for_each_entry(void (*visit)(const stack_element* e, void* ctx), void* ctx);
+void free_undo_journal(void);
+
+// The records of a stack that is not the current one (named_stacks.h).
+// Detaching leaves the journal empty; attaching replaces what it holds.
+typedef struct undo_history undo_history;
+undo_history* undo_detach_history(void);   // NULL if there were no records
+void undo_attach_history(undo_history* h);
+void undo_free_history(undo_history* h);
+void undo_history_for_each_entry(const undo_history* h,
+                                 void (*visit)(const stack_element* e, void* ctx), void* ctx);
+
+#endif // UNDO_H
@@ -0,0 +1,54 @@
+/*
+ * This file is part of Mico's toy RPN Calculator
+ *
+ * Mico's toy RPN Calculator is free software:
+ * you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mico's toy RPN Calculator is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mico's toy RPN Calculator. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef VEC_MATH_H
+#define VEC_MATH_H
+
+#include <stddef.h>
+#include <gsl/gsl_matrix.h>
+
+// Elementary functions over whole matrices, a vector of elements at a
+// time on the level elementwise.h picked. Branch-free polynomial forms
+// of the fdlibm algorithms; the error against the exact result is at most
+//   exp, log, sin, cos   1 ULP
+//   log10                2 ULP
+//   tan, tanh            2.5 ULP
+//   sqrt                 0 ULP (correctly rounded)
+// sin, cos and tan reduce |x| <= 2^20 pi/2 themselves and hand larger
+// arguments to libm. Every level gives the same bits, but below AVX2,
+// where the kernels lose to libm, real sin, cos, tan, exp, log and log10
+// call libm instead (and sqrt, in the scalar level).
+//
+// Complex exp, sin, cos and sqrt use the gsl_complex formulas on these
+// functions; complex sqrt is bit-identical to gsl_complex_sqrt. Other
+// complex functions run gsl_complex per element.
+//
+// dst may be the same matrix as x, but must not overlap it in any other
+// way. Sizes must already match.
+
+typedef enum { VM_SIN, VM_COS, VM_TAN, VM_EXP, VM_LOG, VM_LOG10, VM_SQRT, VM_TANH, VM_FN_COUNT } vm_fn;
+
+void vm_real(vm_fn fn, double* d, const double* x, size_t n);
+void vm_matrix(vm_fn fn, gsl_matrix* dst, const gsl_matrix* x);
+void vm_complex_matrix(vm_fn fn, gsl_matrix_complex* dst, const gsl_matrix_complex* x);
+
+// VM_LOG, VM_LOG10 or VM_SQRT of a real matrix with negative entries,
+// treated as (x, 0), to the bounds above
+void vm_promoted_matrix(vm_fn fn, gsl_matrix_complex* dst, const gsl_matrix* x);
+
+#endif // VEC_MATH_H
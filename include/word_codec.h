@@ -0,0 +1,38 @@
+/*
+ * This file is part of Mico's toy RPN Calculator
+ *
+ * Mico's toy RPN Calculator is free software:
+ * you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mico's toy RPN Calculator is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mico's toy RPN Calculator. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef WORD_CODEC_H
+#define WORD_CODEC_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Lossless codec for arrays of doubles, working on whole 64-bit words so
+// every bit pattern (signed zeros, NaN payloads) comes back unchanged.
+// Two forms, whichever is smaller:
+//   palette  up to 16 distinct values, each element a 1, 2 or 4 bit index;
+//            suits masks from eq/gt and matrices of a few constants
+//   runs     runs of a repeated value and stretches of literals; suits
+//            mostly-zero results and constant blocks
+
+// Packed form of data, or NULL when it would not save a quarter of the
+// size (or out of memory). *size is set to the packed length.
+unsigned char* word_pack(const double* data, size_t count, size_t* size);
+bool word_unpack(const unsigned char* packed, size_t size, double* data, size_t count);
+
+#endif // WORD_CODEC_H
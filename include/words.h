@@ -26,9 +26,12 @@
 #include <stdbool.h>
 #include "stack.h"
 
+struct code_block;
+
 typedef struct {
   char name[MAX_WORD_NAME];
   char body[MAX_WORD_BODY];
+  struct code_block* code;   // body compiled when the word is defined or loaded
 } user_word;
 
 extern user_word words[MAX_WORDS];
@@ -33,68 +33,8 @@
 #include "stack.h"
 #include "math_parsers.h"
 #include "math_helpers.h"
-
-void add_top_two_scalars(Stack* stack) {
-  if (stack->top < 1) {
-    fprintf(stderr,"Not enough elements to add\n");
-    return;
-  }
-  stack_element a = pop(stack);
-  stack_element b = pop(stack);
-
-  if (a.type == TYPE_REAL && b.type == TYPE_REAL) {
-    push_real(stack, a.real + b.real);
-  } else if ((a.type == TYPE_REAL || a.type == TYPE_COMPLEX)
-	     && (b.type == TYPE_REAL || b.type == TYPE_COMPLEX)) {
-    gsl_complex ca = (a.type == TYPE_COMPLEX) ? a.complex_val : gsl_complex_rect(a.real, 0.0);
-    gsl_complex cb = (b.type == TYPE_COMPLEX) ? b.complex_val : gsl_complex_rect(b.real, 0.0);
-    push_complex(stack, gsl_complex_add(ca, cb));
-  } else {
-    fprintf(stderr,"Unsupported types for addition\n");
-  }
-}
-
-void add_top_two_matrices(Stack* stack) {
-  if (stack->top < 1) {
-    fprintf(stderr,"Not enough matrices to add\n");
-    return;
-  }
-  stack_element a = pop(stack);
-  stack_element b = pop(stack);
-
-  if (a.type == TYPE_MATRIX_REAL && b.type == TYPE_MATRIX_REAL) {
-    if (a.matrix_real->size1 != b.matrix_real->size1
-	|| a.matrix_real->size2 != b.matrix_real->size2) {
-      fprintf(stderr,"Matrix dimensions must match\n");
-      gsl_matrix_free(a.matrix_real);
-      gsl_matrix_free(b.matrix_real);
-      return;
-    }
-    gsl_matrix* result = gsl_matrix_alloc(a.matrix_real->size1, a.matrix_real->size2);
-    gsl_matrix_memcpy(result, b.matrix_real);
-    gsl_matrix_add(result, a.matrix_real);
-    gsl_matrix_free(a.matrix_real);
-    gsl_matrix_free(b.matrix_real);
-    push_matrix_real(stack, result);
-  } else if (a.type == TYPE_MATRIX_COMPLEX && b.type == TYPE_MATRIX_COMPLEX) {
-    if (a.matrix_complex->size1 != b.matrix_complex->size1
-	|| a.matrix_complex->size2 != b.matrix_complex->size2) {
-      fprintf(stderr,"Matrix dimensions must match\n");
-      gsl_matrix_complex_free(a.matrix_complex);
-      gsl_matrix_complex_free(b.matrix_complex);
-      return;
-    }
-    gsl_matrix_complex* result =
-      gsl_matrix_complex_alloc(a.matrix_complex->size1, a.matrix_complex->size2);
-    gsl_matrix_complex_memcpy(result, b.matrix_complex);
-    gsl_matrix_complex_add(result, a.matrix_complex);
-    gsl_matrix_complex_free(a.matrix_complex);
-    gsl_matrix_complex_free(b.matrix_complex);
-    push_matrix_complex(stack, result);
-  } else {
-    fprintf(stderr,"Unsupported matrix types for addition\n");
-  }
-}
+#include "binary_fun.h"
+#include "elementwise.h"
 
 void multiply_top_two_scalars(Stack* stack) {
   if (stack->top < 1) {
@@ -164,71 +104,57 @@ void divide_top_two_scalars(Stack* stack) {
   }
 }
 
-void subtract_top_two_matrices(Stack* stack) {
-  if (stack->top < 1) {
-    fprintf(stderr,"Not enough elements for matrix subtraction\n");
-    return;
-  }
-  stack_element b = pop(stack);
-  stack_element a = pop(stack);
+// **************** Reusing operand storage ****************
+// The operands of add_top_two and friends are dropped once the result is
+// stored, so a matrix no other slot, register or undo record refers to
+// can hold the result itself. That saves an allocation and a full pass of
+// copying per operation. Elementwise kernels read (i, j) before writing
+// (i, j), so they are safe to run in place.
+//
+// At the REPL the undo journal shares every entry a line reaches, since
+// it needs the old value back on undo. So only matrices made earlier in
+// the same line, program or word are free to take a result, unless
+// undo_levels is 0. matrix_results_in_place counts the results that did.
+
+// Storage for a result the kernel fills from m elementwise
+static gsl_matrix* real_target(gsl_matrix* m) {
+  return payload_is_shared(m) ? matrix_alloc(m->size1, m->size2) : m;
+}
 
-  if (a.type == TYPE_MATRIX_REAL && b.type == TYPE_MATRIX_REAL) {
-    if (a.matrix_real->size1 != b.matrix_real->size1
-	|| a.matrix_real->size2 != b.matrix_real->size2) {
-      fprintf(stderr,"Matrix size mismatch\n");
-      return;
-    }
-    gsl_matrix* result = gsl_matrix_alloc(a.matrix_real->size1, a.matrix_real->size2);
-    gsl_matrix_memcpy(result, a.matrix_real);
-    gsl_matrix_sub(result, b.matrix_real);
-    push_matrix_real(stack, result);
-  } else if (a.type == TYPE_MATRIX_COMPLEX && b.type == TYPE_MATRIX_COMPLEX) {
-    if (a.matrix_complex->size1 != b.matrix_complex->size1
-	|| a.matrix_complex->size2 != b.matrix_complex->size2) {
-      fprintf(stderr,"Matrix size mismatch\n");
-      return;
-    }
-    gsl_matrix_complex* result =
-      gsl_matrix_complex_alloc(a.matrix_complex->size1, a.matrix_complex->size2);
-    gsl_matrix_complex_memcpy(result, a.matrix_complex);
-    gsl_matrix_complex_sub(result, b.matrix_complex);
-    push_matrix_complex(stack, result);
-  } else {
-    fprintf(stderr,"Unsupported matrix types for subtraction\n");
-  }
+static gsl_matrix_complex* complex_target(gsl_matrix_complex* m) {
+  return payload_is_shared(m) ? matrix_complex_alloc(m->size1, m->size2) : m;
 }
 
-void multiply_top_two_matrices(Stack* stack) {
-  if (stack->top < 1) {
-    fprintf(stderr,"Not enough elements for matrix multiplication\n");
-    return;
-  }
-  stack_element b = pop(stack);
-  stack_element a = pop(stack);
+// Either of two same-sized operands will do
+static gsl_matrix* real_target2(gsl_matrix* x, gsl_matrix* y) {
+  return payload_is_shared(x) && !payload_is_shared(y) ? y : real_target(x);
+}
 
-  if (a.type == TYPE_MATRIX_REAL && b.type == TYPE_MATRIX_REAL) {
-    if (a.matrix_real->size2 != b.matrix_real->size1) {
-      fprintf(stderr,"Matrix dimensions do not allow multiplication\n");
-      return;
-    }
-    gsl_matrix* result =
-      gsl_matrix_alloc(a.matrix_real->size1, b.matrix_real->size2);
-    gsl_blas_dgemm(CblasNoTrans, CblasNoTrans, 1.0, a.matrix_real, b.matrix_real, 0.0, result);
-    push_matrix_real(stack, result);
-  } else if (a.type == TYPE_MATRIX_COMPLEX && b.type == TYPE_MATRIX_COMPLEX) {
-    if (a.matrix_complex->size2 != b.matrix_complex->size1) {
-      fprintf(stderr,"Matrix dimensions do not allow multiplication\n");
-      return;
-    }
-    gsl_matrix_complex* result =
-      gsl_matrix_complex_alloc(a.matrix_complex->size1, b.matrix_complex->size2);
-    gsl_blas_zgemm(CblasNoTrans, CblasNoTrans,
-		   GSL_COMPLEX_ONE, a.matrix_complex, b.matrix_complex,
-		   GSL_COMPLEX_ZERO, result);
-    push_matrix_complex(stack, result);
-  } else {
-    fprintf(stderr,"Unsupported matrix types for multiplication\n");
-  }
+static gsl_matrix_complex* complex_target2(gsl_matrix_complex* x, gsl_matrix_complex* y) {
+  return payload_is_shared(x) && !payload_is_shared(y) ? y : complex_target(x);
+}
+
+static bool holds_matrix(const stack_element* e, const stack_element* result) {
+  if (e->type != result->type) return false;
+  if (e->type == TYPE_MATRIX_REAL) return e->matrix_real == result->matrix_real;
+  if (e->type == TYPE_MATRIX_COMPLEX) return e->matrix_complex == result->matrix_complex;
+  return false;
+}
+
+unsigned long matrix_results_in_place;
+
+// Pop both operands and push result, releasing whichever operand
+// did not end up as the result's storage
+static void replace_operands(Stack* stack, stack_element result) {
+  stack_element* a = &stack->items[stack->top - 1];
+  stack_element* b = &stack->items[stack->top];
+  bool in_a = holds_matrix(a, &result);
+  bool in_b = holds_matrix(b, &result);
+  if (in_a || in_b) matrix_results_in_place++;
+  if (!in_a) release_element(a);
+  if (!in_b) release_element(b);
+  *a = result;
+  stack->top--;
 }
 
 void add_top_two(Stack* stack) {
@@ -263,10 +189,9 @@ void add_top_two(Stack* stack) {
     gsl_matrix* mat = (a->type == TYPE_MATRIX_REAL) ? a->matrix_real : b->matrix_real;
     double val = (a->type == TYPE_REAL) ? a->real : b->real;
 
-    size_t rows = mat->size1, cols = mat->size2;
-    result.matrix_real = gsl_matrix_alloc(rows, cols);
-    gsl_matrix_memcpy(result.matrix_real, mat);
-    gsl_matrix_add_constant(result.matrix_real, val);
+    result.matrix_real = real_target(mat);
+    if (!result.matrix_real) return;
+    ew_matrix_scalar(EW_ADD, result.matrix_real, mat, val);
   }
   else if ((a->type == TYPE_REAL && b->type == TYPE_MATRIX_COMPLEX) ||
 	   (a->type == TYPE_MATRIX_COMPLEX && b->type == TYPE_REAL)) {
@@ -275,16 +200,9 @@ void add_top_two(Stack* stack) {
       (a->type == TYPE_MATRIX_COMPLEX) ? a->matrix_complex : b->matrix_complex;
     double val = (a->type == TYPE_REAL) ? a->real : b->real;
 
-    size_t rows = mat->size1, cols = mat->size2;
-    result.matrix_complex = gsl_matrix_complex_alloc(rows, cols);
-    gsl_matrix_complex_memcpy(result.matrix_complex, mat);
-
-    gsl_complex z = gsl_complex_rect(val, 0.0);
-    for (size_t i = 0; i < rows; ++i)
-      for (size_t j = 0; j < cols; ++j) {
-	gsl_complex old = gsl_matrix_complex_get(result.matrix_complex, i, j);
-	gsl_matrix_complex_set(result.matrix_complex, i, j, gsl_complex_add(old, z));
-      }
+    result.matrix_complex = complex_target(mat);
+    if (!result.matrix_complex) return;
+    ew_complex_matrix_scalar(EW_ADD, result.matrix_complex, mat, gsl_complex_rect(val, 0.0));
   }
   else if ((a->type == TYPE_COMPLEX && b->type == TYPE_MATRIX_REAL) ||
 	   (a->type == TYPE_MATRIX_REAL && b->type == TYPE_COMPLEX)) {
@@ -292,15 +210,9 @@ void add_top_two(Stack* stack) {
     gsl_matrix* mat_real = (a->type == TYPE_MATRIX_REAL) ? a->matrix_real : b->matrix_real;
     gsl_complex z = (a->type == TYPE_COMPLEX) ? a->complex_val : b->complex_val;
 
-    size_t rows = mat_real->size1, cols = mat_real->size2;
-    result.matrix_complex = gsl_matrix_complex_alloc(rows, cols);
-
-    for (size_t i = 0; i < rows; ++i)
-      for (size_t j = 0; j < cols; ++j) {
-	double val = gsl_matrix_get(mat_real, i, j);
-	gsl_matrix_complex_set(result.matrix_complex, i, j,
-			       gsl_complex_add(z, gsl_complex_rect(val, 0.0)));
-      }
+    result.matrix_complex = matrix_complex_alloc(mat_real->size1, mat_real->size2);
+    if (!result.matrix_complex) return;
+    ew_real_matrix_complex_scalar(EW_ADD, result.matrix_complex, mat_real, z);
   }
   else if ((a->type == TYPE_COMPLEX && b->type == TYPE_MATRIX_COMPLEX) ||
 	   (a->type == TYPE_MATRIX_COMPLEX && b->type == TYPE_COMPLEX)) {
@@ -309,15 +221,9 @@ void add_top_two(Stack* stack) {
       (a->type == TYPE_MATRIX_COMPLEX) ? a->matrix_complex : b->matrix_complex;
     gsl_complex z = (a->type == TYPE_COMPLEX) ? a->complex_val : b->complex_val;
 
-    size_t rows = mat->size1, cols = mat->size2;
-    result.matrix_complex = gsl_matrix_complex_alloc(rows, cols);
-    gsl_matrix_complex_memcpy(result.matrix_complex, mat);
-
-    for (size_t i = 0; i < rows; ++i)
-      for (size_t j = 0; j < cols; ++j) {
-	gsl_complex old = gsl_matrix_complex_get(result.matrix_complex, i, j);
-	gsl_matrix_complex_set(result.matrix_complex, i, j, gsl_complex_add(old, z));
-      }
+    result.matrix_complex = complex_target(mat);
+    if (!result.matrix_complex) return;
+    ew_complex_matrix_scalar(EW_ADD, result.matrix_complex, mat, z);
   }
   else if (a->type == TYPE_MATRIX_REAL && b->type == TYPE_MATRIX_REAL) {
     if (a->matrix_real->size1 != b->matrix_real->size1 ||
@@ -326,9 +232,9 @@ void add_top_two(Stack* stack) {
       return;
     }
     result.type = TYPE_MATRIX_REAL;
-    result.matrix_real = gsl_matrix_alloc(a->matrix_real->size1, a->matrix_real->size2);
-    gsl_matrix_memcpy(result.matrix_real, a->matrix_real);
-    gsl_matrix_add(result.matrix_real, b->matrix_real);
+    result.matrix_real = real_target2(a->matrix_real, b->matrix_real);
+    if (!result.matrix_real) return;
+    ew_matrix_matrix(EW_ADD, result.matrix_real, a->matrix_real, b->matrix_real);
   }
   else if (a->type == TYPE_MATRIX_COMPLEX && b->type == TYPE_MATRIX_COMPLEX) {
     if (a->matrix_complex->size1 != b->matrix_complex->size1 ||
@@ -337,25 +243,17 @@ void add_top_two(Stack* stack) {
       return;
     }
     result.type = TYPE_MATRIX_COMPLEX;
-    result.matrix_complex =
-      gsl_matrix_complex_alloc(a->matrix_complex->size1, a->matrix_complex->size2);
-    gsl_matrix_complex_memcpy(result.matrix_complex, a->matrix_complex);
-    gsl_matrix_complex_add(result.matrix_complex, b->matrix_complex);
+    result.matrix_complex = complex_target2(a->matrix_complex, b->matrix_complex);
+    if (!result.matrix_complex) return;
+    ew_complex_matrix_matrix(EW_ADD, result.matrix_complex, a->matrix_complex, b->matrix_complex);
   }
   else {
     fprintf(stderr, "Unsupported operand types in add_top_two.\n");
     return;
   }
 
-  // Free any heap-allocated matrix in a
-  if (a->type == TYPE_MATRIX_REAL && a->matrix_real)
-    gsl_matrix_free(a->matrix_real);
-  if (a->type == TYPE_MATRIX_COMPLEX && a->matrix_complex)
-    gsl_matrix_complex_free(a->matrix_complex);
-
-  // Overwrite a with result and reduce stack
-  *a = result;
-  stack->top--; // pop one element
+  // Drop the operands, keeping a matrix the result was computed in
+  replace_operands(stack, result);
 }
 
 void sub_top_two(Stack* stack) {
@@ -391,18 +289,13 @@ void sub_top_two(Stack* stack) {
     double val = (a->type == TYPE_REAL) ? a->real : b->real;
     int scalar_first = (a->type == TYPE_REAL);
 
-    size_t rows = mat->size1, cols = mat->size2;
-    result.matrix_real = gsl_matrix_alloc(rows, cols);
-    gsl_matrix_memcpy(result.matrix_real, mat);
+    result.matrix_real = real_target(mat);
+    if (!result.matrix_real) return;
 
-    if (scalar_first) {
-      // scalar - matrix
-      gsl_matrix_scale(result.matrix_real, -1.0);
-      gsl_matrix_add_constant(result.matrix_real, val);
-    } else {
-      // matrix - scalar
-      gsl_matrix_add_constant(result.matrix_real, -val);
-    }
+    if (scalar_first)
+      ew_scalar_matrix(EW_SUB, result.matrix_real, val, mat);
+    else
+      ew_matrix_scalar(EW_SUB, result.matrix_real, mat, val);
   }
   else if ((a->type == TYPE_REAL && b->type == TYPE_MATRIX_COMPLEX) ||
 	   (a->type == TYPE_MATRIX_COMPLEX && b->type == TYPE_REAL)) {
@@ -412,25 +305,13 @@ void sub_top_two(Stack* stack) {
     gsl_complex z = gsl_complex_rect((a->type == TYPE_REAL) ? a->real : b->real, 0.0);
     int scalar_first = (a->type == TYPE_REAL);
 
-    size_t rows = mat->size1, cols = mat->size2;
-    result.matrix_complex = gsl_matrix_complex_alloc(rows, cols);
-    gsl_matrix_complex_memcpy(result.matrix_complex, mat);
+    result.matrix_complex = complex_target(mat);
+    if (!result.matrix_complex) return;
 
-    if (scalar_first) {
-      // scalar - matrix
-      for (size_t i = 0; i < rows; ++i)
-	for (size_t j = 0; j < cols; ++j) {
-	  gsl_complex v = gsl_matrix_complex_get(mat, i, j);
-	  gsl_matrix_complex_set(result.matrix_complex, i, j, gsl_complex_sub(z, v));
-	}
-    } else {
-      // matrix - scalar
-      for (size_t i = 0; i < rows; ++i)
-	for (size_t j = 0; j < cols; ++j) {
-	  gsl_complex v = gsl_matrix_complex_get(mat, i, j);
-	  gsl_matrix_complex_set(result.matrix_complex, i, j, gsl_complex_sub(v, z));
-	}
-    }
+    if (scalar_first)
+      ew_complex_scalar_matrix(EW_SUB, result.matrix_complex, z, mat);
+    else
+      ew_complex_matrix_scalar(EW_SUB, result.matrix_complex, mat, z);
   }
   else if ((a->type == TYPE_COMPLEX && b->type == TYPE_MATRIX_REAL) ||
 	   (a->type == TYPE_MATRIX_REAL && b->type == TYPE_COMPLEX)) {
@@ -439,24 +320,13 @@ void sub_top_two(Stack* stack) {
     gsl_complex z = (a->type == TYPE_COMPLEX) ? a->complex_val : b->complex_val;
     int scalar_first = (a->type == TYPE_COMPLEX);
 
-    size_t rows = mat_real->size1, cols = mat_real->size2;
-    result.matrix_complex = gsl_matrix_complex_alloc(rows, cols);
+    result.matrix_complex = matrix_complex_alloc(mat_real->size1, mat_real->size2);
+    if (!result.matrix_complex) return;
 
-    if (scalar_first) {
-      // complex scalar - real matrix
-      for (size_t i = 0; i < rows; ++i)
-	for (size_t j = 0; j < cols; ++j) {
-	  gsl_complex v = gsl_complex_rect(gsl_matrix_get(mat_real, i, j), 0);
-	  gsl_matrix_complex_set(result.matrix_complex, i, j, gsl_complex_sub(z, v));
-	}
-    } else {
-      // real matrix - complex scalar
-      for (size_t i = 0; i < rows; ++i)
-	for (size_t j = 0; j < cols; ++j) {
-	  gsl_complex v = gsl_complex_rect(gsl_matrix_get(mat_real, i, j), 0);
-	  gsl_matrix_complex_set(result.matrix_complex, i, j, gsl_complex_sub(v, z));
-	}
-    }
+    if (scalar_first)
+      ew_complex_scalar_real_matrix(EW_SUB, result.matrix_complex, z, mat_real);
+    else
+      ew_real_matrix_complex_scalar(EW_SUB, result.matrix_complex, mat_real, z);
   }
   else if ((a->type == TYPE_COMPLEX && b->type == TYPE_MATRIX_COMPLEX) ||
 	   (a->type == TYPE_MATRIX_COMPLEX && b->type == TYPE_COMPLEX)) {
@@ -466,24 +336,13 @@ void sub_top_two(Stack* stack) {
     gsl_complex z = (a->type == TYPE_COMPLEX) ? a->complex_val : b->complex_val;
     int scalar_first = (a->type == TYPE_COMPLEX);
 
-    size_t rows = mat->size1, cols = mat->size2;
-    result.matrix_complex = gsl_matrix_complex_alloc(rows, cols);
+    result.matrix_complex = complex_target(mat);
+    if (!result.matrix_complex) return;
 
-    if (scalar_first) {
-      // complex scalar - complex matrix
-      for (size_t i = 0; i < rows; ++i)
-	for (size_t j = 0; j < cols; ++j) {
-	  gsl_complex v = gsl_matrix_complex_get(mat, i, j);
-	  gsl_matrix_complex_set(result.matrix_complex, i, j, gsl_complex_sub(z, v));
-	}
-    } else {
-      // complex matrix - complex scalar
-      for (size_t i = 0; i < rows; ++i)
-	for (size_t j = 0; j < cols; ++j) {
-	  gsl_complex v = gsl_matrix_complex_get(mat, i, j);
-	  gsl_matrix_complex_set(result.matrix_complex, i, j, gsl_complex_sub(v, z));
-	}
-    }
+    if (scalar_first)
+      ew_complex_scalar_matrix(EW_SUB, result.matrix_complex, z, mat);
+    else
+      ew_complex_matrix_scalar(EW_SUB, result.matrix_complex, mat, z);
   }
   else if (a->type == TYPE_MATRIX_REAL && b->type == TYPE_MATRIX_REAL) {
     if (a->matrix_real->size1 != b->matrix_real->size1 ||
@@ -492,9 +351,9 @@ void sub_top_two(Stack* stack) {
       return;
     }
     result.type = TYPE_MATRIX_REAL;
-    result.matrix_real = gsl_matrix_alloc(a->matrix_real->size1, a->matrix_real->size2);
-    gsl_matrix_memcpy(result.matrix_real, a->matrix_real);
-    gsl_matrix_sub(result.matrix_real, b->matrix_real);
+    result.matrix_real = real_target2(a->matrix_real, b->matrix_real);
+    if (!result.matrix_real) return;
+    ew_matrix_matrix(EW_SUB, result.matrix_real, a->matrix_real, b->matrix_real);
   }
   else if (a->type == TYPE_MATRIX_COMPLEX && b->type == TYPE_MATRIX_COMPLEX) {
     if (a->matrix_complex->size1 != b->matrix_complex->size1 ||
@@ -503,25 +362,17 @@ void sub_top_two(Stack* stack) {
       return;
     }
     result.type = TYPE_MATRIX_COMPLEX;
-    result.matrix_complex =
-      gsl_matrix_complex_alloc(a->matrix_complex->size1, a->matrix_complex->size2);
-    gsl_matrix_complex_memcpy(result.matrix_complex, a->matrix_complex);
-    gsl_matrix_complex_sub(result.matrix_complex, b->matrix_complex);
+    result.matrix_complex = complex_target2(a->matrix_complex, b->matrix_complex);
+    if (!result.matrix_complex) return;
+    ew_complex_matrix_matrix(EW_SUB, result.matrix_complex, a->matrix_complex, b->matrix_complex);
   }
   else {
     fprintf(stderr, "Unsupported operand types in sub_top_two.\n");
     return;
   }
 
-  // Free memory in a
-  if (a->type == TYPE_MATRIX_REAL && a->matrix_real)
-    gsl_matrix_free(a->matrix_real);
-  if (a->type == TYPE_MATRIX_COMPLEX && a->matrix_complex)
-    gsl_matrix_complex_free(a->matrix_complex);
-
-  // Store result and pop
-  *a = result;
-  stack->top--;
+  // Drop the operands, keeping a matrix the result was computed in
+  replace_operands(stack, result);
 }
 
 
@@ -559,10 +410,9 @@ void mul_top_two(Stack* stack) {
     double scalar = (a->type == TYPE_REAL) ? a->real : b->real;
     gsl_matrix* mat = (a->type == TYPE_MATRIX_REAL) ? a->matrix_real : b->matrix_real;
 
-    size_t rows = mat->size1, cols = mat->size2;
-    result.matrix_real = gsl_matrix_alloc(rows, cols);
-    gsl_matrix_memcpy(result.matrix_real, mat);
-    gsl_matrix_scale(result.matrix_real, scalar);
+    result.matrix_real = real_target(mat);
+    if (!result.matrix_real) return;
+    ew_matrix_scalar(EW_MUL, result.matrix_real, mat, scalar);
   }
 
   // Real scalar * Complex matrix
@@ -573,10 +423,9 @@ void mul_top_two(Stack* stack) {
     gsl_matrix_complex* mat =
       (a->type == TYPE_MATRIX_COMPLEX) ? a->matrix_complex : b->matrix_complex;
 
-    size_t rows = mat->size1, cols = mat->size2;
-    result.matrix_complex = gsl_matrix_complex_alloc(rows, cols);
-    gsl_matrix_complex_memcpy(result.matrix_complex, mat);
-    gsl_matrix_complex_scale(result.matrix_complex, gsl_complex_rect(scalar, 0.0));
+    result.matrix_complex = complex_target(mat);
+    if (!result.matrix_complex) return;
+    ew_complex_matrix_scalar(EW_MUL, result.matrix_complex, mat, gsl_complex_rect(scalar, 0.0));
   }
 
   // Complex scalar * Real matrix -> Complex matrix
@@ -586,16 +435,9 @@ void mul_top_two(Stack* stack) {
     gsl_complex z = (a->type == TYPE_COMPLEX) ? a->complex_val : b->complex_val;
     gsl_matrix* mat_real = (a->type == TYPE_MATRIX_REAL) ? a->matrix_real : b->matrix_real;
 
-    size_t rows = mat_real->size1, cols = mat_real->size2;
-    result.matrix_complex = gsl_matrix_complex_alloc(rows, cols);
-
-    for (size_t i = 0; i < rows; ++i) {
-      for (size_t j = 0; j < cols; ++j) {
-	double val = gsl_matrix_get(mat_real, i, j);
-	gsl_complex val_c = gsl_complex_rect(val, 0.0);
-	gsl_matrix_complex_set(result.matrix_complex, i, j, gsl_complex_mul(z, val_c));
-      }
-    }
+    result.matrix_complex = matrix_complex_alloc(mat_real->size1, mat_real->size2);
+    if (!result.matrix_complex) return;
+    ew_real_matrix_complex_scalar(EW_MUL, result.matrix_complex, mat_real, z);
   }
 
   // Complex scalar * Complex matrix
@@ -606,15 +448,9 @@ void mul_top_two(Stack* stack) {
     gsl_matrix_complex* mat =
       (a->type == TYPE_MATRIX_COMPLEX) ? a->matrix_complex : b->matrix_complex;
 
-    size_t rows = mat->size1, cols = mat->size2;
-    result.matrix_complex = gsl_matrix_complex_alloc(rows, cols);
-
-    for (size_t i = 0; i < rows; ++i) {
-      for (size_t j = 0; j < cols; ++j) {
-	gsl_complex v = gsl_matrix_complex_get(mat, i, j);
-	gsl_matrix_complex_set(result.matrix_complex, i, j, gsl_complex_mul(z, v));
-      }
-    }
+    result.matrix_complex = complex_target(mat);
+    if (!result.matrix_complex) return;
+    ew_complex_matrix_scalar(EW_MUL, result.matrix_complex, mat, z);
   }
 
   // Real matrix * Real matrix
@@ -625,7 +461,8 @@ void mul_top_two(Stack* stack) {
     }
 
     result.type = TYPE_MATRIX_REAL;
-    result.matrix_real = gsl_matrix_alloc(a->matrix_real->size1, b->matrix_real->size2);
+    result.matrix_real = matrix_alloc(a->matrix_real->size1, b->matrix_real->size2);
+    if (!result.matrix_real) return;
     gsl_blas_dgemm(CblasNoTrans, CblasNoTrans,
 		   1.0, a->matrix_real, b->matrix_real,
 		   0.0, result.matrix_real);
@@ -640,7 +477,8 @@ void mul_top_two(Stack* stack) {
 
     result.type = TYPE_MATRIX_COMPLEX;
     result.matrix_complex =
-      gsl_matrix_complex_alloc(a->matrix_complex->size1, b->matrix_complex->size2);
+      matrix_complex_alloc(a->matrix_complex->size1, b->matrix_complex->size2);
+    if (!result.matrix_complex) return;
     gsl_blas_zgemm(CblasNoTrans, CblasNoTrans,
 		   GSL_COMPLEX_ONE, a->matrix_complex, b->matrix_complex,
 		   GSL_COMPLEX_ZERO, result.matrix_complex);
@@ -651,15 +489,8 @@ void mul_top_two(Stack* stack) {
     return;
   }
 
-  // Free memory in a
-  if (a->type == TYPE_MATRIX_REAL && a->matrix_real)
-    gsl_matrix_free(a->matrix_real);
-  if (a->type == TYPE_MATRIX_COMPLEX && a->matrix_complex)
-    gsl_matrix_complex_free(a->matrix_complex);
-
-  // Store result in-place and pop b
-  *a = result;
-  stack->top--;
+  // Drop the operands, keeping a matrix the result was computed in
+  replace_operands(stack, result);
 }
 
 
@@ -697,21 +528,16 @@ void div_top_two(Stack* stack) {
     result.type = TYPE_MATRIX_REAL;
     gsl_matrix* mat = (a->type == TYPE_MATRIX_REAL) ? a->matrix_real : b->matrix_real;
     double scalar = (a->type == TYPE_REAL) ? a->real : b->real;
-
-    size_t rows = mat->size1, cols = mat->size2;
-    result.matrix_real = gsl_matrix_alloc(rows, cols);
+    result.matrix_real = real_target(mat);
+    if (!result.matrix_real) return;
 
     if (a->type == TYPE_MATRIX_REAL) {
       // Matrix ÷ scalar
-      gsl_matrix_memcpy(result.matrix_real, mat);
+      if (result.matrix_real != mat) gsl_matrix_memcpy(result.matrix_real, mat);
       gsl_matrix_scale(result.matrix_real, 1.0 / scalar);
     } else {
       // Scalar ÷ Matrix: scalar divided by each element
-      for (size_t i = 0; i < rows; ++i)
-	for (size_t j = 0; j < cols; ++j) {
-	  double val = gsl_matrix_get(mat, i, j);
-	  gsl_matrix_set(result.matrix_real, i, j, scalar / val);
-	}
+      ew_scalar_matrix(EW_DIV, result.matrix_real, scalar, mat);
     }
   }
   else if ((a->type == TYPE_MATRIX_REAL && b->type == TYPE_COMPLEX) ||
@@ -722,26 +548,15 @@ void div_top_two(Stack* stack) {
       ? a->complex_val
       : gsl_complex_div(gsl_complex_rect(1.0, 0.0), b->complex_val);
 
-    size_t rows = mat_real->size1, cols = mat_real->size2;
-    result.matrix_complex = gsl_matrix_complex_alloc(rows, cols);
+    result.matrix_complex = matrix_complex_alloc(mat_real->size1, mat_real->size2);
+    if (!result.matrix_complex) return;
 
-    if (a->type == TYPE_MATRIX_REAL) {
+    if (a->type == TYPE_MATRIX_REAL)
       // Real matrix ÷ complex scalar
-      for (size_t i = 0; i < rows; ++i)
-	for (size_t j = 0; j < cols; ++j) {
-	  double val = gsl_matrix_get(mat_real, i, j);
-	  gsl_matrix_complex_set(result.matrix_complex, i, j,
-				 gsl_complex_div(gsl_complex_rect(val, 0.0), scalar));
-	}
-    } else {
+      ew_real_matrix_complex_scalar(EW_DIV, result.matrix_complex, mat_real, scalar);
+    else
       // Complex scalar ÷ real matrix
-      for (size_t i = 0; i < rows; ++i)
-	for (size_t j = 0; j < cols; ++j) {
-	  double val = gsl_matrix_get(mat_real, i, j);
-	  gsl_matrix_complex_set(result.matrix_complex, i, j,
-				 gsl_complex_div(scalar, gsl_complex_rect(val, 0.0)));
-	}
-    }
+      ew_complex_scalar_real_matrix(EW_DIV, result.matrix_complex, scalar, mat_real);
   }
   else if ((a->type == TYPE_MATRIX_COMPLEX && b->type == TYPE_REAL) ||
 	   (a->type == TYPE_REAL && b->type == TYPE_MATRIX_COMPLEX)) {
@@ -751,33 +566,23 @@ void div_top_two(Stack* stack) {
     gsl_complex scalar =
       (a->type == TYPE_REAL) ? gsl_complex_rect(a->real, 0.0) : gsl_complex_rect(1.0, 0.0);
 
-    size_t rows = mat_complex->size1, cols = mat_complex->size2;
-    result.matrix_complex = gsl_matrix_complex_alloc(rows, cols);
+    result.matrix_complex = complex_target(mat_complex);
+    if (!result.matrix_complex) return;
 
-    if (a->type == TYPE_MATRIX_COMPLEX) {
-      // Complex matrix ÷ real scalar
-      gsl_matrix_complex_memcpy(result.matrix_complex, mat_complex);
-      gsl_matrix_complex_scale(result.matrix_complex, gsl_complex_rect(1.0 / b->real, 0.0));
-    } else {
+    if (a->type == TYPE_MATRIX_COMPLEX)
+      // Complex matrix ÷ real scalar, scaled by the reciprocal
+      ew_complex_matrix_scalar(EW_MUL, result.matrix_complex, mat_complex,
+                               gsl_complex_rect(1.0 / b->real, 0.0));
+    else
       // Real scalar ÷ complex matrix
-      for (size_t i = 0; i < rows; ++i)
-	for (size_t j = 0; j < cols; ++j) {
-	  gsl_complex val = gsl_matrix_complex_get(mat_complex, i, j);
-	  gsl_matrix_complex_set(result.matrix_complex, i, j, gsl_complex_div(scalar, val));
-	}
-    }
+      ew_complex_scalar_matrix(EW_DIV, result.matrix_complex, scalar, mat_complex);
   }
   else if (a->type == TYPE_MATRIX_COMPLEX && b->type == TYPE_COMPLEX) {
     // ---- Complex matrix ÷ complex scalar ----
     result.type = TYPE_MATRIX_COMPLEX;
-    size_t rows = a->matrix_complex->size1, cols = a->matrix_complex->size2;
-    result.matrix_complex = gsl_matrix_complex_alloc(rows, cols);
-
-    for (size_t i = 0; i < rows; ++i)
-      for (size_t j = 0; j < cols; ++j) {
-	gsl_complex val = gsl_matrix_complex_get(a->matrix_complex, i, j);
-	gsl_matrix_complex_set(result.matrix_complex, i, j, gsl_complex_div(val, b->complex_val));
-      }
+    result.matrix_complex = complex_target(a->matrix_complex);
+    if (!result.matrix_complex) return;
+    ew_complex_matrix_scalar(EW_DIV, result.matrix_complex, a->matrix_complex, b->complex_val);
   }
 
   // ---- Matrix ÷ Matrix (A * inv(B)) ----
@@ -791,42 +596,48 @@ void div_top_two(Stack* stack) {
     }
 
     if (a->type == TYPE_MATRIX_REAL && b->type == TYPE_MATRIX_REAL) {
-      gsl_matrix* binv = gsl_matrix_alloc(b->matrix_real->size1, b->matrix_real->size2);
+      gsl_matrix* binv = matrix_alloc(b->matrix_real->size1, b->matrix_real->size2);
       gsl_permutation* p = gsl_permutation_alloc(b->matrix_real->size1);
       int signum;
-      gsl_matrix* bcopy = gsl_matrix_alloc(b->matrix_real->size1, b->matrix_real->size2);
-      gsl_matrix_memcpy(bcopy, b->matrix_real);
-      gsl_linalg_LU_decomp(bcopy, p, &signum);
-      gsl_linalg_LU_invert(bcopy, p, binv);
-
+      gsl_matrix* bcopy = matrix_alloc(b->matrix_real->size1, b->matrix_real->size2);
       result.type = TYPE_MATRIX_REAL;
-      result.matrix_real = gsl_matrix_alloc(a->matrix_real->size1, binv->size2);
-      gsl_blas_dgemm(CblasNoTrans, CblasNoTrans, 1.0, a->matrix_real, binv, 0.0, result.matrix_real);
+      result.matrix_real = binv && p && bcopy
+	? matrix_alloc(a->matrix_real->size1, binv->size2) : NULL;
+      if (result.matrix_real) {
+	gsl_matrix_memcpy(bcopy, b->matrix_real);
+	gsl_linalg_LU_decomp(bcopy, p, &signum);
+	gsl_linalg_LU_invert(bcopy, p, binv);
+	gsl_blas_dgemm(CblasNoTrans, CblasNoTrans, 1.0, a->matrix_real, binv, 0.0, result.matrix_real);
+      }
 
-      gsl_matrix_free(binv);
-      gsl_matrix_free(bcopy);
+      matrix_release(binv);
+      matrix_release(bcopy);
       gsl_permutation_free(p);
+      if (!result.matrix_real) return;
     }
     else if (a->type == TYPE_MATRIX_COMPLEX && b->type == TYPE_MATRIX_COMPLEX) {
       gsl_matrix_complex* binv =
-	gsl_matrix_complex_alloc(b->matrix_complex->size1, b->matrix_complex->size2);
+	matrix_complex_alloc(b->matrix_complex->size1, b->matrix_complex->size2);
       gsl_permutation* p = gsl_permutation_alloc(b->matrix_complex->size1);
       int signum;
       gsl_matrix_complex* bcopy =
-	gsl_matrix_complex_alloc(b->matrix_complex->size1, b->matrix_complex->size2);
-      gsl_matrix_complex_memcpy(bcopy, b->matrix_complex);
-      gsl_linalg_complex_LU_decomp(bcopy, p, &signum);
-      gsl_linalg_complex_LU_invert(bcopy, p, binv);
-
+	matrix_complex_alloc(b->matrix_complex->size1, b->matrix_complex->size2);
       result.type = TYPE_MATRIX_COMPLEX;
-      result.matrix_complex = gsl_matrix_complex_alloc(a->matrix_complex->size1, binv->size2);
-      gsl_blas_zgemm(CblasNoTrans, CblasNoTrans,
-		     GSL_COMPLEX_ONE, a->matrix_complex, binv,
-		     GSL_COMPLEX_ZERO, result.matrix_complex);
+      result.matrix_complex = binv && p && bcopy
+	? matrix_complex_alloc(a->matrix_complex->size1, binv->size2) : NULL;
+      if (result.matrix_complex) {
+	gsl_matrix_complex_memcpy(bcopy, b->matrix_complex);
+	gsl_linalg_complex_LU_decomp(bcopy, p, &signum);
+	gsl_linalg_complex_LU_invert(bcopy, p, binv);
+	gsl_blas_zgemm(CblasNoTrans, CblasNoTrans,
+		       GSL_COMPLEX_ONE, a->matrix_complex, binv,
+		       GSL_COMPLEX_ZERO, result.matrix_complex);
+      }
 
-      gsl_matrix_complex_free(binv);
-      gsl_matrix_complex_free(bcopy);
+      matrix_complex_release(binv);
+      matrix_complex_release(bcopy);
       gsl_permutation_free(p);
+      if (!result.matrix_complex) return;
     }
   }
 
@@ -835,14 +646,8 @@ void div_top_two(Stack* stack) {
     return;
   }
 
-  // ---- Cleanup and finalize ----
-  if (a->type == TYPE_MATRIX_REAL && a->matrix_real)
-    gsl_matrix_free(a->matrix_real);
-  if (a->type == TYPE_MATRIX_COMPLEX && a->matrix_complex)
-    gsl_matrix_complex_free(a->matrix_complex);
-
-  *a = result;
-  stack->top--;
+  // Drop the operands, keeping a matrix the result was computed in
+  replace_operands(stack, result);
 }
 
 void pow_top_two(Stack* stack) {
@@ -878,22 +683,28 @@ void pow_top_two(Stack* stack) {
       fprintf(stderr, "Matrix exponent must be non-negative and square.\n");
       return;
     }
-    gsl_matrix* res = gsl_matrix_alloc(a->matrix_real->size1, a->matrix_real->size2);
+    gsl_matrix* res = matrix_alloc(a->matrix_real->size1, a->matrix_real->size2);
+    gsl_matrix* temp = matrix_alloc(a->matrix_real->size1, a->matrix_real->size2);
+    if (!res || !temp) {
+      matrix_release(res);
+      matrix_release(temp);
+      return;
+    }
     gsl_matrix_set_identity(res);
-
-    gsl_matrix* temp = gsl_matrix_alloc(a->matrix_real->size1, a->matrix_real->size2);
     gsl_matrix_memcpy(temp, a->matrix_real);
 
-    for (int i = 0; i < n; i++) {
-      gsl_matrix* temp_res = gsl_matrix_alloc(res->size1, temp->size2);
-      gsl_blas_dgemm(CblasNoTrans, CblasNoTrans, 1.0, res, temp, 0.0, temp_res);
-      gsl_matrix_free(res);
+    for (int i = 0; i < n && res; i++) {
+      gsl_matrix* temp_res = matrix_alloc(res->size1, temp->size2);
+      if (temp_res)
+	gsl_blas_dgemm(CblasNoTrans, CblasNoTrans, 1.0, res, temp, 0.0, temp_res);
+      matrix_release(res);
       res = temp_res;
     }
+    matrix_release(temp);
+    if (!res) return;
 
     result.type = TYPE_MATRIX_REAL;
     result.matrix_real = res;
-    gsl_matrix_free(temp);
   }
 
   else if (a->type == TYPE_MATRIX_COMPLEX && b->type == TYPE_REAL) {
@@ -903,24 +714,30 @@ void pow_top_two(Stack* stack) {
       return;
     }
     gsl_matrix_complex* res =
-      gsl_matrix_complex_alloc(a->matrix_complex->size1, a->matrix_complex->size2);
-    gsl_matrix_complex_set_identity(res);
-
+      matrix_complex_alloc(a->matrix_complex->size1, a->matrix_complex->size2);
     gsl_matrix_complex* temp =
-      gsl_matrix_complex_alloc(a->matrix_complex->size1, a->matrix_complex->size2);
+      matrix_complex_alloc(a->matrix_complex->size1, a->matrix_complex->size2);
+    if (!res || !temp) {
+      matrix_complex_release(res);
+      matrix_complex_release(temp);
+      return;
+    }
+    gsl_matrix_complex_set_identity(res);
     gsl_matrix_complex_memcpy(temp, a->matrix_complex);
 
-    for (int i = 0; i < n; i++) {
-      gsl_matrix_complex* temp_res = gsl_matrix_complex_alloc(res->size1, temp->size2);
-      gsl_blas_zgemm(CblasNoTrans, CblasNoTrans, GSL_COMPLEX_ONE,
-		     res, temp, GSL_COMPLEX_ZERO, temp_res);
-      gsl_matrix_complex_free(res);
+    for (int i = 0; i < n && res; i++) {
+      gsl_matrix_complex* temp_res = matrix_complex_alloc(res->size1, temp->size2);
+      if (temp_res)
+	gsl_blas_zgemm(CblasNoTrans, CblasNoTrans, GSL_COMPLEX_ONE,
+		       res, temp, GSL_COMPLEX_ZERO, temp_res);
+      matrix_complex_release(res);
       res = temp_res;
     }
+    matrix_complex_release(temp);
+    if (!res) return;
 
     result.type = TYPE_MATRIX_COMPLEX;
     result.matrix_complex = res;
-    gsl_matrix_complex_free(temp);
   }
 
   // ---- Unsupported case ----
@@ -929,15 +746,8 @@ void pow_top_two(Stack* stack) {
     return;
   }
 
-  // Free a’s previous data
-  if (a->type == TYPE_MATRIX_REAL && a->matrix_real)
-    gsl_matrix_free(a->matrix_real);
-  if (a->type == TYPE_MATRIX_COMPLEX && a->matrix_complex)
-    gsl_matrix_complex_free(a->matrix_complex);
-
-  // Store result in a and pop b
-  *a = result;
-  stack->top--;
+  // Drop the operands, keeping a matrix the result was computed in
+  replace_operands(stack, result);
 }
 
 void join_2_reals(Stack *s) {
@@ -958,7 +768,7 @@ void join_2_reals(Stack *s) {
     s->top -= 2;
 
     // Push complex scalar
-    if (s->top + 1 >= STACK_SIZE) {
+    if (!stack_reserve(s, 1)) {
       fprintf(stderr, "Error: stack overflow when pushing complex scalar.\n");
       return;
     }
@@ -988,7 +798,7 @@ void join_2_reals(Stack *s) {
     size_t rows = real_mat->size1;
     size_t cols = real_mat->size2;
 
-    gsl_matrix_complex *complex_mat = gsl_matrix_complex_alloc(rows, cols);
+    gsl_matrix_complex *complex_mat = matrix_complex_alloc(rows, cols);
     if (!complex_mat) {
       fprintf(stderr, "Error: failed to allocate complex matrix.\n");
       return;
@@ -1004,16 +814,16 @@ void join_2_reals(Stack *s) {
     }
 
     // Free the old real matrices
-    gsl_matrix_free(real_mat);
-    gsl_matrix_free(imag_mat);
+    matrix_release(real_mat);
+    matrix_release(imag_mat);
 
     // Pop imag and real matrices
     s->top -= 2;
 
     // Push complex matrix
-    if (s->top + 1 >= STACK_SIZE) {
+    if (!stack_reserve(s, 1)) {
       fprintf(stderr, "Error: stack overflow when pushing complex matrix.\n");
-      gsl_matrix_complex_free(complex_mat);
+      matrix_complex_release(complex_mat);
       return;
     }
 
@@ -1048,7 +858,8 @@ int kronecker_top_two(Stack* stack) {
     size_t b_cols = b->matrix_real->size2;
 
     result.type = TYPE_MATRIX_REAL;
-    result.matrix_real = gsl_matrix_alloc(a_rows * b_rows, a_cols * b_cols);
+    result.matrix_real = matrix_alloc(a_rows * b_rows, a_cols * b_cols);
+    if (!result.matrix_real) return 1;
 
     for (size_t i = 0; i < a_rows; ++i) {
       for (size_t j = 0; j < a_cols; ++j) {
@@ -1071,7 +882,8 @@ int kronecker_top_two(Stack* stack) {
     size_t b_cols = b->matrix_complex->size2;
 
     result.type = TYPE_MATRIX_COMPLEX;
-    result.matrix_complex = gsl_matrix_complex_alloc(a_rows * b_rows, a_cols * b_cols);
+    result.matrix_complex = matrix_complex_alloc(a_rows * b_rows, a_cols * b_cols);
+    if (!result.matrix_complex) return 1;
 
     for (size_t i = 0; i < a_rows; ++i) {
       for (size_t j = 0; j < a_cols; ++j) {
@@ -1097,7 +909,8 @@ int kronecker_top_two(Stack* stack) {
     size_t b_cols = b->matrix_complex->size2;
 
     result.type = TYPE_MATRIX_COMPLEX;
-    result.matrix_complex = gsl_matrix_complex_alloc(a_rows * b_rows, a_cols * b_cols);
+    result.matrix_complex = matrix_complex_alloc(a_rows * b_rows, a_cols * b_cols);
+    if (!result.matrix_complex) return 1;
 
     for (size_t i = 0; i < a_rows; ++i) {
       for (size_t j = 0; j < a_cols; ++j) {
@@ -1124,7 +937,8 @@ int kronecker_top_two(Stack* stack) {
     size_t b_cols = b->matrix_real->size2;
 
     result.type = TYPE_MATRIX_COMPLEX;
-    result.matrix_complex = gsl_matrix_complex_alloc(a_rows * b_rows, a_cols * b_cols);
+    result.matrix_complex = matrix_complex_alloc(a_rows * b_rows, a_cols * b_cols);
+    if (!result.matrix_complex) return 1;
 
     for (size_t i = 0; i < a_rows; ++i) {
       for (size_t j = 0; j < a_cols; ++j) {
@@ -1150,9 +964,9 @@ int kronecker_top_two(Stack* stack) {
 
   // Cleanup: free first matrix if allocated
   if (a->type == TYPE_MATRIX_REAL && a->matrix_real)
-    gsl_matrix_free(a->matrix_real);
+    matrix_release(a->matrix_real);
   if (a->type == TYPE_MATRIX_COMPLEX && a->matrix_complex)
-    gsl_matrix_complex_free(a->matrix_complex);
+    matrix_complex_release(a->matrix_complex);
 
   *a = result;
   stack->top--;
@@ -1189,15 +1003,12 @@ void dot_div_top_two(Stack* stack) {
     result.type = TYPE_MATRIX_REAL;
     gsl_matrix* mat = (a->type == TYPE_MATRIX_REAL) ? a->matrix_real : b->matrix_real;
     double val = (a->type == TYPE_REAL) ? a->real : b->real;
-    int scalar_first = (a->type == TYPE_REAL);
-    size_t rows = mat->size1, cols = mat->size2;
-    result.matrix_real = gsl_matrix_alloc(rows, cols);
-    for (size_t i = 0; i < rows; ++i)
-      for (size_t j = 0; j < cols; ++j) {
-        double m = gsl_matrix_get(mat, i, j);
-        double r = scalar_first ? val / m : m / val;
-        gsl_matrix_set(result.matrix_real, i, j, r);
-      }
+    result.matrix_real = real_target(mat);
+    if (!result.matrix_real) return;
+    if (a->type == TYPE_REAL)
+      ew_scalar_matrix(EW_DIV, result.matrix_real, val, mat);
+    else
+      ew_matrix_scalar(EW_DIV, result.matrix_real, mat, val);
   }
   else if ((a->type == TYPE_REAL && b->type == TYPE_MATRIX_COMPLEX) ||
            (a->type == TYPE_MATRIX_COMPLEX && b->type == TYPE_REAL)) {
@@ -1205,30 +1016,24 @@ void dot_div_top_two(Stack* stack) {
     gsl_matrix_complex* mat =
       (a->type == TYPE_MATRIX_COMPLEX) ? a->matrix_complex : b->matrix_complex;
     gsl_complex z = gsl_complex_rect((a->type == TYPE_REAL) ? a->real : b->real, 0.0);
-    int scalar_first = (a->type == TYPE_REAL);
-    size_t rows = mat->size1, cols = mat->size2;
-    result.matrix_complex = gsl_matrix_complex_alloc(rows, cols);
-    for (size_t i = 0; i < rows; ++i)
-      for (size_t j = 0; j < cols; ++j) {
-        gsl_complex v = gsl_matrix_complex_get(mat, i, j);
-        gsl_complex r = scalar_first ? gsl_complex_div(z, v) : gsl_complex_div(v, z);
-        gsl_matrix_complex_set(result.matrix_complex, i, j, r);
-      }
+    result.matrix_complex = complex_target(mat);
+    if (!result.matrix_complex) return;
+    if (a->type == TYPE_REAL)
+      ew_complex_scalar_matrix(EW_DIV, result.matrix_complex, z, mat);
+    else
+      ew_complex_matrix_scalar(EW_DIV, result.matrix_complex, mat, z);
   }
   else if ((a->type == TYPE_COMPLEX && b->type == TYPE_MATRIX_REAL) ||
            (a->type == TYPE_MATRIX_REAL && b->type == TYPE_COMPLEX)) {
     result.type = TYPE_MATRIX_COMPLEX;
     gsl_matrix* mat_real = (a->type == TYPE_MATRIX_REAL) ? a->matrix_real : b->matrix_real;
     gsl_complex z = (a->type == TYPE_COMPLEX) ? a->complex_val : b->complex_val;
-    int scalar_first = (a->type == TYPE_COMPLEX);
-    size_t rows = mat_real->size1, cols = mat_real->size2;
-    result.matrix_complex = gsl_matrix_complex_alloc(rows, cols);
-    for (size_t i = 0; i < rows; ++i)
-      for (size_t j = 0; j < cols; ++j) {
-        gsl_complex v = gsl_complex_rect(gsl_matrix_get(mat_real, i, j), 0);
-        gsl_complex r = scalar_first ? gsl_complex_div(z, v) : gsl_complex_div(v, z);
-        gsl_matrix_complex_set(result.matrix_complex, i, j, r);
-      }
+    result.matrix_complex = matrix_complex_alloc(mat_real->size1, mat_real->size2);
+    if (!result.matrix_complex) return;
+    if (a->type == TYPE_COMPLEX)
+      ew_complex_scalar_real_matrix(EW_DIV, result.matrix_complex, z, mat_real);
+    else
+      ew_real_matrix_complex_scalar(EW_DIV, result.matrix_complex, mat_real, z);
   }
   else if ((a->type == TYPE_COMPLEX && b->type == TYPE_MATRIX_COMPLEX) ||
            (a->type == TYPE_MATRIX_COMPLEX && b->type == TYPE_COMPLEX)) {
@@ -1236,15 +1041,12 @@ void dot_div_top_two(Stack* stack) {
     gsl_matrix_complex* mat =
       (a->type == TYPE_MATRIX_COMPLEX) ? a->matrix_complex : b->matrix_complex;
     gsl_complex z = (a->type == TYPE_COMPLEX) ? a->complex_val : b->complex_val;
-    int scalar_first = (a->type == TYPE_COMPLEX);
-    size_t rows = mat->size1, cols = mat->size2;
-    result.matrix_complex = gsl_matrix_complex_alloc(rows, cols);
-    for (size_t i = 0; i < rows; ++i)
-      for (size_t j = 0; j < cols; ++j) {
-        gsl_complex v = gsl_matrix_complex_get(mat, i, j);
-        gsl_complex r = scalar_first ? gsl_complex_div(z, v) : gsl_complex_div(v, z);
-        gsl_matrix_complex_set(result.matrix_complex, i, j, r);
-      }
+    result.matrix_complex = complex_target(mat);
+    if (!result.matrix_complex) return;
+    if (a->type == TYPE_COMPLEX)
+      ew_complex_scalar_matrix(EW_DIV, result.matrix_complex, z, mat);
+    else
+      ew_complex_matrix_scalar(EW_DIV, result.matrix_complex, mat, z);
   }
   else if (a->type == TYPE_MATRIX_REAL && b->type == TYPE_MATRIX_REAL) {
     if (a->matrix_real->size1 != b->matrix_real->size1 ||
@@ -1253,13 +1055,9 @@ void dot_div_top_two(Stack* stack) {
       return;
     }
     result.type = TYPE_MATRIX_REAL;
-    size_t rows = a->matrix_real->size1, cols = a->matrix_real->size2;
-    result.matrix_real = gsl_matrix_alloc(rows, cols);
-    for (size_t i = 0; i < rows; ++i)
-      for (size_t j = 0; j < cols; ++j)
-        gsl_matrix_set(result.matrix_real, i, j,
-                       gsl_matrix_get(a->matrix_real, i, j) /
-                       gsl_matrix_get(b->matrix_real, i, j));
+    result.matrix_real = real_target2(a->matrix_real, b->matrix_real);
+    if (!result.matrix_real) return;
+    ew_matrix_matrix(EW_DIV, result.matrix_real, a->matrix_real, b->matrix_real);
   }
   else if (a->type == TYPE_MATRIX_COMPLEX && b->type == TYPE_MATRIX_COMPLEX) {
     if (a->matrix_complex->size1 != b->matrix_complex->size1 ||
@@ -1268,29 +1066,17 @@ void dot_div_top_two(Stack* stack) {
       return;
     }
     result.type = TYPE_MATRIX_COMPLEX;
-    size_t rows = a->matrix_complex->size1, cols = a->matrix_complex->size2;
-    result.matrix_complex = gsl_matrix_complex_alloc(rows, cols);
-    for (size_t i = 0; i < rows; ++i)
-      for (size_t j = 0; j < cols; ++j) {
-        gsl_complex z1 = gsl_matrix_complex_get(a->matrix_complex, i, j);
-        gsl_complex z2 = gsl_matrix_complex_get(b->matrix_complex, i, j);
-        gsl_matrix_complex_set(result.matrix_complex, i, j, gsl_complex_div(z1, z2));
-      }
+    result.matrix_complex = complex_target2(a->matrix_complex, b->matrix_complex);
+    if (!result.matrix_complex) return;
+    ew_complex_matrix_matrix(EW_DIV, result.matrix_complex, a->matrix_complex, b->matrix_complex);
   }
   else {
     fprintf(stderr, "Unsupported operand types in dot_div_top_two.\n");
     return;
   }
 
-  // Free memory in a
-  if (a->type == TYPE_MATRIX_REAL && a->matrix_real)
-    gsl_matrix_free(a->matrix_real);
-  if (a->type == TYPE_MATRIX_COMPLEX && a->matrix_complex)
-    gsl_matrix_complex_free(a->matrix_complex);
-
-  // Store result and pop
-  *a = result;
-  stack->top--;
+  // Drop the operands, keeping a matrix the result was computed in
+  replace_operands(stack, result);
 }
 
 void dot_mult_top_two(Stack* stack) {
@@ -1326,11 +1112,9 @@ void dot_mult_top_two(Stack* stack) {
     gsl_matrix* mat =
       (a->type == TYPE_MATRIX_REAL) ? a->matrix_real : b->matrix_real;
     double val = (a->type == TYPE_REAL) ? a->real : b->real;
-    size_t rows = mat->size1, cols = mat->size2;
-    result.matrix_real = gsl_matrix_alloc(rows, cols);
-    for (size_t i = 0; i < rows; ++i)
-      for (size_t j = 0; j < cols; ++j)
-        gsl_matrix_set(result.matrix_real, i, j, val * gsl_matrix_get(mat, i, j));
+    result.matrix_real = real_target(mat);
+    if (!result.matrix_real) return;
+    ew_matrix_scalar(EW_MUL, result.matrix_real, mat, val);
   }
   else if ((a->type == TYPE_REAL && b->type == TYPE_MATRIX_COMPLEX) ||
            (a->type == TYPE_MATRIX_COMPLEX && b->type == TYPE_REAL)) {
@@ -1339,45 +1123,29 @@ void dot_mult_top_two(Stack* stack) {
       (a->type == TYPE_MATRIX_COMPLEX) ? a->matrix_complex : b->matrix_complex;
     gsl_complex z =
       gsl_complex_rect((a->type == TYPE_REAL) ? a->real : b->real, 0.0);
-    size_t rows = mat->size1, cols = mat->size2;
-    result.matrix_complex = gsl_matrix_complex_alloc(rows, cols);
-    for (size_t i = 0; i < rows; ++i)
-      for (size_t j = 0; j < cols; ++j) {
-        gsl_complex v = gsl_matrix_complex_get(mat, i, j);
-        gsl_matrix_complex_set(result.matrix_complex, i, j, gsl_complex_mul(z, v));
-      }
+    result.matrix_complex = complex_target(mat);
+    if (!result.matrix_complex) return;
+    ew_complex_matrix_scalar(EW_MUL, result.matrix_complex, mat, z);
   }
   else if ((a->type == TYPE_COMPLEX && b->type == TYPE_MATRIX_REAL) ||
            (a->type == TYPE_MATRIX_REAL && b->type == TYPE_COMPLEX)) {
     result.type = TYPE_MATRIX_COMPLEX;
     gsl_matrix* mat_real =
       (a->type == TYPE_MATRIX_REAL) ? a->matrix_real : b->matrix_real;
-    gsl_complex tmp = (a->type == TYPE_COMPLEX) ? a->complex_val : b->complex_val;
-    gsl_complex z = gsl_complex_rect(GSL_REAL(tmp), GSL_IMAG(tmp));
-
-    size_t rows = mat_real->size1, cols = mat_real->size2;
-    result.matrix_complex = gsl_matrix_complex_alloc(rows, cols);
-    for (size_t i = 0; i < rows; ++i)
-      for (size_t j = 0; j < cols; ++j) {
-        gsl_complex v = gsl_complex_rect(gsl_matrix_get(mat_real, i, j), 0);
-        gsl_matrix_complex_set(result.matrix_complex, i, j, gsl_complex_mul(z, v));
-      }
+    gsl_complex z = (a->type == TYPE_COMPLEX) ? a->complex_val : b->complex_val;
+    result.matrix_complex = matrix_complex_alloc(mat_real->size1, mat_real->size2);
+    if (!result.matrix_complex) return;
+    ew_real_matrix_complex_scalar(EW_MUL, result.matrix_complex, mat_real, z);
   }
   else if ((a->type == TYPE_COMPLEX && b->type == TYPE_MATRIX_COMPLEX) ||
            (a->type == TYPE_MATRIX_COMPLEX && b->type == TYPE_COMPLEX)) {
     result.type = TYPE_MATRIX_COMPLEX;
     gsl_matrix_complex* mat =
       (a->type == TYPE_MATRIX_COMPLEX) ? a->matrix_complex : b->matrix_complex;
-    gsl_complex tmp = (a->type == TYPE_COMPLEX) ? a->complex_val : b->complex_val;
-    gsl_complex z = gsl_complex_rect(GSL_REAL(tmp), GSL_IMAG(tmp));
-
-    size_t rows = mat->size1, cols = mat->size2;
-    result.matrix_complex = gsl_matrix_complex_alloc(rows, cols);
-    for (size_t i = 0; i < rows; ++i)
-      for (size_t j = 0; j < cols; ++j) {
-        gsl_complex v = gsl_matrix_complex_get(mat, i, j);
-        gsl_matrix_complex_set(result.matrix_complex, i, j, gsl_complex_mul(z, v));
-      }
+    gsl_complex z = (a->type == TYPE_COMPLEX) ? a->complex_val : b->complex_val;
+    result.matrix_complex = complex_target(mat);
+    if (!result.matrix_complex) return;
+    ew_complex_matrix_scalar(EW_MUL, result.matrix_complex, mat, z);
   }
   else if (a->type == TYPE_MATRIX_REAL && b->type == TYPE_MATRIX_REAL) {
     if (a->matrix_real->size1 != b->matrix_real->size1 ||
@@ -1386,13 +1154,9 @@ void dot_mult_top_two(Stack* stack) {
       return;
     }
     result.type = TYPE_MATRIX_REAL;
-    size_t rows = a->matrix_real->size1, cols = a->matrix_real->size2;
-    result.matrix_real = gsl_matrix_alloc(rows, cols);
-    for (size_t i = 0; i < rows; ++i)
-      for (size_t j = 0; j < cols; ++j)
-        gsl_matrix_set(result.matrix_real, i, j,
-                       gsl_matrix_get(a->matrix_real, i, j) *
-                       gsl_matrix_get(b->matrix_real, i, j));
+    result.matrix_real = real_target2(a->matrix_real, b->matrix_real);
+    if (!result.matrix_real) return;
+    ew_matrix_matrix(EW_MUL, result.matrix_real, a->matrix_real, b->matrix_real);
   }
   else if (a->type == TYPE_MATRIX_COMPLEX && b->type == TYPE_MATRIX_COMPLEX) {
     if (a->matrix_complex->size1 != b->matrix_complex->size1 ||
@@ -1401,29 +1165,17 @@ void dot_mult_top_two(Stack* stack) {
       return;
     }
     result.type = TYPE_MATRIX_COMPLEX;
-    size_t rows = a->matrix_complex->size1, cols = a->matrix_complex->size2;
-    result.matrix_complex = gsl_matrix_complex_alloc(rows, cols);
-    for (size_t i = 0; i < rows; ++i)
-      for (size_t j = 0; j < cols; ++j) {
-        gsl_complex z1 = gsl_matrix_complex_get(a->matrix_complex, i, j);
-        gsl_complex z2 = gsl_matrix_complex_get(b->matrix_complex, i, j);
-        gsl_matrix_complex_set(result.matrix_complex, i, j, gsl_complex_mul(z1, z2));
-      }
+    result.matrix_complex = complex_target2(a->matrix_complex, b->matrix_complex);
+    if (!result.matrix_complex) return;
+    ew_complex_matrix_matrix(EW_MUL, result.matrix_complex, a->matrix_complex, b->matrix_complex);
   }
   else {
     fprintf(stderr, "Unsupported operand types in dot_mult_top_two.\n");
     return;
   }
 
-  // Free memory in a
-  if (a->type == TYPE_MATRIX_REAL && a->matrix_real)
-    gsl_matrix_free(a->matrix_real);
-  if (a->type == TYPE_MATRIX_COMPLEX && a->matrix_complex)
-    gsl_matrix_complex_free(a->matrix_complex);
-
-  // Store result and pop
-  *a = result;
-  stack->top--;
+  // Drop the operands, keeping a matrix the result was computed in
+  replace_operands(stack, result);
 }
 
 void dot_pow_top_two(Stack* stack) {
@@ -1452,31 +1204,24 @@ void dot_pow_top_two(Stack* stack) {
     result.type = TYPE_MATRIX_REAL;
     gsl_matrix* mat = (a->type == TYPE_MATRIX_REAL) ? a->matrix_real : b->matrix_real;
     double val = (a->type == TYPE_REAL) ? a->real : b->real;
-    int scalar_first = (a->type == TYPE_REAL);
-    size_t rows = mat->size1, cols = mat->size2;
-    result.matrix_real = gsl_matrix_alloc(rows, cols);
-    for (size_t i = 0; i < rows; ++i)
-      for (size_t j = 0; j < cols; ++j) {
-        double base = scalar_first ? val : gsl_matrix_get(mat, i, j);
-        double expo = scalar_first ? gsl_matrix_get(mat, i, j) : val;
-        gsl_matrix_set(result.matrix_real, i, j, pow(base, expo));
-      }
+    result.matrix_real = real_target(mat);
+    if (!result.matrix_real) return;
+    if (a->type == TYPE_REAL)
+      ew_scalar_matrix(EW_POW, result.matrix_real, val, mat);
+    else
+      ew_matrix_scalar(EW_POW, result.matrix_real, mat, val);
   }
   else if ((a->type == TYPE_COMPLEX && b->type == TYPE_MATRIX_REAL) ||
            (a->type == TYPE_MATRIX_REAL && b->type == TYPE_COMPLEX)) {
     result.type = TYPE_MATRIX_COMPLEX;
     gsl_matrix* mat_real = (a->type == TYPE_MATRIX_REAL) ? a->matrix_real : b->matrix_real;
-    gsl_complex tmp = (a->type == TYPE_COMPLEX) ? a->complex_val : b->complex_val;
-    gsl_complex z = gsl_complex_rect(GSL_REAL(tmp), GSL_IMAG(tmp));
-    int scalar_first = (a->type == TYPE_COMPLEX);
-    size_t rows = mat_real->size1, cols = mat_real->size2;
-    result.matrix_complex = gsl_matrix_complex_alloc(rows, cols);
-    for (size_t i = 0; i < rows; ++i)
-      for (size_t j = 0; j < cols; ++j) {
-        gsl_complex d = gsl_complex_rect(gsl_matrix_get(mat_real, i, j), 0.0);
-        gsl_complex r = scalar_first ? gsl_complex_pow(z, d) : gsl_complex_pow(d, z);
-        gsl_matrix_complex_set(result.matrix_complex, i, j, r);
-      }
+    gsl_complex z = (a->type == TYPE_COMPLEX) ? a->complex_val : b->complex_val;
+    result.matrix_complex = matrix_complex_alloc(mat_real->size1, mat_real->size2);
+    if (!result.matrix_complex) return;
+    if (a->type == TYPE_COMPLEX)
+      ew_complex_scalar_real_matrix(EW_POW, result.matrix_complex, z, mat_real);
+    else
+      ew_real_matrix_complex_scalar(EW_POW, result.matrix_complex, mat_real, z);
   }
   else if ((a->type == TYPE_COMPLEX && b->type == TYPE_MATRIX_COMPLEX) ||
            (a->type == TYPE_MATRIX_COMPLEX && b->type == TYPE_COMPLEX)) {
@@ -1484,16 +1229,12 @@ void dot_pow_top_two(Stack* stack) {
     gsl_matrix_complex* mat =
       (a->type == TYPE_MATRIX_COMPLEX) ? a->matrix_complex : b->matrix_complex;
     gsl_complex z = (a->type == TYPE_COMPLEX) ? a->complex_val : b->complex_val;
-    int scalar_first = (a->type == TYPE_COMPLEX);
-    size_t rows = mat->size1, cols = mat->size2;
-    result.matrix_complex = gsl_matrix_complex_alloc(rows, cols);
-    for (size_t i = 0; i < rows; ++i)
-      for (size_t j = 0; j < cols; ++j) {
-        gsl_complex w = gsl_matrix_complex_get(mat, i, j);
-        gsl_complex r = scalar_first ? gsl_complex_pow(z, w)
-	  : gsl_complex_pow(w, z);
-        gsl_matrix_complex_set(result.matrix_complex, i, j, r);
-      }
+    result.matrix_complex = complex_target(mat);
+    if (!result.matrix_complex) return;
+    if (a->type == TYPE_COMPLEX)
+      ew_complex_scalar_matrix(EW_POW, result.matrix_complex, z, mat);
+    else
+      ew_complex_matrix_scalar(EW_POW, result.matrix_complex, mat, z);
   }
   else if (a->type == TYPE_MATRIX_REAL && b->type == TYPE_MATRIX_REAL) {
     if (a->matrix_real->size1 != b->matrix_real->size1 ||
@@ -1502,14 +1243,9 @@ void dot_pow_top_two(Stack* stack) {
       return;
     }
     result.type = TYPE_MATRIX_REAL;
-    size_t rows = a->matrix_real->size1, cols = a->matrix_real->size2;
-    result.matrix_real = gsl_matrix_alloc(rows, cols);
-    for (size_t i = 0; i < rows; ++i)
-      for (size_t j = 0; j < cols; ++j) {
-        double base = gsl_matrix_get(a->matrix_real, i, j);
-        double exp  = gsl_matrix_get(b->matrix_real, i, j);
-        gsl_matrix_set(result.matrix_real, i, j, pow(base, exp));
-      }
+    result.matrix_real = real_target2(a->matrix_real, b->matrix_real);
+    if (!result.matrix_real) return;
+    ew_matrix_matrix(EW_POW, result.matrix_real, a->matrix_real, b->matrix_real);
   }
   else if (a->type == TYPE_MATRIX_COMPLEX && b->type == TYPE_MATRIX_COMPLEX) {
     if (a->matrix_complex->size1 != b->matrix_complex->size1 ||
@@ -1518,27 +1254,15 @@ void dot_pow_top_two(Stack* stack) {
       return;
     }
     result.type = TYPE_MATRIX_COMPLEX;
-    size_t rows = a->matrix_complex->size1, cols = a->matrix_complex->size2;
-    result.matrix_complex = gsl_matrix_complex_alloc(rows, cols);
-    for (size_t i = 0; i < rows; ++i)
-      for (size_t j = 0; j < cols; ++j) {
-        gsl_complex z1 = gsl_matrix_complex_get(a->matrix_complex, i, j);
-        gsl_complex z2 = gsl_matrix_complex_get(b->matrix_complex, i, j);
-        gsl_matrix_complex_set(result.matrix_complex, i, j, gsl_complex_pow(z1, z2));
-      }
+    result.matrix_complex = complex_target2(a->matrix_complex, b->matrix_complex);
+    if (!result.matrix_complex) return;
+    ew_complex_matrix_matrix(EW_POW, result.matrix_complex, a->matrix_complex, b->matrix_complex);
   }
   else {
     fprintf(stderr, "Unsupported operand types in dot_pow_top_two.\n");
     return;
   }
 
-  // Free memory in a
-  if (a->type == TYPE_MATRIX_REAL && a->matrix_real)
-    gsl_matrix_free(a->matrix_real);
-  if (a->type == TYPE_MATRIX_COMPLEX && a->matrix_complex)
-    gsl_matrix_complex_free(a->matrix_complex);
-
-  // Store result and pop
-  *a = result;
-  stack->top--;
+  // Drop the operands, keeping a matrix the result was computed in
+  replace_operands(stack, result);
 }
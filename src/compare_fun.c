@@ -86,7 +86,8 @@ void dot_cmp_top_two(Stack* stack, comparison_op op) {
     int scalar_first = (a->type == TYPE_REAL);
     size_t rows = mat->size1, cols = mat->size2;
     result.type = TYPE_MATRIX_REAL;
-    result.matrix_real = gsl_matrix_alloc(rows, cols);
+    result.matrix_real = matrix_alloc(rows, cols);
+    if (!result.matrix_real) return;
     for (size_t i = 0; i < rows; ++i)
       for (size_t j = 0; j < cols; ++j) {
         double m = gsl_matrix_get(mat, i, j);
@@ -105,7 +106,8 @@ void dot_cmp_top_two(Stack* stack, comparison_op op) {
     int scalar_first = (a->type == TYPE_COMPLEX);
     size_t rows = mat->size1, cols = mat->size2;
     result.type = TYPE_MATRIX_REAL;
-    result.matrix_real = gsl_matrix_alloc(rows, cols);  // comparisons return real (0/1)
+    result.matrix_real = matrix_alloc(rows, cols);  // comparisons return real (0/1)
+    if (!result.matrix_real) return;
     for (size_t i = 0; i < rows; ++i)
       for (size_t j = 0; j < cols; ++j) {
         gsl_complex w = gsl_matrix_complex_get(mat, i, j);
@@ -124,7 +126,8 @@ void dot_cmp_top_two(Stack* stack, comparison_op op) {
     }
     size_t rows = a->matrix_real->size1, cols = a->matrix_real->size2;
     result.type = TYPE_MATRIX_REAL;
-    result.matrix_real = gsl_matrix_alloc(rows, cols);
+    result.matrix_real = matrix_alloc(rows, cols);
+    if (!result.matrix_real) return;
     for (size_t i = 0; i < rows; ++i)
       for (size_t j = 0; j < cols; ++j) {
         double x = gsl_matrix_get(a->matrix_real, i, j);
@@ -140,7 +143,8 @@ void dot_cmp_top_two(Stack* stack, comparison_op op) {
     }
     size_t rows = a->matrix_complex->size1, cols = a->matrix_complex->size2;
     result.type = TYPE_MATRIX_REAL;
-    result.matrix_real = gsl_matrix_alloc(rows, cols);  // comparison result: 0.0 or 1.0
+    result.matrix_real = matrix_alloc(rows, cols);  // comparison result: 0.0 or 1.0
+    if (!result.matrix_real) return;
     for (size_t i = 0; i < rows; ++i)
       for (size_t j = 0; j < cols; ++j) {
         gsl_complex x = gsl_matrix_complex_get(a->matrix_complex, i, j);
@@ -155,9 +159,9 @@ void dot_cmp_top_two(Stack* stack, comparison_op op) {
 
   // Free old memory
   if (a->type == TYPE_MATRIX_REAL && a->matrix_real)
-    gsl_matrix_free(a->matrix_real);
+    matrix_release(a->matrix_real);
   if (a->type == TYPE_MATRIX_COMPLEX && a->matrix_complex)
-    gsl_matrix_complex_free(a->matrix_complex);
+    matrix_complex_release(a->matrix_complex);
 
   *a = result;
   stack->top--;
@@ -0,0 +1,233 @@
+/*
+ * This file is part of Mico's toy RPN Calculator
+ *
+ * Mico's toy RPN Calculator is free software:
+ * you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mico's toy RPN Calculator is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mico's toy RPN Calculator. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Line compiler. A line is lexed once into a flat array of bc_instr, with
+// numbers decoded, builtins bound to their handlers and identifiers bound
+// to their symbols; eval_fun.c executes the array. Compiled lines are kept
+// in a cache keyed by the line text, so loops in programs and repeated
+// batch lines skip the lexer entirely.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <gsl/gsl_matrix.h>
+#include "lexer.h"
+#include "symbols.h"
+#include "opcode_hash.h"
+#include "eval_fun.h"
+#include "compiler.h"
+#include "peephole.h"
+#include "stack_effects.h"
+
+#define LINE_CACHE_BUCKETS 256
+#define LINE_CACHE_WAYS 4   // lines per bucket; a full bucket drops its least recently used
+
+typedef struct cached_line {
+  uint32_t hash;
+  char* text;
+  code_block* code;
+  struct cached_line* next;
+} cached_line;
+
+// Each bucket is kept in most recently used order
+static cached_line* line_cache[LINE_CACHE_BUCKETS];
+
+line_cache_stats cache_stats;
+
+static bool emit(code_block* cb, int* cap, bc_instr ins) {
+  if (cb->count == *cap) {
+    int new_cap = *cap ? 2 * *cap : 8;
+    bc_instr* grown = realloc(cb->code, (size_t)new_cap * sizeof *grown);
+    if (!grown) return false;
+    cb->code = grown;
+    *cap = new_cap;
+  }
+  cb->code[cb->count++] = ins;
+  return true;
+}
+
+static int add_literal(code_block* cb, int* cap, bc_op op, const char* start, size_t len) {
+  if (cb->literal_count == *cap) {
+    int new_cap = *cap ? 2 * *cap : 4;
+    bc_literal* grown = realloc(cb->literals, (size_t)new_cap * sizeof *grown);
+    if (!grown) return -1;
+    cb->literals = grown;
+    *cap = new_cap;
+  }
+  char* text = malloc(len + 1);
+  if (!text) return -1;
+  memcpy(text, start, len);
+  text[len] = '\0';
+  cb->literals[cb->literal_count] = (bc_literal){op, text, len, NULL};
+  return cb->literal_count++;
+}
+
+// Translate one token; returns false if it produces no instruction
+static bool translate(const Token* tok, bc_instr* ins) {
+  switch (tok->type) {
+  case TOK_EOF:                ins->op = BC_END; return true;
+  case TOK_NUMBER:             ins->op = BC_PUSH_REAL; ins->number = tok->number; return true;
+  case TOK_COMPLEX:
+    ins->op = BC_PUSH_COMPLEX;
+    ins->z.re = tok->z.re;
+    ins->z.im = tok->z.im;
+    return true;
+  case TOK_PLUS:               ins->op = BC_ADD; return true;
+  case TOK_MINUS:              ins->op = BC_SUB; return true;
+  case TOK_STAR:               ins->op = BC_MUL; return true;
+  case TOK_SLASH:              ins->op = BC_DIV; return true;
+  case TOK_CARET:              ins->op = BC_POW; return true;
+  case TOK_DOT_STAR:           ins->op = BC_DOT_MUL; return true;
+  case TOK_DOT_SLASH:          ins->op = BC_DOT_DIV; return true;
+  case TOK_DOT_CARET:          ins->op = BC_DOT_POW; return true;
+  case TOK_BRA:                ins->op = BC_ECHO; ins->ch = '<'; return true;
+  case TOK_KET:                ins->op = BC_ECHO; ins->ch = '>'; return true;
+  case TOK_COLON:              ins->op = BC_ECHO; ins->ch = ':'; return true;
+  case TOK_SEMICOLON:          ins->op = BC_ECHO; ins->ch = ';'; return true;
+  case TOK_VERTICAL:           ins->op = BC_ECHO; ins->ch = '|'; return true;
+  case TOK_IDENTIFIER:         ins->op = BC_CALL; ins->sym = tok->sym; return true;
+  case TOK_FUNCTION:
+    // Names without a handler do nothing, so they need no instruction
+    ins->op = BC_BUILTIN;
+    ins->opcode = tok->sym->opcode;
+    ins->fn = builtin_for_opcode(tok->sym->opcode);
+    return ins->fn != NULL;
+  case TOK_UNKNOWN:            ins->op = BC_ILLEGAL; return true;
+  case TOK_STRING:             ins->op = BC_PUSH_STRING; return true;
+  case TOK_MATRIX_FILE:        ins->op = BC_MATRIX_FILE; return true;
+  case TOK_MATRIX_INLINE_REAL: ins->op = BC_PUSH_MATRIX; return true;
+  case TOK_MATRIX_INLINE_COMPLEX:
+  case TOK_MATRIX_INLINE_MIXED:
+    ins->op = BC_PUSH_CMATRIX;
+    return true;
+  }
+  return false;
+}
+
+code_block* compile_line(const char* line) {
+  code_block* cb = calloc(1, sizeof *cb);
+  if (!cb) {
+    fprintf(stderr, "Out of memory compiling line.\n");
+    return NULL;
+  }
+  cb->refs = 1;
+
+  int code_cap = 0, literal_cap = 0;
+  Lexer lexer = {line, 0};
+  Token tok;
+  do {
+    tok = next_token(&lexer);
+    if (tok.type != TOK_EOF) cb->token_count++;
+
+    bc_instr ins = {.opcode = -1};
+    if (!translate(&tok, &ins)) continue;
+    bool ok = true;
+    if (ins.op == BC_PUSH_STRING || ins.op == BC_MATRIX_FILE ||
+        ins.op == BC_PUSH_MATRIX || ins.op == BC_PUSH_CMATRIX) {
+      ins.literal = add_literal(cb, &literal_cap, ins.op, tok.start, tok.len);
+      ok = ins.literal >= 0;
+    }
+    if (!ok || !emit(cb, &code_cap, ins)) {
+      fprintf(stderr, "Out of memory compiling line.\n");
+      release_code(cb);
+      return NULL;
+    }
+  } while (tok.type != TOK_EOF);
+  peephole_optimize(cb);
+  specialize_code(cb);
+  return cb;
+}
+
+void retain_code(code_block* code) {
+  code->refs++;
+}
+
+void release_code(code_block* code) {
+  if (!code || --code->refs > 0) return;
+  for (int i = 0; i < code->literal_count; i++) {
+    bc_literal* lit = &code->literals[i];
+    if (lit->value && lit->op == BC_PUSH_MATRIX) matrix_release(lit->value);
+    if (lit->value && lit->op == BC_PUSH_CMATRIX) matrix_complex_release(lit->value);
+    free(lit->text);
+  }
+  free(code->literals);
+  free(code->fast);
+  free(code->code);
+  free(code);
+}
+
+void flush_line_cache(void) {
+  for (int b = 0; b < LINE_CACHE_BUCKETS; b++) {
+    cached_line* e = line_cache[b];
+    while (e) {
+      cached_line* next = e->next;
+      release_code(e->code);
+      free(e->text);
+      free(e);
+      e = next;
+    }
+    line_cache[b] = NULL;
+  }
+  cache_stats.flushes++;
+}
+
+code_block* cached_compile_line(const char* line) {
+  size_t len = strlen(line);
+  uint32_t hash = opcode_hash(0, line, len);
+  cached_line** bucket = &line_cache[hash % LINE_CACHE_BUCKETS];
+
+  int ways = 0;
+  for (cached_line** link = bucket; *link; link = &(*link)->next, ways++) {
+    cached_line* e = *link;
+    if (e->hash == hash && !strcmp(e->text, line)) {
+      cache_stats.hits++;
+      *link = e->next;   // to the front
+      e->next = *bucket;
+      *bucket = e;
+      retain_code(e->code);
+      return e->code;
+    }
+  }
+
+  cache_stats.misses++;
+  code_block* code = compile_line(line);
+  if (!code) return NULL;
+
+  if (ways >= LINE_CACHE_WAYS) {
+    cached_line** link = bucket;
+    while ((*link)->next) link = &(*link)->next;
+    release_code((*link)->code);
+    free((*link)->text);
+    free(*link);
+    *link = NULL;
+    cache_stats.evictions++;
+  }
+  cached_line* e = malloc(sizeof *e);
+  char* text = malloc(len + 1);
+  if (!e || !text) {   // still runs, it just is not remembered
+    free(e);
+    free(text);
+    return code;
+  }
+  memcpy(text, line, len + 1);
+  *e = (cached_line){hash, text, code, *bucket};
+  *bucket = e;
+  retain_code(code);   // one reference for the cache, one for the caller
+  return code;
+}
@@ -0,0 +1,602 @@
+/*
+ * This file is part of Mico's toy RPN Calculator
+ *
+ * Mico's toy RPN Calculator is free software:
+ * you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mico's toy RPN Calculator is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mico's toy RPN Calculator. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <math.h>
+#include <gsl/gsl_complex_math.h>
+#include "elementwise.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HAVE_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
+typedef void (*vv_kernel)(double* d, const double* x, const double* y, size_t n);
+typedef void (*vs_kernel)(double* d, const double* x, double s, size_t n);
+typedef void (*sv_kernel)(double* d, double s, const double* x, size_t n);
+typedef void (*cs_kernel)(double* d, const double* x, double sr, double si, size_t n);
+typedef void (*r2c_const_kernel)(double* d, const double* x, double p, double q, double k, size_t n);
+typedef void (*r2c_affine_kernel)(double* d, const double* x, double p, double q,
+                                  double r, double t, size_t n);
+
+typedef struct {
+  vv_kernel vv[EW_OP_COUNT];
+  vs_kernel vs[EW_OP_COUNT];
+  sv_kernel sv[EW_OP_COUNT];
+  // Interleaved complex storage, n counting complex elements
+  vv_kernel cvv[EW_OP_COUNT];
+  cs_kernel cvs[EW_OP_COUNT];   // x op s
+  cs_kernel csv[EW_OP_COUNT];   // s op x
+  // Real v promoted to (v, 0) on the fly, n counting reals
+  r2c_const_kernel r2c_const;     // re = v p + q, im = k
+  r2c_affine_kernel r2c_affine;   // re = v p + q, im = v r + t
+} ew_kernels;
+
+// One kernel per shape and operation: full vectors, then a scalar tail.
+// vop is the vector form of the C operator sop. leave runs on the way
+// out; the wide levels clear the upper register halves there, or the
+// SSE code of the caller stalls on them.
+#define VV_KERNEL(name, attr, vec, w, load, store, set1, leave, vop, sop)     \
+  attr static void name(double* d, const double* x, const double* y, size_t n) { \
+    size_t i = 0;                                                             \
+    for (; i + w <= n; i += w) store(d + i, vop(load(x + i), load(y + i)));   \
+    for (; i < n; i++) d[i] = x[i] sop y[i];                                  \
+    leave;                                                                    \
+  }
+
+#define VS_KERNEL(name, attr, vec, w, load, store, set1, leave, vop, sop)     \
+  attr static void name(double* d, const double* x, double s, size_t n) {     \
+    size_t i = 0;                                                             \
+    vec v = set1(s);                                                          \
+    for (; i + w <= n; i += w) store(d + i, vop(load(x + i), v));             \
+    for (; i < n; i++) d[i] = x[i] sop s;                                     \
+    leave;                                                                    \
+  }
+
+#define SV_KERNEL(name, attr, vec, w, load, store, set1, leave, vop, sop)     \
+  attr static void name(double* d, double s, const double* x, size_t n) {     \
+    size_t i = 0;                                                             \
+    vec v = set1(s);                                                          \
+    for (; i + w <= n; i += w) store(d + i, vop(v, load(x + i)));             \
+    for (; i < n; i++) d[i] = s sop x[i];                                     \
+    leave;                                                                    \
+  }
+
+// pow has no vector instruction; every level shares these
+static void pow_vv(double* d, const double* x, const double* y, size_t n) {
+  for (size_t i = 0; i < n; i++) d[i] = pow(x[i], y[i]);
+}
+
+static void pow_vs(double* d, const double* x, double s, size_t n) {
+  for (size_t i = 0; i < n; i++) d[i] = pow(x[i], s);
+}
+
+static void pow_sv(double* d, double s, const double* x, size_t n) {
+  for (size_t i = 0; i < n; i++) d[i] = pow(s, x[i]);
+}
+
+#define REAL_KERNELS(level, attr, vec, w, load, store, set1, leave, add, sub, mul, div) \
+  VV_KERNEL(level##_vv_add, attr, vec, w, load, store, set1, leave, add, +)   \
+  VV_KERNEL(level##_vv_sub, attr, vec, w, load, store, set1, leave, sub, -)   \
+  VV_KERNEL(level##_vv_mul, attr, vec, w, load, store, set1, leave, mul, *)   \
+  VV_KERNEL(level##_vv_div, attr, vec, w, load, store, set1, leave, div, /)   \
+  VS_KERNEL(level##_vs_add, attr, vec, w, load, store, set1, leave, add, +)   \
+  VS_KERNEL(level##_vs_sub, attr, vec, w, load, store, set1, leave, sub, -)   \
+  VS_KERNEL(level##_vs_mul, attr, vec, w, load, store, set1, leave, mul, *)   \
+  VS_KERNEL(level##_vs_div, attr, vec, w, load, store, set1, leave, div, /)   \
+  SV_KERNEL(level##_sv_add, attr, vec, w, load, store, set1, leave, add, +)   \
+  SV_KERNEL(level##_sv_sub, attr, vec, w, load, store, set1, leave, sub, -)   \
+  SV_KERNEL(level##_sv_mul, attr, vec, w, load, store, set1, leave, mul, *)   \
+  SV_KERNEL(level##_sv_div, attr, vec, w, load, store, set1, leave, div, /)
+
+// Plain C, one element per step; the compiler may still vectorize it
+#define S_LOAD(p) (*(p))
+#define S_STORE(p, v) (*(p) = (v))
+#define S_SET1(s) (s)
+#define S_ADD(a, b) ((a) + (b))
+#define S_SUB(a, b) ((a) - (b))
+#define S_MUL(a, b) ((a) * (b))
+#define S_DIV(a, b) ((a) / (b))
+REAL_KERNELS(scalar, , double, 1, S_LOAD, S_STORE, S_SET1, (void)0, S_ADD, S_SUB, S_MUL, S_DIV)
+
+// Complex kernels work on interleaved (re, im) pairs. Every formula is
+// the one gsl_complex_mul, gsl_complex_div and friends use, term for
+// term, so results match what the old per-element GSL calls gave. The
+// vector forms negate a product by multiplying it by -1, which is exact.
+
+static void scalar_c_add_vv(double* d, const double* x, const double* y, size_t n) {
+  scalar_vv_add(d, x, y, 2 * n);
+}
+
+static void scalar_c_sub_vv(double* d, const double* x, const double* y, size_t n) {
+  scalar_vv_sub(d, x, y, 2 * n);
+}
+
+static void scalar_c_mul_vv(double* d, const double* x, const double* y, size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    double xr = x[2 * i], xi = x[2 * i + 1], yr = y[2 * i], yi = y[2 * i + 1];
+    d[2 * i] = xr * yr - xi * yi;
+    d[2 * i + 1] = xr * yi + xi * yr;
+  }
+}
+
+static void scalar_c_add_vs(double* d, const double* x, double sr, double si, size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    d[2 * i] = x[2 * i] + sr;
+    d[2 * i + 1] = x[2 * i + 1] + si;
+  }
+}
+
+static void scalar_c_sub_vs(double* d, const double* x, double sr, double si, size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    d[2 * i] = x[2 * i] - sr;
+    d[2 * i + 1] = x[2 * i + 1] - si;
+  }
+}
+
+static void scalar_c_sub_sv(double* d, const double* x, double sr, double si, size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    d[2 * i] = sr - x[2 * i];
+    d[2 * i + 1] = si - x[2 * i + 1];
+  }
+}
+
+static void scalar_c_mul_vs(double* d, const double* x, double sr, double si, size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    double xr = x[2 * i], xi = x[2 * i + 1];
+    d[2 * i] = xr * sr - xi * si;
+    d[2 * i + 1] = xr * si + xi * sr;
+  }
+}
+
+// Subtracting a NaN hands it back unchanged, so a kernel that turns "- c"
+// into "+ minus(c)" flips the sign only on numbers
+static double minus(double c) {
+  return isnan(c) ? c : -c;
+}
+
+// s = 1 / |b|, scaled by s before and after, as gsl_complex_div does
+static void c_div1(double* z, double ar, double ai, double br, double bi) {
+  double s = 1.0 / hypot(br, bi);
+  double sbr = s * br, sbi = s * bi;
+  z[0] = (ar * sbr + ai * sbi) * s;
+  z[1] = (ai * sbr - ar * sbi) * s;
+}
+
+static void scalar_c_div_vs(double* d, const double* x, double sr, double si, size_t n) {
+  for (size_t i = 0; i < n; i++) c_div1(d + 2 * i, x[2 * i], x[2 * i + 1], sr, si);
+}
+
+static void scalar_r2c_const(double* d, const double* x, double p, double q, double k, size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    d[2 * i] = x[i] * p + q;
+    d[2 * i + 1] = k;
+  }
+}
+
+static void scalar_r2c_affine(double* d, const double* x, double p, double q,
+                              double r, double t, size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    d[2 * i] = x[i] * p + q;
+    d[2 * i + 1] = x[i] * r + t;
+  }
+}
+
+// Division by a varying complex needs hypot per element, and pow a
+// complex log and exp; every level shares these
+static void c_div_vv(double* d, const double* x, const double* y, size_t n) {
+  for (size_t i = 0; i < n; i++) c_div1(d + 2 * i, x[2 * i], x[2 * i + 1], y[2 * i], y[2 * i + 1]);
+}
+
+static void c_div_sv(double* d, const double* x, double sr, double si, size_t n) {
+  for (size_t i = 0; i < n; i++) c_div1(d + 2 * i, sr, si, x[2 * i], x[2 * i + 1]);
+}
+
+static void c_pow_vv(double* d, const double* x, const double* y, size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    gsl_complex r = gsl_complex_pow(gsl_complex_rect(x[2 * i], x[2 * i + 1]),
+                                    gsl_complex_rect(y[2 * i], y[2 * i + 1]));
+    d[2 * i] = GSL_REAL(r);
+    d[2 * i + 1] = GSL_IMAG(r);
+  }
+}
+
+static void c_pow_vs(double* d, const double* x, double sr, double si, size_t n) {
+  gsl_complex s = gsl_complex_rect(sr, si);
+  for (size_t i = 0; i < n; i++) {
+    gsl_complex r = gsl_complex_pow(gsl_complex_rect(x[2 * i], x[2 * i + 1]), s);
+    d[2 * i] = GSL_REAL(r);
+    d[2 * i + 1] = GSL_IMAG(r);
+  }
+}
+
+static void c_pow_sv(double* d, const double* x, double sr, double si, size_t n) {
+  gsl_complex s = gsl_complex_rect(sr, si);
+  for (size_t i = 0; i < n; i++) {
+    gsl_complex r = gsl_complex_pow(s, gsl_complex_rect(x[2 * i], x[2 * i + 1]));
+    d[2 * i] = GSL_REAL(r);
+    d[2 * i + 1] = GSL_IMAG(r);
+  }
+}
+
+// Real x against complex s, n counting reals
+static void r2c_div_vs(double* d, const double* x, double sr, double si, size_t n) {
+  for (size_t i = 0; i < n; i++) c_div1(d + 2 * i, x[i], 0.0, sr, si);
+}
+
+static void r2c_div_sv(double* d, const double* x, double sr, double si, size_t n) {
+  for (size_t i = 0; i < n; i++) c_div1(d + 2 * i, sr, si, x[i], 0.0);
+}
+
+static void r2c_pow_vs(double* d, const double* x, double sr, double si, size_t n) {
+  gsl_complex s = gsl_complex_rect(sr, si);
+  for (size_t i = 0; i < n; i++) {
+    gsl_complex r = gsl_complex_pow(gsl_complex_rect(x[i], 0.0), s);
+    d[2 * i] = GSL_REAL(r);
+    d[2 * i + 1] = GSL_IMAG(r);
+  }
+}
+
+static void r2c_pow_sv(double* d, const double* x, double sr, double si, size_t n) {
+  gsl_complex s = gsl_complex_rect(sr, si);
+  for (size_t i = 0; i < n; i++) {
+    gsl_complex r = gsl_complex_pow(s, gsl_complex_rect(x[i], 0.0));
+    d[2 * i] = GSL_REAL(r);
+    d[2 * i + 1] = GSL_IMAG(r);
+  }
+}
+
+// Vector forms of the scalar_c_* kernels; the tail goes to those. swap
+// exchanges re and im within each pair, duplo and duphi broadcast the
+// re or im of each pair to both halves, and set2 repeats one (re, im)
+// pair.
+#define COMPLEX_KERNELS(level, attr, vec, w, load, store, set1, set2, leave,   \
+                        add, sub, mul, swap, duplo, duphi)                    \
+  static void level##_c_add_vv(double* d, const double* x, const double* y, size_t n) { \
+    level##_vv_add(d, x, y, 2 * n);                                           \
+  }                                                                           \
+  static void level##_c_sub_vv(double* d, const double* x, const double* y, size_t n) { \
+    level##_vv_sub(d, x, y, 2 * n);                                           \
+  }                                                                           \
+  attr static void level##_c_mul_vv(double* d, const double* x, const double* y, size_t n) { \
+    vec sign = set2(-1.0, 1.0);                                               \
+    size_t i = 0;                                                             \
+    for (; 2 * (n - i) >= w; i += w / 2) {                                    \
+      vec a = load(x + 2 * i), b = load(y + 2 * i);                           \
+      store(d + 2 * i, add(mul(a, duplo(b)), mul(mul(swap(a), duphi(b)), sign))); \
+    }                                                                         \
+    leave;                                                                    \
+    scalar_c_mul_vv(d + 2 * i, x + 2 * i, y + 2 * i, n - i);                  \
+  }                                                                           \
+  attr static void level##_c_mul_vs(double* d, const double* x, double sr, double si, size_t n) { \
+    vec re = set1(sr), im = set2(minus(si), si);                              \
+    size_t i = 0;                                                             \
+    for (; 2 * (n - i) >= w; i += w / 2) {                                    \
+      vec a = load(x + 2 * i);                                                \
+      store(d + 2 * i, add(mul(a, re), mul(swap(a), im)));                    \
+    }                                                                         \
+    leave;                                                                    \
+    scalar_c_mul_vs(d + 2 * i, x + 2 * i, sr, si, n - i);                     \
+  }                                                                           \
+  attr static void level##_c_div_vs(double* d, const double* x, double sr, double si, size_t n) { \
+    double s = 1.0 / hypot(sr, si);                                           \
+    vec vs = set1(s), br = set1(s * sr), bi = set2(s * si, minus(s * si));    \
+    size_t i = 0;                                                             \
+    for (; 2 * (n - i) >= w; i += w / 2) {                                    \
+      vec a = load(x + 2 * i);                                                \
+      store(d + 2 * i, mul(add(mul(a, br), mul(swap(a), bi)), vs));          \
+    }                                                                         \
+    leave;                                                                    \
+    scalar_c_div_vs(d + 2 * i, x + 2 * i, sr, si, n - i);                     \
+  }                                                                           \
+  attr static void level##_c_add_vs(double* d, const double* x, double sr, double si, size_t n) { \
+    vec p = set2(sr, si);                                                     \
+    size_t i = 0;                                                             \
+    for (; 2 * (n - i) >= w; i += w / 2) store(d + 2 * i, add(load(x + 2 * i), p)); \
+    leave;                                                                    \
+    scalar_c_add_vs(d + 2 * i, x + 2 * i, sr, si, n - i);                     \
+  }                                                                           \
+  attr static void level##_c_sub_vs(double* d, const double* x, double sr, double si, size_t n) { \
+    vec p = set2(sr, si);                                                     \
+    size_t i = 0;                                                             \
+    for (; 2 * (n - i) >= w; i += w / 2) store(d + 2 * i, sub(load(x + 2 * i), p)); \
+    leave;                                                                    \
+    scalar_c_sub_vs(d + 2 * i, x + 2 * i, sr, si, n - i);                     \
+  }                                                                           \
+  attr static void level##_c_sub_sv(double* d, const double* x, double sr, double si, size_t n) { \
+    vec p = set2(sr, si);                                                     \
+    size_t i = 0;                                                             \
+    for (; 2 * (n - i) >= w; i += w / 2) store(d + 2 * i, sub(p, load(x + 2 * i))); \
+    leave;                                                                    \
+    scalar_c_sub_sv(d + 2 * i, x + 2 * i, sr, si, n - i);                     \
+  }
+
+// Real v promoted on the fly; store_pairs interleaves a vector of re
+// with a vector of im
+#define R2C_KERNEL(level, attr, vec, w, load, set1, leave, add, mul, store_pairs) \
+  attr static void level##_r2c_affine(double* d, const double* x, double p, double q, \
+                                      double r, double t, size_t n) {         \
+    vec vp = set1(p), vq = set1(q), vr = set1(r), vt = set1(t);               \
+    size_t i = 0;                                                             \
+    for (; i + w <= n; i += w) {                                              \
+      vec v = load(x + i);                                                    \
+      store_pairs(d + 2 * i, add(mul(v, vp), vq), add(mul(v, vr), vt));       \
+    }                                                                         \
+    leave;                                                                    \
+    scalar_r2c_affine(d + 2 * i, x + i, p, q, r, t, n - i);                   \
+  }
+
+// The table of one level, with the promoting kernels it uses
+#define LEVEL_TABLE(level, r2c_const_k, r2c_affine_k)                         \
+  static const ew_kernels level##_kernels = {                                 \
+    .vv  = { [EW_ADD] = level##_vv_add, [EW_SUB] = level##_vv_sub,            \
+             [EW_MUL] = level##_vv_mul, [EW_DIV] = level##_vv_div, [EW_POW] = pow_vv }, \
+    .vs  = { [EW_ADD] = level##_vs_add, [EW_SUB] = level##_vs_sub,            \
+             [EW_MUL] = level##_vs_mul, [EW_DIV] = level##_vs_div, [EW_POW] = pow_vs }, \
+    .sv  = { [EW_ADD] = level##_sv_add, [EW_SUB] = level##_sv_sub,            \
+             [EW_MUL] = level##_sv_mul, [EW_DIV] = level##_sv_div, [EW_POW] = pow_sv }, \
+    .cvv = { [EW_ADD] = level##_c_add_vv, [EW_SUB] = level##_c_sub_vv,        \
+             [EW_MUL] = level##_c_mul_vv, [EW_DIV] = c_div_vv, [EW_POW] = c_pow_vv }, \
+    .cvs = { [EW_ADD] = level##_c_add_vs, [EW_SUB] = level##_c_sub_vs,        \
+             [EW_MUL] = level##_c_mul_vs, [EW_DIV] = level##_c_div_vs, [EW_POW] = c_pow_vs }, \
+    .csv = { [EW_ADD] = level##_c_add_vs, [EW_SUB] = level##_c_sub_sv,        \
+             [EW_MUL] = level##_c_mul_vs, [EW_DIV] = c_div_sv, [EW_POW] = c_pow_sv }, \
+    .r2c_const = r2c_const_k,                                                 \
+    .r2c_affine = r2c_affine_k,                                               \
+  };
+
+LEVEL_TABLE(scalar, scalar_r2c_const, scalar_r2c_affine)
+
+#ifdef HAVE_X86_SIMD
+static inline __attribute__((target("sse2")))
+void sse2_store_pairs(double* d, __m128d re, __m128d im) {
+  _mm_storeu_pd(d, _mm_unpacklo_pd(re, im));
+  _mm_storeu_pd(d + 2, _mm_unpackhi_pd(re, im));
+}
+
+// unpack works within 128-bit lanes; put the lanes back in order
+static inline __attribute__((target("avx2")))
+void avx2_store_pairs(double* d, __m256d re, __m256d im) {
+  __m256d lo = _mm256_unpacklo_pd(re, im), hi = _mm256_unpackhi_pd(re, im);
+  _mm256_storeu_pd(d, _mm256_permute2f128_pd(lo, hi, 0x20));
+  _mm256_storeu_pd(d + 4, _mm256_permute2f128_pd(lo, hi, 0x31));
+}
+
+#define SSE2_SWAP(a) _mm_shuffle_pd(a, a, 1)
+#define SSE2_DUPLO(a) _mm_unpacklo_pd(a, a)
+#define SSE2_DUPHI(a) _mm_unpackhi_pd(a, a)
+#define SSE2_SET2(re, im) _mm_set_pd(im, re)
+#define AVX2_SWAP(a) _mm256_permute_pd(a, 0x5)
+#define AVX2_DUPLO(a) _mm256_permute_pd(a, 0x0)
+#define AVX2_DUPHI(a) _mm256_permute_pd(a, 0xF)
+#define AVX2_SET2(re, im) _mm256_set_pd(im, re, im, re)
+#define AVX512_SWAP(a) _mm512_permute_pd(a, 0x55)
+#define AVX512_DUPLO(a) _mm512_permute_pd(a, 0x00)
+#define AVX512_DUPHI(a) _mm512_permute_pd(a, 0xFF)
+#define AVX512_SET2(re, im) _mm512_set_pd(im, re, im, re, im, re, im, re)
+
+// Promoting with a constant imaginary part (A + w, A - w) is no faster
+// in intrinsics than the optimized scalar loop, and the 512-bit
+// promotion is slower than the 256-bit one; bench_elementwise shows both
+REAL_KERNELS(sse2, __attribute__((target("sse2"))), __m128d, 2,
+             _mm_loadu_pd, _mm_storeu_pd, _mm_set1_pd, (void)0,
+             _mm_add_pd, _mm_sub_pd, _mm_mul_pd, _mm_div_pd)
+COMPLEX_KERNELS(sse2, __attribute__((target("sse2"))), __m128d, 2,
+                _mm_loadu_pd, _mm_storeu_pd, _mm_set1_pd, SSE2_SET2, (void)0,
+                _mm_add_pd, _mm_sub_pd, _mm_mul_pd,
+                SSE2_SWAP, SSE2_DUPLO, SSE2_DUPHI)
+R2C_KERNEL(sse2, __attribute__((target("sse2"))), __m128d, 2,
+           _mm_loadu_pd, _mm_set1_pd, (void)0, _mm_add_pd, _mm_mul_pd, sse2_store_pairs)
+LEVEL_TABLE(sse2, scalar_r2c_const, sse2_r2c_affine)
+
+REAL_KERNELS(avx2, __attribute__((target("avx2"))), __m256d, 4,
+             _mm256_loadu_pd, _mm256_storeu_pd, _mm256_set1_pd, _mm256_zeroupper(),
+             _mm256_add_pd, _mm256_sub_pd, _mm256_mul_pd, _mm256_div_pd)
+COMPLEX_KERNELS(avx2, __attribute__((target("avx2"))), __m256d, 4,
+                _mm256_loadu_pd, _mm256_storeu_pd, _mm256_set1_pd, AVX2_SET2, _mm256_zeroupper(),
+                _mm256_add_pd, _mm256_sub_pd, _mm256_mul_pd,
+                AVX2_SWAP, AVX2_DUPLO, AVX2_DUPHI)
+R2C_KERNEL(avx2, __attribute__((target("avx2"))), __m256d, 4,
+           _mm256_loadu_pd, _mm256_set1_pd, _mm256_zeroupper(),
+           _mm256_add_pd, _mm256_mul_pd, avx2_store_pairs)
+LEVEL_TABLE(avx2, scalar_r2c_const, avx2_r2c_affine)
+
+REAL_KERNELS(avx512, __attribute__((target("avx512f"))), __m512d, 8,
+             _mm512_loadu_pd, _mm512_storeu_pd, _mm512_set1_pd, _mm256_zeroupper(),
+             _mm512_add_pd, _mm512_sub_pd, _mm512_mul_pd, _mm512_div_pd)
+COMPLEX_KERNELS(avx512, __attribute__((target("avx512f"))), __m512d, 8,
+                _mm512_loadu_pd, _mm512_storeu_pd, _mm512_set1_pd, AVX512_SET2, _mm256_zeroupper(),
+                _mm512_add_pd, _mm512_sub_pd, _mm512_mul_pd,
+                AVX512_SWAP, AVX512_DUPLO, AVX512_DUPHI)
+LEVEL_TABLE(avx512, scalar_r2c_const, avx2_r2c_affine)
+#endif
+
+static const ew_kernels* const level_kernels[SIMD_LEVELS] = {
+  [SIMD_SCALAR] = &scalar_kernels,
+#ifdef HAVE_X86_SIMD
+  [SIMD_SSE2]   = &sse2_kernels,
+  [SIMD_AVX2]   = &avx2_kernels,
+  [SIMD_AVX512] = &avx512_kernels,
+#endif
+};
+
+static const char* const level_names[SIMD_LEVELS] = {
+  [SIMD_SCALAR] = "scalar",
+  [SIMD_SSE2]   = "sse2",
+  [SIMD_AVX2]   = "avx2",
+  [SIMD_AVX512] = "avx512",
+};
+
+static const ew_kernels* active;
+static simd_level active_level;
+
+simd_level simd_best_level(void) {
+#ifdef HAVE_X86_SIMD
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f")) return SIMD_AVX512;
+  if (__builtin_cpu_supports("avx2")) return SIMD_AVX2;
+  if (__builtin_cpu_supports("sse2")) return SIMD_SSE2;
+#endif
+  return SIMD_SCALAR;
+}
+
+simd_level simd_use_level(simd_level level) {
+  simd_level best = simd_best_level();
+  if (level > best) level = best;
+  active = level_kernels[level];
+  active_level = level;
+  return level;
+}
+
+const char* simd_level_name(simd_level level) {
+  return level < SIMD_LEVELS ? level_names[level] : "?";
+}
+
+static const ew_kernels* kernels(void) {
+  if (!active) simd_use_level(SIMD_AVX512);
+  return active;
+}
+
+simd_level simd_current_level(void) {
+  kernels();
+  return active_level;
+}
+
+static bool unpadded(const gsl_matrix* m) {
+  return m->tda == m->size2;
+}
+
+static bool unpadded_complex(const gsl_matrix_complex* m) {
+  return m->tda == m->size2;
+}
+
+// Rows are run one kernel call each, or the whole block as one row
+void ew_matrix_matrix(ew_op op, gsl_matrix* dst, const gsl_matrix* x, const gsl_matrix* y) {
+  vv_kernel k = kernels()->vv[op];
+  size_t rows = dst->size1, cols = dst->size2;
+  if (unpadded(dst) && unpadded(x) && unpadded(y)) {
+    cols *= rows;
+    rows = 1;
+  }
+  for (size_t i = 0; i < rows; i++)
+    k(dst->data + i * dst->tda, x->data + i * x->tda, y->data + i * y->tda, cols);
+}
+
+void ew_matrix_scalar(ew_op op, gsl_matrix* dst, const gsl_matrix* x, double s) {
+  vs_kernel k = kernels()->vs[op];
+  size_t rows = dst->size1, cols = dst->size2;
+  if (unpadded(dst) && unpadded(x)) {
+    cols *= rows;
+    rows = 1;
+  }
+  for (size_t i = 0; i < rows; i++)
+    k(dst->data + i * dst->tda, x->data + i * x->tda, s, cols);
+}
+
+void ew_scalar_matrix(ew_op op, gsl_matrix* dst, double s, const gsl_matrix* x) {
+  sv_kernel k = kernels()->sv[op];
+  size_t rows = dst->size1, cols = dst->size2;
+  if (unpadded(dst) && unpadded(x)) {
+    cols *= rows;
+    rows = 1;
+  }
+  for (size_t i = 0; i < rows; i++)
+    k(dst->data + i * dst->tda, s, x->data + i * x->tda, cols);
+}
+
+void ew_complex_matrix_matrix(ew_op op, gsl_matrix_complex* dst,
+                              const gsl_matrix_complex* x, const gsl_matrix_complex* y) {
+  vv_kernel k = kernels()->cvv[op];
+  size_t rows = dst->size1, cols = dst->size2;
+  if (unpadded_complex(dst) && unpadded_complex(x) && unpadded_complex(y)) {
+    cols *= rows;
+    rows = 1;
+  }
+  for (size_t i = 0; i < rows; i++)
+    k(dst->data + 2 * i * dst->tda, x->data + 2 * i * x->tda, y->data + 2 * i * y->tda, cols);
+}
+
+static void complex_with_scalar(cs_kernel k, gsl_matrix_complex* dst,
+                                const gsl_matrix_complex* x, gsl_complex s) {
+  size_t rows = dst->size1, cols = dst->size2;
+  if (unpadded_complex(dst) && unpadded_complex(x)) {
+    cols *= rows;
+    rows = 1;
+  }
+  for (size_t i = 0; i < rows; i++)
+    k(dst->data + 2 * i * dst->tda, x->data + 2 * i * x->tda, GSL_REAL(s), GSL_IMAG(s), cols);
+}
+
+void ew_complex_matrix_scalar(ew_op op, gsl_matrix_complex* dst,
+                              const gsl_matrix_complex* x, gsl_complex s) {
+  complex_with_scalar(kernels()->cvs[op], dst, x, s);
+}
+
+void ew_complex_scalar_matrix(ew_op op, gsl_matrix_complex* dst,
+                              gsl_complex s, const gsl_matrix_complex* x) {
+  complex_with_scalar(kernels()->csv[op], dst, x, s);
+}
+
+// One row of real x against complex s, in either order. The constants
+// reproduce what gsl_complex_add, _sub and _mul do with (v, 0):
+//   (v, 0) + s = (v + sr, 0 + si)      s - (v, 0) = (sr - v, si - 0)
+//   (v, 0) - s = (v - sr, 0 - si)      (v, 0) s = (v sr - 0 si, v si + 0 sr)
+static void promoted_row(ew_op op, bool scalar_first, double* d, const double* x,
+                         double sr, double si, size_t n) {
+  const ew_kernels* k = kernels();
+  switch (op) {
+  case EW_ADD:
+    k->r2c_const(d, x, 1.0, sr, 0.0 + si, n);
+    break;
+  case EW_SUB:
+    if (scalar_first) k->r2c_const(d, x, -1.0, sr, si - 0.0, n);
+    else k->r2c_const(d, x, 1.0, minus(sr), 0.0 - si, n);
+    break;
+  case EW_MUL:
+    k->r2c_affine(d, x, sr, minus(0.0 * si), si, 0.0 * sr, n);
+    break;
+  case EW_DIV:
+    (scalar_first ? r2c_div_sv : r2c_div_vs)(d, x, sr, si, n);
+    break;
+  default:
+    (scalar_first ? r2c_pow_sv : r2c_pow_vs)(d, x, sr, si, n);
+  }
+}
+
+static void promoted(ew_op op, bool scalar_first, gsl_matrix_complex* dst,
+                     const gsl_matrix* x, gsl_complex s) {
+  size_t rows = dst->size1, cols = dst->size2;
+  if (unpadded_complex(dst) && unpadded(x)) {
+    cols *= rows;
+    rows = 1;
+  }
+  for (size_t i = 0; i < rows; i++)
+    promoted_row(op, scalar_first, dst->data + 2 * i * dst->tda, x->data + i * x->tda,
+                 GSL_REAL(s), GSL_IMAG(s), cols);
+}
+
+void ew_real_matrix_complex_scalar(ew_op op, gsl_matrix_complex* dst,
+                                   const gsl_matrix* x, gsl_complex s) {
+  promoted(op, false, dst, x, s);
+}
+
+void ew_complex_scalar_real_matrix(ew_op op, gsl_matrix_complex* dst,
+                                   gsl_complex s, const gsl_matrix* x) {
+  promoted(op, true, dst, x, s);
+}
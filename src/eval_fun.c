@@ -47,127 +47,589 @@
 #include "words.h"
 #include "run_machine.h"
 #include "integration_and_zeros.h"
+#include "symbols.h"
+#include "opcodes.h"
+#include "globals.h"
+#include "peephole.h"
+#include "undo.h"
+#include "mem_account.h"
+#include "spill.h"
+#include "named_stacks.h"
 
-typedef void (*unary_func)(Stack *stack);
-
-typedef struct {
-  const char* name;
-  unary_func func;
-} immutable_unary_op;
-
-static const immutable_unary_op immutable_unary_ops[] = {
-  {"sin",   sin_wrapper},
-  {"cos",   cos_wrapper},
-  {"tan",   tan_wrapper},
-  {"asin",  asin_wrapper},
-  {"acos",  acos_wrapper},
-  {"atan",  atan_wrapper},
-  {"sinh",  sinh_wrapper},
-  {"cosh",  cosh_wrapper},
-  {"tanh",  tanh_wrapper},
-  {"asinh", asinh_wrapper},
-  {"acosh", acosh_wrapper},
-  {"atanh", atanh_wrapper},
-  {"exp",   exp_wrapper},
-  {"chs",   chs_wrapper},
-  {"inv",   inv_wrapper},
-  {NULL,    NULL}
-};
+// **************** Adapters for builtins with other signatures ****************
+#define DEFINE_STACK_OP(name, call)  static void name(Stack* stack) { call; }
 
-typedef struct {
-  const char* name;
-  const char* axis;
-  const char* operation;
-} matrix_reduce_op;
-
-static const matrix_reduce_op reduce_ops[] = {
-  {"cmean", "col", "mean"},
-  {"rmean", "row", "mean"},
-  {"csum",  "col", "sum"},
-  {"rsum",  "row", "sum"},
-  {"cvar",  "col", "var"},
-  {"rvar",  "row", "var"},
-  {"cmin", "col", "min"},
-  {"rmin", "row", "min"},
-  {"cmax",  "col", "max"},
-  {"rmax",  "row", "max"},
-  {NULL, NULL, NULL}
-};
+// Meta level
+static void eval_op(Stack* stack) {
+  if (stack->top < 0) {
+    fprintf(stderr, "Stack is empty: nothing to evaluate.\n");
+    return;
+  }
+  stack_element t = pop(stack);
+  if (t.type != TYPE_STRING) {
+    fprintf(stderr, "Top of stack is not a string: cannot evaluate.\n");
+  } else evaluate_line(stack, element_string(&t));
+  release_element(&t);
+}
+
+static void batch_op(Stack* stack) {
+  if (stack->top < 0) {
+    fprintf(stderr, "Stack is empty: no batch to run.\n");
+    return;
+  }
+  stack_element t = pop(stack);
+  if (t.type != TYPE_STRING) {
+    fprintf(stderr, "Top of stack is not a string: cannot evaluate.\n");
+  } else run_batch(stack, element_string(&t));
+  release_element(&t);
+}
+
+static void run_op(Stack* stack) {
+  if (stack->top < 0) {
+    fprintf(stderr, "Stack is empty: no program to run.\n");
+    return;
+  }
+  stack_element t = pop(stack);
+  if (t.type != TYPE_STRING) {
+    fprintf(stderr, "Top of stack is not a string: cannot evaluate.\n");
+  } else {
+    Program prog = {.count = 0, .label_count = 0};
+    if (!load_program_from_file(element_string(&t), &prog)) {
+      fprintf(stderr, "Failed to load program.\n");
+      release_element(&t);
+      return;
+    }
+    list_program(&prog);
+    run_RPN_code(stack, &prog);
+    free_program(&prog);
+  }
+  release_element(&t);
+}
+
+// Constants
+DEFINE_STACK_OP(gravity_op, push_real(stack, 9.81))
+DEFINE_STACK_OP(pi_op,      push_real(stack, M_PI))
+DEFINE_STACK_OP(e_op,       push_real(stack, exp(1.0)))
+DEFINE_STACK_OP(inf_op,     push_real(stack, INFINITY))
+DEFINE_STACK_OP(nan_op,     push_real(stack, NAN))
+
+// Misc and utility functions
+DEFINE_STACK_OP(help_op,     (void)stack; help_menu())
+DEFINE_STACK_OP(listfcns_op, (void)stack; list_all_functions_sorted())
+DEFINE_STACK_OP(fusions_op,  (void)stack; print_fusion_stats())
+DEFINE_STACK_OP(mem_op,      print_memory_report(stack))
+DEFINE_STACK_OP(clrhist_op,  (void)stack; clear_history())
+DEFINE_STACK_OP(fuck_op,     (void)stack; whose_place())
+DEFINE_STACK_OP(pm_op,       print_matrix(stack); skip_stack_printing = true)
+DEFINE_STACK_OP(ps_op,       print_stack(stack, NULL))
+DEFINE_STACK_OP(print_op,    print_top_scalar(stack))
+DEFINE_STACK_OP(setprec_op,  set_print_precision(stack))
+DEFINE_STACK_OP(sfs_op,      (void)stack; swap_fixed_scientific())
+
+// Date and time functions
+DEFINE_STACK_OP(ddays_op,    delta_days_strings(stack))
+DEFINE_STACK_OP(today_op,    push_today_date(stack))
+DEFINE_STACK_OP(dow_op,      push_weekday_name_from_date_string(stack))
+DEFINE_STACK_OP(dateplus_op, date_plus_days(stack))
+DEFINE_STACK_OP(edmy_op,     extract_day_month_year(stack))
+
+// Stack functions
+DEFINE_STACK_OP(drop_op, pop_and_free(stack))
+DEFINE_STACK_OP(dup_op,  stack_dup(stack))
+DEFINE_STACK_OP(roll_op, stack_roll(stack, 2))
+
+// Comparison and logic functions
+DEFINE_STACK_OP(eq_op,  dot_cmp_top_two(stack, CMP_EQ))
+DEFINE_STACK_OP(neq_op, dot_cmp_top_two(stack, CMP_NE))
+DEFINE_STACK_OP(lt_op,  dot_cmp_top_two(stack, CMP_LT))
+DEFINE_STACK_OP(leq_op, dot_cmp_top_two(stack, CMP_LE))
+DEFINE_STACK_OP(gt_op,  dot_cmp_top_two(stack, CMP_GT))
+DEFINE_STACK_OP(geq_op, dot_cmp_top_two(stack, CMP_GE))
+DEFINE_STACK_OP(and_op, dot_cmp_top_two(stack, CMP_AND))
+DEFINE_STACK_OP(or_op,  dot_cmp_top_two(stack, CMP_OR))
+
+// Register functions
+DEFINE_STACK_OP(pr_op,       (void)stack; show_registers_status())
+DEFINE_STACK_OP(saveregs_op, (void)stack; save_registers_to_file("registers.txt"))
+DEFINE_STACK_OP(loadregs_op, (void)stack; load_registers_from_file("registers.txt"))
+DEFINE_STACK_OP(clregs_op,   (void)stack; free_all_registers())
+
+// Macros and user defined word functions
+DEFINE_STACK_OP(listmacros_op, (void)stack; list_macros())
+DEFINE_STACK_OP(listwords_op,  (void)stack; list_words())
+DEFINE_STACK_OP(loadwords_op,  (void)stack; load_words_from_file())
+DEFINE_STACK_OP(savewords_op,  (void)stack; save_words_to_file())
+DEFINE_STACK_OP(clrwords_op,   (void)stack; clear_words())
+
+// Matrix operations
+DEFINE_STACK_OP(minv_op,      matrix_inverse(stack))
+DEFINE_STACK_OP(pinv_op,      matrix_pseudoinverse(stack))
+DEFINE_STACK_OP(det_op,       matrix_determinant(stack))
+DEFINE_STACK_OP(eig_op,       matrix_eigen_decompose(stack))
+DEFINE_STACK_OP(tran_op,      matrix_transpose(stack))
+DEFINE_STACK_OP(reshape_op,   reshape_matrix(stack))
+DEFINE_STACK_OP(get_aij_op,   select_matrix_element(stack))
+DEFINE_STACK_OP(set_aij_op,   set_matrix_element(stack))
+DEFINE_STACK_OP(split_mat_op, split_matrix(stack))
+DEFINE_STACK_OP(kron_op,      kronecker_top_two(stack))
+DEFINE_STACK_OP(diag_op,      matrix_extract_diagonal(stack))
+DEFINE_STACK_OP(to_diag_op,   make_diag_matrix(stack))
+DEFINE_STACK_OP(chol_op,      matrix_cholesky(stack))
+DEFINE_STACK_OP(svd_op,       matrix_svd(stack))
+DEFINE_STACK_OP(dim_op,       matrix_dimensions(stack))
+DEFINE_STACK_OP(eye_op,       make_unit_matrix(stack))
+DEFINE_STACK_OP(ones_op,      make_matrix_of_ones(stack))
+DEFINE_STACK_OP(rrange_op,    make_row_range(stack))
+DEFINE_STACK_OP(zeroes_op,    make_matrix_of_zeroes(stack))
+DEFINE_STACK_OP(rand_op,      make_random_matrix(stack))
+DEFINE_STACK_OP(randn_op,     make_gaussian_random_matrix(stack))
+DEFINE_STACK_OP(join_v_op,    stack_join_matrix_vertical(stack))
+DEFINE_STACK_OP(join_h_op,    stack_join_matrix_horizontal(stack))
+DEFINE_STACK_OP(cumsum_r_op,  matrix_cumsum_rows(stack))
+DEFINE_STACK_OP(cumsum_c_op,  matrix_cumsum_cols(stack))
+
+// Matrix reduction functions
+DEFINE_STACK_OP(cmean_op, matrix_reduce(stack, "col", "mean"))
+DEFINE_STACK_OP(rmean_op, matrix_reduce(stack, "row", "mean"))
+DEFINE_STACK_OP(csum_op,  matrix_reduce(stack, "col", "sum"))
+DEFINE_STACK_OP(rsum_op,  matrix_reduce(stack, "row", "sum"))
+DEFINE_STACK_OP(cvar_op,  matrix_reduce(stack, "col", "var"))
+DEFINE_STACK_OP(rvar_op,  matrix_reduce(stack, "row", "var"))
+DEFINE_STACK_OP(cmin_op,  matrix_reduce(stack, "col", "min"))
+DEFINE_STACK_OP(rmin_op,  matrix_reduce(stack, "row", "min"))
+DEFINE_STACK_OP(cmax_op,  matrix_reduce(stack, "col", "max"))
+DEFINE_STACK_OP(rmax_op,  matrix_reduce(stack, "row", "max"))
+
+// **************** The opcode table ****************
+// Indexed by the opcodes tools/gen_opcodes.c derives from function_list.c.
+// Names without an entry (e.g. "undo", which the REPL handles, or the
+// program-only tests) are accepted by the lexer and do nothing here.
+static const builtin_func builtins[OP_COUNT] = {
+  [OP_EVAL] = eval_op, [OP_BATCH] = batch_op, [OP_RUN] = run_op,
+
+  [OP_GRAVITY] = gravity_op, [OP_PI] = pi_op, [OP_E] = e_op,
+  [OP_INF] = inf_op, [OP_NAN] = nan_op,
+
+  [OP_HELP] = help_op, [OP_LISTFCNS] = listfcns_op, [OP_FUSIONS] = fusions_op,
+  [OP_MEM] = mem_op, [OP_CLRHIST] = clrhist_op, [OP_FUCK] = fuck_op,
+
+  [OP_PM] = pm_op, [OP_PS] = ps_op, [OP_PRINT] = print_op,
+  [OP_SETPREC] = setprec_op, [OP_SFS] = sfs_op,
+
+  [OP_DDAYS] = ddays_op, [OP_TODAY] = today_op, [OP_DOW] = dow_op,
+  [OP_DATEPLUS] = dateplus_op, [OP_EDMY] = edmy_op,
+
+  [OP_DROP] = drop_op, [OP_CLST] = free_stack, [OP_SWAP] = swap,
+  [OP_DUP] = dup_op, [OP_NIP] = stack_nip, [OP_TUCK] = stack_tuck,
+  [OP_ROLL] = roll_op, [OP_OVER] = stack_over,
+  [OP_SFORK] = stack_fork, [OP_SSWITCH] = stack_switch,
+  [OP_SDROP] = stack_drop_named, [OP_SLIST] = list_named_stacks,
+
+  [OP_ROOTS] = poly_roots, [OP_PVAL] = poly_eval,
+
+  [OP_INTEGRATE] = integrate, [OP_FZERO] = find_zero,
+  [OP_SET_INTG_TOL] = set_integration_precision, [OP_SET_F0_TOL] = set_f0_precision,
+
+  [OP_EQ] = eq_op, [OP_NEQ] = neq_op, [OP_LT] = lt_op, [OP_LEQ] = leq_op,
+  [OP_GT] = gt_op, [OP_GEQ] = geq_op, [OP_AND] = and_op, [OP_OR] = or_op,
+  [OP_NOT] = logical_not_wrapper,
+
+  [OP_NPDF] = npdf_wrapper, [OP_NCDF] = ncdf_wrapper, [OP_NQUANT] = nquant_wrapper,
+  [OP_GAMMA] = gamma_wrapper, [OP_LN_GAMMA] = ln_gamma_wrapper,
+  [OP_BETA] = beta_wrapper, [OP_LN_BETA] = ln_beta_wrapper,
+
+  [OP_FRAC] = frac_wrapper, [OP_INTG] = intg_wrapper,
 
-typedef int (*matrix_func)(Stack*);
-
-typedef struct {
-  const char* name;
-  matrix_func func;
-} matrix_op;
-
-static const matrix_op matrix_ops[] = {
-  {"minv",    matrix_inverse},
-  {"pinv",    matrix_pseudoinverse},
-  {"det",     matrix_determinant},
-  {"eig",     matrix_eigen_decompose},
-  {"tran",    matrix_transpose},
-  {"'",       matrix_transpose},
-  {"reshape", reshape_matrix},
-  {"get_aij", select_matrix_element},
-  {"set_aij", set_matrix_element},
-  {"kron",    kronecker_top_two},
-  {"diag",    matrix_extract_diagonal},
-  {"to_diag", make_diag_matrix},
-  {"chol",    matrix_cholesky},
-  {"svd",     matrix_svd},
-  {"dim",     matrix_dimensions},
-  {"eye",     make_unit_matrix},
-  {"ones",    make_matrix_of_ones},
-  {"rrange",  make_row_range},
-  {"zeroes",  make_matrix_of_zeroes},
-  {"rand",    make_random_matrix},
-  {"randn",   make_gaussian_random_matrix},
-  {"join_v",  stack_join_matrix_vertical},
-  {"join_h",  stack_join_matrix_horizontal},
-  {"cumsum_r",matrix_cumsum_rows},
-  {"cumsum_c",matrix_cumsum_cols},
-  {NULL,      NULL}
+  [OP_FFR] = find_first_free_register, [OP_RCL] = recall_from_register,
+  [OP_STO] = store_to_register, [OP_PR] = pr_op, [OP_SAVEREGS] = saveregs_op,
+  [OP_LOADREGS] = loadregs_op, [OP_CLREGS] = clregs_op,
+
+  [OP_SCON] = concatenate, [OP_S2L] = to_lower, [OP_S2U] = to_upper,
+  [OP_SLEN] = string_length, [OP_SREV] = string_reverse, [OP_INT2STR] = top_to_string,
+
+  [OP_LISTMACROS] = listmacros_op, [OP_LISTWORDS] = listwords_op,
+  [OP_LOADWORDS] = loadwords_op, [OP_SAVEWORDS] = savewords_op,
+  [OP_CLRWORDS] = clrwords_op, [OP_SELWORD] = word_select, [OP_DELWORD] = delete_word,
+
+  [OP_MINV] = minv_op, [OP_PINV] = pinv_op, [OP_DET] = det_op, [OP_EIG] = eig_op,
+  [OP_TRAN] = tran_op, [OP_QUOTE] = tran_op, [OP_RESHAPE] = reshape_op,
+  [OP_GET_AIJ] = get_aij_op, [OP_SET_AIJ] = set_aij_op, [OP_SPLIT_MAT] = split_mat_op,
+  [OP_KRON] = kron_op, [OP_DIAG] = diag_op, [OP_TO_DIAG] = to_diag_op,
+  [OP_CHOL] = chol_op, [OP_SVD] = svd_op, [OP_DIM] = dim_op, [OP_EYE] = eye_op,
+  [OP_ONES] = ones_op, [OP_RRANGE] = rrange_op, [OP_ZEROES] = zeroes_op,
+  [OP_RAND] = rand_op, [OP_RANDN] = randn_op,
+  [OP_JOIN_V] = join_v_op, [OP_JOIN_H] = join_h_op,
+  [OP_CUMSUM_R] = cumsum_r_op, [OP_CUMSUM_C] = cumsum_c_op,
+
+  [OP_SIN] = sin_wrapper, [OP_COS] = cos_wrapper, [OP_TAN] = tan_wrapper,
+  [OP_ASIN] = asin_wrapper, [OP_ACOS] = acos_wrapper, [OP_ATAN] = atan_wrapper,
+  [OP_SINH] = sinh_wrapper, [OP_COSH] = cosh_wrapper, [OP_TANH] = tanh_wrapper,
+  [OP_ASINH] = asinh_wrapper, [OP_ACOSH] = acosh_wrapper, [OP_ATANH] = atanh_wrapper,
+  [OP_EXP] = exp_wrapper, [OP_CHS] = chs_wrapper, [OP_INV] = inv_wrapper,
+
+  [OP_SPLIT_C] = split_complex, [OP_ABS] = abs_wrapper, [OP_RE] = re_wrapper,
+  [OP_IM] = im_wrapper, [OP_ARG] = arg_wrapper, [OP_RE2C] = real2complex,
+  [OP_J2R] = join_2_reals, [OP_LN] = ln_wrapper, [OP_LOG] = log_wrapper,
+  [OP_SQRT] = sqrt_wrapper,
+
+  [OP_CMEAN] = cmean_op, [OP_RMEAN] = rmean_op, [OP_CSUM] = csum_op,
+  [OP_RSUM] = rsum_op, [OP_CVAR] = cvar_op, [OP_RVAR] = rvar_op,
+  [OP_CMIN] = cmin_op, [OP_RMIN] = rmin_op, [OP_CMAX] = cmax_op, [OP_RMAX] = rmax_op,
 };
 
+builtin_func builtin_for_opcode(int opcode) {
+  return (opcode >= 0 && opcode < OP_COUNT) ? builtins[opcode] : NULL;
+}
+
 // **************** The main loop in this file ****************
-void evaluate_line(Stack *stack, char* line) {
+void evaluate_line(Stack *stack, const char* line) {
+  if (is_word_definition(line))   // Check if a new word; insert  if it is
+    return;
+
+  if (line_cache_enabled) {
+    code_block* code = cached_compile_line(line);
+    if (code) {
+      execute_code(stack, code);
+      release_code(code);
+    }
+    return;
+  }
+
+  undo_touch_all(stack);   // tokens are not journaled one by one
   Lexer lexer = {line, 0};
   Token tok;
+  do {   // The lexer loop
+    tok = next_token(&lexer);
+    evaluate_one_token(stack, &tok);
+  } while (tok.type != TOK_EOF);
+}
+
+// Run the body of a macro or user word
+static void evaluate_body(Stack *stack, const char* body) {
+  Lexer sub_lexer = {body, 0};
+  Token sub_tok;
+  do {   // The lexer loop
+    sub_tok = next_token(&sub_lexer);
+    evaluate_one_token(stack, &sub_tok);
+  } while (sub_tok.type != TOK_EOF);
+}
+
+// Run a macro or user word: from its compiled body when the line itself
+// was compiled, otherwise from the text. Macros shadow words of the same name.
+static void call_word(Stack *stack, user_word* w, bool compiled) {
+  code_block* code = w->code;
+  if (!compiled || !code) {
+    undo_touch_all(stack);
+    evaluate_body(stack, w->body);
+    return;
+  }
+  retain_code(code);   // the body may delete or reload its own word
+  execute_code(stack, code);
+  release_code(code);
+}
+
+static void call_symbol(Stack *stack, const symbol* sym, bool compiled) {
+  user_word *m=sym->macro;
+  if (m!=NULL) {
+    call_word(stack, m, compiled);
+    return;
+  }
+
+  user_word *w=sym->word;
+  if (w==NULL)
+    printf("Unknown identifier!\n");
+  else
+    call_word(stack, w, compiled);
+}
+
+// **************** Run a compiled line ****************
+// Inline matrices are parsed on first use and shared with the stack
+// afterwards; a literal that fails to parse is retried, so it reports its
+// error each time
+static gsl_matrix* literal_matrix(bc_literal* lit) {
+  if (!lit->value) lit->value = parse_matrix_literal(lit->text, lit->len);
+  payload_retain(lit->value);
+  return lit->value;
+}
 
-  if (!is_word_definition(line))   // Check if a new word; insert  if it is
-    do {   // The lexer loop
-      tok = next_token(&lexer);
-      evaluate_one_token(stack, tok);    
-    } while (tok.type != TOK_EOF);
+static gsl_matrix_complex* literal_complex_matrix(bc_literal* lit) {
+  if (!lit->value) lit->value = parse_complex_matrix_literal(lit->text, lit->len);
+  payload_retain(lit->value);
+  return lit->value;
+}
+
+// **************** Superinstructions ****************
+// Real scalars take the fast path; anything else replays the instructions
+// the peephole pass fused, so every message and corner case is unchanged.
+#define IS_REAL_AT(s, k) ((s)->top >= (k) && (s)->items[(s)->top - (k)].type == TYPE_REAL)
+#define HAS_ROOM(s, n)   stack_reserve((s), (n))
+
+static void square_op(Stack* stack) {
+  if (IS_REAL_AT(stack, 0) && HAS_ROOM(stack, 1)) {
+    stack->items[stack->top].real *= stack->items[stack->top].real;
+    return;
+  }
+  dup_op(stack);
+  mul_top_two(stack);
+}
+
+static void nip_op(Stack* stack) {
+  if (stack->top >= 1 && (stack->items[stack->top - 1].type == TYPE_REAL ||
+                          stack->items[stack->top - 1].type == TYPE_COMPLEX)) {
+    stack->items[stack->top - 1] = stack->items[stack->top];
+    stack->top--;
+    return;
+  }
+  swap(stack);
+  drop_op(stack);
+}
+
+static void over2_div_op(Stack* stack) {
+  if (IS_REAL_AT(stack, 0) && IS_REAL_AT(stack, 1) && HAS_ROOM(stack, 2)) {
+    double q = stack->items[stack->top - 1].real / stack->items[stack->top].real;
+    stack->items[++stack->top] = (stack_element){.type = TYPE_REAL, .real = q};
+    return;
+  }
+  stack_over(stack);
+  stack_over(stack);
+  div_top_two(stack);
+}
+
+static void over_sub_op(Stack* stack) {
+  if (IS_REAL_AT(stack, 0) && IS_REAL_AT(stack, 1) && HAS_ROOM(stack, 1)) {
+    stack->items[stack->top].real -= stack->items[stack->top - 1].real;
+    return;
+  }
+  stack_over(stack);
+  sub_top_two(stack);
+}
+
+static void swap_div_op(Stack* stack) {
+  if (IS_REAL_AT(stack, 0) && IS_REAL_AT(stack, 1)) {
+    stack->items[stack->top - 1].real =
+      stack->items[stack->top].real / stack->items[stack->top - 1].real;
+    stack->top--;
+    return;
+  }
+  swap(stack);
+  div_top_two(stack);
+}
+
+static void pct_delta_op(Stack* stack) {
+  if (IS_REAL_AT(stack, 0) && IS_REAL_AT(stack, 1) && HAS_ROOM(stack, 1)) {
+    double a = stack->items[stack->top - 1].real;
+    stack->items[stack->top - 1].real = (stack->items[stack->top].real - a) / a;
+    stack->top--;
+    return;
+  }
+  stack_over(stack);
+  sub_top_two(stack);
+  swap(stack);
+  div_top_two(stack);
+}
+
+// <number> followed by + - * /
+static void const_op(Stack* stack, bc_op op, double k) {
+  if (IS_REAL_AT(stack, 0) && HAS_ROOM(stack, 1)) {
+    double* x = &stack->items[stack->top].real;
+    switch (op) {
+    case BC_ADD_K: *x += k; return;
+    case BC_SUB_K: *x -= k; return;
+    case BC_MUL_K: *x *= k; return;
+    default:       *x /= k; return;
+    }
+  }
+  push_real(stack, k);
+  switch (op) {
+  case BC_ADD_K: add_top_two(stack); return;
+  case BC_SUB_K: sub_top_two(stack); return;
+  case BC_MUL_K: mul_top_two(stack); return;
+  default:       div_top_two(stack); return;
+  }
+}
+
+// code->fast is only valid if its inputs really are real and there is room
+static bool fast_path_ok(Stack* stack, const code_block* code) {
+  if (stack->top + 1 < code->fast_needs || !stack_reserve(stack, code->fast_peak))
+    return false;
+  for (int i = 0; i < code->fast_needs; i++)
+    if (stack->items[stack->top - i].type != TYPE_REAL) return false;
+  return true;
+}
+
+// Operands of the check-free ops: k-th real from the top
+#define REAL_AT(k) (stack->items[stack->top - (k)].real)
+
+void execute_code(Stack *stack, code_block* code) {
+  const bc_instr* ins = code->code;
+  if (code->fast && fast_path_ok(stack, code)) ins = code->fast;
+
+  // Journal for undo: once for the block when its reach is known,
+  // otherwise instruction by instruction
+  bool journal = stack == undo_rec.stack;
+  if (journal && code->effect.complete) {
+    if (code->effect.clears) undo_touch_all(stack);
+    else undo_touch(stack, code->effect.needs);
+    journal = false;
+  }
+
+  // Spilled matrices come back one instruction at a time, right before use
+  bool spilling = spill_active();
+
+  for (; ; ins++) {
+    if (journal) undo_touch_instr(stack, ins);
+    if (spilling && !spill_touch(stack, instr_reach(ins))) return;   // the rest is not run
+    if (ins->op >= BC_SQUARE && ins->op <= BC_DIV_K_R) superinstruction_runs[ins->op]++;
+    switch (ins->op) {
+    case BC_END:
+      cache_stats.tokens += (unsigned long long)code->token_count;
+      return;
+    case BC_PUSH_REAL:
+      push_real(stack, ins->number);
+      break;
+    case BC_PUSH_COMPLEX:
+      push_complex(stack, gsl_complex_rect(ins->z.re, ins->z.im));
+      break;
+    case BC_PUSH_STRING: {
+      const bc_literal* lit = &code->literals[ins->literal];
+      push_string_literal(stack, lit->text, lit->len);
+      break;
+    }
+    case BC_PUSH_MATRIX:
+      push_matrix_real(stack, literal_matrix(&code->literals[ins->literal]));
+      break;
+    case BC_PUSH_CMATRIX:
+      push_matrix_complex(stack, literal_complex_matrix(&code->literals[ins->literal]));
+      break;
+    case BC_MATRIX_FILE:
+      read_matrix_from_file(stack, code->literals[ins->literal].text);
+      break;
+    case BC_ADD:     add_top_two(stack); break;
+    case BC_SUB:     sub_top_two(stack); break;
+    case BC_MUL:     mul_top_two(stack); break;
+    case BC_DIV:     div_top_two(stack); break;
+    case BC_POW:     pow_top_two(stack); break;
+    case BC_DOT_MUL: dot_mult_top_two(stack); break;
+    case BC_DOT_DIV: dot_div_top_two(stack); break;
+    case BC_DOT_POW: dot_pow_top_two(stack); break;
+    case BC_BUILTIN:
+      ins->fn(stack);
+      break;
+    case BC_CALL:
+      call_symbol(stack, ins->sym, true);
+      break;
+    case BC_ECHO:
+      printf("%c \n", ins->ch);
+      break;
+    case BC_ILLEGAL:
+      printf("Illegal token.\n");
+      break;
+    case BC_SQUARE:    square_op(stack); break;
+    case BC_NIP:       nip_op(stack); break;
+    case BC_OVER2_DIV: over2_div_op(stack); break;
+    case BC_OVER_SUB:  over_sub_op(stack); break;
+    case BC_SWAP_DIV:  swap_div_op(stack); break;
+    case BC_PCT_DELTA: pct_delta_op(stack); break;
+    case BC_ADD_K:
+    case BC_SUB_K:
+    case BC_MUL_K:
+    case BC_DIV_K:
+      const_op(stack, ins->op, ins->number);
+      break;
+
+    case BC_ADD_RR: REAL_AT(1) += REAL_AT(0); stack->top--; break;
+    case BC_SUB_RR: REAL_AT(1) -= REAL_AT(0); stack->top--; break;
+    case BC_MUL_RR: REAL_AT(1) *= REAL_AT(0); stack->top--; break;
+    case BC_DIV_RR: REAL_AT(1) /= REAL_AT(0); stack->top--; break;
+    case BC_POW_RR: REAL_AT(1) = pow(REAL_AT(1), REAL_AT(0)); stack->top--; break;
+    case BC_CMP_RR: {
+      double a = REAL_AT(1), b = REAL_AT(0);
+      int r = 0;
+      switch ((comparison_op)ins->cmp) {
+      case CMP_EQ:  r = a == b; break;
+      case CMP_NE:  r = a != b; break;
+      case CMP_LT:  r = a <  b; break;
+      case CMP_LE:  r = a <= b; break;
+      case CMP_GT:  r = a >  b; break;
+      case CMP_GE:  r = a >= b; break;
+      case CMP_AND: r = a && b; break;
+      case CMP_OR:  r = a || b; break;
+      }
+      REAL_AT(1) = r;
+      stack->top--;
+      break;
+    }
+    case BC_REAL_FN:  REAL_AT(0) = ins->real_fn(REAL_AT(0)); break;
+    case BC_DUP_R:    stack->items[stack->top + 1] = stack->items[stack->top]; stack->top++; break;
+    case BC_DROP_R:   stack->top--; break;
+    case BC_SWAP_RR: {
+      double t = REAL_AT(0);
+      REAL_AT(0) = REAL_AT(1);
+      REAL_AT(1) = t;
+      break;
+    }
+    case BC_OVER_RR:  stack->items[stack->top + 1] = stack->items[stack->top - 1]; stack->top++; break;
+    case BC_NIP_R:    stack->items[stack->top - 1] = stack->items[stack->top]; stack->top--; break;
+    case BC_SQUARE_R: REAL_AT(0) *= REAL_AT(0); break;
+    case BC_OVER2_DIV_RR:
+      stack->items[stack->top + 1] = (stack_element){.type = TYPE_REAL, .real = REAL_AT(1) / REAL_AT(0)};
+      stack->top++;
+      break;
+    case BC_OVER_SUB_RR: REAL_AT(0) -= REAL_AT(1); break;
+    case BC_SWAP_DIV_RR: REAL_AT(1) = REAL_AT(0) / REAL_AT(1); stack->top--; break;
+    case BC_PCT_DELTA_RR:
+      REAL_AT(1) = (REAL_AT(0) - REAL_AT(1)) / REAL_AT(1);
+      stack->top--;
+      break;
+    case BC_ADD_K_R: REAL_AT(0) += ins->number; break;
+    case BC_SUB_K_R: REAL_AT(0) -= ins->number; break;
+    case BC_MUL_K_R: REAL_AT(0) *= ins->number; break;
+    case BC_DIV_K_R: REAL_AT(0) /= ins->number; break;
+    case BC_OP_COUNT:
+      break;
+    }
+  }
 }
 
 // **************** Process one token ****************
-void evaluate_one_token(Stack *stack, Token tok) {
-  switch (tok.type) {
+// How far down the stack a token's operation reaches, for the spill tier
+static int token_reach(const Token* tok) {
+  switch (tok->type) {
+  case TOK_PLUS: case TOK_MINUS: case TOK_STAR: case TOK_SLASH: case TOK_CARET:
+  case TOK_DOT_STAR: case TOK_DOT_SLASH: case TOK_DOT_CARET:
+    return 2;
+  case TOK_FUNCTION:
+    return builtin_reach(tok->sym->opcode);
+  default:   // pushes, and words, whose bodies reach for themselves
+    return 0;
+  }
+}
+
+void evaluate_one_token(Stack *stack, const Token* tok) {
+  if (spill_active() && !spill_touch(stack, token_reach(tok))) return;
+  switch (tok->type) {
   case TOK_EOF:
     return;
   case TOK_NUMBER:
-    push_real(stack, atof(tok.text));
+    push_real(stack, tok->number);
+    return;
+  case TOK_COMPLEX:
+    push_complex(stack, gsl_complex_rect(tok->z.re, tok->z.im));
     return;
-  case TOK_COMPLEX: {
-    gsl_complex z;
-    if (read_complex(tok.text, &z)) push_complex(stack,z);
-    return;}
   case TOK_STRING:
-    push_string(stack, tok.text);
+    push_string_n(stack, tok->start, tok->len);
     return;
   case TOK_MATRIX_FILE:
-    read_matrix_from_file(stack, tok.text);
+    read_matrix_from_file(stack, tok->start);
     return;
   case TOK_MATRIX_INLINE_REAL:
-    push_matrix_real(stack,parse_matrix_literal(tok.text));
+    push_matrix_real(stack,parse_matrix_literal(tok->start, tok->len));
     return;
   case TOK_MATRIX_INLINE_COMPLEX:
-    push_matrix_complex(stack,parse_complex_matrix_literal(tok.text));
+    push_matrix_complex(stack,parse_complex_matrix_literal(tok->start, tok->len));
     return;
   case TOK_MATRIX_INLINE_MIXED:
-    push_matrix_complex(stack,parse_complex_matrix_literal(tok.text));
+    push_matrix_complex(stack,parse_complex_matrix_literal(tok->start, tok->len));
     return;
   case TOK_PLUS:
     add_top_two(stack);
@@ -205,227 +667,22 @@ void evaluate_one_token(Stack *stack, Token tok) {
   case TOK_SEMICOLON:
     printf("; \n");
     return;
-  case TOK_IDENTIFIER: {
-    user_word *m=find_macro(tok.text);
-    if (m!=NULL) {
-      char *sub_line = strdup(m->body);
-      Lexer sub_lexer = {sub_line, 0};
-      Token sub_tok;
-      do {   // The lexer loop
-	sub_tok = next_token(&sub_lexer);
-	evaluate_one_token(stack, sub_tok);    
-      } while (sub_tok.type != TOK_EOF);
-      return;
-    }
-    
-    user_word *w=find_word(tok.text);
-    if (w==NULL)
-      printf("Unknown identifier!\n");
-    else {
-      char *sub_line = strdup(w->body);
-      Lexer sub_lexer = {sub_line, 0};
-      Token sub_tok;
-      do {   // The lexer loop
-	sub_tok = next_token(&sub_lexer);
-	evaluate_one_token(stack, sub_tok);    
-      } while (sub_tok.type != TOK_EOF);
-    }
+  case TOK_IDENTIFIER:
+    call_symbol(stack, tok->sym, false);
     return;
-  }
   case TOK_FUNCTION: {
-
-    // Meta level
-    if (!strcmp("eval",tok.text)) {
-      if (stack->top < 0) {
-        fprintf(stderr, "Stack is empty: nothing to evaluate.\n");
-        return;
-      }
-      stack_element t = pop(stack);
-      if (t.type != TYPE_STRING) {
-        fprintf(stderr, "Top of stack is not a string: cannot evaluate.\n");
-      } else evaluate_line(stack, t.string);
-      return;
-    }
-
-    if (!strcmp("batch",tok.text)) {
-	if (stack->top < 0) {
-        fprintf(stderr, "Stack is empty: no batch to run.\n");
-        return;
-      }
-      stack_element t = pop(stack);
-      if (t.type != TYPE_STRING) {
-        fprintf(stderr, "Top of stack is not a string: cannot evaluate.\n");
-      } else run_batch(stack, t.string);
-      return;
-    }
-    
-    if (!strcmp("run",tok.text)) {
-	if (stack->top < 0) {
-        fprintf(stderr, "Stack is empty: no program to run.\n");
-        return;
-	}
-	stack_element t = pop(stack);
-	if (t.type != TYPE_STRING) {
-	  fprintf(stderr, "Top of stack is not a string: cannot evaluate.\n");
-	} else {
-	  Program prog = {.count = 0, .label_count = 0};
-	  if (!load_program_from_file(t.string, &prog)) {
-	    fprintf(stderr, "Failed to load program.\n");
-	    return;
-	  }
-	  list_program(&prog);
-	  run_RPN_code(stack, &prog);
-	  free_program(&prog);
-	}
-      return;
-    }
-
-    // ++++++++++++++++ Nullary functions ++++++++++++++++
-    // Constants
-    if (!strcmp("gravity",tok.text)) {push_real(stack,9.81); return; }
-    if (!strcmp("pi",tok.text)) { push_real(stack,M_PI); return; }
-    if (!strcmp("e",tok.text)) { push_real(stack,exp(1.0)); return; }
-    if (!strcmp("inf",tok.text)) { push_real(stack,INFINITY); return; }
-    if (!strcmp("nan",tok.text)) { push_real(stack,NAN); return; }
-
-    // Misc
-    if (!strcmp("help",tok.text)) { help_menu(); return; }
-    if (!strcmp("listfcns",tok.text)) { list_all_functions_sorted(); return; }
-    if (!strcmp("clrhist",tok.text)) { clear_history(); return; }
-    if (!strcmp("fuck",tok.text)) { whose_place(); return; }
-    
-    // Utility functions
-    if (!strcmp("pm",tok.text)) {print_matrix(stack); skip_stack_printing = true; return;}
-    if (!strcmp("ps",tok.text)) {print_stack(stack,NULL); return;}
-    if (!strcmp("print",tok.text)) {print_top_scalar(stack); return;}
-    if (!strcmp("setprec",tok.text)) {set_print_precision(stack); return;}
-    if (!strcmp("sfs",tok.text)) {swap_fixed_scientific(); return;}
-    
-    // Date and time functions
-    if (!strcmp("ddays",tok.text)) { delta_days_strings(stack); return; }
-    if (!strcmp("today",tok.text)) { push_today_date(stack); return; }
-    if (!strcmp("dow",tok.text)) { push_weekday_name_from_date_string(stack); return; }
-    if (!strcmp("dateplus",tok.text)) { date_plus_days(stack); return; }
-    if (!strcmp("edmy",tok.text)) {  extract_day_month_year(stack); return; }
- 
-    // Stack functions
-    if (!strcmp("drop",tok.text)) { pop_and_free(stack); return; }
-    if (!strcmp("clst",tok.text)) { free_stack(stack); return; }
-    if (!strcmp("swap",tok.text)) { swap(stack); return; }
-    if (!strcmp("dup",tok.text)) { stack_dup(stack); return; }
-    if (!strcmp("nip",tok.text)) { stack_nip(stack); return; }
-    if (!strcmp("tuck",tok.text)) { stack_tuck(stack); return; }
-    if (!strcmp("roll",tok.text)) { stack_roll(stack,2); return; }
-    if (!strcmp("over",tok.text)) { stack_over(stack); return; }
-
-    // Polynomial functions
-    if (!strcmp("roots",tok.text)) { poly_roots(stack); return;}
-    if (!strcmp("pval",tok.text)) { poly_eval(stack); return; }
-
-    // Integration and zeros
-    if (!strcmp("integrate",tok.text)) { integrate(stack); return;}
-    if (!strcmp("fzero",tok.text)) { find_zero(stack); return; }
-    if (!strcmp("set_intg_tol",tok.text)) { set_integration_precision(stack); return; }
-    if (!strcmp("set_f0_tol",tok.text))  { set_f0_precision(stack); return; }
-
-    
-    // Comparison and logic functions
-    if (!strcmp("eq",tok.text)) { dot_cmp_top_two(stack, CMP_EQ); return; }
-    if (!strcmp("neq",tok.text)) { dot_cmp_top_two(stack, CMP_NE); return; }
-    if (!strcmp("lt",tok.text)) { dot_cmp_top_two(stack, CMP_LT); return; }
-    if (!strcmp("leq",tok.text)) { dot_cmp_top_two(stack, CMP_LE); return; }
-    if (!strcmp("gt",tok.text)) { dot_cmp_top_two(stack, CMP_GT); return; }
-    if (!strcmp("geq",tok.text)) { dot_cmp_top_two(stack, CMP_GE); return; } 
-    if (!strcmp("and",tok.text)) { dot_cmp_top_two(stack, CMP_AND); return; } 
-    if (!strcmp("or",tok.text)) { dot_cmp_top_two(stack, CMP_OR); return; } 
-    if (!strcmp("not",tok.text)) { logical_not_wrapper(stack); return; } 
-    
-    // Special math functions
-    if (!strcmp("npdf",tok.text)) { npdf_wrapper(stack); return; }
-    if (!strcmp("ncdf",tok.text)) { ncdf_wrapper(stack); return; }
-    if (!strcmp("nquant",tok.text)) { nquant_wrapper(stack); return; }
-    if (!strcmp("gamma",tok.text)) { gamma_wrapper(stack); return; }
-    if (!strcmp("ln_gamma",tok.text)) { ln_gamma_wrapper(stack); return; }
-    if (!strcmp("beta",tok.text)) { beta_wrapper(stack); return; }
-    if (!strcmp("ln_beta",tok.text)) { ln_beta_wrapper(stack); return; }
-
-    // Parts of numbers
-    if (!strcmp("frac",tok.text)) { frac_wrapper(stack); return; }
-    if (!strcmp("intg",tok.text)) { intg_wrapper(stack); return; }
-    
-    // Register functions
-    if (!strcmp("ffr",tok.text)) {  find_first_free_register(stack); return; }
-    if (!strcmp("rcl",tok.text)) { recall_from_register(stack); return; }
-    if (!strcmp("sto",tok.text)) { store_to_register(stack); return; }
-    if (!strcmp("pr",tok.text)) { show_registers_status(); return; }
-    if (!strcmp("saveregs",tok.text)) { save_registers_to_file("registers.txt"); return; }
-    if (!strcmp("loadregs",tok.text)) { load_registers_from_file("registers.txt"); return; }
-    if (!strcmp("clregs",tok.text)) { free_all_registers(); return; }
-
-    // **************** String functions ****************
-    if (!strcmp("scon",tok.text)) {concatenate(stack); return;}
-    if (!strcmp("s2l",tok.text)) { to_lower(stack); return; }
-    if (!strcmp("s2u",tok.text)) { to_upper(stack); return; }
-    if (!strcmp("slen",tok.text)) { string_length(stack); return; }
-    if (!strcmp("srev",tok.text)) { string_reverse(stack); return; }       
-    if (!strcmp("int2str",tok.text)) { top_to_string(stack); return; }       
-
-    // **************** Macros and user defined word functions ****************
-    if (!strcmp("listmacros",tok.text)) {list_macros(); return;}
-    if (!strcmp("listwords",tok.text)) {list_words(); return;}
-    if (!strcmp("loadwords",tok.text)) {load_words_from_file(); return;}
-    if (!strcmp("savewords",tok.text)) {save_words_to_file(); return;}
-    if (!strcmp("clrwords",tok.text)) {clear_words(); return;}
-    if (!strcmp("selword",tok.text)) {word_select(stack); return;}
-    if (!strcmp("delword",tok.text)) {delete_word(stack); return;}
-    
-    // **************** Matrix operations ****************
-    for (int i = 0; matrix_ops[i].name != NULL; ++i) {
-      if (!strcmp(tok.text, matrix_ops[i].name)) {
-	matrix_ops[i].func(stack);
-	return;
-      }
-    }
-
-    if (!strcmp("split_mat",tok.text)) {split_matrix(stack); return; }
-    
-    // **************** Immutable unary functions ****************      
-    for (int i = 0; immutable_unary_ops[i].name != NULL; ++i) {
-      if (!strcmp(tok.text, immutable_unary_ops[i].name)) {
-	immutable_unary_ops[i].func(stack);
-	return;
-      }
-    }
-    // **************** Mutable unary operations ****************     
-    if (!strcmp(tok.text, "split_c")) { split_complex(stack); return; }    
-    if (!strcmp(tok.text, "abs")) { abs_wrapper(stack); return; }
-    if (!strcmp(tok.text, "re")) { re_wrapper(stack); return; }
-    if (!strcmp(tok.text, "im")) { im_wrapper(stack); return; }
-    if (!strcmp(tok.text, "arg")) { arg_wrapper(stack); return; }
-    if (!strcmp(tok.text, "re2c")) { real2complex(stack); return; }
-    if (!strcmp(tok.text, "j2r")) {  join_2_reals(stack); return; }
-    if (!strcmp(tok.text, "ln")) { ln_wrapper(stack); return; }
-    if (!strcmp(tok.text, "log")) { log_wrapper(stack); return; }
-    if (!strcmp(tok.text, "sqrt")) { sqrt_wrapper(stack); return; }   
-    
-    // Matrix reduction functions
-    for (int i = 0; reduce_ops[i].name != NULL; ++i) {
-      if (!strcmp(tok.text, reduce_ops[i].name)) {
-        matrix_reduce(stack, reduce_ops[i].axis, reduce_ops[i].operation);
-        return;
-      }
-    }
-    return;  
-    case TOK_VERTICAL:
-      printf("| \n");
-      return;
-      case TOK_UNKNOWN:
-	printf("Illegal token.\n");
-	return;
-	default:
-	  printf("Unhandled token type.\n");
-	  return;
+    builtin_func f = builtins[tok->sym->opcode];
+    if (f) f(stack);
+    return;
   }
+  case TOK_VERTICAL:
+    printf("| \n");
+    return;
+  case TOK_UNKNOWN:
+    printf("Illegal token.\n");
+    return;
+  default:
+    printf("Unhandled token type.\n");
+    return;
   }
 }
-
@@ -27,9 +27,10 @@ const char* const function_names[] = {
   "npdf", "ncdf", "nquant","gamma", "ln_gamma","beta","ln_beta",
   "re2c", "split_c", "j2r","frac","intg",
   "chs", "inv",
-  "fuck", "help", "listfcns",
+  "fuck", "help", "listfcns", "fusions", "mem",
   "gravity", "pi", "e", "inf", "nan",
   "drop", "clst", "swap", "dup", "nip", "tuck", "roll", "over",
+  "sfork", "sswitch", "sdrop", "slist",
   "scon", "s2l", "s2u", "slen", "srev", "int2str",
   "minv", "pinv", "det", "eig", "tran", "reshape", "get_aij", "set_aij","split_mat","'",
   "kron", "diag", "to_diag", "chol", "svd", "dim", "eye",
@@ -39,7 +40,7 @@ const char* const function_names[] = {
   "cmin", "cmax", "rmin", "rmax",
   "roots", "pval", "integrate", "fzero", "set_intg_tol", "set_f0_tol",
   "rcl", "sto","pr","saveregs","loadregs","clregs","ffr",
-  "print", "pm", "ps", "setprec","sfs","undo",
+  "print", "pm", "ps", "setprec","sfs","undo","redo",
   ".*", "./", ".^",
   "eq","leq","lt","gt","geq","neq","and","or","not",
   "ddays","today","dateplus","dow","edmy",
@@ -53,3 +54,81 @@ const char* const function_names[] = {
   "eval", "batch", "run", 
   NULL
 };
+
+// How far down the stack each builtin may change entries, for the undo
+// journal and the spiller. tools/gen_opcodes.c turns this into the
+// opcode_reach[] table and stops the build if a name above is missing.
+const builtin_reach_spec builtin_reaches[] = {
+  // Printing, listing, settings and files: the stack is untouched
+  {"fuck", 0}, {"help", 0}, {"listfcns", 0},
+  {"fusions", 0}, {"mem", 0},
+  {"ps", 0}, {"sfs", 0},
+  {"pr", 0}, {"saveregs", 0}, {"loadregs", 0},
+  {"clregs", 0}, {"listwords", 0}, {"loadwords", 0},
+  {"savewords", 0}, {"clrwords", 0}, {"listmacros", 0},
+  {"clrhist", 0}, {"undo", 0}, {"redo", 0},
+  {"slist", 0},
+
+  // Pushes only
+  {"gravity", 0}, {"pi", 0}, {"e", 0},
+  {"inf", 0}, {"nan", 0}, {"today", 0}, {"ffr", 0},
+
+  // The top entry
+  {"sin", 1}, {"cos", 1}, {"tan", 1},
+  {"asin", 1}, {"acos", 1}, {"atan", 1},
+  {"sinh", 1}, {"cosh", 1}, {"tanh", 1},
+  {"asinh", 1}, {"acosh", 1}, {"atanh", 1},
+  {"ln", 1}, {"log", 1}, {"exp", 1}, {"sqrt", 1},
+  {"re", 1}, {"im", 1}, {"abs", 1}, {"arg", 1},
+  {"conj", 1}, {"npdf", 1}, {"ncdf", 1},
+  {"nquant", 1}, {"gamma", 1}, {"ln_gamma", 1},
+  {"re2c", 1}, {"split_c", 1}, {"frac", 1},
+  {"intg", 1}, {"chs", 1}, {"inv", 1}, {"not", 1},
+  {"drop", 1}, {"dup", 1},
+  {"s2l", 1}, {"s2u", 1}, {"slen", 1},
+  {"srev", 1}, {"int2str", 1},
+  {"minv", 1}, {"pinv", 1}, {"det", 1}, {"eig", 1},
+  {"tran", 1}, {"'", 1}, {"split_mat", 1},
+  {"diag", 1}, {"to_diag", 1}, {"chol", 1},
+  {"svd", 1}, {"dim", 1}, {"eye", 1}, {"rrange", 1},
+  {"cumsum_r", 1}, {"cumsum_c", 1},
+  {"cmean", 1}, {"rmean", 1}, {"csum", 1},
+  {"rsum", 1}, {"cvar", 1}, {"rvar", 1},
+  {"cmin", 1}, {"cmax", 1}, {"rmin", 1}, {"rmax", 1},
+  {"roots", 1}, {"set_intg_tol", 1}, {"set_f0_tol", 1},
+  {"rcl", 1}, {"print", 1}, {"pm", 1}, {"setprec", 1},
+  {"dow", 1}, {"edmy", 1}, {"delword", 1},
+  {"selword", 1}, {"eval", 1},   // eval'd code journals itself
+  {"sfork", 1}, {"sdrop", 1},
+  {"sswitch", 1},   // journals each side of the switch itself
+
+  // The top two
+  {"pow", 2}, {"beta", 2}, {"ln_beta", 2}, {"j2r", 2},
+  {"swap", 2}, {"nip", 2}, {"tuck", 2}, {"over", 2},
+  {"scon", 2}, {"kron", 2}, {"join_v", 2}, {"join_h", 2},
+  {"ones", 2}, {"zeroes", 2}, {"rand", 2}, {"randn", 2},
+  {"pval", 2}, {"integrate", 2}, {"fzero", 2}, {"sto", 2},
+  {".*", 2}, {"./", 2}, {".^", 2},
+  {"eq", 2}, {"leq", 2}, {"lt", 2}, {"gt", 2},
+  {"geq", 2}, {"neq", 2}, {"and", 2}, {"or", 2},
+  {"ddays", 2}, {"dateplus", 2},
+
+  // Deeper
+  {"roll", 3}, {"reshape", 3}, {"get_aij", 3},
+  {"set_aij", 4},
+
+  // Anything: clearing, program control, programs and batch files
+  {"clst", REACH_WHOLE_STACK},
+  {"top_eq0?", REACH_WHOLE_STACK}, {"top_ge0?", REACH_WHOLE_STACK}, {"top_gt0?", REACH_WHOLE_STACK},
+  {"top_le0?", REACH_WHOLE_STACK}, {"top_lt0?", REACH_WHOLE_STACK},
+  {"top_eg?", REACH_WHOLE_STACK}, {"top_ge?", REACH_WHOLE_STACK}, {"top_gt?", REACH_WHOLE_STACK},
+  {"top_le?", REACH_WHOLE_STACK}, {"top_lt?", REACH_WHOLE_STACK},
+  {"ctr_eq0?", REACH_WHOLE_STACK}, {"ctr_ge0?", REACH_WHOLE_STACK}, {"ctr_gt0?", REACH_WHOLE_STACK},
+  {"ctr_le0?", REACH_WHOLE_STACK}, {"ctr_lt0?", REACH_WHOLE_STACK},
+  {"set_ctr", REACH_WHOLE_STACK}, {"clr_ctr", REACH_WHOLE_STACK},
+  {"ctr_inc", REACH_WHOLE_STACK}, {"ctr_dec", REACH_WHOLE_STACK},
+  {"goto", REACH_WHOLE_STACK}, {"xeq", REACH_WHOLE_STACK}, {"rtn", REACH_WHOLE_STACK},
+  {"end", REACH_WHOLE_STACK}, {"lbl", REACH_WHOLE_STACK},
+  {"batch", REACH_WHOLE_STACK}, {"run", REACH_WHOLE_STACK},
+  {NULL, 0}
+};
@@ -17,12 +17,19 @@
  */
 
 #include "globals.h"
+#include "undo.h"
+#include "matrix_alloc.h"
+#include "mem_account.h"
+#include "spill.h"
 
 bool fixed_point = true;
 bool verbose_mode = false;
 bool completed_batch=false;
 bool test_flag = false;
 bool skip_stack_printing = false;
+bool line_cache_enabled = true;   // run lines through the compiled-line cache
+bool real_kernels_enabled = true; // let integrate/fzero run pure real words as kernels
+int dispatch_mode = DISPATCH_THREADED;
 int print_precision = 6;
 int selected_function = 0;
 char path_to_data_and_programs[MAX_PATH];
@@ -77,6 +84,13 @@ void save_config(const char* filename) {
     fprintf(f, "fixed_point = %d\n", fixed_point);
     fprintf(f, "verbose_mode = %d\n", verbose_mode);
     fprintf(f, "selected_function = %d\n", selected_function);
+    fprintf(f, "dispatch_mode = %d\n", dispatch_mode);
+    fprintf(f, "stack_limit = %d\n", stack_limit);
+    fprintf(f, "undo_levels = %d\n", undo_levels);
+    fprintf(f, "matrix_huge_pages = %d\n", matrix_huge_pages);
+    fprintf(f, "memory_budget_mb = %d\n", memory_budget_mb);
+    fprintf(f, "spill_mb = %d\n", spill_mb);
+    fprintf(f, "register_pack_kb = %d\n", register_pack_kb);
 
     fclose(f);
 }
@@ -100,6 +114,9 @@ void load_config(const char* filename) {
         char* key = line;
         char* value = equal_sign + 1;
 
+        // Trim trailing spaces from key ("key = value")
+        for (char* k = equal_sign - 1; k >= key && *k == ' '; k--) *k = '\0';
+
         // Trim leading spaces from value
         while (*value == ' ') value++;
 
@@ -111,6 +128,20 @@ void load_config(const char* filename) {
             verbose_mode = atoi(value);
         } else if (strcmp(key, "selected_function") == 0) {
             selected_function = atoi(value);
+        } else if (strcmp(key, "dispatch_mode") == 0) {
+            dispatch_mode = atoi(value) ? DISPATCH_THREADED : DISPATCH_SWITCH;
+        } else if (strcmp(key, "stack_limit") == 0) {
+            stack_limit = atoi(value) > 0 ? atoi(value) : 0;   // 0: grow as needed
+        } else if (strcmp(key, "undo_levels") == 0) {
+            undo_levels = atoi(value) > 0 ? atoi(value) : 0;    // 0: no undo
+        } else if (strcmp(key, "matrix_huge_pages") == 0) {
+            matrix_huge_pages = atoi(value) != 0;
+        } else if (strcmp(key, "memory_budget_mb") == 0) {
+            memory_budget_mb = atoi(value) > 0 ? atoi(value) : 0; // 0: no budget
+        } else if (strcmp(key, "spill_mb") == 0) {
+            spill_mb = atoi(value) > 0 ? atoi(value) : 0; // 0: never spill
+        } else if (strcmp(key, "register_pack_kb") == 0) {
+            register_pack_kb = atoi(value) > 0 ? atoi(value) : 0; // 0: never pack
         } else if (strcmp(key, "path_to_data_and_programs") == 0) {
             strncpy(path_to_data_and_programs, value, MAX_PATH - 1);
             path_to_data_and_programs[MAX_PATH - 1] = '\0';
@@ -21,12 +21,36 @@
 
 #include <math.h>
 #include <stdio.h>
+#include <string.h>
 #include "words.h"
 #include "globals.h"
 #include "stack.h"
 #include "eval_fun.h"
+#include "symbols.h"
+#include "real_kernel.h"
 #include "integration_and_zeros.h"
 
+// Kernel of the selected function while a solver runs, if it has one
+static real_kernel active_kernel;
+static bool kernel_active = false;
+
+// Compile the selected function for the solver about to run. The name is
+// looked up the way evaluate_line would see it, so a macro of the same
+// name wins and a builtin name never compiles.
+static void begin_solver(void) {
+  kernel_active = false;
+  if (!real_kernels_enabled || selected_function < 0 || selected_function >= word_count) return;
+  const char* name = words[selected_function].name;
+  const symbol* sym = intern_symbol(name, strlen(name));
+  if (!sym || sym->opcode >= 0) return;
+  kernel_active = build_real_kernel(sym->macro ? sym->macro : sym->word, &active_kernel);
+}
+
+static void end_solver(void) {
+  if (kernel_active) free_real_kernel(&active_kernel);
+  kernel_active = false;
+}
+
 void find_zero(Stack *stack) {
   if (stack->top < 1) {
     fprintf(stderr, "Error: Stack underflow — need two real numbers.\n");
@@ -47,7 +71,10 @@ void find_zero(Stack *stack) {
   }
 
   double root;
-  if (bisection(stack_helper, b.real, a.real, fsolve_tolerance, &root)) {
+  begin_solver();
+  bool found = bisection(stack_helper, b.real, a.real, fsolve_tolerance, &root);
+  end_solver();
+  if (found) {
     push_real(stack, root);
   } else {
     fprintf(stderr, "Warning: Bisection failed — pushing a.real back.\n");
@@ -75,7 +102,9 @@ void integrate(Stack *stack) {
     return;
   }
 
+  begin_solver();
   double result = romberg(stack_helper, b.real, a.real, intg_tolerance, MAX_ROMBERG_ITER);
+  end_solver();
   push_real(stack, result);
 }
 
@@ -134,12 +163,27 @@ void set_f0_precision(Stack *stack) {
 }
 
 double stack_helper(double x) {
-  Stack integration_stack;
-
-  init_stack(&integration_stack);
-  push_real(&integration_stack,x);
-  evaluate_line(&integration_stack, words[selected_function].name);
-  stack_element a = pop(&integration_stack);
+  if (kernel_active) return run_real_kernel(&active_kernel, x);
+
+  // One stack serves every sample, so its storage is allocated once; a
+  // solver nested inside the function gets a stack of its own
+  static Stack shared_stack;
+  static bool shared_busy = false;
+  Stack nested_stack;
+  bool nested = shared_busy;
+  Stack* integration_stack = nested ? &nested_stack : &shared_stack;
+
+  if (nested || !shared_stack.items) init_stack(integration_stack);
+  shared_busy = true;
+  push_real(integration_stack,x);
+  evaluate_line(integration_stack, words[selected_function].name);
+  stack_element a = pop(integration_stack);
+  if (nested) {
+    destroy_stack(integration_stack);
+  } else {
+    free_stack(integration_stack);
+    shared_busy = false;
+  }
   return a.real;
 }
 
@@ -16,6 +16,7 @@
  * along with Mico's toy RPN Calculator. If not, see <https://www.gnu.org/licenses/>.
  */
 
+#define _POSIX_C_SOURCE 200809L
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -24,10 +25,11 @@
 #include <math.h>
 #include <readline/history.h>
 #include <readline/readline.h>
-#include "function_list.h"
 #include "lexer.h"
+#include "symbols.h"
+#include "line_arena.h"
 
-#define TEMP_BUF_SIZE (MAX_TOKEN_LEN * 4 - 1)
+#define NUMBER_BUF_SIZE 64
 
 void skip_whitespace(Lexer* lexer) {
   while (isspace(lexer->input[lexer->pos])) lexer->pos++;
@@ -49,19 +51,26 @@ bool match(Lexer* lexer, char expected) {
   return false;
 }
 
-Token make_token(token_type type, const char* text) {
+Token make_token(token_type type, const char* start, size_t len) {
   Token token;
-  strncpy(token.text, text, MAX_TOKEN_LEN - 1);
-  token.text[MAX_TOKEN_LEN - 1] = '\0';
   token.type = type;
+  token.start = start;
+  token.len = len;
+  token.sym = NULL;
   return token;
 }
 
-bool is_function_name(const char* name) {
-  for (int i = 0; function_names[i]; i++) {
-    if (strcmp(name, function_names[i]) == 0) return true;
+// Decode exactly the characters lex_number accepted (strtod alone would
+// also take hex forms such as "0x1A" that the lexer splits)
+static double decode_number(const char* start, size_t len) {
+  char buf[NUMBER_BUF_SIZE];
+  if (len < sizeof(buf)) {
+    memcpy(buf, start, len);
+    buf[len] = '\0';
+    return atof(buf);
   }
-  return false;
+  char* big = line_strndup(start, len);
+  return big ? atof(big) : NAN;
 }
 
 Token lex_number(Lexer* lexer) {
@@ -81,169 +90,129 @@ Token lex_number(Lexer* lexer) {
     while (isdigit(peek(lexer))) advance(lexer);
   }
 
-  size_t len = lexer->pos - start;
-  char buf[MAX_TOKEN_LEN] = {0};
-
-  size_t copy_len = len >= MAX_TOKEN_LEN - 1 ? MAX_TOKEN_LEN - 1 : len;
-  strncpy(buf, &lexer->input[start], copy_len);
-  //  strncpy(buf, &lexer->input[start], len);
-  buf[len] = '\0';
-  return make_token(TOK_NUMBER, buf);
+  Token token = make_token(TOK_NUMBER, &lexer->input[start], lexer->pos - start);
+  token.number = decode_number(token.start, token.len);
+  return token;
 }
 
 Token lex_identifier(Lexer* lexer) {
   size_t start = lexer->pos;
   while (isalnum(peek(lexer)) || peek(lexer) == '_') advance(lexer);
   size_t len = lexer->pos - start;
-  char buf[MAX_TOKEN_LEN];
 
-  size_t copy_len = len >= MAX_TOKEN_LEN - 1 ? MAX_TOKEN_LEN - 1 : len;
-  strncpy(buf, &lexer->input[start], copy_len);
-  //  strncpy(buf, &lexer->input[start], len);
-  buf[len] = '\0';
-  return make_token(is_function_name(buf) ? TOK_FUNCTION : TOK_IDENTIFIER, buf);
+  // Resolve the name once; the evaluator follows the symbol's bindings
+  const symbol* sym = intern_symbol(&lexer->input[start], len);
+  if (!sym) return make_token(TOK_UNKNOWN, &lexer->input[start], len);
+  Token token = make_token(sym->opcode >= 0 ? TOK_FUNCTION : TOK_IDENTIFIER,
+                           &lexer->input[start], len);
+  token.sym = sym;
+  return token;
 }
 
+// The token is the text between the quotes
 Token lex_string(Lexer* lexer) {
   advance(lexer);
   size_t start = lexer->pos;
   while (peek(lexer) != '"' && peek(lexer) != '\0') advance(lexer);
-  size_t len = lexer->pos - start;
-  char buf[MAX_TOKEN_LEN] = {0};
-  strncpy(buf, &lexer->input[start], len);
-  buf[len] = '\0';
+  Token token = make_token(TOK_STRING, &lexer->input[start], lexer->pos - start);
   match(lexer, '"');
-  return make_token(TOK_STRING, buf);
+  return token;
 }
 
 Token lex_complex(Lexer* lexer) {
   size_t start_pos = lexer->pos;
-  if (!match(lexer, '(')) return make_token(TOK_UNKNOWN, "(");
+  Token unknown = make_token(TOK_UNKNOWN, &lexer->input[start_pos], 1);
+  if (!match(lexer, '(')) return unknown;
   Token real = lex_number(lexer);
-  if (!match(lexer, ',')) { lexer->pos = start_pos; return make_token(TOK_UNKNOWN, "("); }
+  if (!match(lexer, ',')) { lexer->pos = start_pos; return unknown; }
   Token imag = lex_number(lexer);
-  if (!match(lexer, ')')) { lexer->pos = start_pos; return make_token(TOK_UNKNOWN, "("); }
-
-  char temp_buf[TEMP_BUF_SIZE];
-  snprintf(temp_buf, sizeof(temp_buf), "(%s,%s)", real.text, imag.text);
+  if (!match(lexer, ')')) { lexer->pos = start_pos; return unknown; }
 
-  return make_token(TOK_COMPLEX, temp_buf);
+  Token token = make_token(TOK_COMPLEX, &lexer->input[start_pos], lexer->pos - start_pos);
+  token.z.re = real.number;
+  token.z.im = imag.number;
+  return token;
 }
 
+// Called after '['; the token is the whole "[rows,cols,"file"]" text
 Token lex_matrix_file(Lexer* lexer) {
   size_t start_pos = lexer->pos;
-  Token row = lex_number(lexer);
-  if (!match(lexer, ',')) { lexer->pos = start_pos; return make_token(TOK_UNKNOWN, "["); }
-  Token col = lex_number(lexer);
-  if (!match(lexer, ',')) { lexer->pos = start_pos; return make_token(TOK_UNKNOWN, "["); }
-  Token str = lex_string(lexer);
-  if (!match(lexer, ']')) { lexer->pos = start_pos; return make_token(TOK_UNKNOWN, "["); }
-
-  char temp_buf[TEMP_BUF_SIZE];
-  snprintf(temp_buf, sizeof(temp_buf), "[%s,%s,\"%s\"]", row.text, col.text, str.text);
-  
-  return make_token(TOK_MATRIX_FILE, temp_buf);
+  Token unknown = make_token(TOK_UNKNOWN, &lexer->input[start_pos - 1], 1);
+  lex_number(lexer);
+  if (!match(lexer, ',')) { lexer->pos = start_pos; return unknown; }
+  lex_number(lexer);
+  if (!match(lexer, ',')) { lexer->pos = start_pos; return unknown; }
+  lex_string(lexer);
+  if (!match(lexer, ']')) { lexer->pos = start_pos; return unknown; }
+
+  return make_token(TOK_MATRIX_FILE, &lexer->input[start_pos - 1], lexer->pos - start_pos + 1);
 }
 
+// Called after '['; checks "rows cols $ entries" and returns the text
+// between the brackets for parse_matrix_literal and friends
 Token lex_matrix_inline_j(Lexer* lexer) {
   size_t start_pos = lexer->pos;
+  Token unknown = make_token(TOK_UNKNOWN, &lexer->input[start_pos - 1], 1);
 
   // Parse row and column counts
   Token rows = lex_number(lexer);
   if (rows.type != TOK_NUMBER) {
     lexer->pos = start_pos;
-    return make_token(TOK_UNKNOWN, "[");
+    return unknown;
   }
 
   skip_whitespace(lexer);
   Token cols = lex_number(lexer);
   if (cols.type != TOK_NUMBER) {
     lexer->pos = start_pos;
-    return make_token(TOK_UNKNOWN, "[");
+    return unknown;
   }
 
   skip_whitespace(lexer);
   if (!match(lexer, '$')) {
     lexer->pos = start_pos;
-    return make_token(TOK_UNKNOWN, "[");
+    return unknown;
   }
 
   skip_whitespace(lexer);
 
-  // Dynamic buffer for accumulating matrix content
-  size_t cap = 256;
-  size_t len = 0;
-  char* buf = calloc(cap, 1);
-  if (!buf) return make_token(TOK_UNKNOWN, "["); // Allocation failed
-
-  // Prepend "rows cols $"
-  int written = snprintf(buf, cap, "%s %s $", rows.text, cols.text);
-  if (written < 0 || (size_t)written >= cap) {
-    free(buf);
-    return make_token(TOK_UNKNOWN, "[");
-  }
-  len = (size_t)written;
-
   bool has_real = false;
   bool has_complex = false;
-  char temp[MAX_TOKEN_LEN * 2];
 
   while (peek(lexer) != '\0' && peek(lexer) != ']') {
     skip_whitespace(lexer);
 
-    Token t;
     if (peek(lexer) == '(') {
-      t = lex_complex(lexer);
+      if (lex_complex(lexer).type != TOK_COMPLEX) break;
       has_complex = true;
     } else if (isdigit(peek(lexer)) || (peek(lexer) == '-' && isdigit(lexer->input[lexer->pos + 1])))
       {
-	t = lex_number(lexer);
+	lex_number(lexer);
 	has_real = true;
       } else {
       break;
     }
 
-    written = snprintf(temp, sizeof(temp), " %s", t.text);
-    if (written < 0 || (size_t)written >= sizeof(temp)) {
-      fprintf(stderr, "token too long to format\n");
-      continue;
-    }
-
-    if (len + (size_t)written + 1 >= cap) {
-      cap *= 2;
-      char* new_buf = realloc(buf, cap);
-      if (!new_buf) {
-        free(buf);
-        return make_token(TOK_UNKNOWN, "[");
-      }
-      buf = new_buf;
-    }
-
-    memcpy(buf + len, temp, written + 1);
-    len += written;
-
     skip_whitespace(lexer);
   }
 
+  size_t end_pos = lexer->pos;
   if (!match(lexer, ']')) {
-    free(buf);
     lexer->pos = start_pos;
-    return make_token(TOK_UNKNOWN, "[");
+    return unknown;
   }
 
   token_type type = has_complex && has_real ? TOK_MATRIX_INLINE_MIXED
                      : has_complex          ? TOK_MATRIX_INLINE_COMPLEX
                      :                        TOK_MATRIX_INLINE_REAL;
 
-  Token result = make_token(type, buf);
-  free(buf);
-  return result;
+  return make_token(type, &lexer->input[start_pos], end_pos - start_pos);
 }
 
 Token next_token(Lexer* lexer) {
   skip_whitespace(lexer);
   char c = peek(lexer);
-  if (c == '\0') return make_token(TOK_EOF, "<EOF>");
+  if (c == '\0') return make_token(TOK_EOF, &lexer->input[lexer->pos], 0);
 
   if (isdigit(c) || (c == '-' && isdigit(lexer->input[lexer->pos + 1]))) return lex_number(lexer);
   if (c == '(') return lex_complex(lexer);
@@ -275,37 +244,41 @@ if (c == '[') {
   if (isalpha(c) || c == '_') return lex_identifier(lexer);
   if (c == '"') return lex_string(lexer);
 
+  const char* here = &lexer->input[lexer->pos];
+
 // Handle multi-character operators
   if (c == '.' && lexer->input[lexer->pos + 1] == '*') {
     lexer->pos += 2;
-    return make_token(TOK_DOT_STAR, ".*");
+    return make_token(TOK_DOT_STAR, here, 2);
   }
   if (c == '.' && lexer->input[lexer->pos + 1] == '/') {
     lexer->pos += 2;
-    return make_token(TOK_DOT_SLASH, "./");
+    return make_token(TOK_DOT_SLASH, here, 2);
   }
   if (c == '.' && lexer->input[lexer->pos + 1] == '^') {
     lexer->pos += 2;
-    return make_token(TOK_DOT_CARET, ".^");
+    return make_token(TOK_DOT_CARET, here, 2);
   }
-  
+
+  advance(lexer);
   switch (c) {
-  case '+': advance(lexer); return make_token(TOK_PLUS, "+");
-  case '-': advance(lexer); return make_token(TOK_MINUS, "-");
-  case '*': advance(lexer); return make_token(TOK_STAR, "*");
-  case '/': advance(lexer); return make_token(TOK_SLASH, "/");
-  case '^': advance(lexer); return make_token(TOK_CARET, "^");
-  case '<': advance(lexer); return make_token(TOK_BRA, "<");
-  case '>': advance(lexer); return make_token(TOK_KET, ">");
-  case '|': advance(lexer); return make_token(TOK_VERTICAL, "|");
-  case ':': advance(lexer); return make_token(TOK_COLON, ":");
-  case ';': advance(lexer); return make_token(TOK_SEMICOLON, ";");
-  case '\'': advance(lexer); return make_token(TOK_FUNCTION, "'");
-  default: {
-    char unknown_char = advance(lexer);
-    char unk[2] = { unknown_char, '\0' };
-    return make_token(TOK_UNKNOWN, unk);
+  case '+': return make_token(TOK_PLUS, here, 1);
+  case '-': return make_token(TOK_MINUS, here, 1);
+  case '*': return make_token(TOK_STAR, here, 1);
+  case '/': return make_token(TOK_SLASH, here, 1);
+  case '^': return make_token(TOK_CARET, here, 1);
+  case '<': return make_token(TOK_BRA, here, 1);
+  case '>': return make_token(TOK_KET, here, 1);
+  case '|': return make_token(TOK_VERTICAL, here, 1);
+  case ':': return make_token(TOK_COLON, here, 1);
+  case ';': return make_token(TOK_SEMICOLON, here, 1);
+  case '\'': {
+    Token token = make_token(TOK_FUNCTION, here, 1);
+    token.sym = intern_symbol(here, 1);
+    return token;
   }
+  default:
+    return make_token(TOK_UNKNOWN, here, 1);
   }
 }
 
@@ -0,0 +1,83 @@
+/*
+ * This file is part of Mico's toy RPN Calculator
+ *
+ * Mico's toy RPN Calculator is free software:
+ * you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mico's toy RPN Calculator is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mico's toy RPN Calculator. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include "line_arena.h"
+
+#define LINE_ARENA_CHUNK (64 * 1024)
+#define LINE_ARENA_ALIGN 16
+
+typedef struct arena_chunk {
+  struct arena_chunk* next;   // older chunk
+  size_t size;
+  size_t used;
+  max_align_t data[];
+} arena_chunk;
+
+static arena_chunk* chunks;   // newest first
+
+static arena_chunk* new_chunk(size_t size) {
+  arena_chunk* c = malloc(sizeof *c + size);
+  if (!c) return NULL;
+  c->next = chunks;
+  c->size = size;
+  c->used = 0;
+  chunks = c;
+  return c;
+}
+
+void* line_alloc(size_t size) {
+  size = (size + LINE_ARENA_ALIGN - 1) & ~(size_t)(LINE_ARENA_ALIGN - 1);
+  arena_chunk* c = chunks;
+  if (!c || c->size - c->used < size) {
+    c = new_chunk(size > LINE_ARENA_CHUNK ? size : LINE_ARENA_CHUNK);
+    if (!c) return NULL;
+  }
+  void* p = (char*)c->data + c->used;
+  c->used += size;
+  return p;
+}
+
+char* line_strndup(const char* str, size_t len) {
+  char* copy = line_alloc(len + 1);
+  if (!copy) return NULL;
+  memcpy(copy, str, len);
+  copy[len] = '\0';
+  return copy;
+}
+
+// Keep one standard chunk for the next line; oversized ones and the
+// overflow of a busy line go back to the system
+void line_arena_reset(void) {
+  while (chunks && (chunks->next || chunks->size != LINE_ARENA_CHUNK)) {
+    arena_chunk* c = chunks;
+    chunks = c->next;
+    free(c);
+  }
+  if (chunks) chunks->used = 0;
+}
+
+void free_line_arena(void) {
+  while (chunks) {
+    arena_chunk* c = chunks;
+    chunks = c->next;
+    free(c);
+  }
+}
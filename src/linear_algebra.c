@@ -51,8 +51,14 @@ int matrix_inverse(Stack* stack) {
       return 1;
     }
 
-    gsl_matrix* inv = gsl_matrix_alloc(n, n);
-    gsl_matrix* tmp = gsl_matrix_alloc(n, n);
+    gsl_matrix* inv = matrix_alloc(n, n);
+    gsl_matrix* tmp = matrix_alloc(n, n);
+    if (!inv || !tmp) {
+      matrix_release(inv);
+      matrix_release(tmp);
+      stack->top++;   // Restore the operand
+      return 1;
+    }
     gsl_matrix_memcpy(tmp, m.matrix_real);
     gsl_permutation* p = gsl_permutation_alloc(n);
     int signum;
@@ -61,10 +67,10 @@ int matrix_inverse(Stack* stack) {
     int status = gsl_linalg_LU_decomp(tmp, p, &signum);
     if (status != GSL_SUCCESS) {
       fprintf(stderr, "LU decomposition failed\n");
-      gsl_matrix_free(inv);
-      gsl_matrix_free(tmp);
+      matrix_release(inv);
+      matrix_release(tmp);
       gsl_permutation_free(p);
-      gsl_matrix_free(m.matrix_real);
+      matrix_release(m.matrix_real);
       return 1;
     }
 
@@ -72,25 +78,25 @@ int matrix_inverse(Stack* stack) {
     double det = gsl_linalg_LU_det(tmp, signum);
     if ((det == 0.0) || (isnan(det))) {
       fprintf(stderr,"Matrix is singular, cannot invert\n");
-      gsl_matrix_free(inv);
-      gsl_matrix_free(tmp);
+      matrix_release(inv);
+      matrix_release(tmp);
       gsl_permutation_free(p);
-      gsl_matrix_free(m.matrix_real); // free popped matrix
+      matrix_release(m.matrix_real); // free popped matrix
       return 1;
     }
 
     // Now safe to invert
     if (gsl_linalg_LU_invert(tmp, p, inv) != 0) {
       fprintf(stderr,"Matrix inversion failed\n");
-      gsl_matrix_free(inv);
-      gsl_matrix_free(tmp);
+      matrix_release(inv);
+      matrix_release(tmp);
       gsl_permutation_free(p);
-      gsl_matrix_free(m.matrix_real);
+      matrix_release(m.matrix_real);
     }
 
-    gsl_matrix_free(tmp);
+    matrix_release(tmp);
     gsl_permutation_free(p);
-    gsl_matrix_free(m.matrix_real);
+    matrix_release(m.matrix_real);
     push_matrix_real(stack, inv);
     return 0;
 
@@ -101,8 +107,14 @@ int matrix_inverse(Stack* stack) {
       return 1;
     }
 
-    gsl_matrix_complex* inv = gsl_matrix_complex_alloc(n, n);
-    gsl_matrix_complex* tmp = gsl_matrix_complex_alloc(n, n);
+    gsl_matrix_complex* inv = matrix_complex_alloc(n, n);
+    gsl_matrix_complex* tmp = matrix_complex_alloc(n, n);
+    if (!inv || !tmp) {
+      matrix_complex_release(inv);
+      matrix_complex_release(tmp);
+      stack->top++;   // Restore the operand
+      return 1;
+    }
     gsl_matrix_complex_memcpy(tmp, m.matrix_complex);
     gsl_permutation* p = gsl_permutation_alloc(n);
     int signum;
@@ -114,25 +126,25 @@ int matrix_inverse(Stack* stack) {
     gsl_complex det = gsl_linalg_complex_LU_det(tmp, signum);
     if (GSL_REAL(det) == 0.0 && GSL_IMAG(det) == 0.0) {
       fprintf(stderr,"Complex matrix is singular, cannot invert\n");
-      gsl_matrix_complex_free(inv);
-      gsl_matrix_complex_free(tmp);
+      matrix_complex_release(inv);
+      matrix_complex_release(tmp);
       gsl_permutation_free(p);
-      gsl_matrix_complex_free(m.matrix_complex);
+      matrix_complex_release(m.matrix_complex);
       return 1;
     }
 
     // Safe to invert
     if (gsl_linalg_complex_LU_invert(tmp, p, inv) != 0) {
       fprintf(stderr,"Complex matrix inversion failed\n");
-      gsl_matrix_complex_free(inv);
-      gsl_matrix_complex_free(tmp);
+      matrix_complex_release(inv);
+      matrix_complex_release(tmp);
       gsl_permutation_free(p);
-      gsl_matrix_complex_free(m.matrix_complex);
+      matrix_complex_release(m.matrix_complex);
     }
 
-    gsl_matrix_complex_free(tmp);
+    matrix_complex_release(tmp);
     gsl_permutation_free(p);
-    gsl_matrix_complex_free(m.matrix_complex);
+    matrix_complex_release(m.matrix_complex);
     push_matrix_complex(stack, inv);
     return 0;
 
@@ -157,20 +169,24 @@ int matrix_determinant(Stack* stack) {
       return 1;
     }
 
-    gsl_matrix* tmp = gsl_matrix_alloc(n, n);
+    gsl_matrix* tmp = matrix_alloc(n, n);
+    if (!tmp) {
+      stack->top++;   // Restore the operand
+      return 1;
+    }
     gsl_matrix_memcpy(tmp, m.matrix_real);
     gsl_permutation* p = gsl_permutation_alloc(n);
     int signum;
 
     if (gsl_linalg_LU_decomp(tmp, p, &signum) != 0) {
       fprintf(stderr,"Matrix decomposition failed\n");
-      gsl_matrix_free(tmp);
+      matrix_release(tmp);
       gsl_permutation_free(p);
       return 1;
     }
 
     double det = gsl_linalg_LU_det(tmp, signum);
-    gsl_matrix_free(tmp);
+    matrix_release(tmp);
     gsl_permutation_free(p);
     push_real(stack, det);
 
@@ -181,19 +197,23 @@ int matrix_determinant(Stack* stack) {
       return 1;
     }
 
-    gsl_matrix_complex* tmp = gsl_matrix_complex_alloc(n, n);
+    gsl_matrix_complex* tmp = matrix_complex_alloc(n, n);
+    if (!tmp) {
+      stack->top++;   // Restore the operand
+      return 1;
+    }
     gsl_matrix_complex_memcpy(tmp, m.matrix_complex);
     gsl_permutation* p = gsl_permutation_alloc(n);
     int signum;
 
     if (gsl_linalg_complex_LU_decomp(tmp, p, &signum) != 0) {
       fprintf(stderr,"Complex matrix decomposition failed\n");
-      gsl_matrix_complex_free(tmp);
+      matrix_complex_release(tmp);
       gsl_permutation_free(p);
       return 1;
     }
     gsl_complex det = gsl_linalg_complex_LU_det(tmp, signum);
-    gsl_matrix_complex_free(tmp);
+    matrix_complex_release(tmp);
     gsl_permutation_free(p);
     push_complex(stack, det);
     return 0;
@@ -221,7 +241,14 @@ int solve_linear_system(Stack* stack) {
     }
 
     size_t n = a.matrix_real->size1;
-    gsl_matrix* A = gsl_matrix_alloc(n, n);
+    gsl_matrix* A = matrix_alloc(n, n);
+    gsl_matrix* result = matrix_alloc(n, 1);
+    if (!A || !result) {
+      matrix_release(A);
+      matrix_release(result);
+      stack->top += 2;   // Restore the operands
+      return 1;
+    }
     gsl_matrix_memcpy(A, a.matrix_real);
     gsl_vector* B = gsl_vector_alloc(n);
     for (size_t i = 0; i < n; ++i)
@@ -234,12 +261,11 @@ int solve_linear_system(Stack* stack) {
     gsl_linalg_LU_decomp(A, p, &signum);
     gsl_linalg_LU_solve(A, p, B, X);
 
-    gsl_matrix* result = gsl_matrix_alloc(n, 1);
     for (size_t i = 0; i < n; ++i)
       gsl_matrix_set(result, i, 0, gsl_vector_get(X, i));
 
     push_matrix_real(stack, result);
-    gsl_matrix_free(A);
+    matrix_release(A);
     gsl_vector_free(B);
     gsl_vector_free(X);
     gsl_permutation_free(p);
@@ -266,29 +292,37 @@ int matrix_eigen_decompose(Stack* stack) {
     }
 
     // Allocate workspace and result containers
-    gsl_matrix* tmp = gsl_matrix_alloc(n, n);
+    gsl_matrix* tmp = matrix_alloc(n, n);
+    gsl_matrix_complex* evec = matrix_complex_alloc(n, n);
+    gsl_matrix_complex* eval_matrix = matrix_complex_calloc(n, n);
+    if (!tmp || !evec || !eval_matrix) {
+      matrix_release(tmp);
+      matrix_complex_release(evec);
+      matrix_complex_release(eval_matrix);
+      stack->top++;   // Restore the operand
+      return 1;
+    }
     gsl_matrix_memcpy(tmp, m.matrix_real);
     gsl_vector_complex* eval = gsl_vector_complex_alloc(n);
-    gsl_matrix_complex* evec = gsl_matrix_complex_alloc(n, n);
     gsl_eigen_nonsymmv_workspace* w = gsl_eigen_nonsymmv_alloc(n);
 
     if (gsl_eigen_nonsymmv(tmp, eval, evec, w) != 0) {
       fprintf(stderr,"Eigen decomposition failed\n");
-      gsl_matrix_free(tmp);
+      matrix_release(tmp);
       gsl_vector_complex_free(eval);
-      gsl_matrix_complex_free(evec);
+      matrix_complex_release(evec);
+      matrix_complex_release(eval_matrix);
       gsl_eigen_nonsymmv_free(w);
       return 1;
     }
 
     gsl_eigen_nonsymmv_free(w);
-    gsl_matrix_free(tmp);
+    matrix_release(tmp);
 
     // Push results to the stack
     push_matrix_complex(stack, evec);
 
     // Convert eigenvalues (vector) to a diagonal matrix
-    gsl_matrix_complex* eval_matrix = gsl_matrix_complex_calloc(n, n);
     for (size_t i = 0; i < n; ++i) {
       gsl_complex z = gsl_vector_complex_get(eval, i);
       gsl_matrix_complex_set(eval_matrix, i, i, z);
@@ -315,9 +349,10 @@ int matrix_transpose(Stack* stack) {
     size_t rows = m.matrix_real->size1;
     size_t cols = m.matrix_real->size2;
 
-    gsl_matrix* transposed = gsl_matrix_alloc(cols, rows);
+    gsl_matrix* transposed = matrix_alloc(cols, rows);
     if (!transposed) {
       fprintf(stderr,"Memory allocation failed for transposed matrix\n");
+      stack->top++;   // Restore the operand
       return 1;
     }
 
@@ -329,15 +364,16 @@ int matrix_transpose(Stack* stack) {
     }
 
     push_matrix_real(stack, transposed);
-    gsl_matrix_free(m.matrix_real);
+    matrix_release(m.matrix_real);
   }
   else if (m.type == TYPE_MATRIX_COMPLEX) {
     size_t rows = m.matrix_complex->size1;
     size_t cols = m.matrix_complex->size2;
 
-    gsl_matrix_complex* transposed = gsl_matrix_complex_alloc(cols, rows);
+    gsl_matrix_complex* transposed = matrix_complex_alloc(cols, rows);
     if (!transposed) {
       fprintf(stderr,"Memory allocation failed for transposed complex matrix\n");
+      stack->top++;   // Restore the operand
       return 1;
     }
 
@@ -349,7 +385,7 @@ int matrix_transpose(Stack* stack) {
     }
 
     push_matrix_complex(stack, transposed);
-    gsl_matrix_complex_free(m.matrix_complex);
+    matrix_complex_release(m.matrix_complex);
     return 0;
   }
   else {
@@ -395,13 +431,17 @@ int matrix_cholesky(Stack* stack) {
     }
   }
 
-  gsl_matrix* tmp = gsl_matrix_alloc(n, n);
+  gsl_matrix* tmp = matrix_alloc(n, n);
+  if (!tmp) {
+    stack->top++;   // Restore the operand
+    return 1;
+  }
   gsl_matrix_memcpy(tmp, m.matrix_real);
 
   int status = gsl_linalg_cholesky_decomp(tmp);
   if (status != 0) {
     fprintf(stderr,"Cholesky decomposition failed (matrix may not be positive definite)\n");
-    gsl_matrix_free(tmp);
+    matrix_release(tmp);
     return 1;
   }
 
@@ -412,7 +452,7 @@ int matrix_cholesky(Stack* stack) {
     }
   }
 
-  gsl_matrix_free(m.matrix_real); // Free original
+  matrix_release(m.matrix_real); // Free original
   push_matrix_real(stack, tmp);
   return 0;
 }
@@ -433,28 +473,39 @@ int matrix_svd(Stack* stack) {
   size_t m_rows = m.matrix_real->size1;
   size_t m_cols = m.matrix_real->size2;
 
-  gsl_matrix* A = gsl_matrix_alloc(m_rows, m_cols);
-  gsl_matrix_memcpy(A, m.matrix_real);
-
   size_t min_dim = (m_rows < m_cols) ? m_rows : m_cols;
 
+  gsl_matrix* A = matrix_alloc(m_rows, m_cols);
+  gsl_matrix* V = matrix_alloc(m_cols, m_cols);     // Right singular vectors
+  gsl_matrix* U = matrix_alloc(m_rows, min_dim);
+  gsl_matrix* S_mat = matrix_calloc(m_rows, m_cols);
+  if (!A || !V || !U || !S_mat) {
+    matrix_release(A);
+    matrix_release(V);
+    matrix_release(U);
+    matrix_release(S_mat);
+    stack->top++;   // Restore the operand
+    return 1;
+  }
+  gsl_matrix_memcpy(A, m.matrix_real);
+
   gsl_vector* S = gsl_vector_alloc(min_dim);            // Singular values
-  gsl_matrix* V = gsl_matrix_alloc(m_cols, m_cols);     // Right singular vectors
   gsl_vector* work = gsl_vector_alloc(min_dim);         // Workspace
 
   int status = gsl_linalg_SV_decomp(A, V, S, work);
 
   if (status != 0) {
     fprintf(stderr,"SVD decomposition failed\n");
-    gsl_matrix_free(A);
-    gsl_matrix_free(V);
+    matrix_release(A);
+    matrix_release(V);
+    matrix_release(U);
+    matrix_release(S_mat);
     gsl_vector_free(S);
     gsl_vector_free(work);
     return 1;
   }
 
   // Extract U from overwritten A
-  gsl_matrix* U = gsl_matrix_alloc(m_rows, min_dim);
   for (size_t i = 0; i < m_rows; ++i) {
     for (size_t j = 0; j < min_dim; ++j) {
       gsl_matrix_set(U, i, j, gsl_matrix_get(A, i, j));
@@ -462,7 +513,6 @@ int matrix_svd(Stack* stack) {
   }
 
   // Create diagonal matrix for S
-  gsl_matrix* S_mat = gsl_matrix_calloc(m_rows, m_cols);
   for (size_t i = 0; i < min_dim; ++i) {
     gsl_matrix_set(S_mat, i, i, gsl_vector_get(S, i));
   }
@@ -475,8 +525,8 @@ int matrix_svd(Stack* stack) {
   // Clean up
   gsl_vector_free(S);
   gsl_vector_free(work);
-  gsl_matrix_free(A);
-  gsl_matrix_free(m.matrix_real);
+  matrix_release(A);
+  matrix_release(m.matrix_real);
   
   return 0;
 }
@@ -525,22 +575,31 @@ int matrix_pseudoinverse(Stack *stack) {
       return 1;
     }
 
-  gsl_matrix *U = gsl_matrix_alloc(rows, cols);
+  gsl_matrix *U = matrix_alloc(rows, cols);
+  gsl_matrix *V = matrix_alloc(cols, cols);
+  gsl_matrix *S_pinv = matrix_calloc(cols, rows);
+  gsl_matrix *VS_pinv = matrix_alloc(cols, rows);
+  gsl_matrix *A_pinv = matrix_alloc(cols, rows);
+  if (!U || !V || !S_pinv || !VS_pinv || !A_pinv) {
+    matrix_release(U); matrix_release(V);
+    matrix_release(S_pinv); matrix_release(VS_pinv); matrix_release(A_pinv);
+    stack->top++;   // Restore the operand
+    return 1;
+  }
   gsl_matrix_memcpy(U, m.matrix_real);
 
-  gsl_matrix *V = gsl_matrix_alloc(cols, cols);
   gsl_vector *S = gsl_vector_alloc(cols);
   gsl_vector *work = gsl_vector_alloc(cols);
 
   if (gsl_linalg_SV_decomp(U, V, S, work) != 0) {
     fprintf(stderr,"SVD decomposition failed\n");
-    gsl_matrix_free(U); gsl_matrix_free(V);
+    matrix_release(U); matrix_release(V);
+    matrix_release(S_pinv); matrix_release(VS_pinv); matrix_release(A_pinv);
     gsl_vector_free(S); gsl_vector_free(work);
-    gsl_matrix_free(m.matrix_real);
+    matrix_release(m.matrix_real);
     return 1;
   }
 
-  gsl_matrix *S_pinv = gsl_matrix_calloc(cols, rows);
   for (size_t i = 0; i < cols; ++i) {
     double s = gsl_vector_get(S, i);
     if (s > tol) {
@@ -548,20 +607,18 @@ int matrix_pseudoinverse(Stack *stack) {
     }
   }
 
-  gsl_matrix *VS_pinv = gsl_matrix_alloc(cols, rows);
   gsl_blas_dgemm(CblasNoTrans, CblasNoTrans, 1.0, V, S_pinv, 0.0, VS_pinv);
 
   gsl_matrix_transpose(U);
-  gsl_matrix *A_pinv = gsl_matrix_alloc(cols, rows);
   gsl_blas_dgemm(CblasNoTrans, CblasNoTrans, 1.0, VS_pinv, U, 0.0, A_pinv);
 
-  gsl_matrix_free(U);
-  gsl_matrix_free(V);
+  matrix_release(U);
+  matrix_release(V);
   gsl_vector_free(S);
   gsl_vector_free(work);
-  gsl_matrix_free(S_pinv);
-  gsl_matrix_free(VS_pinv);
-  gsl_matrix_free(m.matrix_real);  // free popped matrix
+  matrix_release(S_pinv);
+  matrix_release(VS_pinv);
+  matrix_release(m.matrix_real);  // free popped matrix
 
   push_matrix_real(stack, A_pinv);
   return 0;
@@ -62,6 +62,11 @@
 #include "print_fun.h" 
 #include "words.h" 
 #include "run_machine.h"
+#include "undo.h"
+#include "string_intern.h"
+#include "line_arena.h"
+#include "spill.h"
+#include "named_stacks.h"
 
 // Globals
 gsl_rng * global_rng; // Global random number generator, used throughout the program
@@ -72,16 +77,15 @@ void my_error_handler(const char *reason, const char *file, int line, int gsl_er
   // Do NOT call abort(); this allows graceful recovery
 }
 
-
 int repl(void) {
 
   Stack stack;
-  Stack old_stack;
 
   // Initialize everything needed
   splash_screen();
   init_stack(&stack);
-  init_stack(&old_stack);
+  spill_watch_stack(&stack);
+  init_named_stacks(&stack);
   init_registers();
   load_macros_from_file();
   if (verbose_mode) list_macros();
@@ -110,26 +114,34 @@ int repl(void) {
       continue;
     }
    
-    if (!strcmp(line, "undo")) // Restore the old stack
-      { copy_stack(&stack, &old_stack);
-      } else {
-      copy_stack(&old_stack, &stack);  // Preserve the stack
+    if (!strcmp(line, "undo")) {
+      if (!undo_line(&stack)) printf("Nothing to undo.\n");
+    } else if (!strcmp(line, "redo")) {
+      if (!redo_line(&stack)) printf("Nothing to redo.\n");
+    } else {
+      undo_begin_line(&stack);   // journal what the line changes
       evaluate_line(&stack, line);
+      undo_end_line(&stack);
     }
     if (completed_batch)
       completed_batch = false;
     else
       if (!skip_stack_printing) print_stack(&stack,NULL);
     skip_stack_printing = false;
+    line_arena_reset();   // drop the line's temporaries in one go
     free(line);
   }
 
   // Save config, history, and cleanup
   save_config("../data/config.txt");
   write_history(HISTORY_FILE);
-  free_stack(&old_stack);
-  free_stack(&stack);
+  free_named_stacks();
+  free_undo_journal();
+  destroy_stack(&stack);
   free_all_registers();
+  close_spill_file();
+  free_interned_strings();
+  free_line_arena();
   return 0;
 }
 
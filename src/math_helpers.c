@@ -27,6 +27,7 @@
 #include "stat_fun.h"
 #include "spec_fun.h"
 #include "math_helpers.h"
+#include "vec_math.h"
 
 
 gsl_complex my_complex_asin(gsl_complex z) {
@@ -175,14 +176,37 @@ bool is_zero_complex(gsl_complex z) {
     }								\
   }
 
+// Same, but matrices go through the vector math layer (vec_math.h)
+#define DEFINE_VM_UNARY_WRAPPER(name, real_fn, complex_fn, vm)	\
+  void name##_wrapper(Stack* stack) {				\
+    value_type top_type = stack_top_type(stack);			\
+    switch (top_type) {						\
+    case TYPE_REAL:						\
+      apply_real_unary(stack, real_fn);				\
+      return;							\
+    case TYPE_COMPLEX:						\
+      apply_complex_unary(stack, complex_fn);			\
+      return;							\
+    case TYPE_MATRIX_REAL:					\
+      apply_real_matrix_vm_inplace(stack, vm);			\
+      return;							\
+    case TYPE_MATRIX_COMPLEX:					\
+      apply_complex_matrix_vm_inplace(stack, vm);		\
+      return;							\
+    default:							\
+      fprintf(stderr, "Unsupported type in %s\n", #name);	\
+      return;							\
+    }								\
+  }
+
 // These functions do not mutate types
-DEFINE_UNARY_WRAPPER(sin, sin, gsl_complex_sin)
-  DEFINE_UNARY_WRAPPER(cos, cos, gsl_complex_cos)
-  DEFINE_UNARY_WRAPPER(tan, tan, gsl_complex_tan)
+DEFINE_VM_UNARY_WRAPPER(sin, sin, gsl_complex_sin, VM_SIN)
+  DEFINE_VM_UNARY_WRAPPER(cos, cos, gsl_complex_cos, VM_COS)
+  DEFINE_VM_UNARY_WRAPPER(tan, tan, gsl_complex_tan, VM_TAN)
   DEFINE_UNARY_WRAPPER(sinh, sinh, gsl_complex_sinh)
   DEFINE_UNARY_WRAPPER(cosh, cosh, gsl_complex_cosh)
-  DEFINE_UNARY_WRAPPER(tanh, tanh, gsl_complex_tanh)
-  DEFINE_UNARY_WRAPPER(exp, exp, gsl_complex_exp)
+  DEFINE_VM_UNARY_WRAPPER(tanh, tanh, gsl_complex_tanh, VM_TANH)
+  DEFINE_VM_UNARY_WRAPPER(exp, exp, gsl_complex_exp, VM_EXP)
   DEFINE_UNARY_WRAPPER(chs, negate_real, negate_complex)
   DEFINE_UNARY_WRAPPER(inv, one_over_real, one_over_complex)
   DEFINE_UNARY_WRAPPER(frac, safe_frac, safe_frac_complex)
@@ -287,23 +311,12 @@ void arg_wrapper(Stack *stack) {
   return;
 }
 
-void ln_wrapper(Stack *stack) {
-  stack_element a = pop(stack);
-
-  if (a.type == TYPE_REAL) {
-    if (a.real >= 0.0) {
-      push_real(stack, log(a.real));
-    } else {
-      push_complex(stack, gsl_complex_log(gsl_complex_rect(a.real, 0.0)));
-    }
-  }
-
-  else if (a.type == TYPE_COMPLEX) {
-    push_complex(stack, gsl_complex_log(a.complex_val));
-  }
-
-  else if (a.type == TYPE_MATRIX_REAL) {
-    gsl_matrix* m = a.matrix_real;
+// ln, log and sqrt of a matrix: a real one with negative entries is
+// promoted to complex, as for scalars. Takes over a popped element, or puts
+// it back when the result cannot be allocated.
+static void vm_matrix_result(Stack *stack, stack_element* a, vm_fn fn) {
+  if (a->type == TYPE_MATRIX_REAL) {
+    gsl_matrix* m = a->matrix_real;
     size_t rows = m->size1;
     size_t cols = m->size2;
 
@@ -319,42 +332,52 @@ void ln_wrapper(Stack *stack) {
     }
 
     if (has_negative) {
-      // Promote to complex
-      gsl_matrix_complex* cm = gsl_matrix_complex_alloc(rows, cols);
-      for (size_t i = 0; i < rows; ++i) {
-	for (size_t j = 0; j < cols; ++j) {
-	  double x = gsl_matrix_get(m, i, j);
-	  gsl_complex z = gsl_complex_rect(x, 0.0);
-	  gsl_matrix_complex_set(cm, i, j, gsl_complex_log(z));
-	}
+      gsl_matrix_complex* cm = matrix_complex_alloc(rows, cols);
+      if (!cm) {
+        stack->top++;   // Restore the operand
+        return;
       }
+      vm_promoted_matrix(fn, cm, m);
       push_matrix_complex(stack, cm);
     } else {
-      // Stay real
-      gsl_matrix* rm = gsl_matrix_alloc(rows, cols);
-      for (size_t i = 0; i < rows; ++i) {
-	for (size_t j = 0; j < cols; ++j) {
-	  double x = gsl_matrix_get(m, i, j);
-	  gsl_matrix_set(rm, i, j, log(x));
-	}
+      gsl_matrix* rm = matrix_alloc(rows, cols);
+      if (!rm) {
+        stack->top++;   // Restore the operand
+        return;
       }
+      vm_matrix(fn, rm, m);
       push_matrix_real(stack, rm);
     }
+  } else {
+    gsl_matrix_complex* m = a->matrix_complex;
+    gsl_matrix_complex* result = matrix_complex_alloc(m->size1, m->size2);
+    if (!result) {
+      stack->top++;   // Restore the operand
+      return;
+    }
+    vm_complex_matrix(fn, result, m);
+    push_matrix_complex(stack, result);
   }
+  release_element(a);
+}
 
-  else if (a.type == TYPE_MATRIX_COMPLEX) {
-    gsl_matrix_complex* m = a.matrix_complex;
-    size_t rows = m->size1;
-    size_t cols = m->size2;
+void ln_wrapper(Stack *stack) {
+  stack_element a = pop(stack);
 
-    gsl_matrix_complex* result = gsl_matrix_complex_alloc(rows, cols);
-    for (size_t i = 0; i < rows; ++i) {
-      for (size_t j = 0; j < cols; ++j) {
-	gsl_complex z = gsl_matrix_complex_get(m, i, j);
-	gsl_matrix_complex_set(result, i, j, gsl_complex_log(z));
-      }
+  if (a.type == TYPE_REAL) {
+    if (a.real >= 0.0) {
+      push_real(stack, log(a.real));
+    } else {
+      push_complex(stack, gsl_complex_log(gsl_complex_rect(a.real, 0.0)));
     }
-    push_matrix_complex(stack, result);
+  }
+
+  else if (a.type == TYPE_COMPLEX) {
+    push_complex(stack, gsl_complex_log(a.complex_val));
+  }
+
+  else if (a.type == TYPE_MATRIX_REAL || a.type == TYPE_MATRIX_COMPLEX) {
+    vm_matrix_result(stack, &a, VM_LOG);
   }
   else {
     fprintf(stderr, "ln: unsupported type\n");
@@ -383,61 +406,8 @@ void log_wrapper(Stack *stack) {
     push_complex(stack, result);
   }
 
-  else if (a.type == TYPE_MATRIX_REAL) {
-    gsl_matrix* m = a.matrix_real;
-    size_t rows = m->size1;
-    size_t cols = m->size2;
-
-    bool has_negative = false;
-    for (size_t i = 0; i < rows && !has_negative; ++i) {
-      for (size_t j = 0; j < cols; ++j) {
-	if (gsl_matrix_get(m, i, j) < 0.0) {
-	  has_negative = true;
-	  break;
-	}
-      }
-    }
-
-    if (has_negative) {
-      // Promote to complex
-      gsl_matrix_complex* cm = gsl_matrix_complex_alloc(rows, cols);
-      for (size_t i = 0; i < rows; ++i) {
-	for (size_t j = 0; j < cols; ++j) {
-	  double x = gsl_matrix_get(m, i, j);
-	  gsl_complex z = gsl_complex_rect(x, 0.0);
-	  gsl_complex ln_z = gsl_complex_log(z);
-	  gsl_complex res = gsl_complex_div(ln_z, log10_const);
-	  gsl_matrix_complex_set(cm, i, j, res);
-	}
-      }
-      push_matrix_complex(stack, cm);
-    } else {
-      // Stay real
-      gsl_matrix* rm = gsl_matrix_alloc(rows, cols);
-      for (size_t i = 0; i < rows; ++i) {
-	for (size_t j = 0; j < cols; ++j) {
-	  double x = gsl_matrix_get(m, i, j);
-	  gsl_matrix_set(rm, i, j, log10(x));
-	}
-      }
-      push_matrix_real(stack, rm);
-    }
-  }
-
-  else if (a.type == TYPE_MATRIX_COMPLEX) {
-    gsl_matrix_complex* m = a.matrix_complex;
-    size_t rows = m->size1;
-    size_t cols = m->size2;
-
-    gsl_matrix_complex* result = gsl_matrix_complex_alloc(rows, cols);
-    for (size_t i = 0; i < rows; ++i) {
-      for (size_t j = 0; j < cols; ++j) {
-	gsl_complex z = gsl_matrix_complex_get(m, i, j);
-	gsl_complex ln_z = gsl_complex_log(z);
-	gsl_matrix_complex_set(result, i, j, gsl_complex_div(ln_z, log10_const));
-      }
-    }
-    push_matrix_complex(stack, result);
+  else if (a.type == TYPE_MATRIX_REAL || a.type == TYPE_MATRIX_COMPLEX) {
+    vm_matrix_result(stack, &a, VM_LOG10);
   }
   else {
     fprintf(stderr, "log: unsupported type\n");
@@ -460,57 +430,8 @@ void sqrt_wrapper(Stack *stack) {
     push_complex(stack, gsl_complex_sqrt(a.complex_val));
   }
 
-  else if (a.type == TYPE_MATRIX_REAL) {
-    gsl_matrix* m = a.matrix_real;
-    size_t rows = m->size1;
-    size_t cols = m->size2;
-
-    bool has_negative = false;
-    for (size_t i = 0; i < rows && !has_negative; ++i) {
-      for (size_t j = 0; j < cols; ++j) {
-	if (gsl_matrix_get(m, i, j) < 0.0) {
-	  has_negative = true;
-	  break;
-	}
-      }
-    }
-
-    if (has_negative) {
-      // Promote to complex
-      gsl_matrix_complex* cm = gsl_matrix_complex_alloc(rows, cols);
-      for (size_t i = 0; i < rows; ++i) {
-	for (size_t j = 0; j < cols; ++j) {
-	  double x = gsl_matrix_get(m, i, j);
-	  gsl_complex z = gsl_complex_rect(x, 0.0);
-	  gsl_matrix_complex_set(cm, i, j, gsl_complex_sqrt(z));
-	}
-      }
-      push_matrix_complex(stack, cm);
-    } else {
-      gsl_matrix* rm = gsl_matrix_alloc(rows, cols);
-      for (size_t i = 0; i < rows; ++i) {
-	for (size_t j = 0; j < cols; ++j) {
-	  double x = gsl_matrix_get(m, i, j);
-	  gsl_matrix_set(rm, i, j, sqrt(x));
-	}
-      }
-      push_matrix_real(stack, rm);
-    }
-  }
-
-  else if (a.type == TYPE_MATRIX_COMPLEX) {
-    gsl_matrix_complex* m = a.matrix_complex;
-    size_t rows = m->size1;
-    size_t cols = m->size2;
-
-    gsl_matrix_complex* result = gsl_matrix_complex_alloc(rows, cols);
-    for (size_t i = 0; i < rows; ++i) {
-      for (size_t j = 0; j < cols; ++j) {
-	gsl_complex z = gsl_matrix_complex_get(m, i, j);
-	gsl_matrix_complex_set(result, i, j, gsl_complex_sqrt(z));
-      }
-    }
-    push_matrix_complex(stack, result);
+  else if (a.type == TYPE_MATRIX_REAL || a.type == TYPE_MATRIX_COMPLEX) {
+    vm_matrix_result(stack, &a, VM_SQRT);
   }
 
   else {
@@ -34,6 +34,7 @@
 #include <gsl/gsl_randist.h>
 #include "stack.h"
 #include "math_parsers.h"
+#include "line_arena.h"
 #include "math_helpers.h"
 #include "binary_fun.h"
 #include "unary_fun.h"
@@ -47,7 +48,7 @@ int read_complex(const char* input, gsl_complex* z) {
   return 0; // failure
 }
 
-void read_matrix_from_file(Stack *stack, char *input) {
+void read_matrix_from_file(Stack *stack, const char *input) {
   int rows, cols;
   char filename[1024];
   if (sscanf(input, "[%d,%d,\"%255[^\"]\"]", &rows, &cols, filename) == 3) {
@@ -61,9 +62,10 @@ void read_matrix_from_file(Stack *stack, char *input) {
 }
 
 // Parse real matrices: rows cols $ list of real numbers
-gsl_matrix* parse_matrix_literal(const char* input) {
+gsl_matrix* parse_matrix_literal(const char* input, size_t len) {
+  const char* end = input + len;
   const char* p = input;
-  while (isspace(*p)) p++;
+  while (p < end && isspace(*p)) p++;
 
   char* endptr;
   size_t rows = strtoul(p, &endptr, 10);
@@ -73,7 +75,7 @@ gsl_matrix* parse_matrix_literal(const char* input) {
   }
   p = endptr;
 
-  while (isspace(*p)) p++;
+  while (p < end && isspace(*p)) p++;
 
   size_t cols = strtoul(p, &endptr, 10);
   if (p == endptr) {
@@ -82,28 +84,28 @@ gsl_matrix* parse_matrix_literal(const char* input) {
   }
   p = endptr;
 
-  while (isspace(*p)) p++;
+  while (p < end && isspace(*p)) p++;
 
-  if (*p != '$') {
+  if (p == end || *p != '$') {
     fprintf(stderr, "Expected '$' after rows and columns\n");
     return NULL;
   }
   p++; // skip '$'
 
-  double* data = malloc(rows * cols * sizeof(double));
+  double* data = line_alloc(rows * cols * sizeof(double));
   if (!data) {
     fprintf(stderr, "Memory allocation failed\n");
     return NULL;
   }
 
   size_t count = 0;
-  while (count < rows * cols && *p) {
-    while (isspace(*p)) p++;
+  while (count < rows * cols && p < end) {
+    while (p < end && isspace(*p)) p++;
+    if (p == end) break;
 
     double val = strtod(p, &endptr);
     if (p == endptr) {
       fprintf(stderr, "Invalid real number at entry %zu\n", count);
-      free(data);
       return NULL;
     }
     p = endptr;
@@ -112,14 +114,12 @@ gsl_matrix* parse_matrix_literal(const char* input) {
 
   if (count != rows * cols) {
     fprintf(stderr, "Matrix element count mismatch: expected %zu, got %zu\n", rows * cols, count);
-    free(data);
     return NULL;
   }
 
-  gsl_matrix* m = gsl_matrix_alloc(rows, cols);
+  gsl_matrix* m = matrix_alloc(rows, cols);
   if (!m) {
     fprintf(stderr, "Matrix allocation failed\n");
-    free(data);
     return NULL;
   }
 
@@ -129,14 +129,14 @@ gsl_matrix* parse_matrix_literal(const char* input) {
     }
   }
 
-  free(data);
   return m;
 }
 
 // Parse mixed real/complex matrices: rows cols $ list of real and complex numbers
-gsl_matrix_complex* parse_complex_matrix_literal(const char* input) {
+gsl_matrix_complex* parse_complex_matrix_literal(const char* input, size_t len) {
+  const char* end = input + len;
   const char* p = input;
-  while (isspace(*p)) p++;
+  while (p < end && isspace(*p)) p++;
 
   char* endptr;
   size_t rows = strtoul(p, &endptr, 10);
@@ -146,7 +146,7 @@ gsl_matrix_complex* parse_complex_matrix_literal(const char* input) {
   }
   p = endptr;
 
-  while (isspace(*p)) p++;
+  while (p < end && isspace(*p)) p++;
 
   size_t cols = strtoul(p, &endptr, 10);
   if (p == endptr) {
@@ -155,39 +155,38 @@ gsl_matrix_complex* parse_complex_matrix_literal(const char* input) {
   }
   p = endptr;
 
-  while (isspace(*p)) p++;
+  while (p < end && isspace(*p)) p++;
 
-  if (*p != '$') {
+  if (p == end || *p != '$') {
     fprintf(stderr, "Expected '$' after rows and columns\n");
     return NULL;
   }
   p++; // skip '$'
 
-  gsl_complex* data = malloc(rows * cols * sizeof(gsl_complex));
+  gsl_complex* data = line_alloc(rows * cols * sizeof(gsl_complex));
   if (!data) {
     fprintf(stderr, "Memory allocation failed\n");
     return NULL;
   }
 
   size_t count = 0;
-  while (count < rows * cols && *p) {
-    while (isspace(*p)) p++;
+  while (count < rows * cols && p < end) {
+    while (p < end && isspace(*p)) p++;
+    if (p == end) break;
 
     if (*p == '(') {
       p++; // skip '('
       double real = strtod(p, &endptr);
       if (p == endptr) {
 	fprintf(stderr, "Invalid real part at entry %zu\n", count);
-	free(data);
 	return NULL;
       }
       p = endptr;
 
-      while (isspace(*p)) p++;
+      while (p < end && isspace(*p)) p++;
 
       if (*p != ',') {
 	fprintf(stderr, "Expected ',' between real and imaginary at entry %zu\n", count);
-	free(data);
 	return NULL;
       }
       p++; // skip ','
@@ -195,16 +194,14 @@ gsl_matrix_complex* parse_complex_matrix_literal(const char* input) {
       double imag = strtod(p, &endptr);
       if (p == endptr) {
 	fprintf(stderr, "Invalid imaginary part at entry %zu\n", count);
-	free(data);
 	return NULL;
       }
       p = endptr;
 
-      while (isspace(*p)) p++;
+      while (p < end && isspace(*p)) p++;
 
       if (*p != ')') {
 	fprintf(stderr, "Expected ')' after complex number at entry %zu\n", count);
-	free(data);
 	return NULL;
       }
       p++; // skip ')'
@@ -214,28 +211,24 @@ gsl_matrix_complex* parse_complex_matrix_literal(const char* input) {
       double real = strtod(p, &endptr);
       if (p == endptr) {
 	fprintf(stderr, "Invalid real number at entry %zu\n", count);
-	free(data);
 	return NULL;
       }
       p = endptr;
       data[count++] = gsl_complex_rect(real, 0.0);
     } else {
       fprintf(stderr, "Unexpected character at entry %zu: '%c'\n", count, *p);
-      free(data);
       return NULL;
     }
   }
 
   if (count != rows * cols) {
     fprintf(stderr, "Matrix element count mismatch: expected %zu, got %zu\n", rows * cols, count);
-    free(data);
     return NULL;
   }
 
-  gsl_matrix_complex* m = gsl_matrix_complex_alloc(rows, cols);
+  gsl_matrix_complex* m = matrix_complex_alloc(rows, cols);
   if (!m) {
     fprintf(stderr, "Matrix allocation failed\n");
-    free(data);
     return NULL;
   }
 
@@ -245,7 +238,6 @@ gsl_matrix_complex* parse_complex_matrix_literal(const char* input) {
     }
   }
 
-  free(data);
   return m;
 }
 
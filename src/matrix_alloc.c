@@ -0,0 +1,212 @@
+/*
+ * This file is part of Mico's toy RPN Calculator
+ *
+ * Mico's toy RPN Calculator is free software:
+ * you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mico's toy RPN Calculator is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mico's toy RPN Calculator. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#define _DEFAULT_SOURCE   // madvise
+#include <stdint.h>
+#include <sys/mman.h>
+#include <gsl/gsl_errno.h>
+#include "payload.h"
+#include "matrix_alloc.h"
+#include "mem_account.h"
+#include "spill.h"
+
+#define MATRIX_ALIGN 64                  // one cache line, a full AVX-512 vector
+#define HUGE_PAGE ((size_t)2 << 20)
+#define HUGE_PAGE_MIN ((size_t)4 << 20)  // always holds a whole huge page
+
+int matrix_huge_pages = 1;
+
+// **************** Storage ****************
+// GSL allocates a block with malloc alignment. Each matrix gets a block
+// a few elements longer instead, and starts at the first MATRIX_ALIGN
+// boundary inside it (gsl_matrix_alloc_from_block). Such a matrix does
+// not own its block, so matrix_free releases the block after it.
+//
+// The whole block, spare elements included, is charged to the memory
+// account before it is allocated and kept with the payload counts for
+// matrix_free to credit.
+
+// Elements to skip from data to the boundary; 0 when data is already
+// aligned, or when no whole number of elements reaches it
+static size_t align_offset(const double* data, size_t elem_bytes) {
+  size_t past = (uintptr_t)data % MATRIX_ALIGN;
+  if (past == 0 || past % elem_bytes) return 0;
+  return (MATRIX_ALIGN - past) / elem_bytes;
+}
+
+// The huge pages wholly inside a large block. The block is not rounded
+// up to them, so it stays exactly the memory allocated.
+static void offer_huge_pages(const double* data, size_t bytes) {
+#ifdef MADV_HUGEPAGE
+  if (!matrix_huge_pages || bytes < HUGE_PAGE_MIN) return;
+  uintptr_t start = ((uintptr_t)data + HUGE_PAGE - 1) & ~(uintptr_t)(HUGE_PAGE - 1);
+  uintptr_t end = ((uintptr_t)data + bytes) & ~(uintptr_t)(HUGE_PAGE - 1);
+  if (end > start) madvise((void*)start, end - start, MADV_HUGEPAGE);
+#else
+  (void)data;
+  (void)bytes;
+#endif
+}
+
+// **************** Real matrices ****************
+#define REAL_SPARE (MATRIX_ALIGN / sizeof(double) - 1)
+
+gsl_matrix* matrix_alloc(size_t rows, size_t cols) {
+  if (!rows || !cols) return gsl_matrix_alloc(rows, cols);   // GSL reports it
+  size_t count = rows * cols + REAL_SPARE;
+  size_t bytes = count * sizeof(double);
+  if (!memory_charge(bytes)) return NULL;   // memory_charge said why
+  gsl_block* b = gsl_block_alloc(count);
+  size_t offset = b ? align_offset(b->data, sizeof(double)) : 0;
+  gsl_matrix* m = b ? gsl_matrix_alloc_from_block(b, offset, rows, cols, cols) : NULL;
+  if (!m || !payload_set_charge(m, bytes)) {
+    gsl_matrix_free(m);
+    gsl_block_free(b);
+    memory_credit(bytes);
+    GSL_ERROR_NULL("failed to allocate space for matrix", GSL_ENOMEM);
+  }
+  offer_huge_pages(b->data, b->size * sizeof(double));
+  return m;
+}
+
+gsl_matrix* matrix_calloc(size_t rows, size_t cols) {
+  gsl_matrix* m = matrix_alloc(rows, cols);
+  if (m) gsl_matrix_set_zero(m);
+  return m;
+}
+
+void matrix_free(gsl_matrix* m) {
+  if (!m) return;
+  if (matrix_spilled(m)) spill_forget(m);   // its storage is already gone
+  memory_credit(payload_take_charge(m));   // 0 for matrices GSL allocated
+  gsl_block* b = m->owner ? NULL : m->block;
+  gsl_matrix_free(m);
+  gsl_block_free(b);
+}
+
+// **************** Complex matrices ****************
+#define COMPLEX_SPARE (MATRIX_ALIGN / (2 * sizeof(double)) - 1)
+
+gsl_matrix_complex* matrix_complex_alloc(size_t rows, size_t cols) {
+  if (!rows || !cols) return gsl_matrix_complex_alloc(rows, cols);
+  size_t count = rows * cols + COMPLEX_SPARE;
+  size_t bytes = count * 2 * sizeof(double);
+  if (!memory_charge(bytes)) return NULL;
+  gsl_block_complex* b = gsl_block_complex_alloc(count);
+  size_t offset = b ? align_offset(b->data, 2 * sizeof(double)) : 0;
+  gsl_matrix_complex* m = b ? gsl_matrix_complex_alloc_from_block(b, offset, rows, cols, cols) : NULL;
+  if (!m || !payload_set_charge(m, bytes)) {
+    gsl_matrix_complex_free(m);
+    gsl_block_complex_free(b);
+    memory_credit(bytes);
+    GSL_ERROR_NULL("failed to allocate space for matrix", GSL_ENOMEM);
+  }
+  offer_huge_pages(b->data, b->size * 2 * sizeof(double));
+  return m;
+}
+
+gsl_matrix_complex* matrix_complex_calloc(size_t rows, size_t cols) {
+  gsl_matrix_complex* m = matrix_complex_alloc(rows, cols);
+  if (m) gsl_matrix_complex_set_zero(m);
+  return m;
+}
+
+void matrix_complex_free(gsl_matrix_complex* m) {
+  if (!m) return;
+  if (matrix_complex_spilled(m)) spill_forget(m);
+  memory_credit(payload_take_charge(m));
+  gsl_block_complex* b = m->owner ? NULL : m->block;
+  gsl_matrix_complex_free(m);
+  gsl_block_complex_free(b);
+}
+
+// **************** Storage alone ****************
+// The matrix keeps its dimensions and references; only the block goes.
+// The charge goes with it, and comes back with the new block.
+void matrix_storage_drop(void* m, bool is_complex) {
+  memory_credit(payload_take_charge(m));
+  if (is_complex) {
+    gsl_matrix_complex* c = m;
+    gsl_block_complex_free(c->block);
+    c->block = NULL;
+    c->data = NULL;
+  } else {
+    gsl_matrix* r = m;
+    gsl_block_free(r->block);
+    r->block = NULL;
+    r->data = NULL;
+  }
+}
+
+bool matrix_storage_restore(void* m, bool is_complex) {
+  if (is_complex) {
+    gsl_matrix_complex* c = m;
+    size_t count = c->size1 * c->size2 + COMPLEX_SPARE;
+    size_t bytes = count * 2 * sizeof(double);
+    if (!memory_charge(bytes)) return false;
+    gsl_block_complex* b = gsl_block_complex_alloc(count);
+    if (!b || !payload_set_charge(m, bytes)) {
+      gsl_block_complex_free(b);
+      memory_credit(bytes);
+      return false;
+    }
+    c->block = b;
+    c->data = b->data + 2 * align_offset(b->data, 2 * sizeof(double));
+    offer_huge_pages(b->data, bytes);
+  } else {
+    gsl_matrix* r = m;
+    size_t count = r->size1 * r->size2 + REAL_SPARE;
+    size_t bytes = count * sizeof(double);
+    if (!memory_charge(bytes)) return false;
+    gsl_block* b = gsl_block_alloc(count);
+    if (!b || !payload_set_charge(m, bytes)) {
+      gsl_block_free(b);
+      memory_credit(bytes);
+      return false;
+    }
+    r->block = b;
+    r->data = b->data + align_offset(b->data, sizeof(double));
+    offer_huge_pages(b->data, bytes);
+  }
+  return true;
+}
+
+// For a second owner of a resident matrix that wants to drop its share
+// of the storage but keep the shape: GSL builds the header on the
+// original's block, which is then let go of
+void* matrix_header_like(const void* m, bool is_complex) {
+  if (is_complex) {
+    const gsl_matrix_complex* src = m;
+    size_t offset = (size_t)(src->data - src->block->data) / 2;
+    gsl_matrix_complex* c = gsl_matrix_complex_alloc_from_block(src->block, offset, src->size1,
+                                                                src->size2, src->tda);
+    if (c) {
+      c->block = NULL;
+      c->data = NULL;
+    }
+    return c;
+  }
+  const gsl_matrix* src = m;
+  size_t offset = (size_t)(src->data - src->block->data);
+  gsl_matrix* r = gsl_matrix_alloc_from_block(src->block, offset, src->size1, src->size2, src->tda);
+  if (r) {
+    r->block = NULL;
+    r->data = NULL;
+  }
+  return r;
+}
@@ -54,6 +54,12 @@ int split_matrix(Stack *s) {
       return -1;
     }
 
+    // Make room for all of it at once, with the matrix still in place
+    if (!stack_reserve(s, (int)(matrix->size1 * matrix->size2) - 1)) {
+      fprintf(stderr, "Error: stack overflow.\n");
+      return -1;
+    }
+
     // Remove matrix from the stack
     s->top--;
 
@@ -62,11 +68,6 @@ int split_matrix(Stack *s) {
       for (size_t j = 0; j < matrix->size2; ++j) {
         double val = gsl_matrix_get(matrix, i, j);
 
-        if (s->top >= STACK_SIZE - 1) {
-          fprintf(stderr, "Error: stack overflow.\n");
-          return -1;
-        }
-
         s->top++;
         s->items[s->top].type = TYPE_REAL;
         s->items[s->top].real = val;
@@ -79,6 +80,12 @@ int split_matrix(Stack *s) {
       return -1;
     }
 
+    // Make room for all of it at once, with the matrix still in place
+    if (!stack_reserve(s, (int)(matrix->size1 * matrix->size2) - 1)) {
+      fprintf(stderr, "Error: stack overflow.\n");
+      return -1;
+    }
+
     // Remove matrix from the stack
     s->top--;
 
@@ -87,11 +94,6 @@ int split_matrix(Stack *s) {
       for (size_t j = 0; j < matrix->size2; ++j) {
         gsl_complex z = gsl_matrix_complex_get(matrix, i, j);
 
-        if (s->top >= STACK_SIZE - 1) {
-          fprintf(stderr, "Error: stack overflow.\n");
-          return -1;
-        }
-
         s->top++;
         s->items[s->top].type = TYPE_COMPLEX;
         s->items[s->top].complex_val = z;
@@ -184,6 +186,7 @@ int set_matrix_element(Stack *s) {
 
   size_t row = (size_t)row_elem->real;
   size_t col = (size_t)col_elem->real;
+  if (!make_unique(matrix_elem)) return -1;
 
   if (matrix_elem->type == TYPE_MATRIX_REAL) {
     gsl_matrix *matrix = matrix_elem->matrix_real;
@@ -238,26 +241,34 @@ int matrix_extract_diagonal(Stack* stack) {
     size_t n =
       (m.matrix_real->size1 < m.matrix_real->size2) ? m.matrix_real->size1 : m.matrix_real->size2;
 
-    gsl_matrix* diag = gsl_matrix_calloc(1, n);
+    gsl_matrix* diag = matrix_calloc(1, n);
+    if (!diag) {
+      stack->top++;   // Restore the operand
+      return 1;
+    }
     for (size_t i = 0; i < n; ++i) {
       double val = gsl_matrix_get(m.matrix_real, i, i);
       gsl_matrix_set(diag, 0, i, val);
     }
 
-    gsl_matrix_free(m.matrix_real);
+    matrix_release(m.matrix_real);
     push_matrix_real(stack, diag);
 
   } else if (m.type == TYPE_MATRIX_COMPLEX) {
     size_t n =
       (m.matrix_complex->size1 < m.matrix_complex->size2) ? m.matrix_complex->size1 : m.matrix_complex->size2;
 
-    gsl_matrix_complex* diag = gsl_matrix_complex_calloc(1, n);
+    gsl_matrix_complex* diag = matrix_complex_calloc(1, n);
+    if (!diag) {
+      stack->top++;   // Restore the operand
+      return 1;
+    }
     for (size_t i = 0; i < n; ++i) {
       gsl_complex z = gsl_matrix_complex_get(m.matrix_complex, i, i);
       gsl_matrix_complex_set(diag, 0, i, z);
     }
 
-    gsl_matrix_complex_free(m.matrix_complex);
+    matrix_complex_release(m.matrix_complex);
     push_matrix_complex(stack, diag);
 
   } else {
@@ -288,7 +299,7 @@ int make_unit_matrix(Stack* stack) {
     return 1;
   }
 
-  gsl_matrix* m = gsl_matrix_calloc(n, n); // allocates and zeroes the matrix
+  gsl_matrix* m = matrix_calloc(n, n); // allocates and zeroes the matrix
   if (!m) {
     fprintf(stderr, "Failed to allocate matrix.\n");
     return 1;
@@ -322,7 +333,7 @@ int make_row_range(Stack* stack) {
     return 1;
   }
 
-  gsl_matrix* mat = gsl_matrix_calloc(1, num_cols); // allocates and zeroes the matrix
+  gsl_matrix* mat = matrix_calloc(1, num_cols); // allocates and zeroes the matrix
   if (!mat) {
     fprintf(stderr, "Failed to allocate matrix.\n");
     return 1;
@@ -364,7 +375,7 @@ int make_matrix_of_ones(Stack* stack) {
     return 1;
   }
 
-  gsl_matrix* mat = gsl_matrix_calloc(n, m); // allocates and zeroes the matrix
+  gsl_matrix* mat = matrix_calloc(n, m); // allocates and zeroes the matrix
   if (!mat) {
     fprintf(stderr, "Failed to allocate matrix.\n");
     return 1;
@@ -406,7 +417,7 @@ int make_matrix_of_zeroes(Stack* stack) {
     return 1;
   }
 
-  gsl_matrix* mat = gsl_matrix_calloc(n, m); // allocates and zeroes the matrix
+  gsl_matrix* mat = matrix_calloc(n, m); // allocates and zeroes the matrix
   if (!mat) {
     fprintf(stderr, "Failed to allocate matrix.\n");
     return 1;
@@ -444,7 +455,7 @@ int make_random_matrix(Stack* stack) {
 
   //    gsl_rng * rng = gsl_rng_alloc(gsl_rng_mt19937);
     
-  gsl_matrix* mat = gsl_matrix_alloc(n, m);  // Allocate uninitialized matrix
+  gsl_matrix* mat = matrix_alloc(n, m);  // Allocate uninitialized matrix
   if (!mat) {
     fprintf(stderr, "Failed to allocate matrix.\n");
     return 1;
@@ -484,7 +495,7 @@ int make_gaussian_random_matrix(Stack* stack) {
     fprintf(stderr, "Dimensions must be positive, got %d x %d.\n", n, m);
     return 1;
   }
-  gsl_matrix* mat = gsl_matrix_alloc(n, m);  // Allocate uninitialized matrix
+  gsl_matrix* mat = matrix_alloc(n, m);  // Allocate uninitialized matrix
   if (!mat) {
     fprintf(stderr, "Failed to allocate matrix.\n");
     return 1;
@@ -575,7 +586,7 @@ int reshape_matrix(Stack* stack) {
             return 1;
         }
 
-        gsl_matrix* reshaped = gsl_matrix_alloc(new_rows, new_cols);
+        gsl_matrix* reshaped = matrix_alloc(new_rows, new_cols);
         if (!reshaped) {
             fprintf(stderr, "Allocation failed for reshaped matrix.\n");
             return 1;
@@ -593,7 +604,7 @@ int reshape_matrix(Stack* stack) {
         }
 
         // Replace original matrix
-        gsl_matrix_free(original);
+        matrix_release(original);
         mat_elem->matrix_real = reshaped;
 
     } else if (mat_elem->type == TYPE_MATRIX_COMPLEX) {
@@ -610,7 +621,7 @@ int reshape_matrix(Stack* stack) {
             return 1;
         }
 
-        gsl_matrix_complex* reshaped = gsl_matrix_complex_alloc(new_rows, new_cols);
+        gsl_matrix_complex* reshaped = matrix_complex_alloc(new_rows, new_cols);
         if (!reshaped) {
             fprintf(stderr, "Allocation failed for reshaped complex matrix.\n");
             return 1;
@@ -626,7 +637,7 @@ int reshape_matrix(Stack* stack) {
             }
         }
 
-        gsl_matrix_complex_free(original);
+        matrix_complex_release(original);
         mat_elem->matrix_complex = reshaped;
 
     } else {
@@ -663,7 +674,11 @@ int make_diag_matrix(Stack *stack) {
         // Remove original vector from stack
         stack->top--;
 
-        gsl_matrix *diag = gsl_matrix_calloc(len, len);
+        gsl_matrix *diag = matrix_calloc(len, len);
+        if (!diag) {
+            stack->top++;   // Put the vector back
+            return -1;
+        }
         for (size_t i = 0; i < len; ++i) {
             double val = (vec->size1 == 1)
                          ? gsl_matrix_get(vec, 0, i)
@@ -672,7 +687,7 @@ int make_diag_matrix(Stack *stack) {
         }
 
         push_matrix_real(stack, diag);
-        gsl_matrix_free(vec);
+        matrix_release(vec);
     }
     else if (top->type == TYPE_MATRIX_COMPLEX) {
         gsl_matrix_complex *vec = top->matrix_complex;
@@ -689,7 +704,11 @@ int make_diag_matrix(Stack *stack) {
 
         stack->top--;
 
-        gsl_matrix_complex *diag = gsl_matrix_complex_calloc(len, len);
+        gsl_matrix_complex *diag = matrix_complex_calloc(len, len);
+        if (!diag) {
+            stack->top++;   // Put the vector back
+            return -1;
+        }
         for (size_t i = 0; i < len; ++i) {
             gsl_complex val = (vec->size1 == 1)
                               ? gsl_matrix_complex_get(vec, 0, i)
@@ -698,7 +717,7 @@ int make_diag_matrix(Stack *stack) {
         }
 
         push_matrix_complex(stack, diag);
-        gsl_matrix_complex_free(vec);
+        matrix_complex_release(vec);
     }
     else {
         fprintf(stderr, "Error: top of stack is not a matrix.\n");
@@ -727,12 +746,17 @@ int stack_join_matrix_vertical(Stack* stack) {
 
     if (mixed) {
         // Promote both to complex
-        gsl_matrix_complex* mc1 = gsl_matrix_complex_alloc(
+        gsl_matrix_complex* mc1 = matrix_complex_alloc(
             (second->type == TYPE_MATRIX_REAL) ? second->matrix_real->size1 : second->matrix_complex->size1,
             (second->type == TYPE_MATRIX_REAL) ? second->matrix_real->size2 : second->matrix_complex->size2);
-        gsl_matrix_complex* mc2 = gsl_matrix_complex_alloc(
+        gsl_matrix_complex* mc2 = matrix_complex_alloc(
             (top->type == TYPE_MATRIX_REAL) ? top->matrix_real->size1 : top->matrix_complex->size1,
             (top->type == TYPE_MATRIX_REAL) ? top->matrix_real->size2 : top->matrix_complex->size2);
+        if (!mc1 || !mc2) {
+            matrix_complex_release(mc1);
+            matrix_complex_release(mc2);
+            return 1;
+        }
 
         // Fill mc1
         if (second->type == TYPE_MATRIX_REAL) {
@@ -757,13 +781,18 @@ int stack_join_matrix_vertical(Stack* stack) {
         // Check column compatibility
         if (mc1->size2 != mc2->size2) {
             fprintf(stderr, "Column sizes must match to join matrices.\n");
-            gsl_matrix_complex_free(mc1);
-            gsl_matrix_complex_free(mc2);
+            matrix_complex_release(mc1);
+            matrix_complex_release(mc2);
             return 1;
         }
 
         // Allocate joined matrix
-        gsl_matrix_complex* joined = gsl_matrix_complex_alloc(mc1->size1 + mc2->size1, mc1->size2);
+        gsl_matrix_complex* joined = matrix_complex_alloc(mc1->size1 + mc2->size1, mc1->size2);
+        if (!joined) {
+            matrix_complex_release(mc1);
+            matrix_complex_release(mc2);
+            return 1;
+        }
         gsl_matrix_complex_view top_block =
 	  gsl_matrix_complex_submatrix(joined, 0, 0, mc1->size1, mc1->size2);
         gsl_matrix_complex_view bot_block =
@@ -773,8 +802,8 @@ int stack_join_matrix_vertical(Stack* stack) {
         gsl_matrix_complex_memcpy(&bot_block.matrix, mc2);
 
         // Clean up
-        gsl_matrix_complex_free(mc1);
-        gsl_matrix_complex_free(mc2);
+        matrix_complex_release(mc1);
+        matrix_complex_release(mc2);
 
         // Pop both, push result
         pop(stack);
@@ -791,7 +820,8 @@ int stack_join_matrix_vertical(Stack* stack) {
         rows2 = top->matrix_real->size1;
         cols1 = second->matrix_real->size2;
 
-        gsl_matrix* joined = gsl_matrix_alloc(rows1 + rows2, cols1);
+        gsl_matrix* joined = matrix_alloc(rows1 + rows2, cols1);
+        if (!joined) return 1;
         gsl_matrix_view top_block = gsl_matrix_submatrix(joined, 0, 0, rows1, cols1);
         gsl_matrix_view bot_block = gsl_matrix_submatrix(joined, rows1, 0, rows2, cols1);
 
@@ -820,12 +850,17 @@ int stack_join_matrix_horizontal(Stack* stack) {
     bool mixed = top_complex || second_complex;
 
     if (mixed) {
-        gsl_matrix_complex* mc1 = gsl_matrix_complex_alloc(
+        gsl_matrix_complex* mc1 = matrix_complex_alloc(
             (second->type == TYPE_MATRIX_REAL) ? second->matrix_real->size1 : second->matrix_complex->size1,
             (second->type == TYPE_MATRIX_REAL) ? second->matrix_real->size2 : second->matrix_complex->size2);
-        gsl_matrix_complex* mc2 = gsl_matrix_complex_alloc(
+        gsl_matrix_complex* mc2 = matrix_complex_alloc(
             (top->type == TYPE_MATRIX_REAL) ? top->matrix_real->size1 : top->matrix_complex->size1,
             (top->type == TYPE_MATRIX_REAL) ? top->matrix_real->size2 : top->matrix_complex->size2);
+        if (!mc1 || !mc2) {
+            matrix_complex_release(mc1);
+            matrix_complex_release(mc2);
+            return 1;
+        }
 
         // Promote real to complex if necessary
         if (second->type == TYPE_MATRIX_REAL) {
@@ -849,12 +884,17 @@ int stack_join_matrix_horizontal(Stack* stack) {
         // Check row compatibility
         if (mc1->size1 != mc2->size1) {
             fprintf(stderr, "Row sizes must match to join matrices horizontally.\n");
-            gsl_matrix_complex_free(mc1);
-            gsl_matrix_complex_free(mc2);
+            matrix_complex_release(mc1);
+            matrix_complex_release(mc2);
             return 1;
         }
 
-        gsl_matrix_complex* joined = gsl_matrix_complex_alloc(mc1->size1, mc1->size2 + mc2->size2);
+        gsl_matrix_complex* joined = matrix_complex_alloc(mc1->size1, mc1->size2 + mc2->size2);
+        if (!joined) {
+            matrix_complex_release(mc1);
+            matrix_complex_release(mc2);
+            return 1;
+        }
         gsl_matrix_complex_view left =
 	  gsl_matrix_complex_submatrix(joined, 0, 0, mc1->size1, mc1->size2);
         gsl_matrix_complex_view right =
@@ -863,8 +903,8 @@ int stack_join_matrix_horizontal(Stack* stack) {
         gsl_matrix_complex_memcpy(&left.matrix, mc1);
         gsl_matrix_complex_memcpy(&right.matrix, mc2);
 
-        gsl_matrix_complex_free(mc1);
-        gsl_matrix_complex_free(mc2);
+        matrix_complex_release(mc1);
+        matrix_complex_release(mc2);
 
         pop(stack);
         pop(stack);
@@ -880,7 +920,8 @@ int stack_join_matrix_horizontal(Stack* stack) {
         size_t cols1 = second->matrix_real->size2;
         size_t cols2 = top->matrix_real->size2;
 
-        gsl_matrix* joined = gsl_matrix_alloc(rows, cols1 + cols2);
+        gsl_matrix* joined = matrix_alloc(rows, cols1 + cols2);
+        if (!joined) return 1;
         gsl_matrix_view left = gsl_matrix_submatrix(joined, 0, 0, rows, cols1);
         gsl_matrix_view right = gsl_matrix_submatrix(joined, 0, cols1, rows, cols2);
 
@@ -904,7 +945,8 @@ int matrix_cumsum_rows(Stack* stack) {
 
     if (top->type == TYPE_MATRIX_REAL) {
         gsl_matrix* m = top->matrix_real;
-        gsl_matrix* result = gsl_matrix_alloc(m->size1, m->size2);
+        gsl_matrix* result = matrix_alloc(m->size1, m->size2);
+        if (!result) return 1;
 
         for (size_t i = 0; i < m->size1; i++) {
             double sum = 0.0;
@@ -919,7 +961,8 @@ int matrix_cumsum_rows(Stack* stack) {
     }
     else if (top->type == TYPE_MATRIX_COMPLEX) {
         gsl_matrix_complex* m = top->matrix_complex;
-        gsl_matrix_complex* result = gsl_matrix_complex_alloc(m->size1, m->size2);
+        gsl_matrix_complex* result = matrix_complex_alloc(m->size1, m->size2);
+        if (!result) return 1;
 
         for (size_t i = 0; i < m->size1; i++) {
             gsl_complex sum = gsl_complex_rect(0.0, 0.0);
@@ -950,7 +993,8 @@ int matrix_cumsum_cols(Stack* stack) {
 
     if (top->type == TYPE_MATRIX_REAL) {
         gsl_matrix* m = top->matrix_real;
-        gsl_matrix* result = gsl_matrix_alloc(m->size1, m->size2);
+        gsl_matrix* result = matrix_alloc(m->size1, m->size2);
+        if (!result) return 1;
 
         for (size_t j = 0; j < m->size2; j++) {
             double sum = 0.0;
@@ -965,7 +1009,8 @@ int matrix_cumsum_cols(Stack* stack) {
     }
     else if (top->type == TYPE_MATRIX_COMPLEX) {
         gsl_matrix_complex* m = top->matrix_complex;
-        gsl_matrix_complex* result = gsl_matrix_complex_alloc(m->size1, m->size2);
+        gsl_matrix_complex* result = matrix_complex_alloc(m->size1, m->size2);
+        if (!result) return 1;
 
         for (size_t j = 0; j < m->size2; j++) {
             gsl_complex sum = gsl_complex_rect(0.0, 0.0);
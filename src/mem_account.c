@@ -0,0 +1,155 @@
+/*
+ * This file is part of Mico's toy RPN Calculator
+ *
+ * Mico's toy RPN Calculator is free software:
+ * you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mico's toy RPN Calculator is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mico's toy RPN Calculator. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "stack.h"
+#include "registers.h"
+#include "undo.h"
+#include "mem_account.h"
+#include "spill.h"
+#include "named_stacks.h"
+
+int memory_budget_mb = 0;
+
+static size_t live;   // bytes of matrix data allocated and not yet freed
+static size_t peak;
+
+static size_t budget_bytes(void) {
+  return (size_t)memory_budget_mb << 20;
+}
+
+static bool memory_fits(size_t bytes) {
+  return memory_budget_mb <= 0 || live + bytes <= budget_bytes();
+}
+
+bool memory_charge(size_t bytes) {
+  if (!memory_fits(bytes)) {
+    fprintf(stderr, "Memory budget of %d MB exceeded: %.1f MB in use, %.1f MB more requested.\n",
+            memory_budget_mb, live / 1048576.0, bytes / 1048576.0);
+    return false;
+  }
+  live += bytes;
+  if (live > peak) peak = live;
+  return true;
+}
+
+size_t memory_in_use(void) {
+  return live;
+}
+
+void memory_credit(size_t bytes) {
+  live = bytes < live ? live - bytes : 0;
+}
+
+// **************** Breakdown by owner ****************
+// A payload shared by several owners is counted once, for the first owner
+// that reaches it: stack, registers, undo journal, then parked named stacks.
+enum { OWN_STACK, OWN_REGISTERS, OWN_UNDO, OWN_PARKED, OWNERS };
+
+typedef struct {
+  const void** seen;   // open addressing, NULL for empty
+  size_t capacity;     // power of two
+  size_t used;
+  int owner;
+  size_t matrices[OWNERS];
+  size_t strings[OWNERS];
+} tally;
+
+static bool first_visit(tally* t, const void* p) {
+  if (2 * (t->used + 1) > t->capacity) {
+    size_t capacity = t->capacity ? 2 * t->capacity : 256;
+    const void** seen = calloc(capacity, sizeof *seen);
+    if (!seen) return true;   // may count twice, but never skips
+    for (size_t i = 0; i < t->capacity; i++) {
+      if (!t->seen[i]) continue;
+      size_t j = ((uintptr_t)t->seen[i] >> 4) & (capacity - 1);
+      while (seen[j]) j = (j + 1) & (capacity - 1);
+      seen[j] = t->seen[i];
+    }
+    free(t->seen);
+    t->seen = seen;
+    t->capacity = capacity;
+  }
+  size_t j = ((uintptr_t)p >> 4) & (t->capacity - 1);
+  while (t->seen[j]) {
+    if (t->seen[j] == p) return false;
+    j = (j + 1) & (t->capacity - 1);
+  }
+  t->seen[j] = p;
+  t->used++;
+  return true;
+}
+
+static void count_element(const stack_element* e, void* ctx) {
+  tally* t = ctx;
+  switch (e->type) {
+  case TYPE_STRING:
+    if (!e->short_string && first_visit(t, e->string))
+      t->strings[t->owner] += strlen(e->string) + 1;
+    break;
+  case TYPE_MATRIX_REAL:   // spilled data is counted once, as the spill file
+    if (first_visit(t, e->matrix_real) && !matrix_spilled(e->matrix_real))
+      t->matrices[t->owner] += e->matrix_real->size1 * e->matrix_real->size2 * sizeof(double);
+    break;
+  case TYPE_MATRIX_COMPLEX:
+    if (first_visit(t, e->matrix_complex) && !matrix_complex_spilled(e->matrix_complex))
+      t->matrices[t->owner] += e->matrix_complex->size1 * e->matrix_complex->size2 * 2 * sizeof(double);
+    break;
+  default:
+    break;
+  }
+}
+
+static void print_kb(const char* owner, size_t matrices, size_t strings) {
+  printf("%-11s %12.1f KB %12.1f KB\n", owner, matrices / 1024.0, strings / 1024.0);
+}
+
+void print_memory_report(const Stack* stack) {
+  tally t = {0};
+  t.owner = OWN_STACK;
+  for (int i = 0; i <= stack->top; i++) count_element(&stack->items[i], &t);
+  t.owner = OWN_REGISTERS;
+  for (int i = 0; i < MAX_REG; i++)
+    if (registers[i].occupied) count_element(&registers[i].value, &t);
+  t.owner = OWN_UNDO;
+  undo_for_each_entry(count_element, &t);
+  parked_histories_for_each_entry(count_element, &t);
+  t.owner = OWN_PARKED;
+  parked_stacks_for_each_entry(count_element, &t);
+  free(t.seen);
+
+  size_t owned = packed_bytes();
+  for (int o = 0; o < OWNERS; o++) owned += t.matrices[o];
+
+  printf("%-11s %15s %15s\n", "owner", "matrices", "strings");
+  print_kb("stack", t.matrices[OWN_STACK], t.strings[OWN_STACK]);
+  print_kb("registers", t.matrices[OWN_REGISTERS], t.strings[OWN_REGISTERS]);
+  print_kb("undo", t.matrices[OWN_UNDO], t.strings[OWN_UNDO]);
+  print_kb("stacks", t.matrices[OWN_PARKED], t.strings[OWN_PARKED]);
+  print_kb("packed", packed_bytes(), 0);
+  // Literals of cached lines, matrices of an operation in progress and
+  // the alignment slack of each block
+  print_kb("other", live > owned ? live - owned : 0, 0);
+  printf("matrix data: %.1f KB now, %.1f KB peak, ", live / 1024.0, peak / 1024.0);
+  if (memory_budget_mb > 0) printf("budget %d MB\n", memory_budget_mb);
+  else printf("no budget\n");
+  print_spill_stats();
+}
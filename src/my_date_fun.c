@@ -22,11 +22,17 @@ int extract_day_month_year(Stack* stack) {
     }
 
     int day, month, year;
-    if (sscanf(date_elem.string, "%d.%d.%d", &day, &month, &year) != 3) {
+    if (sscanf(element_string(&date_elem), "%d.%d.%d", &day, &month, &year) != 3) {
         fprintf(stderr, "Error: Invalid date format. Expected DD.MM.YYYY\n");
         return 1;
     }
 
+    if (!stack_reserve(stack, 3)) {
+        fprintf(stderr, "Error: Stack overflow\n");
+        stack->top++;   // leave the date where it was
+        return 1;
+    }
+
     // Push year
     stack_element y = { .type = TYPE_REAL, .real = year };
     stack->items[++stack->top] = y;
@@ -59,7 +65,7 @@ int date_plus_days(Stack* stack) {
       }
 
     int day, month, year;
-    if (sscanf(date_elem.string, "%d.%d.%d", &day, &month, &year) != 3) {
+    if (sscanf(element_string(&date_elem), "%d.%d.%d", &day, &month, &year) != 3) {
         fprintf(stderr, "Error: Invalid date format. Expected DD.MM.YYYY\n");
         return 1;
     }
@@ -91,23 +97,7 @@ int date_plus_days(Stack* stack) {
              new_date->tm_mon + 1,
              new_date->tm_year + 1900);
 
-    char* result = strdup(buffer);
-    if (!result) {
-        fprintf(stderr, "Error: Memory allocation failed\n");
-        return 1;
-    }
-
-    stack_element out;
-    out.type = TYPE_STRING;
-    out.string = result;
-
-    if (stack->top >= STACK_SIZE - 1) {
-        fprintf(stderr, "Error: Stack overflow\n");
-        free(result);
-        return 1;
-    }
-
-    stack->items[++stack->top] = out;
+    push_string(stack, buffer);
     return 0;
 }
 
@@ -126,7 +116,7 @@ int push_weekday_name_from_date_string(Stack* stack) {
     }
 
     int day, month, year;
-    if (sscanf(elem.string, "%d.%d.%d", &day, &month, &year) != 3) {
+    if (sscanf(element_string(&elem), "%d.%d.%d", &day, &month, &year) != 3) {
         fprintf(stderr, "Error: Invalid date format. Expected DD.MM.YYYY\n");
         return 1;
     }
@@ -153,23 +143,7 @@ int push_weekday_name_from_date_string(Stack* stack) {
     }
 
     const char* weekday_name = weekdays[date.tm_wday];
-    char* result = strdup(weekday_name);
-    if (!result) {
-        fprintf(stderr, "Error: Memory allocation failed\n");
-        return 1;
-    }
-
-    stack_element out;
-    out.type = TYPE_STRING;
-    out.string = result;
-
-    if (stack->top >= STACK_SIZE - 1) {
-        fprintf(stderr, "Error: Stack overflow\n");
-        free(result);
-        return 1;
-    }
-
-    stack->items[++stack->top] = out;
+    push_string(stack, weekday_name);
     return 0;
 }
 
@@ -194,24 +168,7 @@ int push_today_date(Stack* stack) {
              tm_now->tm_mon + 1,
              tm_now->tm_year + 1900);
 
-    // Duplicate the string before pushing
-    char* date_str = strdup(buffer);
-    if (!date_str) {
-        fprintf(stderr, "Error: memory allocation failed\n");
-        return 1;
-    }
-
-    stack_element elem;
-    elem.type = TYPE_STRING;
-    elem.string = date_str;
-
-    if (stack->top >= STACK_SIZE - 1) {
-        fprintf(stderr, "Error: stack overflow\n");
-        free(date_str);
-        return 1;
-    }
-
-    stack->items[++stack->top] = elem;
+    push_string(stack, buffer);
     return 0;
 }
 
@@ -231,8 +188,8 @@ int delta_days_strings(Stack* stack) {
     }
 
     struct tm tm1 = {0}, tm2 = {0};
-    if (sscanf(a.string, "%d.%d.%d", &tm1.tm_mday, &tm1.tm_mon, &tm1.tm_year) != 3 ||
-        sscanf(b.string, "%d.%d.%d", &tm2.tm_mday, &tm2.tm_mon, &tm2.tm_year) != 3) {
+    if (sscanf(element_string(&a), "%d.%d.%d", &tm1.tm_mday, &tm1.tm_mon, &tm1.tm_year) != 3 ||
+        sscanf(element_string(&b), "%d.%d.%d", &tm2.tm_mday, &tm2.tm_mon, &tm2.tm_year) != 3) {
         fprintf(stderr, "Error: invalid date format. Use DD.MM.YYYY\n");
         return 1;
     }
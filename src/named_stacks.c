@@ -0,0 +1,172 @@
+/*
+ * This file is part of Mico's toy RPN Calculator
+ *
+ * Mico's toy RPN Calculator is free software:
+ * you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mico's toy RPN Calculator is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mico's toy RPN Calculator. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "stack.h"
+#include "undo.h"
+#include "spill.h"
+#include "named_stacks.h"
+
+typedef struct {
+  char name[NAMED_STACK_NAME_MAX + 1];
+  Stack stack;              // empty while current: the REPL's Stack holds it
+  undo_history* history;    // likewise, the undo journal holds it
+} named_stack;
+
+static named_stack* stacks;
+static int stack_count;
+static int stack_capacity;
+static int current;         // index of the stack in use
+static Stack* repl_stack;
+
+static named_stack* add_stack(const char* name) {
+  if (stack_count == stack_capacity) {
+    int capacity = stack_capacity ? 2 * stack_capacity : 8;
+    named_stack* grown = realloc(stacks, (size_t)capacity * sizeof *grown);
+    if (!grown) {
+      fprintf(stderr, "Out of memory for another stack.\n");
+      return NULL;
+    }
+    stacks = grown;
+    stack_capacity = capacity;
+  }
+  named_stack* s = &stacks[stack_count++];
+  snprintf(s->name, sizeof s->name, "%s", name);
+  init_stack(&s->stack);
+  s->history = NULL;
+  return s;
+}
+
+void init_named_stacks(Stack* stack) {
+  repl_stack = stack;
+  current = 0;
+  if (stack_count == 0) add_stack("main");
+}
+
+static int find_stack(const char* name) {
+  for (int i = 0; i < stack_count; i++)
+    if (!strcmp(stacks[i].name, name)) return i;
+  return -1;
+}
+
+// Takes the name off the top; false, with a message, if there is none
+static bool pop_name(Stack* stack, const char* op, char* name) {
+  if (stack != repl_stack || stack_count == 0) {
+    fprintf(stderr, "%s: named stacks only work at the REPL.\n", op);
+    return false;
+  }
+  if (stack->top < 0 || stack->items[stack->top].type != TYPE_STRING) {
+    fprintf(stderr, "%s: need a stack name on top of the stack.\n", op);
+    return false;
+  }
+  stack_element e = pop(stack);
+  size_t len = strlen(element_string(&e));
+  bool ok = len > 0 && len <= NAMED_STACK_NAME_MAX;
+  if (ok) memcpy(name, element_string(&e), len + 1);
+  else fprintf(stderr, "%s: stack names are 1 to %d characters.\n", op, NAMED_STACK_NAME_MAX);
+  release_element(&e);
+  return ok;
+}
+
+void stack_fork(Stack* stack) {
+  char name[NAMED_STACK_NAME_MAX + 1];
+  if (!pop_name(stack, "sfork", name)) return;
+  if (find_stack(name) >= 0) {
+    fprintf(stderr, "sfork: there is already a stack named %s.\n", name);
+    return;
+  }
+  named_stack* s = add_stack(name);
+  if (s && !copy_stack(&s->stack, stack)) {
+    destroy_stack(&s->stack);
+    stack_count--;
+  }
+}
+
+void stack_switch(Stack* stack) {
+  char name[NAMED_STACK_NAME_MAX + 1];
+  if (!pop_name(stack, "sswitch", name)) return;
+  int to = find_stack(name);
+  if (to < 0) {
+    fprintf(stderr, "sswitch: no stack named %s.\n", name);
+    return;
+  }
+  if (to == current) return;
+
+  // What the line did so far is undone on the stack it did it to
+  bool journaled = undo_rec.stack == stack;
+  undo_end_line(stack);
+
+  stacks[current].stack = *stack;
+  stacks[current].history = undo_detach_history();
+  *stack = stacks[to].stack;
+  init_stack(&stacks[to].stack);
+  undo_attach_history(stacks[to].history);
+  stacks[to].history = NULL;
+  current = to;
+
+  spill_watch_stack(stack);   // its positions now hold other entries
+  if (journaled) undo_begin_line(stack);
+}
+
+void stack_drop_named(Stack* stack) {
+  char name[NAMED_STACK_NAME_MAX + 1];
+  if (!pop_name(stack, "sdrop", name)) return;
+  int i = find_stack(name);
+  if (i < 0) {
+    fprintf(stderr, "sdrop: no stack named %s.\n", name);
+    return;
+  }
+  if (i == current) {
+    fprintf(stderr, "sdrop: %s is the stack in use; switch away from it first.\n", name);
+    return;
+  }
+  destroy_stack(&stacks[i].stack);
+  undo_free_history(stacks[i].history);
+  memmove(&stacks[i], &stacks[i + 1], (size_t)(stack_count - i - 1) * sizeof *stacks);
+  stack_count--;
+  if (i < current) current--;
+}
+
+void list_named_stacks(Stack* stack) {
+  (void)stack;
+  for (int i = 0; i < stack_count; i++) {
+    const Stack* s = i == current ? repl_stack : &stacks[i].stack;
+    printf("%c %-16s %d entries\n", i == current ? '*' : ' ', stacks[i].name, s->top + 1);
+  }
+}
+
+void parked_stacks_for_each_entry(void (*visit)(const stack_element* e, void* ctx), void* ctx) {
+  for (int i = 0; i < stack_count; i++)
+    for (int k = 0; k <= stacks[i].stack.top; k++) visit(&stacks[i].stack.items[k], ctx);
+}
+
+void parked_histories_for_each_entry(void (*visit)(const stack_element* e, void* ctx), void* ctx) {
+  for (int i = 0; i < stack_count; i++) undo_history_for_each_entry(stacks[i].history, visit, ctx);
+}
+
+void free_named_stacks(void) {
+  for (int i = 0; i < stack_count; i++) {
+    destroy_stack(&stacks[i].stack);
+    undo_free_history(stacks[i].history);
+  }
+  free(stacks);
+  stacks = NULL;
+  stack_count = stack_capacity = current = 0;
+}
@@ -0,0 +1,34 @@
+/*
+ * This file is part of Mico's toy RPN Calculator
+ *
+ * Mico's toy RPN Calculator is free software:
+ * you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mico's toy RPN Calculator is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mico's toy RPN Calculator. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include <stdint.h>
+#include "function_list.h"
+#include "opcode_hash.h"
+#include "opcode_hash_tables.h"   // generated by tools/gen_opcodes.c
+
+int lookup_opcode(const char* name, size_t len) {
+  int32_t d = opcode_displacement[opcode_hash(0, name, len) % OPCODE_HASH_SIZE];
+  uint32_t slot = d < 0 ? (uint32_t)(-d - 1) : opcode_hash((uint32_t)d, name, len) % OPCODE_HASH_SIZE;
+  int op = opcode_slot[slot];
+  const char* candidate = function_names[op];
+
+  // Any string hashes to some slot; only the builtin stored there matches
+  if (strncmp(candidate, name, len) != 0 || candidate[len] != '\0') return -1;
+  return op;
+}
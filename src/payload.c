@@ -0,0 +1,154 @@
+/*
+ * This file is part of Mico's toy RPN Calculator
+ *
+ * Mico's toy RPN Calculator is free software:
+ * you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mico's toy RPN Calculator is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mico's toy RPN Calculator. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "payload.h"
+#include "string_intern.h"
+
+// Open addressing on the payload address, linear probing, no tombstones.
+// A payload has an entry while it is shared or while it carries a charge.
+typedef struct {
+  const void* ptr;
+  int extra;            // references beyond the first
+  size_t charged;       // bytes memory_charge'd for its storage
+} payload_ref;
+
+static payload_ref* table;
+static size_t table_size;    // power of two, or 0 before first use
+static size_t table_used;
+
+static size_t slot_of(const void* p) {
+  uint64_t h = (uint64_t)(uintptr_t)p * 0x9E3779B97F4A7C15ull;
+  return (size_t)(h >> 32) & (table_size - 1);
+}
+
+static payload_ref* find(const void* p) {
+  if (table_used == 0) return NULL;
+  for (size_t i = slot_of(p);; i = (i + 1) & (table_size - 1)) {
+    if (table[i].ptr == p) return &table[i];
+    if (!table[i].ptr) return NULL;
+  }
+}
+
+static bool grow_table(void) {
+  size_t old_size = table_size;
+  payload_ref* old = table;
+  size_t size = old_size ? 2 * old_size : 64;
+  payload_ref* fresh = calloc(size, sizeof *fresh);
+  if (!fresh) return false;
+
+  table = fresh;
+  table_size = size;
+  for (size_t i = 0; i < old_size; i++) {
+    if (!old[i].ptr) continue;
+    size_t j = slot_of(old[i].ptr);
+    while (table[j].ptr) j = (j + 1) & (table_size - 1);
+    table[j] = old[i];
+  }
+  free(old);
+  return true;
+}
+
+// Backward-shift deletion keeps every probe chain unbroken
+static void remove_slot(payload_ref* ref) {
+  size_t i = (size_t)(ref - table);
+  size_t j = i;
+  table[i].ptr = NULL;
+  for (;;) {
+    j = (j + 1) & (table_size - 1);
+    if (!table[j].ptr) break;
+    size_t home = slot_of(table[j].ptr);
+    // Move j into the hole at i unless its home lies cyclically in (i, j]
+    if ((i <= j) ? (home <= i || home > j) : (home <= i && home > j)) {
+      table[i] = table[j];
+      table[j].ptr = NULL;
+      i = j;
+    }
+  }
+  table_used--;
+}
+
+static payload_ref* insert(const void* p) {
+  if (2 * (table_used + 1) > table_size && !grow_table()) return NULL;
+  size_t i = slot_of(p);
+  while (table[i].ptr) i = (i + 1) & (table_size - 1);
+  table[i] = (payload_ref){p, 0, 0};
+  table_used++;
+  return &table[i];
+}
+
+void payload_retain(const void* p) {
+  if (!p) return;
+  payload_ref* ref = find(p);
+  if (!ref) ref = insert(p);
+  if (!ref) {
+    // Cannot track it: better to leak a payload than to free it twice
+    fprintf(stderr, "Out of memory sharing a value; it will not be freed.\n");
+    return;
+  }
+  ref->extra++;
+}
+
+bool payload_release(const void* p) {
+  payload_ref* ref = p ? find(p) : NULL;
+  if (!ref || ref->extra == 0) return true;
+  if (--ref->extra == 0 && !ref->charged) remove_slot(ref);
+  return false;
+}
+
+bool payload_is_shared(const void* p) {
+  payload_ref* ref = p ? find(p) : NULL;
+  return ref && ref->extra > 0;
+}
+
+bool payload_set_charge(const void* p, size_t bytes) {
+  payload_ref* ref = find(p);
+  if (!ref) ref = insert(p);
+  if (!ref) return false;
+  ref->charged = bytes;
+  return true;
+}
+
+size_t payload_charge(const void* p) {
+  payload_ref* ref = p ? find(p) : NULL;
+  return ref ? ref->charged : 0;
+}
+
+size_t payload_take_charge(const void* p) {
+  payload_ref* ref = p ? find(p) : NULL;
+  if (!ref) return 0;
+  size_t bytes = ref->charged;
+  ref->charged = 0;
+  if (ref->extra == 0) remove_slot(ref);
+  return bytes;
+}
+
+void matrix_release(gsl_matrix* m) {
+  if (payload_release(m)) matrix_free(m);
+}
+
+void matrix_complex_release(gsl_matrix_complex* m) {
+  if (payload_release(m)) matrix_complex_free(m);
+}
+
+void string_release(char* s) {
+  if (payload_release(s)) free(s);
+  else if (!payload_is_shared(s)) release_if_interned(s);
+}
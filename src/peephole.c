@@ -0,0 +1,101 @@
+/*
+ * This file is part of Mico's toy RPN Calculator
+ *
+ * Mico's toy RPN Calculator is free software:
+ * you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mico's toy RPN Calculator is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mico's toy RPN Calculator. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Peephole pass over compiled code. Short instruction sequences that the
+// macros and programs use all the time are fused into one superinstruction
+// (see the end of bc_op). Each fused op has a fast path for real scalars
+// and otherwise replays the original sequence, so results never change.
+
+#include <stdio.h>
+#include <stdbool.h>
+#include "opcodes.h"
+#include "compiler.h"
+#include "peephole.h"
+
+#define PEEPHOLE_MAX_PATTERN 4
+
+typedef struct {
+  bc_op op;
+  int opcode;          // which builtin, for BC_BUILTIN
+} bc_pattern;
+
+typedef struct {
+  const char* name;
+  bc_op fused;
+  int length;
+  bc_pattern pattern[PEEPHOLE_MAX_PATTERN];
+  unsigned long sites;   // places the rule fired in compiled code
+} peephole_rule;
+
+// Tried in order at every position, so longer patterns come first.
+// A BC_PUSH_REAL in a pattern hands its number to the fused instruction.
+static peephole_rule rules[] = {
+  {"over - swap /", BC_PCT_DELTA, 4,
+   {{BC_BUILTIN, OP_OVER}, {BC_SUB, OP_NONE}, {BC_BUILTIN, OP_SWAP}, {BC_DIV, OP_NONE}}, 0},
+  {"over over /",   BC_OVER2_DIV, 3,
+   {{BC_BUILTIN, OP_OVER}, {BC_BUILTIN, OP_OVER}, {BC_DIV, OP_NONE}}, 0},
+  {"dup *",         BC_SQUARE,    2, {{BC_BUILTIN, OP_DUP}, {BC_MUL, OP_NONE}}, 0},
+  {"swap drop",     BC_NIP,       2, {{BC_BUILTIN, OP_SWAP}, {BC_BUILTIN, OP_DROP}}, 0},
+  {"over -",        BC_OVER_SUB,  2, {{BC_BUILTIN, OP_OVER}, {BC_SUB, OP_NONE}}, 0},
+  {"swap /",        BC_SWAP_DIV,  2, {{BC_BUILTIN, OP_SWAP}, {BC_DIV, OP_NONE}}, 0},
+  {"<number> +",    BC_ADD_K,     2, {{BC_PUSH_REAL, OP_NONE}, {BC_ADD, OP_NONE}}, 0},
+  {"<number> -",    BC_SUB_K,     2, {{BC_PUSH_REAL, OP_NONE}, {BC_SUB, OP_NONE}}, 0},
+  {"<number> *",    BC_MUL_K,     2, {{BC_PUSH_REAL, OP_NONE}, {BC_MUL, OP_NONE}}, 0},
+  {"<number> /",    BC_DIV_K,     2, {{BC_PUSH_REAL, OP_NONE}, {BC_DIV, OP_NONE}}, 0},
+};
+
+#define RULE_COUNT ((int)(sizeof rules / sizeof rules[0]))
+
+unsigned long superinstruction_runs[BC_OP_COUNT];
+
+static bool matches(const peephole_rule* r, const bc_instr* code, int n) {
+  if (r->length > n) return false;
+  for (int k = 0; k < r->length; k++) {
+    if (code[k].op != r->pattern[k].op) return false;
+    if (code[k].op == BC_BUILTIN && code[k].opcode != r->pattern[k].opcode) return false;
+  }
+  return true;
+}
+
+void peephole_optimize(code_block* code) {
+  int out = 0;
+  for (int i = 0; i < code->count; ) {
+    const peephole_rule* hit = NULL;
+    for (int r = 0; r < RULE_COUNT && !hit; r++)
+      if (matches(&rules[r], &code->code[i], code->count - i)) hit = &rules[r];
+
+    if (!hit) {
+      code->code[out++] = code->code[i++];
+      continue;
+    }
+    bc_instr fused = {.op = hit->fused};
+    if (hit->pattern[0].op == BC_PUSH_REAL) fused.number = code->code[i].number;
+    code->code[out++] = fused;
+    rules[hit - rules].sites++;
+    i += hit->length;
+  }
+  code->count = out;
+}
+
+void print_fusion_stats(void) {
+  printf("%-16s %10s %14s\n", "fusion", "sites", "executions");
+  for (int r = 0; r < RULE_COUNT; r++)
+    printf("%-16s %10lu %14lu\n", rules[r].name, rules[r].sites,
+           superinstruction_runs[rules[r].fused] +
+           superinstruction_runs[BC_FAST_FUSED(rules[r].fused)]);
+}
@@ -119,7 +119,12 @@ void poly_roots(Stack* stack) {
         return;
     }
 
-    gsl_matrix_complex* result = gsl_matrix_complex_alloc(1, n - 1);
+    gsl_matrix_complex* result = matrix_complex_alloc(1, n - 1);
+    if (!result) {
+        free(z);
+        stack->top++;   // Restore the operand
+        return;
+    }
     for (size_t i = 0; i < n - 1; ++i) {
         double re = z[2 * i];
         double im = z[2 * i + 1];
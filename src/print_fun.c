@@ -51,7 +51,7 @@ void print_top_scalar(const Stack* stack) {
 	     print_precision, GSL_IMAG(stack->items[i].complex_val));
     break;
   case TYPE_STRING:
-    printf("[%d] 𝒮 : \"%s\"\n", i, stack->items[i].string);
+    printf("[%d] 𝒮 : \"%s\"\n", i, element_string(&stack->items[i]));
     break;
   default:
     break;
@@ -84,7 +84,7 @@ void print_stack(const Stack* stack, char *title) {
 	       print_precision, GSL_IMAG(stack->items[i].complex_val));
       break;
     case TYPE_STRING:
-      printf("[%d] 𝒮 : \"%s\"\n", i, stack->items[i].string);
+      printf("[%d] 𝒮 : \"%s\"\n", i, element_string(&stack->items[i]));
       break;
     case TYPE_MATRIX_REAL:
       printf("[%d] Mℝ: %zu x %zu matrix\n", i,
@@ -0,0 +1,212 @@
+/*
+ * This file is part of Mico's toy RPN Calculator
+ *
+ * Mico's toy RPN Calculator is free software:
+ * you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mico's toy RPN Calculator is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mico's toy RPN Calculator. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <math.h>
+#include "compiler.h"
+#include "compare_fun.h"
+#include "opcodes.h"
+#include "stack_effects.h"
+#include "symbols.h"
+#include "real_kernel.h"
+
+#define MAX_KERNEL_INLINE 8
+
+// sp points at the top entry; every step returns the new top
+static double* k_push(double* sp, const kernel_step* s)  { *++sp = s->k; return sp; }
+static double* k_add(double* sp, const kernel_step* s)   { (void)s; sp[-1] += sp[0]; return sp - 1; }
+static double* k_sub(double* sp, const kernel_step* s)   { (void)s; sp[-1] -= sp[0]; return sp - 1; }
+static double* k_mul(double* sp, const kernel_step* s)   { (void)s; sp[-1] *= sp[0]; return sp - 1; }
+static double* k_div(double* sp, const kernel_step* s)   { (void)s; sp[-1] /= sp[0]; return sp - 1; }
+static double* k_pow(double* sp, const kernel_step* s)   { (void)s; sp[-1] = pow(sp[-1], sp[0]); return sp - 1; }
+static double* k_fn(double* sp, const kernel_step* s)    { *sp = s->f(*sp); return sp; }
+static double* k_dup(double* sp, const kernel_step* s)   { (void)s; sp[1] = sp[0]; return sp + 1; }
+static double* k_drop(double* sp, const kernel_step* s)  { (void)s; return sp - 1; }
+static double* k_over(double* sp, const kernel_step* s)  { (void)s; sp[1] = sp[-1]; return sp + 1; }
+static double* k_nip(double* sp, const kernel_step* s)   { (void)s; sp[-1] = sp[0]; return sp - 1; }
+static double* k_square(double* sp, const kernel_step* s) { (void)s; *sp *= *sp; return sp; }
+static double* k_add_k(double* sp, const kernel_step* s) { *sp += s->k; return sp; }
+static double* k_sub_k(double* sp, const kernel_step* s) { *sp -= s->k; return sp; }
+static double* k_mul_k(double* sp, const kernel_step* s) { *sp *= s->k; return sp; }
+static double* k_div_k(double* sp, const kernel_step* s) { *sp /= s->k; return sp; }
+
+static double* k_swap(double* sp, const kernel_step* s) {
+  (void)s;
+  double t = sp[0];
+  sp[0] = sp[-1];
+  sp[-1] = t;
+  return sp;
+}
+
+static double* k_tuck(double* sp, const kernel_step* s) {   // over swap: a b -> a a b
+  (void)s;
+  sp[1] = sp[0];
+  sp[0] = sp[-1];
+  return sp + 1;
+}
+
+static double* k_over2_div(double* sp, const kernel_step* s) { (void)s; sp[1] = sp[-1] / sp[0]; return sp + 1; }
+static double* k_over_sub(double* sp, const kernel_step* s)  { (void)s; sp[0] -= sp[-1]; return sp; }
+static double* k_swap_div(double* sp, const kernel_step* s)  { (void)s; sp[-1] = sp[0] / sp[-1]; return sp - 1; }
+static double* k_pct_delta(double* sp, const kernel_step* s) { (void)s; sp[-1] = (sp[0] - sp[-1]) / sp[-1]; return sp - 1; }
+
+static double* k_cmp(double* sp, const kernel_step* s) {
+  double a = sp[-1], b = sp[0];
+  int r = 0;
+  switch ((comparison_op)s->cmp) {
+  case CMP_EQ:  r = a == b; break;
+  case CMP_NE:  r = a != b; break;
+  case CMP_LT:  r = a <  b; break;
+  case CMP_LE:  r = a <= b; break;
+  case CMP_GT:  r = a >  b; break;
+  case CMP_GE:  r = a >= b; break;
+  case CMP_AND: r = a && b; break;
+  case CMP_OR:  r = a || b; break;
+  }
+  sp[-1] = r;
+  return sp - 1;
+}
+
+// How each bytecode op maps to a closure, for the ops whose effect on
+// reals is fixed. needs is counted from the top, delta is the net change.
+static const struct {
+  kernel_fn fn;
+  int needs;
+  int delta;
+} op_steps[BC_OP_COUNT] = {
+  [BC_PUSH_REAL] = {k_push, 0, 1},
+  [BC_ADD] = {k_add, 2, -1}, [BC_SUB] = {k_sub, 2, -1},
+  [BC_MUL] = {k_mul, 2, -1}, [BC_DIV] = {k_div, 2, -1},
+  [BC_POW] = {k_pow, 2, -1},
+  [BC_SQUARE] = {k_square, 1, 0}, [BC_NIP] = {k_nip, 2, -1},
+  [BC_OVER2_DIV] = {k_over2_div, 2, 1}, [BC_OVER_SUB] = {k_over_sub, 2, 0},
+  [BC_SWAP_DIV] = {k_swap_div, 2, -1}, [BC_PCT_DELTA] = {k_pct_delta, 2, -1},
+  [BC_ADD_K] = {k_add_k, 1, 0}, [BC_SUB_K] = {k_sub_k, 1, 0},
+  [BC_MUL_K] = {k_mul_k, 1, 0}, [BC_DIV_K] = {k_div_k, 1, 0},
+};
+
+static const struct {
+  kernel_fn fn;
+  int needs;
+  int delta;
+} shuffle_steps[] = {
+  [FX_CONST] = {k_push, 0, 1},
+  [FX_REAL_UNARY] = {k_fn, 1, 0}, [FX_TO_REAL] = {k_fn, 1, 0},
+  [FX_CMP] = {k_cmp, 2, -1},
+  [FX_DUP] = {k_dup, 1, 1}, [FX_DROP] = {k_drop, 1, -1},
+  [FX_SWAP] = {k_swap, 2, 0}, [FX_OVER] = {k_over, 2, 1},
+  [FX_NIP] = {k_nip, 2, -1}, [FX_TUCK] = {k_tuck, 2, 1},
+};
+
+typedef struct {
+  real_kernel* kernel;
+  int depth;            // entries on the kernel stack, x included
+} kernel_builder;
+
+static bool emit(kernel_builder* b, kernel_fn fn, int needs, int delta, kernel_step step) {
+  // An underflow must stay an interpreter error, so it never compiles
+  if (!fn || b->depth < needs || b->depth + delta > KERNEL_STACK_SIZE) return false;
+  if (b->kernel->count == b->kernel->capacity) {
+    int capacity = b->kernel->capacity ? 2 * b->kernel->capacity : 16;
+    kernel_step* steps = realloc(b->kernel->steps, (size_t)capacity * sizeof *steps);
+    if (!steps) return false;
+    b->kernel->steps = steps;
+    b->kernel->capacity = capacity;
+  }
+  step.fn = fn;
+  b->kernel->steps[b->kernel->count++] = step;
+  b->depth += delta;
+  return true;
+}
+
+static bool translate(kernel_builder* b, const code_block* cb, int nesting);
+
+static bool translate_builtin(kernel_builder* b, int opcode) {
+  builtin_effect fx = builtin_effect_of(opcode);
+  kernel_step step = {0};
+
+  switch (fx) {
+  case FX_CONST:
+    step.k = constant_of(opcode);
+    break;
+  case FX_REAL_UNARY:
+  case FX_TO_REAL:
+    // Only where the builtin does nothing but apply a real function
+    if (!(step.f = real_unary_of(opcode))) return false;
+    break;
+  case FX_CMP:
+    step.cmp = comparison_of(opcode);
+    break;
+  case FX_DUP: case FX_DROP: case FX_SWAP: case FX_OVER: case FX_NIP: case FX_TUCK:
+    break;
+  default:              // printing, maybe-complex results, roll, clst, the rest
+    return false;
+  }
+  return emit(b, shuffle_steps[fx].fn, shuffle_steps[fx].needs, shuffle_steps[fx].delta, step);
+}
+
+static bool translate_call(kernel_builder* b, const symbol* sym, int nesting) {
+  // Inline what the name is bound to now: a kernel lives for one solver run
+  const user_word* w = sym->macro ? sym->macro : sym->word;
+  if (!w || !w->code || nesting >= MAX_KERNEL_INLINE) return false;
+  return translate(b, w->code, nesting + 1);
+}
+
+static bool translate(kernel_builder* b, const code_block* cb, int nesting) {
+  for (int i = 0; i < cb->count; i++) {
+    const bc_instr* ins = &cb->code[i];
+    kernel_step step = {0};
+
+    switch (ins->op) {
+    case BC_END:
+      return true;
+    case BC_BUILTIN:
+      if (!translate_builtin(b, ins->opcode)) return false;
+      break;
+    case BC_CALL:
+      if (!translate_call(b, ins->sym, nesting)) return false;
+      break;
+    default:
+      step.k = ins->number;    // PUSH_REAL and the *_K immediates
+      if (!emit(b, op_steps[ins->op].fn, op_steps[ins->op].needs, op_steps[ins->op].delta, step))
+        return false;
+    }
+  }
+  return true;
+}
+
+bool build_real_kernel(const user_word* w, real_kernel* kernel) {
+  *kernel = (real_kernel){0};
+  if (!w || !w->code) return false;
+
+  kernel_builder b = {kernel, 1};
+  // Only reals ever reach the stack, so the result is x's function or a
+  // constant; with nothing left on top the interpreter would underflow
+  if (!translate(&b, w->code, 0) || b.depth < 1) {
+    free_real_kernel(kernel);
+    return false;
+  }
+  return true;
+}
+
+void free_real_kernel(real_kernel* kernel) {
+  free(kernel->steps);
+  *kernel = (real_kernel){0};
+}
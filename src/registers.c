@@ -21,65 +21,16 @@
 #include <stdbool.h>
 #include "stack.h"
 #include "registers.h"
+#include "spill.h"
 
+// Registers share payloads with the stack, like dup does
 stack_element copy_element(const stack_element* src) {
-  stack_element copy;
-  copy.type = src->type;
-
-  switch (src->type) {
-  case TYPE_REAL:
-    copy.real = src->real;
-    break;
-
-  case TYPE_COMPLEX:
-    copy.complex_val = src->complex_val;
-    break;
-
-  case TYPE_STRING:
-    copy.string = strdup(src->string);
-    break;
-
-  case TYPE_MATRIX_REAL:
-    if (src->matrix_real) {
-      size_t r = src->matrix_real->size1;
-      size_t c = src->matrix_real->size2;
-      copy.matrix_real = gsl_matrix_alloc(r, c);
-      gsl_matrix_memcpy(copy.matrix_real, src->matrix_real);
-    } else {
-      copy.matrix_real = NULL;
-    }
-    break;
-
-  case TYPE_MATRIX_COMPLEX:
-    if (src->matrix_complex) {
-      size_t r = src->matrix_complex->size1;
-      size_t c = src->matrix_complex->size2;
-      copy.matrix_complex = gsl_matrix_complex_alloc(r, c);
-      gsl_matrix_complex_memcpy(copy.matrix_complex, src->matrix_complex);
-    } else {
-      copy.matrix_complex = NULL;
-    }
-    break;
-  }
-
-  return copy;
+  return share_element(src);
 }
 
 
 void free_element(stack_element* el) {
-  switch (el->type) {
-  case TYPE_STRING:
-    free(el->string);
-    break;
-  case TYPE_MATRIX_REAL:
-    gsl_matrix_free(el->matrix_real);
-    break;
-  case TYPE_MATRIX_COMPLEX:
-    gsl_matrix_complex_free(el->matrix_complex);
-    break;
-  default:
-    break;
-  }
+  release_element(el);
   el->type = TYPE_REAL;
   el->real = 0.0;
 }
@@ -110,8 +61,11 @@ void store_to_register(Stack* stack) {
     free_element(&registers[reg_index].value);
   }
 
-  registers[reg_index].value = copy_element(value_elem);
+  // The value leaves the stack, so the register simply takes it over
+  registers[reg_index].value = *value_elem;
   registers[reg_index].occupied = true;
+  spill_register_used(reg_index);
+  spill_pack(&registers[reg_index].value);
 
   stack->top -= 2;  // remove reg index and value
 }
@@ -140,13 +94,28 @@ void recall_from_register(Stack* stack) {
     return;
   }
 
-  stack_element copy = copy_element(&registers[reg_index].value);
-
-  if (stack->top + 1 >= STACK_SIZE) {
+  if (!stack_reserve(stack, 1)) {
     fprintf(stderr, "Stack overflow.\n");
     return;
   }
 
+  // A packed register stays packed; the stack gets an unpacked copy
+  stack_element* reg = &registers[reg_index].value;
+  stack_element copy;
+  spill_register_used(reg_index);
+  if (packed_size_of(reg)) {
+    if (!spill_unpack_copy(reg, &copy)) {
+      fprintf(stderr, "Not enough memory to unpack register %d.\n", reg_index);
+      return;
+    }
+  } else {
+    if (!spill_load_element(reg)) {
+      fprintf(stderr, "Register %d could not be recalled.\n", reg_index);
+      return;
+    }
+    copy = copy_element(reg);
+  }
+
   stack->items[++stack->top] = copy;
 }
 
@@ -159,6 +128,33 @@ void show_registers_status(void) {
     }
   }
   if (MAX_REG % 8 != 0) printf("\n");  // final newline if not aligned
+
+  // Matrices, with what they take up
+  for (int i = 0; i < MAX_REG; ++i) {
+    const stack_element* el = &registers[i].value;
+    if (!registers[i].occupied) continue;
+    size_t rows, cols, bytes;
+    bool spilled;
+    if (el->type == TYPE_MATRIX_REAL) {
+      rows = el->matrix_real->size1;
+      cols = el->matrix_real->size2;
+      bytes = rows * cols * sizeof(double);
+      spilled = matrix_spilled(el->matrix_real);
+    } else if (el->type == TYPE_MATRIX_COMPLEX) {
+      rows = el->matrix_complex->size1;
+      cols = el->matrix_complex->size2;
+      bytes = rows * cols * 2 * sizeof(double);
+      spilled = matrix_complex_spilled(el->matrix_complex);
+    } else {
+      continue;
+    }
+    printf("R[%2d] %zu x %zu %s: %.1f KB", i, rows, cols,
+           el->type == TYPE_MATRIX_REAL ? "Mℝ" : "Mℂ", bytes / 1024.0);
+    size_t packed = packed_size_of(el);
+    if (packed >= 1024) printf(", packed to %.1f KB\n", packed / 1024.0);
+    else if (packed) printf(", packed to %zu bytes\n", packed);
+    else printf("%s\n", spilled ? ", on disk" : "");
+  }
 }
 
 void init_registers(void) {
@@ -189,6 +185,10 @@ void save_registers_to_file(const char* filename) {
     if (!registers[i].occupied) continue;
 
     stack_element* el = &registers[i].value;
+    if (!spill_load_element(el)) {
+      fprintf(stderr, "Register %d not saved.\n", i);
+      continue;
+    }
     fprintf(f, "REG %d ", i);
 
     switch (el->type) {
@@ -199,7 +199,7 @@ void save_registers_to_file(const char* filename) {
       fprintf(f, "COMPLEX (%.17g,%.17g)\n", GSL_REAL(el->complex_val), GSL_IMAG(el->complex_val));
       break;
     case TYPE_STRING:
-      fprintf(f, "STRING \"%s\"\n", el->string);
+      fprintf(f, "STRING \"%s\"\n", element_string(el));
       break;
     case TYPE_MATRIX_REAL: {
       gsl_matrix* m = el->matrix_real;
@@ -260,8 +260,7 @@ void load_registers_from_file(const char* filename) {
       char* end = strrchr(line, '"');
       if (!start || !end || start == end) continue;
       *end = '\0';
-      el.type = TYPE_STRING;
-      el.string = strdup(start + 1);
+      if (!set_string(&el, start + 1, (size_t)(end - start - 1))) continue;
     } else if (strcmp(type, "MATRIX_REAL") == 0) {
       size_t r, c;
       char* ptr = strchr(line, ' ') + 1; // skip "REG"
@@ -269,7 +268,8 @@ void load_registers_from_file(const char* filename) {
       ptr = strchr(ptr, ' ') + 1; // skip type
       sscanf(ptr, "%zu %zu", &r, &c);
       el.type = TYPE_MATRIX_REAL;
-      el.matrix_real = gsl_matrix_alloc(r, c);
+      el.matrix_real = matrix_alloc(r, c);
+      if (!el.matrix_real) continue;
       ptr = strchr(ptr, ' ') + 1; // skip rows
       ptr = strchr(ptr, ' ') + 1; // skip cols
       for (size_t i = 0; i < r * c; ++i) {
@@ -286,7 +286,8 @@ void load_registers_from_file(const char* filename) {
       ptr = strchr(ptr, ' ') + 1;
       sscanf(ptr, "%zu %zu", &r, &c);
       el.type = TYPE_MATRIX_COMPLEX;
-      el.matrix_complex = gsl_matrix_complex_alloc(r, c);
+      el.matrix_complex = matrix_complex_alloc(r, c);
+      if (!el.matrix_complex) continue;
       ptr = strchr(ptr, ' ') + 1;
       ptr = strchr(ptr, ' ') + 1;
       for (size_t i = 0; i < r * c; ++i) {
@@ -37,6 +37,8 @@
 #include "stack.h"
 #include "registers.h"
 #include "run_machine.h"
+#include "compiler.h"
+#include "globals.h"
 
 #define MAX_COUNTERS 32
 
@@ -189,8 +191,6 @@ bool is_ctr_compare(Stack* stack, const char* op) {
 }
 
 // Build the dispatch table
-typedef bool (*compare_fn)(Stack* stack);
-
 typedef struct {
     const char* name;
     compare_fn fn;
@@ -227,7 +227,7 @@ compare_fn get_compare_fn(const char* name) {
     return NULL;
 }
 
-int run_batch(Stack *stack, char *fname) {
+int run_batch(Stack *stack, const char *fname) {
   FILE* f = fopen(fname, "r");
   if (!f) {
     perror("Failed to open input file");
@@ -248,18 +248,6 @@ int run_batch(Stack *stack, char *fname) {
   return 0;
 }
 
-bool evaluate_test_condition(Stack* stack, const char* test_name) {
-  bool result;
-  compare_fn fn = get_compare_fn(test_name);
-  if (fn) {
-    result = fn(stack);
-  } else {
-    fprintf(stderr, "Unknown condition: %s\n", test_name);
-    result=false;
-  }
-  return result;
-}
-
 int find_label(const Program* prog, const char* label) {
   for (int i = 0; i < prog->label_count; ++i) {
     if (strcmp(prog->labels[i].label, label) == 0)
@@ -283,6 +271,34 @@ void list_program(const Program* prog) {
   }
 }
 
+// Resolve jump targets and test predicates; reports every problem it finds
+static bool link_program(Program* prog) {
+  bool ok = true;
+  for (int i = 0; i < prog->count; ++i) {
+    Instruction* instr = &prog->program[i];
+    switch (instr->type) {
+    case INSTR_GOTO:
+    case INSTR_GOSUB:
+      instr->target = find_label(prog, instr->arg);
+      if (instr->target < 0) {
+        fprintf(stderr, "Undefined label: %s (step %d)\n", instr->arg, i);
+        ok = false;
+      }
+      break;
+    case INSTR_TEST:
+      instr->test = get_compare_fn(instr->arg);
+      if (!instr->test) {
+        fprintf(stderr, "Unknown condition: %s (step %d)\n", instr->arg, i);
+        ok = false;
+      }
+      break;
+    default:
+      break;
+    }
+  }
+  return ok;
+}
+
 bool load_program_from_file(const char* filename, Program* prog) {
   FILE* f = fopen(filename, "r");
   if (!f) {
@@ -294,11 +310,24 @@ bool load_program_from_file(const char* filename, Program* prog) {
     line[strcspn(line, "\r\n")] = '\0';
     if (strlen(line) == 0) continue;
 
-    Instruction instr;
-    instr.arg = strdup(line);
+    if (prog->count >= MAX_PROGRAM) {
+      fprintf(stderr, "Program too long: at most %d steps.\n", MAX_PROGRAM);
+      fclose(f);
+      free_program(prog);
+      return false;
+    }
+
+    Instruction instr = {.arg = NULL};
 
     if (strncmp(line, "LBL ", 4) == 0) {
+      if (prog->label_count >= MAX_LABELS) {
+        fprintf(stderr, "Too many labels: at most %d.\n", MAX_LABELS);
+        fclose(f);
+        free_program(prog);
+        return false;
+      }
       instr.type = INSTR_LABEL;
+      instr.arg = strdup(line);
       strncpy(prog->labels[prog->label_count].label, line + 4, 31);
       prog->labels[prog->label_count].pc = prog->count;
       prog->label_count++;
@@ -310,17 +339,28 @@ bool load_program_from_file(const char* filename, Program* prog) {
       instr.arg = strdup(line + 6);
     } else if (strcmp(line, "RTN") == 0) {
       instr.type = INSTR_RTN;
+      instr.arg = strdup(line);
     } else if (strcmp(line, "END") == 0) {
       instr.type = INSTR_END;
+      instr.arg = strdup(line);
     } else if (strstr(line, "?") != NULL) {
       instr.type = INSTR_TEST;
+      instr.arg = strdup(line);
     } else {
       instr.type = INSTR_WORD;
+      instr.arg = strdup(line);
+      // Word definitions must go through evaluate_line when they run
+      if (line[strspn(line, " \t")] != ':') instr.code = compile_line(line);
     }
 
     prog->program[prog->count++] = instr;
   }
   fclose(f);
+
+  if (!link_program(prog)) {
+    free_program(prog);
+    return false;
+  }
   return true;
 }
 
@@ -328,65 +368,125 @@ void free_program(Program* prog) {
     for (int i = 0; i < prog->count; ++i) {
         free(prog->program[i].arg);  // Safe even if arg is NULL
         prog->program[i].arg = NULL; // Optional: clear pointer after freeing
+        if (prog->program[i].type == INSTR_WORD) {
+          release_code(prog->program[i].code);
+          prog->program[i].code = NULL;
+        }
     }
+    prog->count = 0;
+    prog->label_count = 0;
     // If you dynamically allocated `prog` itself, you can free it too:
     // free(prog);
 }
 
 
-void run_RPN_code(Stack* stack, Program* prog) {
-  int pc = 0;
+// **************** The program interpreter ****************
+// Each step returns the next pc, or -1 to stop. The switch loop and the
+// threaded loop below share these, so they cannot drift apart.
+
+typedef struct {
   int call_stack[MAX_PROGRAM];
-  int call_top = -1;
-
-  while (pc < prog->count) {
-    Instruction instr = prog->program[pc];
-    switch (instr.type) {
-    case INSTR_WORD:
-      evaluate_line(stack, instr.arg);
-      pc++;
-      break;
-    case INSTR_LABEL:
-      pc++;
-      break;
-    case INSTR_GOTO: {
-      int target = find_label(prog, instr.arg);
-      if (target >= 0) pc = target;
-      else {
-	fprintf(stderr,"Invalid label: %s\n", instr.arg);
-	return;
-      }
-      break;
-    }
-    case INSTR_GOSUB: {
-      int target = find_label(prog, instr.arg);
-      if (target >= 0) {
-	call_stack[++call_top] = pc + 1;
-	pc = target;
-      } else {
-	fprintf(stderr,"Invalid subroutine label: %s\n", instr.arg);
-	return;
-      }
-      break;
-    }
-    case INSTR_RTN:
-      if (call_top >= 0)
-	pc = call_stack[call_top--];
-      else {
-	fprintf(stderr,"Return stack underflow\n");
-	return;
-      }
-      break;
-    case INSTR_END:
-      return;
-    case INSTR_TEST:
-      if (evaluate_test_condition(stack, instr.arg)) {
-	pc++;
-      } else {
-	pc += 2;
-      }
-      break;
+  int call_top;
+} machine_state;
+
+static inline int step_word(Stack* stack, const Instruction* instr, int pc) {
+  if (instr->code && line_cache_enabled) execute_code(stack, instr->code);
+  else evaluate_line(stack, instr->arg);
+  return pc + 1;
+}
+
+static inline int step_gosub(const Instruction* instr, machine_state* m, int pc) {
+  if (m->call_top + 1 >= MAX_PROGRAM) {
+    fprintf(stderr,"Return stack overflow\n");
+    return -1;
+  }
+  m->call_stack[++m->call_top] = pc + 1;
+  return instr->target;
+}
+
+static inline int step_rtn(machine_state* m) {
+  if (m->call_top < 0) {
+    fprintf(stderr,"Return stack underflow\n");
+    return -1;
+  }
+  return m->call_stack[m->call_top--];
+}
+
+static inline int step_test(Stack* stack, const Instruction* instr, int pc) {
+  // A failed test skips the next instruction
+  return instr->test(stack) ? pc + 1 : pc + 2;
+}
+
+static void run_switch(Stack* stack, Program* prog) {
+  machine_state m = {.call_top = -1};
+  int pc = 0;
+
+  while (pc >= 0 && pc < prog->count) {
+    const Instruction* instr = &prog->program[pc];
+    switch (instr->type) {
+    case INSTR_WORD:  pc = step_word(stack, instr, pc); break;
+    case INSTR_LABEL: pc++; break;
+    case INSTR_GOTO:  pc = instr->target; break;
+    case INSTR_GOSUB: pc = step_gosub(instr, &m, pc); break;
+    case INSTR_RTN:   pc = step_rtn(&m); break;
+    case INSTR_END:   return;
+    case INSTR_TEST:  pc = step_test(stack, instr, pc); break;
     }
   }
 }
 
+#if defined(__GNUC__)
+// Direct threading: before running, every instruction is replaced by the
+// address of its handler, and each handler jumps straight to the next one.
+// Labels as values are a GNU extension, hence the pragma.
+#define HAVE_THREADED_DISPATCH 1
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+
+static void run_threaded(Stack* stack, Program* prog) {
+  static void* const handlers[] = {
+    [INSTR_WORD] = &&do_word,   [INSTR_LABEL] = &&do_label,
+    [INSTR_GOTO] = &&do_goto,   [INSTR_GOSUB] = &&do_gosub,
+    [INSTR_RTN]  = &&do_rtn,    [INSTR_END]   = &&do_halt,
+    [INSTR_TEST] = &&do_test,
+  };
+
+  // Two trailing halts: a failed test on the last step lands on count + 1
+  void** thread = malloc((size_t)(prog->count + 2) * sizeof *thread);
+  if (!thread) {
+    run_switch(stack, prog);
+    return;
+  }
+  for (int i = 0; i < prog->count; i++) thread[i] = handlers[prog->program[i].type];
+  thread[prog->count] = thread[prog->count + 1] = &&do_halt;
+
+  machine_state m = {.call_top = -1};
+  int pc = 0;
+
+#define NEXT(next_pc) do { pc = (next_pc); if (pc < 0) goto do_halt; goto *thread[pc]; } while (0)
+
+  goto *thread[pc];
+
+ do_word:  NEXT(step_word(stack, &prog->program[pc], pc));
+ do_label: NEXT(pc + 1);
+ do_goto:  NEXT(prog->program[pc].target);
+ do_gosub: NEXT(step_gosub(&prog->program[pc], &m, pc));
+ do_rtn:   NEXT(step_rtn(&m));
+ do_test:  NEXT(step_test(stack, &prog->program[pc], pc));
+ do_halt:
+  free(thread);
+#undef NEXT
+}
+
+#pragma GCC diagnostic pop
+#endif
+
+void run_RPN_code(Stack* stack, Program* prog) {
+#ifdef HAVE_THREADED_DISPATCH
+  if (dispatch_mode == DISPATCH_THREADED) {
+    run_threaded(stack, prog);
+    return;
+  }
+#endif
+  run_switch(stack, prog);
+}
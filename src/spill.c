@@ -0,0 +1,519 @@
+/*
+ * This file is part of Mico's toy RPN Calculator
+ *
+ * Mico's toy RPN Calculator is free software:
+ * you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mico's toy RPN Calculator is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mico's toy RPN Calculator. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#define _DEFAULT_SOURCE   // mkstemp, pread, pwrite, ftruncate
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include "stack.h"
+#include "registers.h"
+#include "payload.h"
+#include "matrix_alloc.h"
+#include "mem_account.h"
+#include "undo.h"
+#include "word_codec.h"
+#include "named_stacks.h"
+#include "spill.h"
+
+#define SPILL_MIN_BYTES ((size_t)64 << 10)   // smaller matrices are not worth the I/O
+#define SPILL_MAGIC 0x4d4d52504e53504cull    // "MMRPNSPL"
+
+int spill_mb = 0;
+int register_pack_kb = 0;
+int spilled_count = 0;
+
+// Every record in the file is a header followed by the raw doubles
+typedef struct {
+  uint64_t magic;
+  uint64_t rows;
+  uint64_t cols;
+  uint64_t is_complex;
+} spill_header;
+
+typedef struct {
+  const void* m;            // gsl_matrix or gsl_matrix_complex without its data
+  unsigned char* packed;    // the data compressed in memory, or NULL when on disk
+  off_t offset;
+  size_t size;              // packed length, or header and data in the file
+  size_t bytes;             // the data as it was
+} spill_record;
+
+typedef struct {
+  off_t offset;
+  size_t size;
+} spill_hole;
+
+static int spill_fd = -1;
+static off_t file_end;
+static spill_record* records;
+static int record_capacity;
+static spill_hole* holes;
+static int hole_count, hole_capacity;
+static size_t on_disk;       // bytes of matrix data in the file
+static int packed_count;
+static size_t packed_size;   // bytes of packed data held in memory
+static size_t packed_raw;    // what they unpack to
+
+static struct {
+  unsigned long written;
+  unsigned long read;
+  unsigned long packed;
+  unsigned long unpacked;
+} spill_stats;
+
+// Recency: one clock tick per operation on the watched stack. Stack
+// entries below an operation's reach keep their position, so ticks are
+// kept per position; registers have their own.
+static Stack* watched;
+static unsigned long clock_now;
+static unsigned long* position_ticks;
+static int ticks_capacity;
+static int ticked_top = -1;
+static unsigned long register_ticks[MAX_REG];
+
+void spill_watch_stack(Stack* stack) {
+  watched = stack;
+  ticked_top = -1;   // whatever is on it counts as just used
+}
+
+void spill_register_used(int index) {
+  if (index >= 0 && index < MAX_REG) register_ticks[index] = ++clock_now;
+}
+
+size_t spilled_bytes(void) {
+  return on_disk;
+}
+
+size_t packed_bytes(void) {
+  return packed_size;
+}
+
+// **************** The file ****************
+static bool open_spill_file(void) {
+  if (spill_fd >= 0) return true;
+  const char* dir = getenv("TMPDIR");
+  char path[4096];
+  snprintf(path, sizeof path, "%s/mm_rpn_spill_XXXXXX", dir && *dir ? dir : "/tmp");
+  spill_fd = mkstemp(path);
+  if (spill_fd < 0) {
+    perror("spill file");
+    return false;
+  }
+  unlink(path);   // gone with the process, however it ends
+  return true;
+}
+
+static bool write_all(const void* buf, size_t size, off_t offset) {
+  const char* p = buf;
+  while (size > 0) {
+    ssize_t n = pwrite(spill_fd, p, size, offset);
+    if (n <= 0) return false;
+    p += n;
+    size -= (size_t)n;
+    offset += n;
+  }
+  return true;
+}
+
+static bool read_all(void* buf, size_t size, off_t offset) {
+  char* p = buf;
+  while (size > 0) {
+    ssize_t n = pread(spill_fd, p, size, offset);
+    if (n <= 0) return false;
+    p += n;
+    size -= (size_t)n;
+    offset += n;
+  }
+  return true;
+}
+
+// First fit among the holes left by reloaded matrices, else the end
+static off_t place(size_t size) {
+  for (int i = 0; i < hole_count; i++) {
+    if (holes[i].size < size) continue;
+    off_t offset = holes[i].offset;
+    holes[i].offset += (off_t)size;
+    holes[i].size -= size;
+    if (holes[i].size == 0) holes[i] = holes[--hole_count];
+    return offset;
+  }
+  off_t offset = file_end;
+  file_end += (off_t)size;
+  return offset;
+}
+
+static void release_space(off_t offset, size_t size) {
+  if (spilled_count == 0) {   // nothing left: start the file over
+    hole_count = 0;
+    file_end = 0;
+    if (ftruncate(spill_fd, 0) != 0) perror("spill file");
+    return;
+  }
+  if (offset + (off_t)size == file_end) {
+    file_end = offset;
+    return;
+  }
+  if (hole_count == hole_capacity) {
+    int capacity = hole_capacity ? 2 * hole_capacity : 16;
+    spill_hole* grown = realloc(holes, (size_t)capacity * sizeof *grown);
+    if (!grown) return;   // the space is lost until the file starts over
+    holes = grown;
+    hole_capacity = capacity;
+  }
+  holes[hole_count++] = (spill_hole){offset, size};
+}
+
+static spill_record* find_record(const void* m) {
+  for (int i = 0; i < spilled_count; i++)
+    if (records[i].m == m) return &records[i];
+  return NULL;
+}
+
+// Drop a record, keeping the array dense
+static void remove_record(spill_record* r) {
+  spill_record gone = *r;
+  *r = records[--spilled_count];
+  if (gone.packed) {
+    free(gone.packed);
+    memory_credit(gone.size);
+    packed_count--;
+    packed_size -= gone.size;
+    packed_raw -= gone.bytes;
+    return;
+  }
+  on_disk -= gone.bytes;
+  release_space(gone.offset, gone.size);
+}
+
+static bool reserve_record(void) {
+  if (spilled_count < record_capacity) return true;
+  int capacity = record_capacity ? 2 * record_capacity : 16;
+  spill_record* grown = realloc(records, (size_t)capacity * sizeof *grown);
+  if (!grown) return false;
+  records = grown;
+  record_capacity = capacity;
+  return true;
+}
+
+// **************** Out and back in ****************
+// Real and complex matrices differ only in the element size, so both go
+// through the real layout with the column count doubled for complex data.
+static bool spill_out(const void* m, bool is_complex) {
+  const gsl_matrix* r = m;
+  const gsl_matrix_complex* c = m;
+  size_t rows = is_complex ? c->size1 : r->size1;
+  size_t cols = is_complex ? c->size2 : r->size2;
+  double* data = is_complex ? c->data : r->data;
+  size_t bytes = rows * cols * (is_complex ? 2 : 1) * sizeof(double);
+
+  if (!reserve_record()) return false;
+  if (!open_spill_file()) {
+    spill_mb = 0;   // no file, no tier; say so once
+    return false;
+  }
+
+  spill_header h = {SPILL_MAGIC, rows, cols, is_complex};
+  size_t size = sizeof h + bytes;
+  off_t offset = place(size);
+  if (!write_all(&h, sizeof h, offset) || !write_all(data, bytes, offset + (off_t)sizeof h)) {
+    perror("spill file");
+    release_space(offset, size);
+    return false;
+  }
+
+  records[spilled_count++] = (spill_record){m, NULL, offset, size, bytes};
+  on_disk += bytes;
+  spill_stats.written++;
+  matrix_storage_drop((void*)m, is_complex);
+  return true;
+}
+
+static bool restore(const spill_record* rec, double* data) {
+  if (rec->packed)
+    return word_unpack(rec->packed, rec->size, data, rec->bytes / sizeof(double));
+  spill_header h;
+  return read_all(&h, sizeof h, rec->offset) && h.magic == SPILL_MAGIC &&
+         read_all(data, rec->bytes, rec->offset + (off_t)sizeof h);
+}
+
+// On failure the matrix stays spilled, and whatever needed it must give up
+static bool spill_in(const void* m, bool is_complex) {
+  spill_record* rec = find_record(m);
+  if (!rec) return true;
+
+  if (!matrix_storage_restore((void*)m, is_complex)) {
+    fprintf(stderr, "Cannot load a spilled matrix back into memory.\n");
+    return false;
+  }
+  double* data = is_complex ? ((const gsl_matrix_complex*)m)->data : ((const gsl_matrix*)m)->data;
+  if (!restore(rec, data)) {
+    matrix_storage_drop((void*)m, is_complex);
+    fprintf(stderr, "Cannot load a spilled matrix back into memory.\n");
+    return false;
+  }
+  if (rec->packed) spill_stats.unpacked++;
+  else spill_stats.read++;
+  remove_record(rec);
+  return true;
+}
+
+bool spill_load_element(const stack_element* e) {
+  if (e->type == TYPE_MATRIX_REAL && matrix_spilled(e->matrix_real))
+    return spill_in(e->matrix_real, false);
+  if (e->type == TYPE_MATRIX_COMPLEX && matrix_complex_spilled(e->matrix_complex))
+    return spill_in(e->matrix_complex, true);
+  return true;
+}
+
+void spill_forget(const void* m) {
+  spill_record* rec = find_record(m);
+  if (rec) remove_record(rec);
+}
+
+// **************** Choosing what goes ****************
+typedef struct {
+  const stack_element* e;
+  unsigned long tick;
+} spill_candidate;
+
+typedef struct {
+  spill_candidate* items;
+  int n;
+  int capacity;
+} candidate_list;
+
+static int by_tick(const void* a, const void* b) {
+  const spill_candidate* x = a;
+  const spill_candidate* y = b;
+  return (x->tick > y->tick) - (x->tick < y->tick);
+}
+
+static const void* payload_of(const stack_element* e) {
+  if (e->type == TYPE_MATRIX_REAL) return e->matrix_real;
+  if (e->type == TYPE_MATRIX_COMPLEX) return e->matrix_complex;
+  return NULL;
+}
+
+// Data bytes of a resident matrix in storage matrix_alloc charged, which
+// is what matrix_storage_restore hands back; 0 for anything else
+static size_t whole_bytes(const stack_element* e) {
+  if (!payload_charge(payload_of(e))) return 0;
+  if (e->type == TYPE_MATRIX_REAL) {
+    const gsl_matrix* m = e->matrix_real;
+    return m->data && m->tda == m->size2 ? m->size1 * m->size2 * sizeof(double) : 0;
+  }
+  if (e->type == TYPE_MATRIX_COMPLEX) {
+    const gsl_matrix_complex* m = e->matrix_complex;
+    return m->data && m->tda == m->size2 ? m->size1 * m->size2 * 2 * sizeof(double) : 0;
+  }
+  return 0;
+}
+
+static bool spillable(const stack_element* e) {
+  return whole_bytes(e) >= SPILL_MIN_BYTES;
+}
+
+static void add_candidate(candidate_list* list, const stack_element* e, unsigned long tick) {
+  if (!spillable(e)) return;
+  if (list->n == list->capacity) {
+    int capacity = list->capacity ? 2 * list->capacity : 64;
+    spill_candidate* grown = realloc(list->items, (size_t)capacity * sizeof *grown);
+    if (!grown) return;
+    list->items = grown;
+    list->capacity = capacity;
+  }
+  list->items[list->n++] = (spill_candidate){e, tick};
+}
+
+// Journaled entries only come back on undo, and parked stacks on a
+// switch, so they count as the oldest
+static void add_journaled(const stack_element* e, void* ctx) {
+  add_candidate(ctx, e, 0);
+}
+
+// The entries from low up are about to be used, and so is anything they share
+static bool pinned(const Stack* stack, int low, const void* p) {
+  for (int i = low; i <= stack->top; i++)
+    if (payload_of(&stack->items[i]) == p) return true;
+  return false;
+}
+
+static void trim(Stack* stack, int low) {
+  size_t limit = (size_t)spill_mb << 20;
+  if (memory_in_use() <= limit) return;
+
+  candidate_list list = {0};
+  for (int i = 0; i < low; i++) add_candidate(&list, &stack->items[i], position_ticks[i]);
+  for (int i = 0; i < MAX_REG; i++)
+    if (registers[i].occupied) add_candidate(&list, &registers[i].value, register_ticks[i]);
+  undo_for_each_entry(add_journaled, &list);
+  parked_stacks_for_each_entry(add_journaled, &list);
+  parked_histories_for_each_entry(add_journaled, &list);
+  if (list.n > 0) qsort(list.items, (size_t)list.n, sizeof *list.items, by_tick);
+
+  for (int i = 0; i < list.n && memory_in_use() > limit; i++) {
+    const stack_element* e = list.items[i].e;
+    // A shared matrix may already have gone under another owner
+    if (!spillable(e) || pinned(stack, low, payload_of(e))) continue;
+    if (!spill_out(payload_of(e), e->type == TYPE_MATRIX_COMPLEX)) break;
+  }
+  free(list.items);
+}
+
+static void mark_recent(Stack* stack, int low) {
+  if (stack->top + 1 > ticks_capacity) {
+    int capacity = stack->capacity > stack->top + 1 ? stack->capacity : stack->top + 1;
+    unsigned long* grown = realloc(position_ticks, (size_t)capacity * sizeof *grown);
+    if (!grown) return;
+    position_ticks = grown;
+    ticks_capacity = capacity;
+  }
+  // What the last operation reached, plus everything pushed since
+  clock_now++;
+  int from = low < ticked_top + 1 ? low : ticked_top + 1;
+  for (int i = from; i <= stack->top; i++) position_ticks[i] = clock_now;
+  ticked_top = stack->top;
+}
+
+bool spill_touch(Stack* stack, int reach) {
+  int low = reach > stack->top + 1 ? 0 : stack->top + 1 - reach;
+  for (int i = low; i <= stack->top && spilled_count > 0; i++)
+    if (!spill_load_element(&stack->items[i])) return false;
+  if (stack != watched || spill_mb <= 0) return true;
+  mark_recent(stack, low);
+  if (memory_in_use() > (size_t)spill_mb << 20 && ticks_capacity > stack->top)
+    trim(stack, low);
+  return true;
+}
+
+// **************** Packed registers ****************
+// Compressed in memory rather than written out: the record keeps the
+// packed bytes, and the matrix is otherwise a spilled one. A matrix the
+// stack or the undo journal still shares keeps its data for them; the
+// register swaps its reference for a header of its own.
+bool spill_pack(stack_element* e) {
+  size_t bytes = whole_bytes(e);
+  if (register_pack_kb <= 0 || bytes == 0 || bytes < (size_t)register_pack_kb << 10 ||
+      !reserve_record())
+    return false;
+  bool is_complex = e->type == TYPE_MATRIX_COMPLEX;
+  double* data = is_complex ? e->matrix_complex->data : e->matrix_real->data;
+  size_t size;
+  unsigned char* packed = word_pack(data, bytes / sizeof(double), &size);
+  if (!packed) return false;
+
+  const void* m = payload_of(e);
+  if (payload_is_shared(m)) {
+    if (!memory_charge(size)) {   // nothing is freed to make room
+      free(packed);
+      return false;
+    }
+    void* own = matrix_header_like(m, is_complex);
+    if (!own) {
+      memory_credit(size);
+      free(packed);
+      return false;
+    }
+    if (is_complex) {
+      matrix_complex_release(e->matrix_complex);
+      e->matrix_complex = own;
+    } else {
+      matrix_release(e->matrix_real);
+      e->matrix_real = own;
+    }
+    m = own;
+  } else {
+    matrix_storage_drop((void*)m, is_complex);
+    (void)memory_charge(size);   // fits: it replaces more than it takes
+  }
+  records[spilled_count++] = (spill_record){m, packed, 0, size, bytes};
+  packed_count++;
+  packed_size += size;
+  packed_raw += bytes;
+  spill_stats.packed++;
+  return true;
+}
+
+size_t packed_size_of(const stack_element* e) {
+  const void* m = payload_of(e);
+  const spill_record* rec = m ? find_record(m) : NULL;
+  return rec && rec->packed ? rec->size : 0;
+}
+
+bool spill_unpack_copy(const stack_element* e, stack_element* copy) {
+  const void* m = payload_of(e);
+  const spill_record* rec = m ? find_record(m) : NULL;
+  if (!rec || !rec->packed) return false;
+
+  size_t count = rec->bytes / sizeof(double);
+  if (e->type == TYPE_MATRIX_REAL) {
+    gsl_matrix* c = matrix_alloc(e->matrix_real->size1, e->matrix_real->size2);
+    if (!c) return false;
+    if (!word_unpack(rec->packed, rec->size, c->data, count)) {
+      matrix_release(c);
+      return false;
+    }
+    *copy = (stack_element){.type = TYPE_MATRIX_REAL, .matrix_real = c};
+  } else {
+    gsl_matrix_complex* c = matrix_complex_alloc(e->matrix_complex->size1,
+                                                     e->matrix_complex->size2);
+    if (!c) return false;
+    if (!word_unpack(rec->packed, rec->size, c->data, count)) {
+      matrix_complex_release(c);
+      return false;
+    }
+    *copy = (stack_element){.type = TYPE_MATRIX_COMPLEX, .matrix_complex = c};
+  }
+  spill_stats.unpacked++;
+  return true;
+}
+
+// **************** Statistics and cleanup ****************
+void print_spill_stats(void) {
+  int on_file = spilled_count - packed_count;
+  if (spill_mb > 0 || on_file > 0) {
+    printf("spill file: %d matrices, %.1f KB; %lu written, %lu read back",
+           on_file, on_disk / 1024.0, spill_stats.written, spill_stats.read);
+    if (spill_mb > 0) printf("; keeps %d MB resident\n", spill_mb);
+    else printf(" (off)\n");
+  }
+  if (register_pack_kb > 0 || packed_count > 0) {
+    printf("packed: %d matrices, %.1f KB for %.1f KB; %lu packed, %lu unpacked",
+           packed_count, packed_size / 1024.0, packed_raw / 1024.0,
+           spill_stats.packed, spill_stats.unpacked);
+    if (register_pack_kb > 0) printf("; sto packs from %d KB\n", register_pack_kb);
+    else printf(" (off)\n");
+  }
+}
+
+void close_spill_file(void) {
+  for (int i = 0; i < spilled_count; i++) free(records[i].packed);
+  if (spill_fd >= 0) close(spill_fd);
+  spill_fd = -1;
+  free(records);
+  free(holes);
+  free(position_ticks);
+  records = NULL;
+  holes = NULL;
+  position_ticks = NULL;
+  record_capacity = hole_capacity = hole_count = ticks_capacity = 0;
+  spilled_count = packed_count = 0;
+  on_disk = packed_size = packed_raw = 0;
+  ticked_top = -1;
+}
@@ -165,9 +165,11 @@ void help_menu(void) {
   printf("    Enter inline matrices as in J language [#rows #cols $ values]. \n");
   printf("    Example: [2 2 $ -1 2 5 1]. Matrix entries can be real or complex.\n");
   printf("    Read matrix from file as [#rows, #cols, \"filename\"].\n");
-  printf("    You can undo the last line entry with undo.\n");
+  printf("    You can undo the last line entry with undo, and again to go further\n");
+  printf("    back; redo reapplies what undo took back.\n");
   subtitle("Stack manipulations");
   printf("    drop, dup, swap, clst, nip, tuck, roll, over\n");
+  printf("    \"name\" sfork {copy to a new named stack}, \"name\" sswitch, \"name\" sdrop, slist\n");
   subtitle("Math functions");
   printf("    Math functions work on scalars and matrices wherever possible. \n");
   printf("    Basic stuff: +, -, *, /, ^,  ln, exp, log, chs, inv, pct, pctchg \n");
@@ -201,6 +203,8 @@ void help_menu(void) {
   printf("    setprec {set print precision}, sfs {fix<->sci}\n");
   subtitle("Help and utilities");
   printf("    listfcns {list built in functions}\n");
+  printf("    fusions {peephole fusion statistics}\n");
+  printf("    mem {memory in use by stack, registers and undo}\n");
   printf("    listmacros {list predefined macros}\n");
   printf("    listwords {list user-defined words}\n");
   printf("    new words start with : end with ;\n");
@@ -22,57 +22,96 @@
 
 #define _POSIX_C_SOURCE 200809L
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <limits.h>
 #include <complex.h>
 #include <gsl/gsl_matrix.h>
 #include <gsl/gsl_complex_math.h>
 #include "stack.h"
+#include "string_intern.h"
+
+int stack_limit = 0;
 
 void init_stack(Stack* stack) {
+  stack->items = NULL;
   stack->top = -1;
+  stack->capacity = 0;
+}
+
+void destroy_stack(Stack* stack) {
+  free_stack(stack);
+  free(stack->items);
+  init_stack(stack);
+}
+
+bool stack_grow(Stack* stack, int n) {
+  long needed = (long)stack->top + 1 + n;
+  if (needed <= stack->capacity) return true;
+  if (stack_limit > 0 && needed > stack_limit) return false;
+
+  long capacity = stack->capacity ? 2L * stack->capacity : STACK_INITIAL_CAPACITY;
+  if (capacity < needed) capacity = needed;
+  if (stack_limit > 0 && capacity > stack_limit) capacity = stack_limit;
+  if (capacity > INT_MAX) return false;
+
+  stack_element* items = realloc(stack->items, (size_t)capacity * sizeof *items);
+  if (!items) return false;
+  stack->items = items;
+  stack->capacity = (int)capacity;
+  return true;
+}
+
+void stack_overflow(void) {
+  fprintf(stderr,"Stack overflow\n");
+}
+
+stack_element stack_underflow(void) {
+  printf("Stack underflow\n");
+  return (stack_element){.type = TYPE_REAL, .real = 0.0};
 }
 
 int stack_size(const Stack* stack) {
   return stack->top + 1;
 }
 
-void push_real(Stack* stack, double value) {
-  if (stack->top >= STACK_SIZE - 1) {
-    fprintf(stderr,"Stack overflow\n");
-    return;
-  }
-  stack->top++;
-  stack->items[stack->top].type = TYPE_REAL;
-  stack->items[stack->top].real = value;
+void push_string(Stack* stack, const char* str) {
+  push_string_n(stack, str, strlen(str));
 }
 
-void push_complex(Stack* stack, gsl_complex value) {
-  if (stack->top >= STACK_SIZE - 1) {
-    fprintf(stderr,"Stack overflow\n");
+void push_string_n(Stack* stack, const char* str, size_t len) {
+  if (!stack_reserve(stack, 1)) {
+    stack_overflow();
     return;
   }
-  stack->top++;
-  stack->items[stack->top].type = TYPE_COMPLEX;
-  stack->items[stack->top].complex_val = value;
+  if (set_string(&stack->items[stack->top + 1], str, len)) stack->top++;
 }
 
-void push_string(Stack* stack, const char* str) {
-  if (stack->top >= STACK_SIZE - 1) {
-    fprintf(stderr,"Stack overflow\n");
+void push_string_literal(Stack* stack, const char* str, size_t len) {
+  if (len <= SHORT_STRING_MAX) {
+    push_string_n(stack, str, len);
     return;
   }
-  stack->top++;
-  stack->items[stack->top].type = TYPE_STRING;
-  stack->items[stack->top].string = strdup(str);
-  if (!stack->items[stack->top].string) {
+  if (!stack_reserve(stack, 1)) {
+    stack_overflow();
+    return;
+  }
+  stack_element* e = &stack->items[stack->top + 1];
+  e->type = TYPE_STRING;
+  e->short_string = false;
+  e->string = intern_string(str, len);
+  if (!e->string) {
     fprintf(stderr,"Memory allocation failed\n");
-    stack->top--;
+    e->type = TYPE_REAL;
+    e->real = 0.0;
+    return;
   }
+  stack->top++;
 }
 
 void push_matrix_real(Stack* stack, gsl_matrix* matrix) {
-  if (stack->top >= STACK_SIZE - 1) {
-    fprintf(stderr,"Stack overflow\n");
+  if (!stack_reserve(stack, 1)) {
+    stack_overflow();
     return;
   }
   if (NULL == matrix) {
@@ -85,8 +124,8 @@ void push_matrix_real(Stack* stack, gsl_matrix* matrix) {
 }
 
 void push_matrix_complex(Stack* stack, gsl_matrix_complex* matrix) {
-  if (stack->top >= STACK_SIZE - 1) {
-    fprintf(stderr,"Stack overflow\n");
+  if (!stack_reserve(stack, 1)) {
+    stack_overflow();
     return;
   }
   stack->top++;
@@ -94,19 +133,6 @@ void push_matrix_complex(Stack* stack, gsl_matrix_complex* matrix) {
   stack->items[stack->top].matrix_complex = matrix;
 }
 
-stack_element pop(Stack* stack) {
-  stack_element popped;
-  if (stack->top < 0) {
-    printf("Stack underflow\n");
-    popped.type = TYPE_REAL;
-    popped.real = 0.0;
-    return popped;
-  }
-  popped = stack->items[stack->top];
-  stack->top--;
-  return popped;
-}
-
 void swap(Stack* stack) {
   if (stack->top < 1) {
     fprintf(stderr,"Too few elements on stack!\n");
@@ -123,41 +149,12 @@ int stack_dup(Stack* stack) {
     fprintf(stderr,"Stack is empty! Cannot duplicate.\n");
     return -1; // Error
   }
-  if (stack->top + 1 >= STACK_SIZE) {
+  if (!stack_reserve(stack, 1)) {
     fprintf(stderr,"Stack overflow! Cannot duplicate.\n");
     return -1; // Error
   }
-  if ((stack->items[stack->top].type == TYPE_REAL)
-      || (stack->items[stack->top].type == TYPE_COMPLEX)) {
-    stack->items[stack->top + 1] = stack->items[stack->top];
-    stack->top++;
-  }
-  if (stack->items[stack->top].type == TYPE_MATRIX_REAL) {
-    stack->items[stack->top + 1].type = TYPE_MATRIX_REAL;  
-    size_t rows = stack->items[stack->top].matrix_real->size1;
-    size_t cols = stack->items[stack->top].matrix_real->size2;
-    stack->items[stack->top + 1].matrix_real = gsl_matrix_alloc(rows, cols);
-    gsl_matrix_memcpy(
-		      stack->items[stack->top + 1].matrix_real,
-		      stack->items[stack->top].matrix_real);
-    stack->top++;
-  }
-  if (stack->items[stack->top].type == TYPE_MATRIX_COMPLEX) {
-    stack->items[stack->top + 1].type = TYPE_MATRIX_COMPLEX;
-    size_t rows = stack->items[stack->top].matrix_complex->size1;
-    size_t cols = stack->items[stack->top].matrix_complex->size2;
-    stack->items[stack->top + 1].matrix_complex =
-      gsl_matrix_complex_alloc(rows, cols);
-    gsl_matrix_complex_memcpy(stack->items[stack->top + 1].matrix_complex,
-			      stack->items[stack->top].matrix_complex);
-    stack->top++;
-  }
-  if (stack->items[stack->top].type == TYPE_STRING) {
-    stack->items[stack->top + 1].type = TYPE_STRING;
-    stack->items[stack->top + 1].string =
-      strdup(stack->items[stack->top].string);
-    stack->top++;
-  }
+  stack->items[stack->top + 1] = share_element(&stack->items[stack->top]);
+  stack->top++;
   return 0; // Success
 }
 
@@ -183,6 +180,9 @@ stack_element pop_and_free(Stack* stack) {
   }
   popped = stack->items[stack->top];
   stack->top--;
+  // Drop this reference, so a payload shared with dup becomes unique again.
+  // Only the type and scalar values of the result are still usable.
+  release_element(&popped);
   return popped;
 }
 
@@ -196,23 +196,95 @@ stack_element* view_top(Stack* stack) {
 
 void free_stack(Stack* stack) {
   while (stack->top >= 0) {
-    switch (stack->items[stack->top].type) {
-    case TYPE_STRING:
-      free(stack->items[stack->top].string);
-      break;
-    case TYPE_MATRIX_REAL:
-      gsl_matrix_free(stack->items[stack->top].matrix_real);
-      break;
-    case TYPE_MATRIX_COMPLEX:
-      gsl_matrix_complex_free(stack->items[stack->top].matrix_complex);
-      break;
-    default:
-      break;
-    }
+    release_element(&stack->items[stack->top]);
     stack->top--;
   }
 }
 
+stack_element share_element(const stack_element* e) {
+  switch (e->type) {
+  case TYPE_STRING:         if (!e->short_string) payload_retain(e->string); break;
+  case TYPE_MATRIX_REAL:    payload_retain(e->matrix_real); break;
+  case TYPE_MATRIX_COMPLEX: payload_retain(e->matrix_complex); break;
+  default: break;
+  }
+  return *e;
+}
+
+void release_element(stack_element* e) {
+  switch (e->type) {
+  case TYPE_STRING:         if (!e->short_string) string_release(e->string); break;
+  case TYPE_MATRIX_REAL:    matrix_release(e->matrix_real); break;
+  case TYPE_MATRIX_COMPLEX: matrix_complex_release(e->matrix_complex); break;
+  default: break;
+  }
+}
+
+// Copy-on-write: a payload that other slots, registers or the undo copy
+// still see is duplicated before the caller writes into it
+bool make_unique(stack_element* e) {
+  switch (e->type) {
+  case TYPE_STRING:
+    if (!e->short_string && payload_is_shared(e->string)) {
+      char* copy = strdup(e->string);
+      if (!copy) break;
+      string_release(e->string);
+      e->string = copy;
+    }
+    return true;
+  case TYPE_MATRIX_REAL:
+    if (payload_is_shared(e->matrix_real)) {
+      gsl_matrix* copy = matrix_alloc(e->matrix_real->size1, e->matrix_real->size2);
+      if (!copy) break;
+      gsl_matrix_memcpy(copy, e->matrix_real);
+      matrix_release(e->matrix_real);
+      e->matrix_real = copy;
+    }
+    return true;
+  case TYPE_MATRIX_COMPLEX:
+    if (payload_is_shared(e->matrix_complex)) {
+      gsl_matrix_complex* copy = matrix_complex_alloc(e->matrix_complex->size1,
+                                                          e->matrix_complex->size2);
+      if (!copy) break;
+      gsl_matrix_complex_memcpy(copy, e->matrix_complex);
+      matrix_complex_release(e->matrix_complex);
+      e->matrix_complex = copy;
+    }
+    return true;
+  default:
+    return true;
+  }
+  fprintf(stderr, "Memory allocation failed\n");
+  return false;
+}
+
+char* init_string(stack_element* e, size_t len) {
+  e->type = TYPE_STRING;
+  e->short_string = len <= SHORT_STRING_MAX;
+  char* buf = e->short_string ? e->text : malloc(len + 1);
+  if (!buf) {
+    fprintf(stderr, "Memory allocation failed\n");
+    e->type = TYPE_REAL;
+    e->real = 0.0;
+    return NULL;
+  }
+  if (!e->short_string) e->string = buf;
+  buf[len] = '\0';
+  return buf;
+}
+
+bool set_string(stack_element* e, const char* str, size_t len) {
+  char* buf = init_string(e, len);
+  if (!buf) return false;
+  memcpy(buf, str, len);
+  return true;
+}
+
+char* writable_string(stack_element* e) {
+  if (!make_unique(e)) return NULL;
+  return e->short_string ? e->text : e->string;
+}
+
 gsl_matrix* load_matrix_from_file(int rows, int cols, const char* filename) {
   FILE* f = fopen(filename, "r");
   if (!f) {
@@ -220,7 +292,7 @@ gsl_matrix* load_matrix_from_file(int rows, int cols, const char* filename) {
     return NULL;
   }
 
-  gsl_matrix* m = gsl_matrix_alloc(rows, cols);
+  gsl_matrix* m = matrix_alloc(rows, cols);
   if (!m) {
     fclose(f);
     fprintf(stderr, "Failed to allocate matrix.\n");
@@ -232,7 +304,7 @@ gsl_matrix* load_matrix_from_file(int rows, int cols, const char* filename) {
       double val;
       if (fscanf(f, "%lf", &val) != 1) {
 	fprintf(stderr, "Failed to read value at [%d, %d] from file '%s'\n", i, j, filename);
-	gsl_matrix_free(m);
+	matrix_release(m);
 	fclose(f);
 	return NULL;
       }
@@ -302,9 +374,10 @@ int save_stack_to_file(Stack* stack, const char* filename) {
       break;
 
     case TYPE_STRING: {
-      size_t len = strlen(elem->string) + 1; // Include null terminator
+      const char* str = element_string(elem);
+      size_t len = strlen(str) + 1; // Include null terminator
       if (fwrite(&len, sizeof(size_t), 1, file) != 1 ||
-	  fwrite(elem->string, sizeof(char), len, file) != len) {
+	  fwrite(str, sizeof(char), len, file) != len) {
 	perror("fwrite string");
 	fclose(file);
 	return -1;
@@ -358,11 +431,18 @@ int load_stack_from_file(Stack* stack, const char* filename) {
   }
 
   // Read the number of elements (top index)
-  if (fread(&stack->top, sizeof(int), 1, file) != 1) {
+  int top;
+  if (fread(&top, sizeof(int), 1, file) != 1) {
     perror("fread top");
     fclose(file);
     return -1;
   }
+  if (top < -1 || !stack_reserve(stack, top - stack->top)) {
+    stack_overflow();
+    fclose(file);
+    return -1;
+  }
+  stack->top = top;
 
   for (int i = 0; i <= stack->top; ++i) {
     stack_element* elem = &stack->items[i];
@@ -399,16 +479,16 @@ int load_stack_from_file(Stack* stack, const char* filename) {
 	return -1;
       }
 
-      elem->string = malloc(len);
-      if (!elem->string) {
+      char* buf = len ? init_string(elem, len - 1) : NULL;
+      if (!buf) {
 	perror("malloc string");
 	fclose(file);
 	return -1;
       }
 
-      if (fread(elem->string, sizeof(char), len, file) != len) {
+      if (fread(buf, sizeof(char), len, file) != len) {
 	perror("fread string");
-	free(elem->string);
+	release_element(elem);
 	fclose(file);
 	return -1;
       }
@@ -424,7 +504,7 @@ int load_stack_from_file(Stack* stack, const char* filename) {
 	return -1;
       }
 
-      elem->matrix_real = gsl_matrix_alloc(rows, cols);
+      elem->matrix_real = matrix_alloc(rows, cols);
       if (!elem->matrix_real) {
 	fprintf(stderr, "Failed to allocate matrix_real\n");
 	fclose(file);
@@ -433,7 +513,7 @@ int load_stack_from_file(Stack* stack, const char* filename) {
 
       if (fread(elem->matrix_real->data, sizeof(double), rows * cols, file) != rows * cols) {
 	perror("fread matrix_real data");
-	gsl_matrix_free(elem->matrix_real);
+	matrix_release(elem->matrix_real);
 	fclose(file);
 	return -1;
       }
@@ -449,7 +529,7 @@ int load_stack_from_file(Stack* stack, const char* filename) {
 	return -1;
       }
 
-      elem->matrix_complex = gsl_matrix_complex_alloc(rows, cols);
+      elem->matrix_complex = matrix_complex_alloc(rows, cols);
       if (!elem->matrix_complex) {
 	fprintf(stderr, "Failed to allocate matrix_complex\n");
 	fclose(file);
@@ -459,7 +539,7 @@ int load_stack_from_file(Stack* stack, const char* filename) {
       if (fread(elem->matrix_complex->data, sizeof(double), 2*rows*cols, file) != 2*rows*cols)
 	{
 	  perror("fread matrix_complex data");
-	  gsl_matrix_complex_free(elem->matrix_complex);
+	  matrix_complex_release(elem->matrix_complex);
 	  fclose(file);
 	  return -1;
 	}
@@ -478,64 +558,16 @@ int load_stack_from_file(Stack* stack, const char* filename) {
 }
 
 int copy_stack(Stack* dest, const Stack* src) {
-  dest->top = src->top;
-
-  for (int i = 0; i <= src->top; ++i) {
-    stack_element src_elem = src->items[i];
-    stack_element* dest_elem = &dest->items[i];
-    dest_elem->type = src_elem.type;
-
-    switch (src_elem.type) {
-    case TYPE_REAL:
-      dest_elem->real = src_elem.real;
-      break;
-
-    case TYPE_COMPLEX:
-      dest_elem->complex_val = src_elem.complex_val;
-      break;
-
-    case TYPE_STRING:
-      dest_elem->string = strdup(src_elem.string);
-      if (!dest_elem->string) {
-	fprintf(stderr, "Error: failed to allocate string in stack copy.\n");
-	return 0;
-      }
-      break;
-
-    case TYPE_MATRIX_REAL:
-      if (!src_elem.matrix_real) {
-	dest_elem->matrix_real = NULL;
-	break;
-      }
-      dest_elem->matrix_real = gsl_matrix_alloc(src_elem.matrix_real->size1,
-						src_elem.matrix_real->size2);
-      if (!dest_elem->matrix_real) {
-	fprintf(stderr, "Error: failed to allocate real matrix.\n");
-	return 0;
-      }
-      gsl_matrix_memcpy(dest_elem->matrix_real, src_elem.matrix_real);
-      break;
-
-    case TYPE_MATRIX_COMPLEX:
-      if (!src_elem.matrix_complex) {
-	dest_elem->matrix_complex = NULL;
-	break;
-      }
-      dest_elem->matrix_complex = gsl_matrix_complex_alloc(src_elem.matrix_complex->size1,
-							   src_elem.matrix_complex->size2);
-      if (!dest_elem->matrix_complex) {
-	fprintf(stderr, "Error: failed to allocate complex matrix.\n");
-	return 0;
-      }
-      gsl_matrix_complex_memcpy(dest_elem->matrix_complex, src_elem.matrix_complex);
-      break;
-
-    default:
-      fprintf(stderr, "Error: unknown type in stack copy.\n");
-      return 0;
-    }
+  free_stack(dest);
+  if (!stack_reserve(dest, src->top + 1)) {
+    fprintf(stderr, "Error: no room for the stack copy.\n");
+    return 0;
   }
 
+  // Entries share their payloads; make_unique separates them on a write
+  for (int i = 0; i <= src->top; ++i)
+    dest->items[i] = share_element(&src->items[i]);
+  dest->top = src->top;
   return 1; // success
 }
 
@@ -549,7 +581,7 @@ void stack_nip(Stack* stack) {
 }
 
 void stack_tuck(Stack* stack) {
-  if (stack->top < 1 || stack->top + 1 >= STACK_SIZE) {
+  if (stack->top < 1 || !stack_reserve(stack, 1)) {
     fprintf(stderr, "tuck: stack underflow or overflow\n");
     return;
   }
@@ -559,11 +591,11 @@ void stack_tuck(Stack* stack) {
 }
 
 void stack_over(Stack* stack) {
-  if (stack->top < 1 || stack->top + 1 >= STACK_SIZE) {
+  if (stack->top < 1 || !stack_reserve(stack, 1)) {
     fprintf(stderr, "over: stack underflow or overflow\n");
     return;
   }
-  stack_element copy = stack->items[stack->top - 1];
+  stack_element copy = share_element(&stack->items[stack->top - 1]);
   stack->items[++stack->top] = copy;
 }
 
@@ -0,0 +1,346 @@
+/*
+ * This file is part of Mico's toy RPN Calculator
+ *
+ * Mico's toy RPN Calculator is free software:
+ * you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mico's toy RPN Calculator is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mico's toy RPN Calculator. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Stack effect and type inference for compiled code.
+//
+// The analysis runs the instructions over an abstract stack of value
+// kinds. Where both the depth and the operand kinds of an instruction are
+// known, it can be replaced by a variant without checks (BC_ADD_RR and
+// friends). Those variants go into a second copy of the code, code->fast,
+// analysed as if the inputs were real; execute_code takes it only after
+// checking exactly that on entry. The analysis with no assumptions gives
+// code->effect, which also catches words that pop from a stack they have
+// just cleared.
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <math.h>
+#include "stack.h"
+#include "compare_fun.h"
+#include "math_helpers.h"
+#include "opcodes.h"
+#include "stack_effects.h"
+
+#define MAX_TRACKED_DEPTH 64
+
+static const unsigned char builtin_effects[OP_COUNT] = {
+  [OP_PRINT] = FX_NONE,
+  [OP_PI] = FX_CONST, [OP_E] = FX_CONST, [OP_GRAVITY] = FX_CONST,
+  [OP_INF] = FX_CONST, [OP_NAN] = FX_CONST,
+  [OP_SIN] = FX_REAL_UNARY, [OP_COS] = FX_REAL_UNARY, [OP_TAN] = FX_REAL_UNARY,
+  [OP_ASIN] = FX_REAL_UNARY, [OP_ACOS] = FX_REAL_UNARY, [OP_ATAN] = FX_REAL_UNARY,
+  [OP_SINH] = FX_REAL_UNARY, [OP_COSH] = FX_REAL_UNARY, [OP_TANH] = FX_REAL_UNARY,
+  [OP_ASINH] = FX_REAL_UNARY, [OP_ACOSH] = FX_REAL_UNARY, [OP_ATANH] = FX_REAL_UNARY,
+  [OP_EXP] = FX_REAL_UNARY, [OP_CHS] = FX_REAL_UNARY, [OP_INV] = FX_REAL_UNARY,
+  [OP_FRAC] = FX_REAL_UNARY, [OP_INTG] = FX_REAL_UNARY, [OP_NOT] = FX_REAL_UNARY,
+  [OP_LN] = FX_NUMBER_UNARY, [OP_LOG] = FX_NUMBER_UNARY, [OP_SQRT] = FX_NUMBER_UNARY,
+  [OP_ABS] = FX_TO_REAL, [OP_RE] = FX_TO_REAL, [OP_IM] = FX_TO_REAL, [OP_ARG] = FX_TO_REAL,
+  [OP_EQ] = FX_CMP, [OP_NEQ] = FX_CMP, [OP_LT] = FX_CMP, [OP_LEQ] = FX_CMP,
+  [OP_GT] = FX_CMP, [OP_GEQ] = FX_CMP, [OP_AND] = FX_CMP, [OP_OR] = FX_CMP,
+  [OP_DUP] = FX_DUP, [OP_DROP] = FX_DROP, [OP_SWAP] = FX_SWAP, [OP_OVER] = FX_OVER,
+  [OP_NIP] = FX_NIP, [OP_TUCK] = FX_TUCK, [OP_ROLL] = FX_ROLL, [OP_CLST] = FX_CLST,
+};
+
+// The real function each FX_REAL_UNARY builtin applies to a real, where
+// calling it directly is all the builtin does
+static double (*const real_unary[OP_COUNT])(double) = {
+  [OP_SIN] = sin, [OP_COS] = cos, [OP_TAN] = tan,
+  [OP_ASIN] = asin, [OP_ACOS] = acos, [OP_ATAN] = atan,
+  [OP_SINH] = sinh, [OP_COSH] = cosh, [OP_TANH] = tanh,
+  [OP_ASINH] = asinh, [OP_ACOSH] = acosh, [OP_ATANH] = atanh,
+  [OP_EXP] = exp, [OP_CHS] = negate_real, [OP_INV] = one_over_real,
+  [OP_FRAC] = safe_frac, [OP_INTG] = safe_int, [OP_ABS] = fabs,
+};
+
+static const int cmp_of[OP_COUNT] = {
+  [OP_EQ] = CMP_EQ, [OP_NEQ] = CMP_NE, [OP_LT] = CMP_LT, [OP_LEQ] = CMP_LE,
+  [OP_GT] = CMP_GT, [OP_GEQ] = CMP_GE, [OP_AND] = CMP_AND, [OP_OR] = CMP_OR,
+};
+
+// Values of the FX_CONST builtins, as eval_fun.c pushes them
+static const double constants[OP_COUNT] = {
+  [OP_PI] = M_PI, [OP_E] = 2.71828182845904523536, [OP_GRAVITY] = 9.81,
+  [OP_INF] = INFINITY, [OP_NAN] = NAN,
+};
+
+builtin_effect builtin_effect_of(int opcode) {
+  return (opcode >= 0 && opcode < OP_COUNT) ? (builtin_effect)builtin_effects[opcode] : FX_UNKNOWN;
+}
+
+double (*real_unary_of(int opcode))(double) {
+  return (opcode >= 0 && opcode < OP_COUNT) ? real_unary[opcode] : NULL;
+}
+
+int comparison_of(int opcode) {
+  return cmp_of[opcode];
+}
+
+double constant_of(int opcode) {
+  return constants[opcode];
+}
+
+typedef struct {
+  value_kind slot[MAX_TRACKED_INPUTS + MAX_TRACKED_DEPTH];  // depth d is slot[d + MAX_TRACKED_INPUTS]
+  int depth;            // relative to the entry depth
+  int low;              // lowest depth reached
+  int peak;
+  bool cleared;         // depth is absolute: clst ran
+  bool underflow;
+} abstract_stack;
+
+static bool is_number(value_kind k) {
+  return k == VK_REAL || k == VK_COMPLEX || k == VK_NUMBER;
+}
+
+static value_kind arith_kind(value_kind a, value_kind b) {
+  if (a == VK_REAL && b == VK_REAL) return VK_REAL;
+  if (a == VK_NUMBER || b == VK_NUMBER) return VK_NUMBER;
+  return VK_COMPLEX;
+}
+
+// k-th entry from the top, 0 being the top
+static value_kind *at(abstract_stack* s, int k) {
+  return &s->slot[s->depth - 1 - k + MAX_TRACKED_INPUTS];
+}
+
+// Are there n entries? Below the entry depth they are inputs, unless the
+// stack was cleared, in which case the instruction is sure to underflow.
+static bool need(abstract_stack* s, int n) {
+  if (s->depth - n < 0 && s->cleared) {
+    s->underflow = true;
+    return false;
+  }
+  if (s->depth - n < -MAX_TRACKED_INPUTS) return false;
+  if (s->depth - n < s->low) s->low = s->depth - n;
+  return true;
+}
+
+static bool push(abstract_stack* s, value_kind k) {
+  if (s->depth + 1 > MAX_TRACKED_DEPTH) return false;
+  s->slot[s->depth + MAX_TRACKED_INPUTS] = k;
+  s->depth++;
+  if (s->depth > s->peak) s->peak = s->depth;
+  return true;
+}
+
+// Room for n temporary entries above the current depth
+static bool reserve(abstract_stack* s, int n) {
+  if (s->depth + n > MAX_TRACKED_DEPTH) return false;
+  if (s->depth + n > s->peak) s->peak = s->depth + n;
+  return true;
+}
+
+// Model a builtin; false stops the analysis. *fast is set to the
+// check-free replacement when there is one.
+static bool model_builtin(abstract_stack* s, const bc_instr* ins, bc_instr* fast) {
+  value_kind a, b, c;
+  switch ((builtin_effect)builtin_effects[ins->opcode]) {
+  case FX_NONE:
+    return true;
+  case FX_CONST:
+    return push(s, VK_REAL);
+  case FX_REAL_UNARY:
+    if (!need(s, 1) || !is_number(a = *at(s, 0))) return false;
+    if (a == VK_REAL && real_unary[ins->opcode]) {
+      fast->op = BC_REAL_FN;
+      fast->real_fn = real_unary[ins->opcode];
+    }
+    return true;
+  case FX_NUMBER_UNARY:
+    if (!need(s, 1) || !is_number(*at(s, 0))) return false;
+    *at(s, 0) = VK_NUMBER;
+    return true;
+  case FX_TO_REAL:
+    if (!need(s, 1) || !is_number(a = *at(s, 0))) return false;
+    if (a == VK_REAL && real_unary[ins->opcode]) {
+      fast->op = BC_REAL_FN;
+      fast->real_fn = real_unary[ins->opcode];
+    }
+    *at(s, 0) = VK_REAL;
+    return true;
+  case FX_CMP:
+    if (!need(s, 2) || !is_number(a = *at(s, 1)) || !is_number(b = *at(s, 0))) return false;
+    if (a == VK_REAL && b == VK_REAL) {
+      fast->op = BC_CMP_RR;
+      fast->cmp = cmp_of[ins->opcode];
+    }
+    s->depth--;
+    *at(s, 0) = VK_REAL;
+    return true;
+  case FX_DUP:
+    if (!need(s, 1) || (a = *at(s, 0)) == VK_ANY) return false;
+    if (a == VK_REAL) fast->op = BC_DUP_R;
+    return push(s, a);
+  case FX_DROP:
+    if (!need(s, 1) || (a = *at(s, 0)) == VK_ANY) return false;
+    if (a == VK_REAL) fast->op = BC_DROP_R;
+    s->depth--;
+    return true;
+  case FX_SWAP:
+    if (!need(s, 2) || (a = *at(s, 1)) == VK_ANY || (b = *at(s, 0)) == VK_ANY) return false;
+    if (a == VK_REAL && b == VK_REAL) fast->op = BC_SWAP_RR;
+    *at(s, 1) = b;
+    *at(s, 0) = a;
+    return true;
+  case FX_OVER:
+    if (!need(s, 2) || (a = *at(s, 1)) == VK_ANY || *at(s, 0) == VK_ANY) return false;
+    if (a == VK_REAL && *at(s, 0) == VK_REAL) fast->op = BC_OVER_RR;
+    return push(s, a);
+  case FX_NIP:
+    if (!need(s, 2) || (a = *at(s, 1)) == VK_ANY || (b = *at(s, 0)) == VK_ANY) return false;
+    if (a == VK_REAL) fast->op = BC_NIP_R;
+    s->depth--;
+    *at(s, 0) = b;
+    return true;
+  case FX_TUCK:        // over swap: a b -> a a b
+    if (!need(s, 2) || (a = *at(s, 1)) == VK_ANY || (b = *at(s, 0)) == VK_ANY) return false;
+    *at(s, 0) = a;
+    return push(s, b);
+  case FX_ROLL:        // a b c -> b c a
+    if (!need(s, 3) || (a = *at(s, 2)) == VK_ANY || (b = *at(s, 1)) == VK_ANY ||
+        (c = *at(s, 0)) == VK_ANY)
+      return false;
+    *at(s, 2) = b;
+    *at(s, 1) = c;
+    *at(s, 0) = a;
+    return true;
+  case FX_CLST:
+    s->depth = 0;
+    s->cleared = true;
+    return true;
+  case FX_UNKNOWN:
+    return false;
+  }
+  return false;
+}
+
+// Binary scalar arithmetic: + - * / ^
+static bool model_arith(abstract_stack* s, bc_op rr, bc_instr* fast) {
+  value_kind a, b;
+  if (!need(s, 2) || !is_number(a = *at(s, 1)) || !is_number(b = *at(s, 0))) return false;
+  if (a == VK_REAL && b == VK_REAL) fast->op = rr;
+  s->depth--;
+  *at(s, 0) = arith_kind(a, b);
+  return true;
+}
+
+static bool model(abstract_stack* s, const bc_instr* ins, bc_instr* fast) {
+  value_kind a, b;
+  switch (ins->op) {
+  case BC_END:
+  case BC_ECHO:
+  case BC_ILLEGAL:
+    return true;
+  case BC_PUSH_REAL:    return push(s, VK_REAL);
+  case BC_PUSH_COMPLEX: return push(s, VK_COMPLEX);
+  case BC_PUSH_STRING:  return push(s, VK_STRING);
+  case BC_ADD:          return model_arith(s, BC_ADD_RR, fast);
+  case BC_SUB:          return model_arith(s, BC_SUB_RR, fast);
+  case BC_MUL:          return model_arith(s, BC_MUL_RR, fast);
+  case BC_DIV:          return model_arith(s, BC_DIV_RR, fast);
+  case BC_POW:          return model_arith(s, BC_POW_RR, fast);
+  case BC_BUILTIN:      return model_builtin(s, ins, fast);
+
+  case BC_SQUARE:      // the copy or constant is pushed first, kind is kept
+  case BC_ADD_K:
+  case BC_SUB_K:
+  case BC_MUL_K:
+  case BC_DIV_K:
+    if (!need(s, 1) || !is_number(a = *at(s, 0)) || !reserve(s, 1)) return false;
+    if (a == VK_REAL) fast->op = BC_FAST_FUSED(ins->op);
+    return true;
+  case BC_NIP:
+    if (!need(s, 2) || (a = *at(s, 1)) == VK_ANY || (b = *at(s, 0)) == VK_ANY) return false;
+    if (a == VK_REAL) fast->op = BC_FAST_FUSED(ins->op);
+    s->depth--;
+    *at(s, 0) = b;
+    return true;
+  case BC_OVER2_DIV:   // a b -> a b a/b, by way of a b a b
+    if (!need(s, 2) || !is_number(a = *at(s, 1)) || !is_number(b = *at(s, 0)) ||
+        !reserve(s, 2))
+      return false;
+    if (a == VK_REAL && b == VK_REAL) fast->op = BC_FAST_FUSED(ins->op);
+    return push(s, arith_kind(a, b));
+  case BC_OVER_SUB:    // a b -> a b-a
+  case BC_SWAP_DIV:    // a b -> b/a
+  case BC_PCT_DELTA:   // a b -> (b-a)/a
+    if (!need(s, 2) || !is_number(a = *at(s, 1)) || !is_number(b = *at(s, 0))) return false;
+    if (ins->op != BC_SWAP_DIV && !reserve(s, 1)) return false;   // the copy made by over
+    if (a == VK_REAL && b == VK_REAL) fast->op = BC_FAST_FUSED(ins->op);
+    if (ins->op != BC_OVER_SUB) s->depth--;
+    *at(s, 0) = arith_kind(a, b);
+    return true;
+
+  default:   // matrices, files, calls and the check-free ops themselves
+    return false;
+  }
+}
+
+stack_effect analyse_code(const bc_instr* code, int count,
+                          const value_kind* inputs, int n_inputs,
+                          bc_instr* out, int* specialized, value_kind* result) {
+  abstract_stack s = {.depth = 0};
+  for (int i = 0; i < MAX_TRACKED_INPUTS; i++)
+    s.slot[MAX_TRACKED_INPUTS - 1 - i] = i < n_inputs ? inputs[i] : VK_ANY;
+
+  if (out) memcpy(out, code, (size_t)count * sizeof *code);
+  if (specialized) *specialized = 0;
+
+  int i = 0;
+  for (; i < count; i++) {
+    bc_instr fast = code[i];
+    if (!model(&s, &code[i], &fast)) break;
+    if (out && fast.op != code[i].op) {
+      out[i] = fast;
+      if (specialized) (*specialized)++;
+    }
+  }
+
+  stack_effect fx = {
+    .complete = i == count,
+    .underflows = s.underflow,
+    .clears = s.cleared,
+    .needs = -s.low,
+    .delta = s.depth,
+    .peak = s.peak,
+  };
+  if (result) *result = (fx.complete && s.depth > 0) ? *at(&s, 0) : VK_ANY;
+  return fx;
+}
+
+void specialize_code(code_block* code) {
+  code->effect = analyse_code(code->code, code->count, NULL, 0, NULL, NULL, NULL);
+
+  bc_instr* fast = malloc((size_t)code->count * sizeof *fast);
+  if (!fast) return;
+
+  value_kind reals[MAX_TRACKED_INPUTS];
+  for (int i = 0; i < MAX_TRACKED_INPUTS; i++) reals[i] = VK_REAL;
+
+  int specialized = 0;
+  stack_effect fx = analyse_code(code->code, code->count, reals, MAX_TRACKED_INPUTS,
+                                 fast, &specialized, NULL);
+  if (specialized == 0) {
+    free(fast);
+    return;
+  }
+  code->fast = fast;
+  code->fast_needs = fx.needs;
+  code->fast_peak = fx.peak;
+}
@@ -73,7 +73,7 @@ void matrix_column_means(Stack* stack) {
     size_t rows = mat->size1;
     size_t cols = mat->size2;
 
-    gsl_matrix* mean = gsl_matrix_calloc(1, cols);
+    gsl_matrix* mean = matrix_calloc(1, cols);
     if (!mean) {
       fprintf(stderr, "Failed to allocate result matrix.\n");
       return;
@@ -90,9 +90,9 @@ void matrix_column_means(Stack* stack) {
     stack_element result;
     result.type = TYPE_MATRIX_REAL;
     result.matrix_real = mean;
-    if (stack->top + 1 >= STACK_SIZE) {
+    if (!stack_reserve(stack, 1)) {
       fprintf(stderr, "Stack overflow.\n");
-      gsl_matrix_free(mean);
+      matrix_release(mean);
       return;
     }
     stack->items[++stack->top] = result;
@@ -107,7 +107,7 @@ void matrix_column_means(Stack* stack) {
     size_t rows = mat->size1;
     size_t cols = mat->size2;
 
-    gsl_matrix_complex* mean = gsl_matrix_complex_calloc(1, cols);
+    gsl_matrix_complex* mean = matrix_complex_calloc(1, cols);
     if (!mean) {
       fprintf(stderr, "Failed to allocate complex result matrix.\n");
       return;
@@ -126,9 +126,9 @@ void matrix_column_means(Stack* stack) {
     stack_element result;
     result.type = TYPE_MATRIX_COMPLEX;
     result.matrix_complex = mean;
-    if (stack->top + 1 >= STACK_SIZE) {
+    if (!stack_reserve(stack, 1)) {
       fprintf(stderr, "Stack overflow.\n");
-      gsl_matrix_complex_free(mean);
+      matrix_complex_release(mean);
       return;
     }
     stack->items[++stack->top] = result;
@@ -174,7 +174,7 @@ void matrix_column_means(Stack* stack) {
 /*     gsl_matrix* result = NULL; */
 
 /*     if (compute_rows) { */
-/*       result = gsl_matrix_calloc(rows, 1); */
+/*       result = matrix_calloc(rows, 1); */
 /*       if (!result) { */
 /* 	fprintf(stderr, "Failed to allocate result matrix.\n"); */
 /* 	return; */
@@ -199,7 +199,7 @@ void matrix_column_means(Stack* stack) {
 /* 	gsl_matrix_set(result, i, 0, res); */
 /*       } */
 /*     } else if (compute_cols) { */
-/*       result = gsl_matrix_calloc(1, cols); */
+/*       result = matrix_calloc(1, cols); */
 /*       if (!result) { */
 /* 	fprintf(stderr, "Failed to allocate result matrix.\n"); */
 /* 	return; */
@@ -230,7 +230,7 @@ void matrix_column_means(Stack* stack) {
 /*     out.matrix_real = result; */
 /*     if (stack->top + 1 >= STACK_SIZE) { */
 /*       fprintf(stderr, "Stack overflow.\n"); */
-/*       gsl_matrix_free(result); */
+/*       matrix_release(result); */
 /*       return; */
 /*     } */
 /*     stack->items[++stack->top] = out; */
@@ -248,7 +248,7 @@ void matrix_column_means(Stack* stack) {
 /*     gsl_matrix_complex* result = NULL; */
 
 /*     if (compute_rows) { */
-/*       result = gsl_matrix_complex_calloc(rows, 1); */
+/*       result = matrix_complex_calloc(rows, 1); */
 /*       if (!result) { */
 /* 	fprintf(stderr, "Failed to allocate complex result matrix.\n"); */
 /* 	return; */
@@ -275,7 +275,7 @@ void matrix_column_means(Stack* stack) {
 /* 	gsl_matrix_complex_set(result, i, 0, res); */
 /*       } */
 /*     } else if (compute_cols) { */
-/*       result = gsl_matrix_complex_calloc(1, cols); */
+/*       result = matrix_complex_calloc(1, cols); */
 /*       if (!result) { */
 /* 	fprintf(stderr, "Failed to allocate complex result matrix.\n"); */
 /* 	return; */
@@ -308,7 +308,7 @@ void matrix_column_means(Stack* stack) {
 /*     out.matrix_complex = result; */
 /*     if (stack->top + 1 >= STACK_SIZE) { */
 /*       fprintf(stderr, "Stack overflow.\n"); */
-/*       gsl_matrix_complex_free(result); */
+/*       matrix_complex_release(result); */
 /*       return; */
 /*     } */
 /*     stack->items[++stack->top] = out; */
@@ -360,7 +360,8 @@ void matrix_reduce(Stack* stack, const char* axis, const char* op) {
     gsl_matrix* result = NULL;
 
     if (compute_rows) {
-      result = gsl_matrix_calloc(rows, 1);
+      result = matrix_calloc(rows, 1);
+      if (!result) return;
       for (size_t i = 0; i < rows; ++i) {
         double acc = 0.0, acc_sq = 0.0;
         double extreme = do_max ? -GSL_POSINF : GSL_POSINF;
@@ -383,7 +384,8 @@ void matrix_reduce(Stack* stack, const char* axis, const char* op) {
         gsl_matrix_set(result, i, 0, res);
       }
     } else if (compute_cols) {
-      result = gsl_matrix_calloc(1, cols);
+      result = matrix_calloc(1, cols);
+      if (!result) return;
       for (size_t j = 0; j < cols; ++j) {
         double acc = 0.0, acc_sq = 0.0;
         double extreme = do_max ? -GSL_POSINF : GSL_POSINF;
@@ -408,9 +410,9 @@ void matrix_reduce(Stack* stack, const char* axis, const char* op) {
     }
 
     stack_element out = {.type = TYPE_MATRIX_REAL, .matrix_real = result};
-    if (stack->top + 1 >= STACK_SIZE) {
+    if (!stack_reserve(stack, 1)) {
       fprintf(stderr, "Stack overflow.\n");
-      gsl_matrix_free(result);
+      matrix_release(result);
       return;
     }
     stack->items[++stack->top] = out;
@@ -426,7 +428,8 @@ void matrix_reduce(Stack* stack, const char* axis, const char* op) {
     gsl_matrix_complex* result = NULL;
 
     if (compute_rows) {
-      result = gsl_matrix_complex_calloc(rows, 1);
+      result = matrix_complex_calloc(rows, 1);
+      if (!result) return;
       for (size_t i = 0; i < rows; ++i) {
         gsl_complex acc = gsl_complex_rect(0.0, 0.0);
         gsl_complex acc_sq = gsl_complex_rect(0.0, 0.0);
@@ -456,7 +459,8 @@ void matrix_reduce(Stack* stack, const char* axis, const char* op) {
         gsl_matrix_complex_set(result, i, 0, res);
       }
     } else if (compute_cols) {
-      result = gsl_matrix_complex_calloc(1, cols);
+      result = matrix_complex_calloc(1, cols);
+      if (!result) return;
       for (size_t j = 0; j < cols; ++j) {
         gsl_complex acc = gsl_complex_rect(0.0, 0.0);
         gsl_complex acc_sq = gsl_complex_rect(0.0, 0.0);
@@ -488,9 +492,9 @@ void matrix_reduce(Stack* stack, const char* axis, const char* op) {
     }
 
     stack_element out = {.type = TYPE_MATRIX_COMPLEX, .matrix_complex = result};
-    if (stack->top + 1 >= STACK_SIZE) {
+    if (!stack_reserve(stack, 1)) {
       fprintf(stderr, "Stack overflow.\n");
-      gsl_matrix_complex_free(result);
+      matrix_complex_release(result);
       return;
     }
     stack->items[++stack->top] = out;
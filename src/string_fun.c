@@ -32,24 +32,23 @@ void concatenate(Stack* stack) {
     return;
   }
 
-  const char* str1 = stack->items[stack->top - 1].string;
-  const char* str2 = stack->items[stack->top].string;
-
-  size_t new_len = strlen(str1) + strlen(str2) + 1;
-  char* result = malloc(new_len);
-  if (!result) {
-    fprintf(stderr,"Memory allocation failed\n");
-    return;
-  }
-
-  strcpy(result, str1);
-  strcat(result, str2);
-
-  free(stack->items[stack->top].string);
-  free(stack->items[stack->top - 1].string);
-  stack->top -= 2;
-  push_string(stack, result);
-  free(result);
+  stack_element* a = &stack->items[stack->top - 1];
+  stack_element* b = &stack->items[stack->top];
+  const char* str1 = element_string(a);
+  const char* str2 = element_string(b);
+  size_t len1 = strlen(str1), len2 = strlen(str2);
+
+  // Build the result in its final place: inline, or one heap buffer
+  stack_element result;
+  char* out = init_string(&result, len1 + len2);
+  if (!out) return;
+  memcpy(out, str1, len1);
+  memcpy(out + len1, str2, len2);
+
+  release_element(a);
+  release_element(b);
+  *a = result;
+  stack->top--;
 }
 
 void to_upper(Stack* stack) {
@@ -57,15 +56,9 @@ void to_upper(Stack* stack) {
     fprintf(stderr,"Top item must be a string\n");
     return;
   }
-  char* orig = stack->items[stack->top].string;
-  char* upper = strdup(orig);
-  if (!upper) {
-    fprintf(stderr,"Memory allocation failed\n");
-    return;
-  }
-  for (char* p = upper; *p; ++p) *p = toupper((unsigned char)*p);
-  free(orig);
-  stack->items[stack->top].string = upper;
+  char* str = writable_string(&stack->items[stack->top]);
+  if (!str) return;
+  for (char* p = str; *p; ++p) *p = toupper((unsigned char)*p);
 }
 
 void to_lower(Stack* stack) {
@@ -73,15 +66,9 @@ void to_lower(Stack* stack) {
     fprintf(stderr,"Top item must be a string\n");
     return;
   }
-  char* orig = stack->items[stack->top].string;
-  char* lower = strdup(orig);
-  if (!lower) {
-    fprintf(stderr,"Memory allocation failed\n");
-    return;
-  }
-  for (char* p = lower; *p; ++p) *p = tolower((unsigned char)*p);
-  free(orig);
-  stack->items[stack->top].string = lower;
+  char* str = writable_string(&stack->items[stack->top]);
+  if (!str) return;
+  for (char* p = str; *p; ++p) *p = tolower((unsigned char)*p);
 }
 
 void string_length(Stack* stack) {
@@ -89,8 +76,8 @@ void string_length(Stack* stack) {
     fprintf(stderr,"Top item must be a string\n");
     return;
   }
-  size_t len = strlen(stack->items[stack->top].string);
-  free(stack->items[stack->top].string);
+  size_t len = strlen(element_string(&stack->items[stack->top]));
+  release_element(&stack->items[stack->top]);
   stack->top--;
   push_real(stack, (double)len);
 }
@@ -100,7 +87,8 @@ void string_reverse(Stack* stack) {
     fprintf(stderr,"Top item must be a string\n");
     return;
   }
-  char* str = stack->items[stack->top].string;
+  char* str = writable_string(&stack->items[stack->top]);
+  if (!str) return;
   size_t len = strlen(str);
   for (size_t i = 0; i < len / 2; ++i) {
     char tmp = str[i];
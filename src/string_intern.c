@@ -0,0 +1,114 @@
+/*
+ * This file is part of Mico's toy RPN Calculator
+ *
+ * Mico's toy RPN Calculator is free software:
+ * you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mico's toy RPN Calculator is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mico's toy RPN Calculator. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include "opcode_hash.h"
+#include "payload.h"
+#include "string_intern.h"
+
+#define INTERN_BUCKETS 64   // initial size; doubles when the table fills
+
+typedef struct interned {
+  char* text;
+  size_t len;
+  struct interned* next;
+} interned;
+
+static interned** intern_table;
+static size_t intern_buckets;
+static size_t intern_count;
+
+static bool grow_intern_table(void) {
+  size_t buckets = intern_buckets ? 2 * intern_buckets : INTERN_BUCKETS;
+  interned** table = calloc(buckets, sizeof *table);
+  if (!table) return false;
+  for (size_t b = 0; b < intern_buckets; b++) {
+    interned* s = intern_table[b];
+    while (s) {
+      interned* next = s->next;
+      uint32_t bucket = opcode_hash(0, s->text, s->len) % buckets;
+      s->next = table[bucket];
+      table[bucket] = s;
+      s = next;
+    }
+  }
+  free(intern_table);
+  intern_table = table;
+  intern_buckets = buckets;
+  return true;
+}
+
+char* intern_string(const char* str, size_t len) {
+  uint32_t hash = opcode_hash(0, str, len);
+  if (intern_table) {
+    for (interned* s = intern_table[hash % intern_buckets]; s; s = s->next) {
+      if (s->len == len && !memcmp(s->text, str, len)) {
+        payload_retain(s->text);
+        return s->text;
+      }
+    }
+  }
+
+  char* copy = strndup(str, len);
+  if (!copy) return NULL;
+  if (intern_count >= intern_buckets && !grow_intern_table() && !intern_table) return copy;
+  interned* s = malloc(sizeof *s);
+  if (!s) return copy;
+  s->text = copy;
+  s->len = len;
+  s->next = intern_table[hash % intern_buckets];
+  intern_table[hash % intern_buckets] = s;
+  intern_count++;
+  payload_retain(copy);   // the table's own reference
+  return copy;
+}
+
+// Only the pointer identifies the entry: a private copy with the same
+// text is not the table's
+void release_if_interned(char* str) {
+  if (!intern_table) return;
+  size_t len = strlen(str);
+  interned** link = &intern_table[opcode_hash(0, str, len) % intern_buckets];
+  for (; *link; link = &(*link)->next) {
+    if ((*link)->text != str) continue;
+    interned* s = *link;
+    *link = s->next;
+    free(s);
+    intern_count--;
+    free(str);   // the reference left was the table's
+    return;
+  }
+}
+
+void free_interned_strings(void) {
+  for (size_t b = 0; b < intern_buckets; b++) {
+    while (intern_table[b]) {
+      interned* s = intern_table[b];
+      intern_table[b] = s->next;
+      if (payload_release(s->text)) free(s->text);
+      free(s);
+    }
+  }
+  free(intern_table);
+  intern_table = NULL;
+  intern_buckets = intern_count = 0;
+}
@@ -0,0 +1,102 @@
+/*
+ * This file is part of Mico's toy RPN Calculator
+ *
+ * Mico's toy RPN Calculator is free software:
+ * you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mico's toy RPN Calculator is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mico's toy RPN Calculator. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include "opcode_hash.h"
+#include "words.h"
+#include "symbols.h"
+
+#define SYMBOL_BUCKETS 512   // initial size; doubles when the table fills
+
+static symbol** symbol_table;
+static size_t symbol_buckets;
+static size_t symbol_count;
+
+static void bind_user_words(symbol* sym) {
+  sym->macro = NULL;
+  sym->word = NULL;
+  // First definition wins, as it did with the old linear find_word/find_macro
+  for (int i = macro_count - 1; i >= 0; i--)
+    if (strlen(macros[i].name) == sym->len && !memcmp(macros[i].name, sym->name, sym->len))
+      sym->macro = &macros[i];
+  for (int i = word_count - 1; i >= 0; i--)
+    if (strlen(words[i].name) == sym->len && !memcmp(words[i].name, sym->name, sym->len))
+      sym->word = &words[i];
+}
+
+// Every name the lexer meets stays interned, since compiled code may
+// refer to a word before it is defined; keep chains short as that grows
+static bool grow_symbol_table(void) {
+  size_t buckets = symbol_buckets ? 2 * symbol_buckets : SYMBOL_BUCKETS;
+  symbol** table = calloc(buckets, sizeof *table);
+  if (!table) return false;
+  for (size_t b = 0; b < symbol_buckets; b++) {
+    symbol* s = symbol_table[b];
+    while (s) {
+      symbol* next = s->next;
+      uint32_t bucket = opcode_hash(0, s->name, s->len) % buckets;
+      s->next = table[bucket];
+      table[bucket] = s;
+      s = next;
+    }
+  }
+  free(symbol_table);
+  symbol_table = table;
+  symbol_buckets = buckets;
+  return true;
+}
+
+symbol* intern_symbol(const char* name, size_t len) {
+  uint32_t hash = opcode_hash(0, name, len);
+  if (symbol_table) {
+    for (symbol* s = symbol_table[hash % symbol_buckets]; s; s = s->next)
+      if (s->len == len && !memcmp(s->name, name, len)) return s;
+  }
+  if (symbol_count >= symbol_buckets && !grow_symbol_table() && !symbol_table) {
+    fprintf(stderr, "Out of memory interning symbol.\n");
+    return NULL;
+  }
+
+  symbol* s = malloc(sizeof *s);
+  char* copy = malloc(len + 1);
+  if (!s || !copy) {
+    fprintf(stderr, "Out of memory interning symbol.\n");
+    free(s);
+    free(copy);
+    return NULL;
+  }
+  memcpy(copy, name, len);
+  copy[len] = '\0';
+  s->name = copy;
+  s->len = len;
+  s->opcode = lookup_opcode(name, len);
+  bind_user_words(s);
+  s->next = symbol_table[hash % symbol_buckets];
+  symbol_table[hash % symbol_buckets] = s;
+  symbol_count++;
+  return s;
+}
+
+void rebind_word_symbols(void) {
+  for (size_t b = 0; b < symbol_buckets; b++)
+    for (symbol* s = symbol_table[b]; s; s = s->next)
+      bind_user_words(s);
+}
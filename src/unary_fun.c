@@ -27,6 +27,7 @@
 #include "math_parsers.h"
 #include "math_helpers.h"
 #include "binary_fun.h"
+#include "vec_math.h"
 #include "unary_fun.h"
 
 // === Unary math functions for real and complex ===
@@ -57,6 +58,7 @@ void apply_complex_matrix_unary_inplace(Stack* stack, gsl_complex (*func)(gsl_co
     fprintf(stderr,"Top of stack is not a complex matrix!\n");
     return;
   }
+  if (!make_unique(top)) return;
 
   gsl_matrix_complex* mat = top->matrix_complex;
   size_t rows = mat->size1;
@@ -81,6 +83,7 @@ void apply_real_matrix_unary_inplace(Stack* stack, double (*func)(double)) {
     fprintf(stderr,"Top of stack is not a real matrix!\n");
     return;
   }
+  if (!make_unique(top)) return;
 
   gsl_matrix* mat = top->matrix_real;
   size_t rows = mat->size1;
@@ -94,6 +97,38 @@ void apply_real_matrix_unary_inplace(Stack* stack, double (*func)(double)) {
   }
 }
 
+// Same as above, but through the vector math layer, a vector of elements
+// at a time
+void apply_real_matrix_vm_inplace(Stack* stack, vm_fn fn) {
+  if (stack->top < 0) {
+    fprintf(stderr,"Stack is empty!\n");
+    return;
+  }
+
+  stack_element* top = &stack->items[stack->top];
+  if (top->type != TYPE_MATRIX_REAL) {
+    fprintf(stderr,"Top of stack is not a real matrix!\n");
+    return;
+  }
+  if (!make_unique(top)) return;
+  vm_matrix(fn, top->matrix_real, top->matrix_real);
+}
+
+void apply_complex_matrix_vm_inplace(Stack* stack, vm_fn fn) {
+  if (stack->top < 0) {
+    fprintf(stderr,"Stack is empty!\n");
+    return;
+  }
+
+  stack_element* top = &stack->items[stack->top];
+  if (top->type != TYPE_MATRIX_COMPLEX) {
+    fprintf(stderr,"Top of stack is not a complex matrix!\n");
+    return;
+  }
+  if (!make_unique(top)) return;
+  vm_complex_matrix(fn, top->matrix_complex, top->matrix_complex);
+}
+
 void complex_matrix_real_part(Stack *s) {
   if (s->top < 0 || s->items[s->top].type != TYPE_MATRIX_COMPLEX) {
     fprintf(stderr, "Error: top of stack must be a complex matrix.\n");
@@ -111,7 +146,7 @@ void complex_matrix_real_part(Stack *s) {
   size_t rows = matrix->size1;
   size_t cols = matrix->size2;
 
-  gsl_matrix *result = gsl_matrix_alloc(rows, cols);
+  gsl_matrix *result = matrix_alloc(rows, cols);
   if (!result) {
     fprintf(stderr, "Error: failed to allocate result matrix.\n");
     return;
@@ -127,16 +162,16 @@ void complex_matrix_real_part(Stack *s) {
 
   // Inline stackl_pop:
   if (src->type == TYPE_MATRIX_COMPLEX && src->matrix_complex) {
-    gsl_matrix_complex_free(src->matrix_complex);
+    matrix_complex_release(src->matrix_complex);
   }
 
   //    src->type = TYPE_NONE; // Mark slot as empty
   s->top--;
 
   // Inline stackl_push_rmatrix:
-  if (s->top + 1 >= STACK_SIZE) {
+  if (!stack_reserve(s, 1)) {
     fprintf(stderr, "Error: stack overflow when pushing result matrix.\n");
-    gsl_matrix_free(result);
+    matrix_release(result);
     return;
   }
   s->top++;
@@ -162,7 +197,7 @@ void complex_matrix_imag_part(Stack *s) {
   size_t rows = matrix->size1;
   size_t cols = matrix->size2;
 
-  gsl_matrix *result = gsl_matrix_alloc(rows, cols);
+  gsl_matrix *result = matrix_alloc(rows, cols);
   if (!result) {
     fprintf(stderr, "Error: failed to allocate result matrix.\n");
     return;
@@ -178,15 +213,15 @@ void complex_matrix_imag_part(Stack *s) {
 
   // Inline stackl_pop:
   if (src->type == TYPE_MATRIX_COMPLEX && src->matrix_complex) {
-    gsl_matrix_complex_free(src->matrix_complex);
+    matrix_complex_release(src->matrix_complex);
   }
   //    src->type = TYPE_NONE; // Mark slot as empty
   s->top--;
 
   // Inline stackl_push_rmatrix:
-  if (s->top + 1 >= STACK_SIZE) {
+  if (!stack_reserve(s, 1)) {
     fprintf(stderr, "Error: stack overflow when pushing result matrix.\n");
-    gsl_matrix_free(result);
+    matrix_release(result);
     return;
   }
   s->top++;
@@ -212,7 +247,7 @@ void complex_matrix_abs_by_element(Stack *s) {
   size_t rows = matrix->size1;
   size_t cols = matrix->size2;
 
-  gsl_matrix *result = gsl_matrix_alloc(rows, cols);
+  gsl_matrix *result = matrix_alloc(rows, cols);
   if (!result) {
     fprintf(stderr, "Error: failed to allocate result matrix.\n");
     return;
@@ -228,15 +263,15 @@ void complex_matrix_abs_by_element(Stack *s) {
 
   // Inline stackl_pop:
   if (src->type == TYPE_MATRIX_COMPLEX && src->matrix_complex) {
-    gsl_matrix_complex_free(src->matrix_complex);
+    matrix_complex_release(src->matrix_complex);
   }
   //    src->type = TYPE_NONE; // Mark slot as empty
   s->top--;
 
   // Inline stackl_push_rmatrix:
-  if (s->top + 1 >= STACK_SIZE) {
+  if (!stack_reserve(s, 1)) {
     fprintf(stderr, "Error: stack overflow when pushing result matrix.\n");
-    gsl_matrix_free(result);
+    matrix_release(result);
     return;
   }
   s->top++;
@@ -271,7 +306,7 @@ void real2complex(Stack *s) {
     size_t rows = real_mat->size1;
     size_t cols = real_mat->size2;
 
-    gsl_matrix_complex *complex_mat = gsl_matrix_complex_alloc(rows, cols);
+    gsl_matrix_complex *complex_mat = matrix_complex_alloc(rows, cols);
     if (!complex_mat) {
       fprintf(stderr, "Error: failed to allocate complex matrix.\n");
       return;
@@ -286,7 +321,7 @@ void real2complex(Stack *s) {
     }
 
     // Free the old real matrix
-    gsl_matrix_free(real_mat);
+    matrix_release(real_mat);
 
     // Update the stack element
     src->type = TYPE_MATRIX_COMPLEX;
@@ -320,7 +355,7 @@ void split_complex(Stack *s) {
     double imag_part = GSL_IMAG(src->complex_val);
 
     // Check space for two pushes
-    if (s->top + 2 >= STACK_SIZE) {
+    if (!stack_reserve(s, 2)) {
       fprintf(stderr, "Error: not enough space on stack to split scalar.\n");
       return;
     }
@@ -353,12 +388,12 @@ void split_complex(Stack *s) {
     size_t rows = matrix->size1;
     size_t cols = matrix->size2;
 
-    gsl_matrix *real_mat = gsl_matrix_alloc(rows, cols);
-    gsl_matrix *imag_mat = gsl_matrix_alloc(rows, cols);
+    gsl_matrix *real_mat = matrix_alloc(rows, cols);
+    gsl_matrix *imag_mat = matrix_alloc(rows, cols);
     if (!real_mat || !imag_mat) {
       fprintf(stderr, "Error: failed to allocate real/imag matrices.\n");
-      gsl_matrix_free(real_mat);
-      gsl_matrix_free(imag_mat);
+      matrix_release(real_mat);
+      matrix_release(imag_mat);
       return;
     }
 
@@ -371,15 +406,15 @@ void split_complex(Stack *s) {
     }
 
     // Check space for two pushes
-    if (s->top + 2 >= STACK_SIZE) {
+    if (!stack_reserve(s, 2)) {
       fprintf(stderr, "Error: not enough space on stack to split matrix.\n");
-      gsl_matrix_free(real_mat);
-      gsl_matrix_free(imag_mat);
+      matrix_release(real_mat);
+      matrix_release(imag_mat);
       return;
     }
 
     // Pop the complex matrix
-    gsl_matrix_complex_free(matrix);
+    matrix_complex_release(matrix);
     s->top--;
 
     // Push real part
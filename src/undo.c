@@ -0,0 +1,299 @@
+/*
+ * This file is part of Mico's toy RPN Calculator
+ *
+ * Mico's toy RPN Calculator is free software:
+ * you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mico's toy RPN Calculator is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mico's toy RPN Calculator. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "opcodes.h"
+#include "opcode_reach.h"   // generated by tools/gen_opcodes.c
+#include "undo.h"
+
+int undo_levels = 16;
+undo_recorder undo_rec = {NULL, 0};
+
+// **************** How far down each operation reaches ****************
+// opcode_reach[] comes from builtin_reaches[] in function_list.c
+_Static_assert(OPCODE_REACH_COUNT == OP_COUNT, "opcode_reach.h is out of date");
+
+// Whole-stack builtins reach everything; callers clamp at the bottom
+#define REACH_ALL (1 << 30)
+
+int builtin_reach(int opcode) {
+  if (opcode < 0 || opcode >= OP_COUNT || opcode_reach[opcode] < 0) return REACH_ALL;
+  return opcode_reach[opcode];
+}
+
+int instr_reach(const bc_instr* ins) {
+  switch (ins->op) {
+  case BC_END:
+  case BC_PUSH_REAL:
+  case BC_PUSH_COMPLEX:
+  case BC_PUSH_STRING:
+  case BC_PUSH_MATRIX:
+  case BC_PUSH_CMATRIX:
+  case BC_MATRIX_FILE:
+  case BC_CALL:           // the callee's code reaches for itself
+  case BC_ECHO:
+  case BC_ILLEGAL:
+    return 0;
+  case BC_BUILTIN:
+    return builtin_reach(ins->opcode);
+  case BC_SQUARE:
+  case BC_ADD_K: case BC_SUB_K: case BC_MUL_K: case BC_DIV_K:
+  case BC_SQUARE_R:
+  case BC_ADD_K_R: case BC_SUB_K_R: case BC_MUL_K_R: case BC_DIV_K_R:
+  case BC_REAL_FN:
+  case BC_DUP_R:
+  case BC_DROP_R:
+    return 1;
+  default:                // binary operators and the other fused forms
+    return 2;
+  }
+}
+
+void undo_touch_instr(Stack* stack, const bc_instr* ins) {
+  undo_touch(stack, instr_reach(ins));
+}
+
+// **************** Saving what a line touches ****************
+static struct {
+  int entry_depth;        // stack depth when the line started
+  stack_element* saved;   // entries [low, entry_depth) as they were, top first
+  int count;
+  int capacity;
+} line;
+
+void undo_save_below(Stack* stack, int low) {
+  if (low < 0) low = 0;
+  int n = undo_rec.low - low;
+  if (n <= 0) return;
+  if (line.count + n > line.capacity) {
+    int capacity = line.capacity ? line.capacity : 16;
+    while (capacity < line.count + n) capacity *= 2;
+    stack_element* saved = realloc(line.saved, (size_t)capacity * sizeof *saved);
+    if (!saved) {
+      // Without room to save them the line cannot be undone; stop recording
+      fprintf(stderr, "Out of memory: this line cannot be undone.\n");
+      for (int i = 0; i < line.count; i++) release_element(&line.saved[i]);
+      line.count = 0;
+      undo_rec.stack = NULL;
+      return;
+    }
+    line.saved = saved;
+    line.capacity = capacity;
+  }
+  for (int i = undo_rec.low - 1; i >= low; i--)
+    line.saved[line.count++] = share_element(&stack->items[i]);
+  undo_rec.low = low;
+}
+
+// **************** The journal ****************
+// One record per line that changed the stack: from index low up, the
+// line replaced `before` entries with `after` entries.
+typedef struct {
+  int low;
+  int before_count;
+  int after_count;
+  stack_element* entries;   // before_count entries, then after_count entries
+} undo_record;
+
+static undo_record* ring;   // undo_levels records, oldest at ring[first]
+static int first;
+static int count;           // records in the ring
+static int done;            // of which this many are applied to the stack
+
+static undo_record* record_at(int i) {
+  return &ring[(first + i) % undo_levels];
+}
+
+static void free_record(undo_record* r) {
+  for (int i = 0; i < r->before_count + r->after_count; i++)
+    release_element(&r->entries[i]);
+  free(r->entries);
+  r->entries = NULL;
+}
+
+// The very same value, not just an equal one
+static bool same_element(const stack_element* a, const stack_element* b) {
+  if (a->type != b->type) return false;
+  switch (a->type) {
+  case TYPE_REAL:           return !memcmp(&a->real, &b->real, sizeof a->real);
+  case TYPE_COMPLEX:        return !memcmp(&a->complex_val, &b->complex_val, sizeof a->complex_val);
+  case TYPE_STRING:
+    if (a->short_string != b->short_string) return false;
+    return a->short_string ? !strcmp(a->text, b->text) : a->string == b->string;
+  case TYPE_MATRIX_REAL:    return a->matrix_real == b->matrix_real;
+  case TYPE_MATRIX_COMPLEX: return a->matrix_complex == b->matrix_complex;
+  }
+  return false;
+}
+
+void undo_begin_line(Stack* stack) {
+  if (undo_levels <= 0) return;
+  undo_rec.stack = stack;
+  undo_rec.low = stack->top + 1;
+  line.entry_depth = stack->top + 1;
+  line.count = 0;
+}
+
+void undo_end_line(Stack* stack) {
+  if (undo_rec.stack != stack) return;
+  undo_rec.stack = NULL;
+
+  // Entries a line only looked at (print, pm, a failed type check) are
+  // still there unchanged; leave them out of the record
+  int low = undo_rec.low;
+  int depth = stack->top + 1;
+  while (low < line.entry_depth && low < depth &&
+         same_element(&line.saved[line.entry_depth - 1 - low], &stack->items[low])) {
+    release_element(&line.saved[--line.count]);
+    low++;
+  }
+  if (low == line.entry_depth && depth == low) {   // nothing changed
+    line.count = 0;
+    return;
+  }
+
+  undo_record r = {low, line.count, depth - low, NULL};
+  r.entries = malloc((size_t)(r.before_count + r.after_count) * sizeof *r.entries + 1);
+  if (!ring) ring = calloc((size_t)undo_levels, sizeof *ring);
+  if (!r.entries || !ring) {
+    fprintf(stderr, "Out of memory: this line cannot be undone.\n");
+    for (int i = 0; i < line.count; i++) release_element(&line.saved[i]);
+    line.count = 0;
+    free(r.entries);
+    return;
+  }
+  for (int i = 0; i < r.before_count; i++)   // saved is top first
+    r.entries[i] = line.saved[r.before_count - 1 - i];
+  line.count = 0;
+  for (int i = 0; i < r.after_count; i++)
+    r.entries[r.before_count + i] = share_element(&stack->items[low + i]);
+
+  // A new line ends the redo history; a full ring forgets its oldest line
+  while (count > done) free_record(record_at(--count));
+  if (count == undo_levels) {
+    free_record(record_at(0));
+    first = (first + 1) % undo_levels;
+    count--;
+  }
+  *record_at(count++) = r;
+  done = count;
+}
+
+// Put n entries back in place of the `current` ones from index low up
+static bool replace_from(Stack* stack, int low, int current, const stack_element* entries, int n) {
+  if (stack->top + 1 != low + current || !stack_reserve(stack, n - current)) {
+    fprintf(stderr, "The stack no longer matches the undo journal.\n");
+    return false;
+  }
+  while (stack->top >= low) release_element(&stack->items[stack->top--]);
+  for (int i = 0; i < n; i++)
+    stack->items[++stack->top] = share_element(&entries[i]);
+  return true;
+}
+
+bool undo_line(Stack* stack) {
+  if (done == 0) return false;
+  undo_record* r = record_at(done - 1);
+  if (replace_from(stack, r->low, r->after_count, r->entries, r->before_count)) done--;
+  return true;
+}
+
+bool redo_line(Stack* stack) {
+  if (done == count) return false;
+  undo_record* r = record_at(done);
+  if (replace_from(stack, r->low, r->before_count,
+                   r->entries + r->before_count, r->after_count)) done++;
+  return true;
+}
+
+void undo_for_each_entry(void (*visit)(const stack_element* e, void* ctx), void* ctx) {
+  for (int i = 0; i < count; i++) {
+    const undo_record* r = record_at(i);
+    for (int k = 0; k < r->before_count + r->after_count; k++) visit(&r->entries[k], ctx);
+  }
+  for (int i = 0; i < line.count; i++) visit(&line.saved[i], ctx);
+}
+
+// **************** Histories of parked stacks ****************
+// Every named stack keeps its own records. The current one lives in the
+// statics above; a parked one is moved out into an undo_history.
+struct undo_history {
+  undo_record* ring;
+  int first;
+  int count;
+  int done;
+};
+
+static void free_records(void) {
+  while (count > 0) free_record(record_at(--count));
+  done = 0;
+  first = 0;
+  free(ring);
+  ring = NULL;
+}
+
+undo_history* undo_detach_history(void) {
+  if (!ring) return NULL;
+  undo_history* h = malloc(sizeof *h);
+  if (!h) {
+    fprintf(stderr, "Out of memory: the undo history of this stack is lost.\n");
+    free_records();
+    return NULL;
+  }
+  *h = (undo_history){ring, first, count, done};
+  ring = NULL;
+  first = count = done = 0;
+  return h;
+}
+
+void undo_attach_history(undo_history* h) {
+  free_records();
+  if (!h) return;
+  ring = h->ring;
+  first = h->first;
+  count = h->count;
+  done = h->done;
+  free(h);
+}
+
+void undo_free_history(undo_history* h) {
+  if (!h) return;
+  undo_history* current = undo_detach_history();
+  undo_attach_history(h);
+  free_records();
+  undo_attach_history(current);
+}
+
+void undo_history_for_each_entry(const undo_history* h,
+                                 void (*visit)(const stack_element* e, void* ctx), void* ctx) {
+  if (!h) return;
+  for (int i = 0; i < h->count; i++) {
+    const undo_record* r = &h->ring[(h->first + i) % undo_levels];
+    for (int k = 0; k < r->before_count + r->after_count; k++) visit(&r->entries[k], ctx);
+  }
+}
+
+void free_undo_journal(void) {
+  free_records();
+  for (int i = 0; i < line.count; i++) release_element(&line.saved[i]);
+  free(line.saved);
+  line.saved = NULL;
+  line.count = line.capacity = 0;
+}
@@ -0,0 +1,501 @@
+/*
+ * This file is part of Mico's toy RPN Calculator
+ *
+ * Mico's toy RPN Calculator is free software:
+ * you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mico's toy RPN Calculator is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mico's toy RPN Calculator. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+#include <math.h>
+#include <gsl/gsl_complex_math.h>
+#include "elementwise.h"
+#include "math_helpers.h"
+#include "vec_math.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HAVE_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
+typedef void (*vm_kernel)(vm_fn fn, double* d, const double* x, size_t n);
+
+// Adding 1.5 * 2^52 rounds to an integer, which the low mantissa bits
+// then hold
+static const double shifter = 0x1.8p52;
+static const long long shifter_bits = 0x4338000000000000LL;
+static const long long mantissa = 0x000fffffffffffffLL;
+static const unsigned long long sign_bit = 0x8000000000000000ULL;
+
+// exp: fdlibm e_exp.c, x = k ln2 + r and a rational form in r^2
+static const double ln2_hi = 6.93147180369123816490e-01;
+static const double ln2_lo = 1.90821492927058770002e-10;
+static const double inv_ln2 = 1.44269504088896338700e+00;
+static const double exp_max = 7.09782712893383973096e+02;
+static const double exp_min = -7.45133219101941108420e+02;
+static const double exp_p1 = 1.66666666666666019037e-01;
+static const double exp_p2 = -2.77777777770155933842e-03;
+static const double exp_p3 = 6.61375632143793436117e-05;
+static const double exp_p4 = -1.65339022054652515390e-06;
+static const double exp_p5 = 4.13813679705723846039e-08;
+
+// log: fdlibm e_log.c, log(1 + f) through s = f / (2 + f)
+static const double lg1 = 6.666666666666735130e-01;
+static const double lg2 = 3.999999999940941908e-01;
+static const double lg3 = 2.857142874366239149e-01;
+static const double lg4 = 2.222219843214978396e-01;
+static const double lg5 = 1.818357216161805012e-01;
+static const double lg6 = 1.531383769920937332e-01;
+static const double lg7 = 1.479819860511658591e-01;
+
+// log10: fdlibm e_log10.c
+static const double inv_ln10 = 4.34294481903251816668e-01;
+static const double log10_2hi = 3.01029995663611771306e-01;
+static const double log10_2lo = 3.69423907715893078616e-13;
+
+// tanh below 1/8: the Taylor series to x^15; the next term is under 2^-58 x
+static const double tanh_t3 = -1.0 / 3.0;
+static const double tanh_t5 = 2.0 / 15.0;
+static const double tanh_t7 = -17.0 / 315.0;
+static const double tanh_t9 = 62.0 / 2835.0;
+static const double tanh_t11 = -1382.0 / 155925.0;
+static const double tanh_t13 = 21844.0 / 6081075.0;
+static const double tanh_t15 = -929569.0 / 638512875.0;
+#define TANH_SERIES tanh_t3 + z * (tanh_t5 + z * (tanh_t7 + z * (tanh_t9 + z * (tanh_t11 + z * (tanh_t13 + z * tanh_t15)))))
+
+// sin and cos: the medium case of FreeBSD e_rem_pio2.c, then k_sin.c and
+// k_cos.c; beyond trig_max the reduction needs more bits of pi
+static const double trig_max = 0x1.921fb54442d18p20;
+static const double inv_pio2 = 6.36619772367581382433e-01;
+static const double pio2_1 = 1.57079632673412561417e+00;
+static const double pio2_1t = 6.07710050650619224932e-11;
+static const double pio2_2 = 6.07710050630396597660e-11;
+static const double pio2_2t = 2.02226624879595063154e-21;
+static const double pio2_3 = 2.02226624871116645580e-21;
+static const double pio2_3t = 8.47842766036889956997e-32;
+static const double sin_s1 = -1.66666666666666324348e-01;
+static const double sin_s2 = 8.33333333332248946124e-03;
+static const double sin_s3 = -1.98412698298579493134e-04;
+static const double sin_s4 = 2.75573137070700676789e-06;
+static const double sin_s5 = -2.50507602534068634195e-08;
+static const double sin_s6 = 1.58969099521155010221e-10;
+static const double cos_c1 = 4.16666666666666019037e-02;
+static const double cos_c2 = -1.38888888888741095749e-03;
+static const double cos_c3 = 2.48015872894767294178e-05;
+static const double cos_c4 = -2.75573143513906633035e-07;
+static const double cos_c5 = 2.08757232129817482790e-09;
+static const double cos_c6 = -1.13596475577881948265e-11;
+
+// One set of kernels per level on GCC vectors of w doubles, so every
+// level runs the same operations in the same order. Masks are the
+// all-ones lanes a vector compare gives; sel picks a where m is set.
+// vsqrt is the level's square root, and leave runs on the way out as in
+// elementwise.c.
+#define VM_KERNELS(level, attr, w, vsqrt, leave)                              \
+  typedef double level##_vd __attribute__((vector_size(8 * w)));              \
+  typedef long long level##_vi __attribute__((vector_size(8 * w)));           \
+  typedef unsigned long long level##_vu __attribute__((vector_size(8 * w)));  \
+                                                                              \
+  attr static inline level##_vd level##_sel(level##_vi m, level##_vd a, level##_vd b) { \
+    return (level##_vd)(((level##_vi)a & m) | ((level##_vi)b & ~m));          \
+  }                                                                           \
+  attr static inline level##_vd level##_set1(double c) {                      \
+    level##_vd v = {0};                                                       \
+    return v + c;                                                             \
+  }                                                                           \
+  attr static inline bool level##_any(level##_vi m) {                         \
+    long long r = 0;                                                          \
+    for (int j = 0; j < w; j++) r |= m[j];                                    \
+    return r != 0;                                                            \
+  }                                                                           \
+  attr static inline level##_vi level##_expo(level##_vd x) {                  \
+    return ((level##_vi)x >> 52) & 0x7ff;                                     \
+  }                                                                           \
+  /* k as a double, for |k| < 2^51 */                                         \
+  attr static inline level##_vd level##_from_int(level##_vi k) {              \
+    return (level##_vd)(k + shifter_bits) - shifter;                          \
+  }                                                                           \
+  /* 2^k, for -1022 <= k <= 1023 */                                           \
+  attr static inline level##_vd level##_pow2(level##_vi k) {                  \
+    return (level##_vd)((k + 1023) << 52);                                    \
+  }                                                                           \
+                                                                              \
+  /* x = k ln2 + hi - lo, |hi - lo| <= ln2 / 2 */                             \
+  attr static inline level##_vi level##_exp_reduce(level##_vd x, level##_vd* hi, level##_vd* lo) { \
+    level##_vd t = x * inv_ln2 + shifter;                                     \
+    level##_vd k = t - shifter;                                               \
+    *hi = x - k * ln2_hi;                                                     \
+    *lo = k * ln2_lo;                                                         \
+    return (level##_vi)t - shifter_bits;                                      \
+  }                                                                           \
+  /* exp(r) = 1 + r + tail(r) */                                              \
+  attr static inline level##_vd level##_exp_tail(level##_vd r) {              \
+    level##_vd z = r * r;                                                     \
+    level##_vd c = r - z * (exp_p1 + z * (exp_p2 + z * (exp_p3 + z * (exp_p4 + z * exp_p5)))); \
+    return (r * c) / (2.0 - c);                                               \
+  }                                                                           \
+  attr static inline level##_vd level##_exp(level##_vd x) {                   \
+    level##_vd xc = level##_sel(x > 710.0, level##_set1(710.0), x);           \
+    xc = level##_sel(xc < -746.0, level##_set1(-746.0), xc);                  \
+    level##_vd hi, lo;                                                        \
+    level##_vi k = level##_exp_reduce(xc, &hi, &lo);                          \
+    level##_vd y = 1.0 - ((lo - level##_exp_tail(hi - lo)) - hi);             \
+    /* In two steps, so subnormal results are rounded once */                 \
+    level##_vi k1 = k >> 1;                                                   \
+    y = y * level##_pow2(k1) * level##_pow2(k - k1);                          \
+    y = level##_sel(x > exp_max, level##_set1(HUGE_VAL), y);                  \
+    return level##_sel(x < exp_min, level##_set1(0.0), y);                    \
+  }                                                                           \
+  /* e^y - 1 for 0 <= y <= 709 */                                             \
+  attr static inline level##_vd level##_expm1(level##_vd y) {                 \
+    level##_vd hi, lo;                                                        \
+    level##_vi k = level##_exp_reduce(y, &hi, &lo);                           \
+    level##_vd em = hi - (lo - level##_exp_tail(hi - lo));                    \
+    level##_vd two = level##_pow2(k);                                         \
+    return two * em + (two - 1.0);                                            \
+  }                                                                           \
+                                                                              \
+  /* x = 2^k (1 + f), sqrt(2)/2 <= 1 + f < sqrt(2) */                         \
+  attr static inline level##_vd level##_log(level##_vd x) {                   \
+    level##_vi sub = x < 0x1p-1022;                                           \
+    level##_vi ix = (level##_vi)level##_sel(sub, x * 0x1p54, x);              \
+    level##_vi hx = ix & mantissa;                                            \
+    level##_vi i = (hx + 0x95f6400000000LL) & 0x10000000000000LL;             \
+    level##_vi k = (ix >> 52) - 1023 + (i >> 52) + (sub & -54);               \
+    level##_vd f = (level##_vd)(hx | (i ^ 0x3ff0000000000000LL)) - 1.0;       \
+    level##_vd dk = level##_from_int(k);                                      \
+    level##_vd s = f / (2.0 + f);                                             \
+    level##_vd z = s * s, zz = z * z;                                         \
+    level##_vd t1 = zz * (lg2 + zz * (lg4 + zz * lg6));                       \
+    level##_vd t2 = z * (lg1 + zz * (lg3 + zz * (lg5 + zz * lg7)));           \
+    level##_vd r = t2 + t1;                                                   \
+    level##_vd hfsq = 0.5 * f * f;                                            \
+    level##_vi hw = hx >> 32;                                                 \
+    level##_vd y = level##_sel(((hw - 0x6147a) | (0x6b851 - hw)) > 0,         \
+                               dk * ln2_hi - ((hfsq - (s * (hfsq + r) + dk * ln2_lo)) - f), \
+                               dk * ln2_hi - ((s * (f - r) - dk * ln2_lo) - f)); \
+    y = level##_sel(x == 0.0, level##_set1(-HUGE_VAL), y);                    \
+    y = level##_sel(x < 0.0, level##_set1(NAN), y);                           \
+    return level##_sel(x < HUGE_VAL, y, x);                                   \
+  }                                                                           \
+  /* x = 2^k m with m in [1, 2), or [1/2, 1) when k < 0 */                    \
+  attr static inline level##_vd level##_log10(level##_vd x) {                 \
+    level##_vi sub = x < 0x1p-1022;                                           \
+    level##_vi ix = (level##_vi)level##_sel(sub, x * 0x1p54, x);              \
+    level##_vi k = (ix >> 52) - 1023 + (sub & -54);                           \
+    level##_vi i = (k >> 63) & 1;                                             \
+    level##_vd m = (level##_vd)((ix & mantissa) | ((0x3ff - i) << 52));       \
+    level##_vd y = level##_from_int(k + i);                                   \
+    level##_vd r = (y * log10_2lo + inv_ln10 * level##_log(m)) + y * log10_2hi; \
+    r = level##_sel(x == 0.0, level##_set1(-HUGE_VAL), r);                    \
+    r = level##_sel(x < 0.0, level##_set1(NAN), r);                           \
+    return level##_sel(x < HUGE_VAL, r, x);                                   \
+  }                                                                           \
+                                                                              \
+  /* x = n pi/2 + y0 + y1, taking 33 bits of pi/2 at a time for as long       \
+     as e_rem_pio2.c would; then the sin and cos kernels on [-pi/4, pi/4]     \
+     and the quadrant n */                                                    \
+  attr static void level##_sincos(level##_vd x, level##_vd* sp, level##_vd* cp) { \
+    level##_vd t = x * inv_pio2 + shifter;                                    \
+    level##_vd fn = t - shifter;                                              \
+    level##_vu n = (level##_vu)t;                                             \
+    level##_vd r = x - fn * pio2_1, v = fn * pio2_1t;                         \
+    level##_vi j = level##_expo(x);                                           \
+    /* A second piece when the first cancels more than 16 bits */             \
+    level##_vd r2 = r - fn * pio2_2;                                          \
+    level##_vd v2 = fn * pio2_2t - ((r - r2) - fn * pio2_2);                  \
+    level##_vi more = j - level##_expo(r - v) > 16;                           \
+    /* and a third when the second cancels more than 49 */                    \
+    level##_vd r3 = r2 - fn * pio2_3;                                         \
+    level##_vd v3 = fn * pio2_3t - ((r2 - r3) - fn * pio2_3);                 \
+    level##_vi most = more & (j - level##_expo(r2 - v2) > 49);                \
+    r = level##_sel(most, r3, level##_sel(more, r2, r));                      \
+    v = level##_sel(most, v3, level##_sel(more, v2, v));                      \
+    level##_vd y0 = r - v, y1 = (r - y0) - v;                                 \
+                                                                              \
+    level##_vd z = y0 * y0, zz = z * z, zy = z * y0;                          \
+    level##_vd rs = sin_s2 + z * (sin_s3 + z * sin_s4) + z * zz * (sin_s5 + z * sin_s6); \
+    level##_vd s = y0 - ((z * (0.5 * y1 - zy * rs) - y1) - zy * sin_s1);      \
+    level##_vd rc = z * (cos_c1 + z * (cos_c2 + z * cos_c3)) + zz * zz * (cos_c4 + z * (cos_c5 + z * cos_c6)); \
+    level##_vd hz = 0.5 * z, q = 1.0 - hz;                                    \
+    level##_vd c = q + (((1.0 - q) - hz) + (z * rc - y0 * y1));               \
+                                                                              \
+    level##_vi odd = -(level##_vi)(n & 1);                                    \
+    *sp = (level##_vd)((level##_vu)level##_sel(odd, c, s) ^ ((n & 2) << 62)); \
+    *cp = (level##_vd)((level##_vu)level##_sel(odd, s, c) ^ (((n + 1) & 2) << 62)); \
+                                                                              \
+    level##_vi big = (level##_vd)((level##_vu)x & ~sign_bit) > trig_max;      \
+    if (level##_any(big))                                                     \
+      for (int j = 0; j < w; j++)                                             \
+        if (big[j]) {                                                         \
+          (*sp)[j] = sin(x[j]);                                               \
+          (*cp)[j] = cos(x[j]);                                               \
+        }                                                                     \
+  }                                                                           \
+                                                                              \
+  attr static inline level##_vd level##_tanh(level##_vd x) {                  \
+    level##_vu sign = (level##_vu)x & sign_bit;                               \
+    level##_vd ax = (level##_vd)((level##_vu)x ^ sign);                       \
+    level##_vd e = level##_expm1(2.0 * level##_sel(ax > 20.0, level##_set1(20.0), ax)); \
+    level##_vd z = ax * ax;                                                   \
+    level##_vd p = ax + ax * (z * (TANH_SERIES));                             \
+    level##_vd t = level##_sel(ax < 0.125, p, e / (e + 2.0));                 \
+    return (level##_vd)((level##_vu)t | sign);                                \
+  }                                                                           \
+                                                                              \
+  /* sinh and cosh as gsl_complex_sin and _cos need them */                   \
+  attr static void level##_sinhcosh(level##_vd b, level##_vd* shp, level##_vd* chp) { \
+    level##_vu sign = (level##_vu)b & sign_bit;                               \
+    level##_vd ab = (level##_vd)((level##_vu)b ^ sign);                       \
+    level##_vi huge = ab > 709.0;                                             \
+    level##_vd e = level##_expm1(level##_sel(huge, level##_set1(709.0), ab)); \
+    level##_vd sh = 0.5 * (e + e / (e + 1.0));                                \
+    level##_vd ch = 0.5 * ((e + 1.0) + 1.0 / (e + 1.0));                      \
+    if (level##_any(huge)) {                                                  \
+      /* e^|b| overflows before half of it does */                            \
+      level##_vd h = level##_exp(0.5 * ab);                                   \
+      h = (0.5 * h) * h;                                                      \
+      sh = level##_sel(huge, h, sh);                                          \
+      ch = level##_sel(huge, h, ch);                                          \
+    }                                                                         \
+    *shp = (level##_vd)((level##_vu)sh | sign);                               \
+    *chp = ch;                                                                \
+  }                                                                           \
+                                                                              \
+  /* gsl_complex_sqrt, operation for operation */                             \
+  attr static void level##_csqrt(level##_vd x, level##_vd y, level##_vd* zr, level##_vd* zi) { \
+    level##_vd ax = (level##_vd)((level##_vu)x & ~sign_bit);                  \
+    level##_vd ay = (level##_vd)((level##_vu)y & ~sign_bit);                  \
+    level##_vi ge = ax >= ay;                                                 \
+    level##_vd t = level##_sel(ge, ay, ax) / level##_sel(ge, ax, ay);         \
+    level##_vd u = vsqrt(1.0 + t * t);                                        \
+    level##_vd s = level##_sel(ge, level##_set1(1.0), t);                     \
+    level##_vd wv = vsqrt(level##_sel(ge, ax, ay)) * vsqrt(0.5 * (s + u));    \
+    level##_vd vim = level##_sel(y >= 0.0, wv, -wv);                          \
+    level##_vi pos = x >= 0.0;                                                \
+    level##_vi zero = (x == 0.0) & (y == 0.0);                                \
+    *zr = level##_sel(zero, level##_set1(0.0), level##_sel(pos, wv, y / (2.0 * vim))); \
+    *zi = level##_sel(zero, level##_set1(0.0), level##_sel(pos, y / (2.0 * wv), vim)); \
+  }                                                                           \
+                                                                              \
+  attr static level##_vd level##_one(vm_fn fn, level##_vd v) {                \
+    level##_vd s, c;                                                          \
+    switch (fn) {                                                             \
+    case VM_SIN:   level##_sincos(v, &s, &c); return s;                       \
+    case VM_COS:   level##_sincos(v, &s, &c); return c;                       \
+    case VM_TAN:   level##_sincos(v, &s, &c); return s / c;                   \
+    case VM_EXP:   return level##_exp(v);                                     \
+    case VM_LOG:   return level##_log(v);                                     \
+    case VM_LOG10: return level##_log10(v);                                   \
+    case VM_SQRT:  return vsqrt(v);                                           \
+    default:       return level##_tanh(v);                                    \
+    }                                                                         \
+  }                                                                           \
+                                                                              \
+  attr static void level##_complex_one(vm_fn fn, level##_vd a, level##_vd b,  \
+                                       level##_vd* zr, level##_vd* zi) {      \
+    level##_vd s, c, sh, ch;                                                  \
+    level##_vi real = b == 0.0;                                               \
+    switch (fn) {                                                             \
+    case VM_EXP:                                                              \
+      level##_sincos(b, &s, &c);                                              \
+      ch = level##_exp(a);                                                    \
+      *zr = ch * c;                                                           \
+      *zi = ch * s;                                                           \
+      return;                                                                 \
+    case VM_SIN:                                                              \
+      level##_sincos(a, &s, &c);                                              \
+      level##_sinhcosh(b, &sh, &ch);                                          \
+      *zr = level##_sel(real, s, s * ch);                                     \
+      *zi = level##_sel(real, level##_set1(0.0), c * sh);                     \
+      return;                                                                 \
+    case VM_COS:                                                              \
+      level##_sincos(a, &s, &c);                                              \
+      level##_sinhcosh(b, &sh, &ch);                                          \
+      *zr = level##_sel(real, c, c * ch);                                     \
+      *zi = level##_sel(real, level##_set1(0.0), s * -sh);                    \
+      return;                                                                 \
+    default:                                                                  \
+      level##_csqrt(a, b, zr, zi);                                            \
+    }                                                                         \
+  }                                                                           \
+                                                                              \
+  /* Full vectors, then the tail padded out to one more */                    \
+  attr static void level##_real(vm_fn fn, double* d, const double* x, size_t n) { \
+    level##_vd v;                                                             \
+    size_t i = 0;                                                             \
+    for (; i + w <= n; i += w) {                                              \
+      memcpy(&v, x + i, sizeof v);                                            \
+      v = level##_one(fn, v);                                                 \
+      memcpy(d + i, &v, sizeof v);                                            \
+    }                                                                         \
+    if (i < n) {                                                              \
+      v = level##_set1(1.0);                                                  \
+      memcpy(&v, x + i, (n - i) * sizeof(double));                            \
+      v = level##_one(fn, v);                                                 \
+      memcpy(d + i, &v, (n - i) * sizeof(double));                            \
+    }                                                                         \
+    leave;                                                                    \
+  }                                                                           \
+                                                                              \
+  /* n counts complex elements */                                             \
+  attr static void level##_complex(vm_fn fn, double* d, const double* x, size_t n) { \
+    for (size_t i = 0; i < n; i += w) {                                       \
+      size_t m = n - i < w ? n - i : w;                                       \
+      level##_vd a = level##_set1(1.0), b = level##_set1(0.0);                \
+      for (size_t j = 0; j < m; j++) {                                        \
+        a[j] = x[2 * (i + j)];                                                \
+        b[j] = x[2 * (i + j) + 1];                                            \
+      }                                                                       \
+      level##_complex_one(fn, a, b, &a, &b);                                  \
+      for (size_t j = 0; j < m; j++) {                                        \
+        d[2 * (i + j)] = a[j];                                                \
+        d[2 * (i + j) + 1] = b[j];                                            \
+      }                                                                       \
+    }                                                                         \
+    leave;                                                                    \
+  }
+
+#define SCALAR_SQRT(v) ((scalar_vd){ sqrt((v)[0]) })
+
+VM_KERNELS(scalar, , 1, SCALAR_SQRT, (void)0)
+
+#ifdef HAVE_X86_SIMD
+VM_KERNELS(sse2, __attribute__((target("sse2"))), 2, _mm_sqrt_pd, (void)0)
+VM_KERNELS(avx2, __attribute__((target("avx2"))), 4, _mm256_sqrt_pd, _mm256_zeroupper())
+VM_KERNELS(avx512, __attribute__((target("avx512f"))), 8, _mm512_sqrt_pd, _mm256_zeroupper())
+#endif
+
+static const vm_kernel real_kernels[SIMD_LEVELS] = {
+  [SIMD_SCALAR] = scalar_real,
+#ifdef HAVE_X86_SIMD
+  [SIMD_SSE2]   = sse2_real,
+  [SIMD_AVX2]   = avx2_real,
+  [SIMD_AVX512] = avx512_real,
+#endif
+};
+
+static const vm_kernel complex_kernels[SIMD_LEVELS] = {
+  [SIMD_SCALAR] = scalar_complex,
+#ifdef HAVE_X86_SIMD
+  [SIMD_SSE2]   = sse2_complex,
+  [SIMD_AVX2]   = avx2_complex,
+  [SIMD_AVX512] = avx512_complex,
+#endif
+};
+
+// The lowest level at which each real kernel beats libm (see
+// bin/bench_vec_math); below it libm runs per element. Without AVX2
+// only tanh gains, and sqrt once SSE2 does two at a time.
+static const simd_level vector_from[VM_FN_COUNT] = {
+  [VM_SIN] = SIMD_AVX2, [VM_COS] = SIMD_AVX2, [VM_TAN] = SIMD_AVX2,
+  [VM_EXP] = SIMD_AVX2, [VM_LOG] = SIMD_AVX2, [VM_LOG10] = SIMD_AVX2,
+  [VM_SQRT] = SIMD_SSE2, [VM_TANH] = SIMD_SCALAR,
+};
+
+static double (*const libm_fn[VM_FN_COUNT])(double) = {
+  [VM_SIN] = sin, [VM_COS] = cos, [VM_TAN] = tan, [VM_EXP] = exp,
+  [VM_LOG] = log, [VM_LOG10] = log10, [VM_SQRT] = sqrt, [VM_TANH] = tanh,
+};
+
+static void libm_real(vm_fn fn, double* d, const double* x, size_t n) {
+  double (*f)(double) = libm_fn[fn];
+  for (size_t i = 0; i < n; i++) d[i] = f(x[i]);
+}
+
+static vm_kernel real_kernel(vm_fn fn) {
+  simd_level level = simd_current_level();
+  return level >= vector_from[fn] ? real_kernels[level] : libm_real;
+}
+
+// Complex functions without a vector form
+static gsl_complex (*const complex_fallback[VM_FN_COUNT])(gsl_complex) = {
+  [VM_TAN] = gsl_complex_tan,
+  [VM_LOG] = gsl_complex_log,
+  [VM_LOG10] = log10_complex_not_gsl,
+  [VM_TANH] = gsl_complex_tanh,
+};
+
+void vm_real(vm_fn fn, double* d, const double* x, size_t n) {
+  real_kernel(fn)(fn, d, x, n);
+}
+
+// Rows one call each, or the whole block as one row
+void vm_matrix(vm_fn fn, gsl_matrix* dst, const gsl_matrix* x) {
+  vm_kernel k = real_kernel(fn);
+  size_t rows = dst->size1, cols = dst->size2;
+  if (dst->tda == cols && x->tda == cols) {
+    cols *= rows;
+    rows = 1;
+  }
+  for (size_t i = 0; i < rows; i++)
+    k(fn, dst->data + i * dst->tda, x->data + i * x->tda, cols);
+}
+
+static void fallback_row(gsl_complex (*f)(gsl_complex), double* d, const double* x, size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    gsl_complex z = f(gsl_complex_rect(x[2 * i], x[2 * i + 1]));
+    d[2 * i] = GSL_REAL(z);
+    d[2 * i + 1] = GSL_IMAG(z);
+  }
+}
+
+void vm_complex_matrix(vm_fn fn, gsl_matrix_complex* dst, const gsl_matrix_complex* x) {
+  vm_kernel k = complex_kernels[simd_current_level()];
+  gsl_complex (*f)(gsl_complex) = complex_fallback[fn];
+  size_t rows = dst->size1, cols = dst->size2;
+  if (dst->tda == cols && x->tda == cols) {
+    cols *= rows;
+    rows = 1;
+  }
+  for (size_t i = 0; i < rows; i++) {
+    double* d = dst->data + 2 * i * dst->tda;
+    const double* s = x->data + 2 * i * x->tda;
+    if (f) fallback_row(f, d, s, cols);
+    else k(fn, d, s, cols);
+  }
+}
+
+#define PROMOTE_CHUNK 256
+
+// sqrt goes through the complex kernel on (x, 0). The logs take the log
+// of |x|; the argument is pi for negative x, 0 otherwise (NaN stays NaN).
+void vm_promoted_matrix(vm_fn fn, gsl_matrix_complex* dst, const gsl_matrix* x) {
+  double im = fn == VM_LOG10 ? M_PI * inv_ln10 : M_PI;
+  double buf[PROMOTE_CHUNK];
+  for (size_t i = 0; i < dst->size1; i++) {
+    double* d = dst->data + 2 * i * dst->tda;
+    const double* s = x->data + i * x->tda;
+    size_t n = dst->size2;
+    if (fn == VM_SQRT) {
+      for (size_t j = 0; j < n; j++) {
+        d[2 * j] = s[j];
+        d[2 * j + 1] = 0.0;
+      }
+      complex_kernels[simd_current_level()](fn, d, d, n);
+      continue;
+    }
+    for (size_t j0 = 0; j0 < n; j0 += PROMOTE_CHUNK) {
+      size_t m = n - j0 < PROMOTE_CHUNK ? n - j0 : PROMOTE_CHUNK;
+      for (size_t j = 0; j < m; j++) buf[j] = fabs(s[j0 + j]);
+      vm_real(fn, buf, buf, m);
+      for (size_t j = 0; j < m; j++) {
+        double v = s[j0 + j];
+        d[2 * (j0 + j)] = buf[j];
+        d[2 * (j0 + j) + 1] = v < 0.0 ? im : isnan(v) ? v : 0.0;
+      }
+    }
+  }
+}
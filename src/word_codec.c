@@ -0,0 +1,216 @@
+/*
+ * This file is part of Mico's toy RPN Calculator
+ *
+ * Mico's toy RPN Calculator is free software:
+ * you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mico's toy RPN Calculator is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mico's toy RPN Calculator. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "word_codec.h"
+
+#define PALETTE_MAX 16
+#define MIN_RUN 3            // shorter repeats stay in the literal stretch
+
+enum { FORM_PALETTE = 'P', FORM_RUNS = 'R' };
+
+static uint64_t word_at(const double* data, size_t i) {
+  uint64_t w;
+  memcpy(&w, &data[i], sizeof w);
+  return w;
+}
+
+static size_t varint_len(size_t v) {
+  size_t k = 1;
+  for (; v >= 0x80; v >>= 7) k++;
+  return k;
+}
+
+static unsigned char* put_varint(unsigned char* p, size_t v) {
+  for (; v >= 0x80; v >>= 7) *p++ = (unsigned char)(v | 0x80);
+  *p++ = (unsigned char)v;
+  return p;
+}
+
+static bool get_varint(const unsigned char** p, const unsigned char* end, size_t* v) {
+  *v = 0;
+  for (int shift = 0; *p < end && shift < 64; shift += 7) {
+    unsigned char b = *(*p)++;
+    *v |= (size_t)(b & 0x7f) << shift;
+    if (!(b & 0x80)) return true;
+  }
+  return false;
+}
+
+// **************** Palette ****************
+// Distinct words in order of appearance; PALETTE_MAX + 1 if there are more
+static int collect_palette(const double* data, size_t count, uint64_t* palette) {
+  int n = 0;
+  uint64_t last = 0;
+  for (size_t i = 0; i < count; i++) {
+    uint64_t w = word_at(data, i);
+    if (n && w == last) continue;
+    last = w;
+    int k = 0;
+    while (k < n && palette[k] != w) k++;
+    if (k < n) continue;
+    if (n == PALETTE_MAX) return PALETTE_MAX + 1;
+    palette[n++] = w;
+  }
+  return n;
+}
+
+static int index_bits(int n) {
+  return n <= 2 ? 1 : n <= 4 ? 2 : 4;
+}
+
+// Form, palette length, the palette, then the indices, low bits first
+static size_t palette_size(int n, size_t count) {
+  return 2 + (size_t)n * sizeof(uint64_t) + (count * (size_t)index_bits(n) + 7) / 8;
+}
+
+static void encode_palette(const double* data, size_t count,
+                           const uint64_t* palette, int n, unsigned char* out) {
+  int bits = index_bits(n);
+  int per_byte = 8 / bits;
+  out[0] = FORM_PALETTE;
+  out[1] = (unsigned char)n;
+  memcpy(out + 2, palette, (size_t)n * sizeof *palette);
+  unsigned char* idx = out + 2 + (size_t)n * sizeof *palette;
+  memset(idx, 0, (count * (size_t)bits + 7) / 8);
+
+  int k = 0;
+  for (size_t i = 0; i < count; i++) {
+    uint64_t w = word_at(data, i);
+    if (palette[k] != w) {
+      k = 0;
+      while (palette[k] != w) k++;
+    }
+    idx[i / (size_t)per_byte] |= (unsigned char)(k << (i % (size_t)per_byte * (size_t)bits));
+  }
+}
+
+static bool decode_palette(const unsigned char* in, size_t size, double* data, size_t count) {
+  if (size < 2) return false;
+  int n = in[1];
+  if (n < 1 || n > PALETTE_MAX || size != palette_size(n, count)) return false;
+  uint64_t palette[PALETTE_MAX];
+  memcpy(palette, in + 2, (size_t)n * sizeof *palette);
+  const unsigned char* idx = in + 2 + (size_t)n * sizeof *palette;
+  int bits = index_bits(n);
+  int per_byte = 8 / bits;
+  unsigned mask = (1u << bits) - 1;
+
+  for (size_t i = 0; i < count; i++) {
+    unsigned k = (idx[i / (size_t)per_byte] >> (i % (size_t)per_byte * (size_t)bits)) & mask;
+    if ((int)k >= n) return false;
+    memcpy(&data[i], &palette[k], sizeof(double));
+  }
+  return true;
+}
+
+// **************** Runs ****************
+// Tokens of varint (length << 1 | is_run), then one word for a run or
+// length words for a literal stretch. With out NULL only measures.
+static size_t run_at(const double* data, size_t count, size_t i) {
+  uint64_t w = word_at(data, i);
+  size_t j = i + 1;
+  while (j < count && word_at(data, j) == w) j++;
+  return j - i;
+}
+
+static size_t encode_runs(const double* data, size_t count, unsigned char* out) {
+  size_t size = 1;
+  unsigned char* p = out;
+  if (p) *p++ = FORM_RUNS;
+
+  for (size_t i = 0; i < count;) {
+    size_t start = i;
+    size_t run = 0;
+    while (i < count && (run = run_at(data, count, i)) < MIN_RUN) i += run;
+    if (i > start) {
+      size_t len = i - start;
+      size += varint_len(len << 1) + len * sizeof(double);
+      if (p) {
+        p = put_varint(p, len << 1);
+        memcpy(p, &data[start], len * sizeof(double));
+        p += len * sizeof(double);
+      }
+    }
+    if (i < count) {
+      size += varint_len(run << 1 | 1) + sizeof(double);
+      if (p) {
+        p = put_varint(p, run << 1 | 1);
+        memcpy(p, &data[i], sizeof(double));
+        p += sizeof(double);
+      }
+      i += run;
+    }
+  }
+  return size;
+}
+
+static bool decode_runs(const unsigned char* in, size_t size, double* data, size_t count) {
+  const unsigned char* p = in + 1;
+  const unsigned char* end = in + size;
+  size_t i = 0;
+  while (i < count) {
+    size_t token;
+    if (!get_varint(&p, end, &token)) return false;
+    size_t len = token >> 1;
+    if (len == 0 || len > count - i) return false;
+    if (token & 1) {
+      if ((size_t)(end - p) < sizeof(double)) return false;
+      double v;
+      memcpy(&v, p, sizeof v);
+      p += sizeof v;
+      for (size_t k = 0; k < len; k++) data[i + k] = v;
+    } else {
+      if ((size_t)(end - p) / sizeof(double) < len) return false;
+      memcpy(&data[i], p, len * sizeof(double));
+      p += len * sizeof(double);
+    }
+    i += len;
+  }
+  return p == end;
+}
+
+// **************** Entry points ****************
+unsigned char* word_pack(const double* data, size_t count, size_t* size) {
+  if (count == 0) return NULL;
+  size_t raw = count * sizeof(double);
+  uint64_t palette[PALETTE_MAX];
+  int n = collect_palette(data, count, palette);
+  size_t by_palette = n <= PALETTE_MAX ? palette_size(n, count) : SIZE_MAX;
+  size_t by_runs = encode_runs(data, count, NULL);
+  size_t best = by_palette < by_runs ? by_palette : by_runs;
+  if (best > raw - raw / 4) return NULL;
+
+  unsigned char* out = malloc(best);
+  if (!out) return NULL;
+  if (by_palette <= by_runs) encode_palette(data, count, palette, n, out);
+  else encode_runs(data, count, out);
+  *size = best;
+  return out;
+}
+
+bool word_unpack(const unsigned char* packed, size_t size, double* data, size_t count) {
+  if (size < 1) return false;
+  switch (packed[0]) {
+  case FORM_PALETTE: return decode_palette(packed, size, data, count);
+  case FORM_RUNS:    return decode_runs(packed, size, data, count);
+  default:           return false;
+  }
+}
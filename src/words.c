@@ -22,6 +22,8 @@
 #include <stdbool.h>
 #include "globals.h"
 #include "words.h"
+#include "symbols.h"
+#include "compiler.h"
 
 user_word words[MAX_WORDS];
 int word_count = 0;
@@ -29,6 +31,19 @@ int word_count = 0;
 user_word macros[MAX_WORDS];
 int macro_count = 0;
 
+// Bodies are compiled once, here, and run from bytecode on every call
+static void compile_body(user_word* w) {
+  release_code(w->code);
+  w->code = compile_line(w->body);
+}
+
+static void release_bodies(user_word* list, int count) {
+  for (int i = 0; i < count; i++) {
+    release_code(list[i].code);
+    list[i].code = NULL;
+  }
+}
+
 // Macros files
 void list_macros(void) {
   if (macro_count > 0) {
@@ -45,6 +60,7 @@ int load_macros_from_file(void) {
     return -1;
   }
 
+  release_bodies(macros, macro_count);
   macro_count = 0;
   while (macro_count < MAX_WORDS && !feof(f)) {
     char name[MAX_WORD_NAME];
@@ -53,11 +69,13 @@ int load_macros_from_file(void) {
     if (fscanf(f, "%15s %[^\n]", name, body) == 2) {
       strncpy(macros[macro_count].name, name, MAX_WORD_NAME);
       strncpy(macros[macro_count].body, body, MAX_WORD_BODY);
+      compile_body(&macros[macro_count]);
       macro_count++;
     }
   }
 
   fclose(f);
+  rebind_word_symbols();
   return 0;
 }
 
@@ -94,11 +112,15 @@ int delete_word_by_index(int index) {
     return -1; // Invalid index
   }
 
+  release_code(words[index].code);
+
   // Shift elements left from index+1 onward
   for (int i = index; i < word_count - 1; i++) {
     words[i] = words[i + 1];
   }
   word_count--;
+  words[word_count].code = NULL;   // now owned by the slot before it
+  rebind_word_symbols();
   return 0;
 }
 
@@ -118,7 +140,9 @@ void word_select(Stack * stack) {
 }
 
 void clear_words(void) {
+  release_bodies(words, word_count);
   word_count=0;
+  rebind_word_symbols();
 }
 
 int save_words_to_file(void) {
@@ -143,6 +167,7 @@ int load_words_from_file(void) {
     return -1;
   }
 
+  release_bodies(words, word_count);
   word_count = 0;
   while (word_count < MAX_WORDS && !feof(f)) {
     char name[MAX_WORD_NAME];
@@ -151,11 +176,13 @@ int load_words_from_file(void) {
     if (fscanf(f, "%15s %[^\n]", name, body) == 2) {
       strncpy(words[word_count].name, name, MAX_WORD_NAME);
       strncpy(words[word_count].body, body, MAX_WORD_BODY);
+      compile_body(&words[word_count]);
       word_count++;
     }
   }
 
   fclose(f);
+  rebind_word_symbols();
   return 0;
 }
 
@@ -216,12 +243,21 @@ bool is_word_definition(const char *s) {
       return false;
     }
 
-    user_word *w = &words[word_count++];
+    user_word *w = &words[word_count];
     strncpy(w->name, name, MAX_WORD_NAME);
     w->name[MAX_WORD_NAME - 1] = '\0';
 
     strncpy(w->body, body_start, body_len);
     w->body[body_len] = '\0';
+    compile_body(w);
+    if (w->code && w->code->effect.underflows) {
+      fprintf(stderr, "Word %s not defined: it always underflows the stack.\n", w->name);
+      release_code(w->code);
+      w->code = NULL;
+      return true;
+    }
+    word_count++;
+    rebind_word_symbols();
     printf("New word %s <- %s\n",w->name,w->body);
     return true;
 }
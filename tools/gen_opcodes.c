@@ -0,0 +1,234 @@
+/*
+ * This file is part of Mico's toy RPN Calculator
+ *
+ * Mico's toy RPN Calculator is free software:
+ * you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mico's toy RPN Calculator is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mico's toy RPN Calculator. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Build-time generator for the builtin opcode table.
+//
+// Linked against src/function_list.c, it writes three headers into the
+// directory given on the command line:
+//   opcodes.h             - enum with one OP_* constant per function name
+//   opcode_hash_tables.h  - displacement and slot tables of a minimal
+//                           perfect hash over the same names
+//   opcode_reach.h        - stack reach per opcode, from builtin_reaches[];
+//                           a name without exactly one entry there is an error
+//
+// The hash is "hash and displace": every name falls into a bucket by
+// opcode_hash(0, name); each bucket then gets a seed (or a direct slot for
+// singletons) such that no two names share a slot. Lookup is two hashes
+// and one string compare, whatever the name.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdint.h>
+#include "function_list.h"
+#include "opcode_hash.h"
+
+#define MAX_SEED_TRIES 10000000
+
+typedef struct {
+  int bucket;
+  int count;
+  int members[16];
+} bucket_info;
+
+static int by_size_desc(const void* a, const void* b) {
+  const bucket_info* x = a;
+  const bucket_info* y = b;
+  return y->count - x->count;
+}
+
+// "top_eq0?" -> "TOP_EQ0_Q", ".*" -> "DOT_STAR", "'" -> "QUOTE"
+static void enum_name(const char* name, char* out, size_t cap) {
+  size_t k = 0;
+  for (const char* p = name; *p && k + 8 < cap; p++) {
+    const char* piece = NULL;
+    char one[2] = {0};
+    switch (*p) {
+    case '.':  piece = "DOT_"; break;
+    case '*':  piece = "STAR"; break;
+    case '/':  piece = "SLASH"; break;
+    case '^':  piece = "CARET"; break;
+    case '\'': piece = "QUOTE"; break;
+    case '?':  piece = "_Q"; break;
+    default:
+      one[0] = isalnum((unsigned char)*p) ? (char)toupper((unsigned char)*p) : '_';
+      piece = one;
+    }
+    size_t len = strlen(piece);
+    memcpy(out + k, piece, len);
+    k += len;
+  }
+  out[k] = '\0';
+}
+
+int main(int argc, char** argv) {
+  if (argc != 2) {
+    fprintf(stderr, "usage: %s <output-dir>\n", argv[0]);
+    return 1;
+  }
+
+  int n = 0;
+  while (function_names[n]) n++;
+
+  // Enum identifiers must be unique after mangling
+  char (*enums)[64] = calloc((size_t)n, sizeof *enums);
+  for (int i = 0; i < n; i++) {
+    enum_name(function_names[i], enums[i], sizeof enums[i]);
+    for (int j = 0; j < i; j++) {
+      if (!strcmp(enums[i], enums[j])) {
+        fprintf(stderr, "gen_opcodes: \"%s\" and \"%s\" both map to OP_%s\n",
+                function_names[j], function_names[i], enums[i]);
+        return 1;
+      }
+    }
+  }
+
+  // Every builtin needs its stack reach, once
+  int* reach = malloc((size_t)n * sizeof *reach);
+  for (int i = 0; i < n; i++) reach[i] = -2;
+  int bad = 0;
+  for (const builtin_reach_spec* r = builtin_reaches; r->name; r++) {
+    int i = 0;
+    while (i < n && strcmp(function_names[i], r->name)) i++;
+    if (i == n) {
+      fprintf(stderr, "gen_opcodes: stack reach given for unknown builtin \"%s\"\n", r->name);
+      bad = 1;
+    } else if (reach[i] != -2) {
+      fprintf(stderr, "gen_opcodes: stack reach of \"%s\" given twice\n", r->name);
+      bad = 1;
+    } else {
+      reach[i] = r->reach;
+    }
+  }
+  for (int i = 0; i < n; i++) {
+    if (reach[i] == -2) {
+      fprintf(stderr, "gen_opcodes: no stack reach for \"%s\" in builtin_reaches[]\n",
+              function_names[i]);
+      bad = 1;
+    }
+  }
+  if (bad) return 1;
+
+  // First level: distribute names into n buckets
+  bucket_info* buckets = calloc((size_t)n, sizeof *buckets);
+  for (int b = 0; b < n; b++) buckets[b].bucket = b;
+  for (int i = 0; i < n; i++) {
+    const char* s = function_names[i];
+    int b = (int)(opcode_hash(0, s, strlen(s)) % (uint32_t)n);
+    if (buckets[b].count == (int)(sizeof buckets[b].members / sizeof(int))) {
+      fprintf(stderr, "gen_opcodes: bucket overflow, change the hash\n");
+      return 1;
+    }
+    buckets[b].members[buckets[b].count++] = i;
+  }
+  qsort(buckets, (size_t)n, sizeof *buckets, by_size_desc);
+
+  int32_t* displacement = calloc((size_t)n, sizeof *displacement);
+  int* slot_op = malloc((size_t)n * sizeof *slot_op);
+  for (int s = 0; s < n; s++) slot_op[s] = -1;
+
+  // Second level: find a seed per multi-name bucket
+  int b = 0;
+  for (; b < n && buckets[b].count > 1; b++) {
+    bucket_info* bk = &buckets[b];
+    int slots[16];
+    uint32_t seed = 1;
+    for (;; seed++) {
+      if (seed > MAX_SEED_TRIES) {
+        fprintf(stderr, "gen_opcodes: no seed found for bucket %d\n", bk->bucket);
+        return 1;
+      }
+      int ok = 1;
+      for (int m = 0; m < bk->count && ok; m++) {
+        const char* s = function_names[bk->members[m]];
+        slots[m] = (int)(opcode_hash(seed, s, strlen(s)) % (uint32_t)n);
+        if (slot_op[slots[m]] >= 0) ok = 0;
+        for (int q = 0; q < m && ok; q++)
+          if (slots[q] == slots[m]) ok = 0;
+      }
+      if (ok) break;
+    }
+    for (int m = 0; m < bk->count; m++) slot_op[slots[m]] = bk->members[m];
+    displacement[bk->bucket] = (int32_t)seed;
+  }
+
+  // Singletons go straight into the remaining free slots
+  int free_slot = 0;
+  for (; b < n && buckets[b].count == 1; b++) {
+    while (slot_op[free_slot] >= 0) free_slot++;
+    slot_op[free_slot] = buckets[b].members[0];
+    displacement[buckets[b].bucket] = -free_slot - 1;
+  }
+
+  char path[4096];
+  snprintf(path, sizeof path, "%s/opcodes.h", argv[1]);
+  FILE* f = fopen(path, "w");
+  if (!f) {
+    perror(path);
+    return 1;
+  }
+  fprintf(f, "/* Generated by tools/gen_opcodes.c from src/function_list.c. Do not edit. */\n\n");
+  fprintf(f, "#ifndef OPCODES_H\n#define OPCODES_H\n\n");
+  fprintf(f, "typedef enum {\n  OP_NONE = -1,\n");
+  for (int i = 0; i < n; i++) {
+    char constant[80];
+    snprintf(constant, sizeof constant, "OP_%s", enums[i]);
+    fprintf(f, "  %-20s = %3d,  /* \"%s\" */\n", constant, i, function_names[i]);
+  }
+  fprintf(f, "  OP_COUNT = %d\n} opcode;\n\n#endif // OPCODES_H\n", n);
+  fclose(f);
+
+  snprintf(path, sizeof path, "%s/opcode_hash_tables.h", argv[1]);
+  f = fopen(path, "w");
+  if (!f) {
+    perror(path);
+    return 1;
+  }
+  fprintf(f, "/* Generated by tools/gen_opcodes.c from src/function_list.c. Do not edit. */\n\n");
+  fprintf(f, "#define OPCODE_HASH_SIZE %d\n\n", n);
+  fprintf(f, "static const int32_t opcode_displacement[OPCODE_HASH_SIZE] = {");
+  for (int i = 0; i < n; i++)
+    fprintf(f, "%s%d%s", i % 12 ? " " : "\n  ", displacement[i], i + 1 < n ? "," : "");
+  fprintf(f, "\n};\n\nstatic const int16_t opcode_slot[OPCODE_HASH_SIZE] = {");
+  for (int i = 0; i < n; i++)
+    fprintf(f, "%s%d%s", i % 12 ? " " : "\n  ", slot_op[i], i + 1 < n ? "," : "");
+  fprintf(f, "\n};\n");
+  fclose(f);
+
+  snprintf(path, sizeof path, "%s/opcode_reach.h", argv[1]);
+  f = fopen(path, "w");
+  if (!f) {
+    perror(path);
+    return 1;
+  }
+  fprintf(f, "/* Generated by tools/gen_opcodes.c from src/function_list.c. Do not edit. */\n\n");
+  fprintf(f, "#define OPCODE_REACH_COUNT %d\n\n", n);
+  fprintf(f, "static const signed char opcode_reach[OPCODE_REACH_COUNT] = {");
+  for (int i = 0; i < n; i++)
+    fprintf(f, "%s%d%s", i % 16 ? " " : "\n  ", reach[i], i + 1 < n ? "," : "");
+  fprintf(f, "\n};\n");
+  fclose(f);
+
+  free(reach);
+  free(enums);
+  free(buckets);
+  free(displacement);
+  free(slot_op);
+  return 0;
+}